@@ -5,19 +5,31 @@ if not exist build (
     mkdir build || exit /b 1
 )
 
-for /f "delims=" %%i in ('pkg-config --cflags gtk+-3.0 2^>nul') do set "GTK_CFLAGS=%%i"
+for /f "delims=" %%i in ('pkg-config --cflags gtk+-3.0 json-glib-1.0 2^>nul') do set "GTK_CFLAGS=%%i"
 if not defined GTK_CFLAGS (
-    echo Failed to query GTK+ 3 build flags via pkg-config. >&2
+    echo Failed to query GTK+ 3 and json-glib build flags via pkg-config. >&2
     exit /b 1
 )
 
-for /f "delims=" %%i in ('pkg-config --libs gtk+-3.0 2^>nul') do set "GTK_LIBS=%%i"
+for /f "delims=" %%i in ('pkg-config --libs gtk+-3.0 json-glib-1.0 2^>nul') do set "GTK_LIBS=%%i"
 if not defined GTK_LIBS (
-    echo Failed to query GTK+ 3 linker flags via pkg-config. >&2
+    echo Failed to query GTK+ 3 and json-glib linker flags via pkg-config. >&2
     exit /b 1
 )
 
-gcc -std=c11 -Wall -Wextra -O2 -mwindows %GTK_CFLAGS% src\fast_cut.c -o build\fast_cut.exe %GTK_LIBS%
+set "LIBAV_CFLAGS="
+set "LIBAV_LIBS="
+if "%FAST_CUT_LIBAV%"=="1" (
+    set "LIBAV_CFLAGS=-DFAST_CUT_LIBAV"
+    for /f "delims=" %%i in ('pkg-config --cflags libavformat libavcodec libavfilter libavutil 2^>nul') do set "LIBAV_CFLAGS=-DFAST_CUT_LIBAV %%i"
+    for /f "delims=" %%i in ('pkg-config --libs libavformat libavcodec libavfilter libavutil 2^>nul') do set "LIBAV_LIBS=%%i"
+)
+if "%FAST_CUT_LIBAV%"=="1" if not defined LIBAV_LIBS (
+    echo Failed to query libav* build flags via pkg-config. >&2
+    exit /b 1
+)
+
+gcc -std=c11 -Wall -Wextra -O2 -mwindows %GTK_CFLAGS% %LIBAV_CFLAGS% src\fast_cut.c -o build\fast_cut.exe %GTK_LIBS% %LIBAV_LIBS%
 if errorlevel 1 (
     echo Build failed. >&2
     exit /b 1
@@ -1,10 +1,590 @@
-﻿#include <gtk/gtk.h>
+﻿#ifdef __linux__
+/* For cpu_set_t and sched_setaffinity. */
+#define _GNU_SOURCE
+#endif
+#include <gtk/gtk.h>
 #include <gio/gio.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef G_OS_UNIX
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <glib-unix.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+#ifdef G_OS_WIN32
+#include <windows.h>
+#endif
+#ifdef FAST_CUT_LIBAV
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#endif
 
 #define APP_TITLE "Fast Cut"
+#define FFMPEG_STDERR_TAIL_LINES 20
+#define FFMPEG_CANCEL_GRACE_SECONDS 5
+#define SMART_CUT_EPSILON_S 0.001
+#define FRAME_EPSILON_S 0.0005
+#define CHUNK_THREADS_PER_CHILD 4
+#define CHUNK_MIN_SECONDS 5.0
+#define SEGMENT_GRID_SECONDS 10.0
+#define SEGMENT_STORE_VERSION 1
+#define SEGMENT_STORE_INPUTS 4
+#define RESUME_SEGMENT_SECONDS 60.0
+#define RESUME_JOURNAL_VERSION 1
+#define WATCH_SIDECAR_SUFFIX ".cuts"
+#define WATCH_SETTLE_SECONDS 2
+#define RPC_SOCKET_NAME "fast_cut.sock"
+#define RPC_OUTBOX_LINES 256
+#define THROTTLE_RECHECK_SECONDS 5
+#define VERIFY_WORKERS 2
+#define VERIFY_TOLERANCE_S 0.5
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+#define PREFETCH_DEFAULT_MB 512
+#define PREFETCH_STEP_BYTES (8 * 1024 * 1024)
+#define PRESET_AUTO "auto"
+#define PRESET_TUNE_SAMPLES 3
+#define PRESET_TUNE_SAMPLE_SECONDS 5.0
+#define PRESET_TUNE_DEFAULT_SPEED 4.0
+#define THUMB_HEIGHT 54
+#define THUMB_WORKERS 2
+#define THUMB_CACHE_DEFAULT_MB 64
+#define DEFAULT_HARDWARE_SESSIONS 2
+#define DEFAULT_SOFTWARE_SLOTS 1
+#define MAX_RANGES_PER_PASS 4
+#define LOG_PANE_LINES 5000
+#define LOG_FLUSH_INTERVAL_MS 16
+#define JOB_LOG_MAX_AGE_DAYS 14
+#define BENCH_SOURCE_SECONDS 40
+#define BENCH_SOURCE_FPS 30
+#define BENCH_RANGE_START_S 7
+#define BENCH_QUICK_SOURCES 2
+#define BENCH_DEFAULT_THRESHOLD_PCT 10.0
+#define BENCH_RSS_SAMPLE_US 50000
+#define PROBE_INDEX_MAGIC "FCPROBE"
+#define PROBE_INDEX_VERSION 2
+#define PROBE_INDEX_BYTE_ORDER 0x01020304u
+#define PROBE_INDEX_ENTRIES "format=start_time,duration:stream=codec_name,profile,pix_fmt,width,height:packet=pts_time,pos,flags"
+#define OUTPUT_CACHE_VERSION 1
+#define OUTPUT_CACHE_DEFAULT_MB 0
+#define OUTPUT_CACHE_FINGERPRINT_BYTES (1024 * 1024)
+#define OUTPUT_CACHE_STALE_SECONDS (24 * 60 * 60)
+#define OUTPUT_STDOUT "-"
+#define OUTPUT_STDOUT_FD 3
+#define OUTPUT_STDOUT_URL "pipe:" G_STRINGIFY(OUTPUT_STDOUT_FD)
+
+/*
+ * How an ffmpeg run ended. The process figures are read from /proc and stay 0
+ * elsewhere; for a cut made of several runs they cover all of its children.
+ */
+typedef struct {
+    gint exit_status;
+    gboolean cancelled;
+    gchar *stderr_tail;
+    gint64 spawn_us;
+    gint64 peak_rss_kib;
+    gdouble cpu_s;
+} FfmpegResult;
+
+typedef struct {
+    gint64 frame;
+    gdouble fps;
+    gdouble speed;
+    gint64 out_time_us;
+    gdouble bitrate_kbps;
+    gboolean ended;
+} FfmpegProgress;
+
+typedef void (*FfmpegLineFunc)(const gchar *line, gpointer user_data);
+typedef void (*FfmpegProgressFunc)(const FfmpegProgress *progress, gpointer user_data);
+
+typedef enum {
+    CUT_MODE_REENCODE,
+    CUT_MODE_SMART,
+    CUT_MODE_CHUNKED,
+    CUT_MODE_INCREMENTAL,
+    CUT_MODE_RESUMABLE,
+    CUT_MODE_JOIN
+} CutMode;
+
+/*
+ * Container of the output. MP4 writes its index at the end, after the whole
+ * encode; fragmented MP4, MPEG-TS and Matroska can be played, uploaded or
+ * piped while ffmpeg is still writing them.
+ */
+typedef enum {
+    OUTPUT_FORMAT_MP4,
+    OUTPUT_FORMAT_FMP4,
+    OUTPUT_FORMAT_MPEGTS,
+    OUTPUT_FORMAT_MATROSKA
+} OutputFormat;
+
+typedef struct EncoderBackend EncoderBackend;
+
+/* Linux I/O scheduling classes, numbered as ioprio_set() expects them. */
+typedef enum {
+    IO_CLASS_DEFAULT,
+    IO_CLASS_REALTIME,
+    IO_CLASS_BEST_EFFORT,
+    IO_CLASS_IDLE
+} IoClass;
+
+/*
+ * How the ffmpeg children of one job share the machine. Zero fields keep the
+ * default; cpus, when set, lists the CPU numbers the children may run on.
+ * threads caps the encoder's -threads and is part of the encode settings.
+ */
+typedef struct {
+    gint nice_level;
+    IoClass io_class;
+    gint io_level;
+    GArray *cpus;
+    guint threads;
+} ResourcePolicy;
+
+#ifdef G_OS_UNIX
+/* The parts of a policy the forked child applies to itself before exec. */
+typedef struct {
+    gint nice_level;
+    IoClass io_class;
+    gint io_level;
+#ifdef __linux__
+    gboolean has_affinity;
+    cpu_set_t cpus;
+#endif
+} ChildSetup;
+#endif
+
+/* Appends -c:v and the encoder options for one backend; threads 0 keeps ffmpeg's default. */
+typedef void (*EncoderArgsFunc)(const EncoderBackend *encoder, GPtrArray *args, const gchar *preset, guint threads);
+
+/*
+ * One video encoder ffmpeg may provide. The table below is ordered fastest
+ * first, which is also the order used to pick a default.
+ */
+struct EncoderBackend {
+    const gchar *id;
+    const gchar *label;
+    const gchar *encoder;
+    const gchar *codec;
+    gboolean hardware;
+    const gchar *preset_option;
+    const gchar * const *presets;
+    guint default_preset;
+    const gchar * const *rate_control;
+    EncoderArgsFunc append_args;
+};
+
+/* A further time range cut from the same input and the output it is written to. */
+typedef struct {
+    gchar *start_time;
+    gchar *end_time;
+    gchar *output_path;
+} CutRange;
+
+/* One clip of a join: a range of an input, or the whole file when the times are NULL. */
+typedef struct {
+    gchar *input_path;
+    gchar *start_time;
+    gchar *end_time;
+} JoinClip;
+
+/*
+ * One ffmpeg job. extra_ranges, when set, holds more ranges of the same input
+ * that are encoded in the same pass, so the source is only decoded once.
+ * join_clips, when set, makes the job a join of those clips into output_path;
+ * input_path is then the first clip's. output_path may also be OUTPUT_STDOUT
+ * or a unix: or tcp:// URL, see output_is_stream(). policy is filled in by
+ * the scheduler when the job is queued.
+ */
+typedef struct {
+    gchar *input_path;
+    gchar *start_time;
+    gchar *end_time;
+    const EncoderBackend *encoder;
+    gchar *preset;
+    gchar *output_path;
+    CutMode mode;
+    OutputFormat format;
+    GPtrArray *extra_ranges;
+    GPtrArray *join_clips;
+    ResourcePolicy policy;
+} CutJob;
+
+typedef struct {
+    gchar *codec_name;
+    gchar *profile;
+    gchar *pix_fmt;
+    gint width;
+    gint height;
+} VideoStreamInfo;
+
+/* The first audio stream of an input; codec_name stays NULL when there is none. */
+typedef struct {
+    gchar *codec_name;
+    gchar *channel_layout;
+    gint sample_rate;
+    gint channels;
+} AudioStreamInfo;
+
+/*
+ * Header of a probe cache file. It is followed by keyframe_count ProbeKeyframe
+ * records and frame_count frame timestamps (gdouble), both sorted by pts and
+ * counted from the input's start_time like -ss, and
+ * the whole file is mapped as is. Files are in host byte order; byte_order
+ * tells apart a file copied from a machine with the other one.
+ */
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+    gint64 file_size;
+    gint64 file_mtime;
+    gdouble duration_s;
+    gint32 width;
+    gint32 height;
+    gchar codec_name[32];
+    gchar profile[32];
+    gchar pix_fmt[32];
+    guint64 keyframe_count;
+    guint64 frame_count;
+} ProbeIndexHeader;
+
+typedef struct {
+    gdouble pts_s;
+    gint64 pos;
+} ProbeKeyframe;
+
+/* A mapped probe cache file; the pointers point into the mapping. */
+typedef struct {
+    GMappedFile *file;
+    const ProbeIndexHeader *header;
+    const ProbeKeyframe *keyframes;
+    const gdouble *frames;
+} ProbeIndex;
+
+/* What one ffprobe run over the first video stream reported, before it is written out or checked. */
+typedef struct {
+    ProbeIndexHeader header;
+    gdouble start_s;
+    gboolean have_stream;
+    GArray *keyframes;
+    GArray *frames;
+    GString *messages;
+} ProbeScan;
+
+/* One complete entry of the output cache; last_used is the mtime of its entry.json. */
+typedef struct {
+    gchar *path;
+    gint64 bytes;
+    gint64 last_used;
+} OutputCacheEntry;
+
+G_STATIC_ASSERT(sizeof(ProbeIndexHeader) % 8 == 0);
+G_STATIC_ASSERT(sizeof(ProbeKeyframe) == 16);
+
+/* Forwards one ffmpeg invocation of a multi-step cut to the job's callbacks. */
+typedef struct {
+    FfmpegLineFunc line_func;
+    FfmpegProgressFunc progress_func;
+    gpointer user_data;
+    gint64 offset_us;
+    gint64 spawn_us;
+    gint64 peak_rss_kib;
+    gdouble cpu_s;
+    const ResourcePolicy *policy;
+} CutStepContext;
+
+/* One sample encode of a preset trial, run on its own thread. */
+typedef struct {
+    gchar **argv;
+    const ResourcePolicy *policy;
+    GCancellable *cancellable;
+    FfmpegResult *result;
+    GError *error;
+} PresetTuneSample;
+
+typedef struct ChunkedEncode ChunkedEncode;
+
+/* One keyframe-aligned sub-range of a chunked encode, run on the chunk pool. */
+typedef struct {
+    ChunkedEncode *encode;
+    guint index;
+    gdouble from_s;
+    gdouble duration_s;
+    gint64 frame_count;
+    gchar *output_path;
+    FfmpegProgress progress;
+    FfmpegResult *result;
+    GError *error;
+    gint64 started_us;
+    gint64 finished_us;
+} ChunkTask;
+
+struct ChunkedEncode {
+    CutJob *job;
+    CutStepContext *step;
+    GCancellable *cancellable;
+    GMutex lock;
+    GPtrArray *chunks;
+};
+
+#ifdef FAST_CUT_LIBAV
+/* State of one in-process cut; timestamps are in the input stream's time base. */
+typedef struct {
+    AVFormatContext *input;
+    AVFormatContext *output;
+    AVCodecContext *decoder;
+    AVCodecContext *encoder;
+    AVFilterGraph *graph;
+    AVFilterContext *buffersrc;
+    AVFilterContext *buffersink;
+    gint video_index;
+    gint audio_index;
+    AVStream *video_out;
+    AVStream *audio_out;
+    gint64 video_start;
+    gint64 video_end;
+    gint64 video_tolerance;
+    gint64 audio_start;
+    gint64 audio_end;
+    gboolean video_started;
+    gboolean video_done;
+    gint64 frames;
+    gint64 out_time_us;
+    gint64 started_us;
+    gint64 last_report_us;
+    CutStepContext *step;
+} LibavCut;
+#endif
+
+typedef enum {
+    JOB_STATUS_QUEUED,
+    JOB_STATUS_RUNNING,
+    JOB_STATUS_VERIFYING,
+    JOB_STATUS_DONE,
+    JOB_STATUS_FAILED,
+    JOB_STATUS_CANCELLED
+} JobStatus;
+
+/* How much of an output is checked after ffmpeg reported success. */
+typedef enum {
+    VERIFY_OFF,
+    VERIFY_PROBE,
+    VERIFY_DECODE
+} VerifyLevel;
+
+typedef struct JobScheduler JobScheduler;
+typedef struct PrefetchRun PrefetchRun;
+typedef struct WatchFolder WatchFolder;
+typedef struct RpcServer RpcServer;
+typedef struct QueueJob QueueJob;
+
+typedef void (*JobStatusFunc)(QueueJob *job, gpointer user_data);
+typedef void (*JobLineFunc)(QueueJob *job, const gchar *line, gpointer user_data);
+typedef void (*JobProgressFunc)(QueueJob *job, const FfmpegProgress *progress, gpointer user_data);
+
+/*
+ * Timings of one job. The scheduler stamps the queue, start, finish and
+ * verification times; the frame figures are updated on the worker from each
+ * progress block and only read once the job has finished.
+ */
+typedef struct {
+    gint64 queued_us;
+    gint64 started_us;
+    gint64 finished_us;
+    gint64 verified_us;
+    gint64 first_frame_us;
+    gint64 last_progress_us;
+    gint64 last_frame;
+    gint64 frames;
+    gdouble min_fps;
+    guint intervals;
+} JobTelemetry;
+
+struct QueueJob {
+    guint id;
+    CutJob *cut;
+    JobStatus status;
+    gboolean hardware;
+    gint64 duration_us;
+    gboolean duration_probed;
+    GCancellable *cancellable;
+    gchar *status_detail;
+    JobScheduler *scheduler;
+    gpointer view_data;
+    GDestroyNotify view_data_free;
+    JobTelemetry telemetry;
+    gboolean prefetched;
+    gint64 prefetch_bytes;
+    FfmpegProgress progress;
+};
+
+/* Running totals per encoder for the Prometheus textfile. */
+typedef struct {
+    guint done;
+    guint failed;
+    guint cancelled;
+    gdouble frames;
+    gdouble wall_s;
+    gdouble media_s;
+    gdouble cpu_s;
+    gdouble last_fps;
+    gdouble last_speed;
+    gdouble last_peak_rss_bytes;
+} TelemetryTotals;
+
+/*
+ * Dispatches queued jobs to worker threads on the main loop. Hardware encoders
+ * cap concurrent sessions per GPU and software encoders saturate the CPU, so
+ * each class has its own limit.
+ */
+struct JobScheduler {
+    GQueue jobs;
+    guint next_id;
+    guint hardware_limit;
+    guint software_limit;
+    guint hardware_running;
+    guint software_running;
+    JobStatusFunc status_func;
+    JobLineFunc line_func;
+    JobProgressFunc progress_func;
+    gpointer user_data;
+    gchar *telemetry_path;
+    gchar *prometheus_path;
+    GHashTable *telemetry_totals;
+    ResourcePolicy policy;
+    gdouble max_load;
+    gint64 min_free_mib;
+    guint throttle_source;
+    gint64 prefetch_budget;
+    PrefetchRun *prefetch;
+    VerifyLevel verify;
+    GThreadPool *verify_pool;
+};
+
+/*
+ * Verification of one encoded job on the scheduler's verify pool. It owns the
+ * encode's result until the job's final status, and with it its telemetry,
+ * is set on the main loop.
+ */
+typedef struct {
+    QueueJob *job;
+    VerifyLevel level;
+    FfmpegResult *result;
+    GError *error;
+} VerifyTask;
+
+/* An output's packet scan, and the step whose log gets ffprobe's other lines. */
+typedef struct {
+    ProbeScan *scan;
+    CutStepContext *step;
+} VerifyScan;
+
+typedef struct {
+    QueueJob *job;
+    gchar *line;
+    FfmpegProgress progress;
+} FfmpegTaskMessage;
+
+/*
+ * One read-ahead of a queued job's input on a worker thread. The scheduler
+ * clears its pointer when it is freed first, so the completion only cleans up.
+ */
+struct PrefetchRun {
+    JobScheduler *scheduler;
+    guint job_id;
+    gchar *input_path;
+    gdouble start_s;
+    gdouble end_s;
+    gint64 budget;
+    GCancellable *cancellable;
+};
+
+/*
+ * One log shown in the shared log view: the GUI's own messages or one job's
+ * output. Lines collect in pending and reach the text buffer in one batch per
+ * flush, and the buffer keeps only the newest LOG_PANE_LINES of them.
+ */
+typedef struct {
+    GtkWidget *view;
+    GtkTextBuffer *buffer;
+    GtkTextMark *end_mark;
+    GQueue pending;
+    guint flush_source;
+    gchar *last_line;
+    guint repeats;
+    gboolean ends_with_stats;
+    FILE *spill;
+    gchar *spill_path;
+    gboolean remove_spill;
+} LogPane;
+
+/*
+ * Timeline of keyframe thumbnails under the time entries. Worker threads make
+ * the thumbnails and hand them to the main loop, which alone touches the rest:
+ * entries holds them in memory, least recently drawn at the tail of lru, up to
+ * limit bytes, and disk_dir keeps them for the next time the file is opened.
+ * generation changes with the file; workers skip requests of an older one.
+ */
+typedef struct {
+    GtkWidget *area;
+    const ProbeIndex *index;
+    gchar *input_path;
+    gchar *file_key;
+    gchar *disk_dir;
+    gint generation;
+    GCancellable *cancellable;
+    GThreadPool *pool;
+    GHashTable *pending;
+    GHashTable *entries;
+    GQueue lru;
+    gsize bytes;
+    gsize limit;
+    guint draw_id;
+    gdouble press_x;
+} ThumbStrip;
+
+typedef struct {
+    gchar *key;
+    GdkPixbuf *pixbuf;
+    gsize bytes;
+    GList *link;
+} ThumbEntry;
+
+/* One thumbnail to make; draw_id and slot order the pool so the latest draw goes first, left to right. */
+typedef struct {
+    ThumbStrip *strip;
+    gint generation;
+    guint draw_id;
+    guint slot;
+    gchar *key;
+    gchar *input_path;
+    gchar *disk_dir;
+    gchar *disk_path;
+    gdouble pts_s;
+    GCancellable *cancellable;
+    GdkPixbuf *pixbuf;
+} ThumbRequest;
 
 typedef struct {
     GtkWidget *window;
@@ -15,56 +595,596 @@ typedef struct {
     GtkWidget *end_hour_entry;
     GtkWidget *end_min_entry;
     GtkWidget *end_sec_entry;
+    GtkWidget *ranges_entry;
+    GtkWidget *encoder_combo;
     GtkWidget *preset_combo;
+    GtkWidget *mode_combo;
+    GtkWidget *format_combo;
     GtkWidget *output_entry;
+    GtkWidget *hardware_spin;
+    GtkWidget *software_spin;
     GtkWidget *start_button;
+    GtkWidget *cancel_button;
+    GtkWidget *remove_button;
+    GtkWidget *progress_bar;
+    GtkWidget *job_view;
+    GtkListStore *job_store;
     GtkWidget *log_view;
-    GtkTextBuffer *log_buffer;
+    LogPane *log_pane;
     gboolean output_customized;
     gboolean suppress_output_changed;
     gchar *output_last_auto;
-    gboolean task_running;
+    gboolean quit_when_idle;
+    JobScheduler *scheduler;
+    ThumbStrip *strip;
+    RpcServer *rpc;
 } AppWidgets;
 
 typedef struct {
-    gint exit_status;
-    gchar *stdout_buf;
-    gchar *stderr_buf;
-} FfmpegResult;
+    LogPane *log;
+    GtkTreeRowReference *row;
+} JobView;
+
+/* Columns of a manifest row, also used for a single cut given as options. */
+enum {
+    MANIFEST_FIELD_INPUT,
+    MANIFEST_FIELD_START,
+    MANIFEST_FIELD_END,
+    MANIFEST_FIELD_PRESET,
+    MANIFEST_FIELD_OUTPUT,
+    MANIFEST_FIELD_ENCODER,
+    MANIFEST_FIELD_MODE,
+    MANIFEST_FIELD_FORMAT,
+    MANIFEST_N_FIELDS
+};
+
+typedef struct {
+    JobScheduler *scheduler;
+    GMainLoop *loop;
+    const EncoderBackend *encoder;
+    const gchar *preset;
+    CutMode mode;
+    OutputFormat format;
+    gboolean verbose;
+    gboolean single_pass;
+    guint rejected;
+    WatchFolder *watch;
+} HeadlessRun;
+
+/* A recording's sidecar cut list and the cuts queued from it. */
+typedef struct {
+    gchar *sidecar_path;
+    gchar *input_path;
+    guint pending;
+    guint failed;
+    gboolean cancelled;
+} WatchBatch;
+
+/*
+ * Last seen size and mtime of a sidecar and its recording while they are
+ * still being written. A file is complete once it was closed after writing
+ * or has not changed over WATCH_SETTLE_SECONDS.
+ */
+typedef struct {
+    gint64 sidecar_size;
+    gint64 sidecar_mtime;
+    gint64 input_size;
+    gint64 input_mtime;
+    gboolean sampled;
+    gboolean sidecar_closed;
+    gboolean input_closed;
+} WatchSettle;
+
+/*
+ * Watch mode: spool folders monitored for recordings with a sidecar cut list.
+ * settling holds the sidecars whose files may still be growing, batches the
+ * ones with cuts queued, and jobs maps queue job ids to their batch. The
+ * settle timer only runs while something is settling.
+ */
+struct WatchFolder {
+    HeadlessRun *run;
+    GPtrArray *monitors;
+    GHashTable *settling;
+    GHashTable *batches;
+    GHashTable *jobs;
+    guint settle_source;
+    gboolean stopping;
+    guint done;
+    guint failed;
+};
+
+/*
+ * Local job API: clients on the socket send one JSON request per line and get
+ * one JSON reply per line, plus events for the jobs they subscribed to.
+ * defaults holds what headless_build_cut falls back to for a request.
+ */
+struct RpcServer {
+    JobScheduler *scheduler;
+    HeadlessRun defaults;
+    GSocketService *service;
+    gchar *socket_path;
+    GList *clients;
+};
+
+/*
+ * One connection. Every pending read or write holds a reference; server is
+ * NULL once the client is closed. Lines wait in outbox while a write is in
+ * flight, and progress events are dropped rather than queued without bound
+ * for a client that does not keep up. A client that has stopped sending is
+ * still answered, and keeps getting events while it is subscribed.
+ */
+typedef struct {
+    gint refs;
+    RpcServer *server;
+    GSocketConnection *connection;
+    GDataInputStream *input;
+    GCancellable *cancellable;
+    GQueue outbox;
+    gchar *writing;
+    gboolean input_closed;
+    gboolean subscribed;
+    guint subscribed_job;
+} RpcClient;
+
+/* One synthetic benchmark input; encoder is the backend id used to generate it. */
+typedef struct {
+    const gchar *codec;
+    const gchar *encoder;
+    gint width;
+    gint height;
+    gint gop;
+} BenchSource;
 
+typedef struct {
+    const gchar *dir;
+    JsonBuilder *builder;
+    GHashTable *baseline;
+    gdouble threshold_pct;
+    gboolean verbose;
+    guint cases;
+    guint failed;
+    guint regressions;
+} BenchRun;
+
+typedef struct {
+    gint stop;
+    gint64 peak_kib;
+} BenchRssSampler;
+
+enum {
+    JOB_COL_ID,
+    JOB_COL_INPUT,
+    JOB_COL_RANGE,
+    JOB_COL_OUTPUT,
+    JOB_COL_STATUS,
+    JOB_COL_PROGRESS,
+    JOB_COL_DETAILS,
+    JOB_COL_JOB,
+    JOB_N_COLUMNS
+};
+
+static int run_headless(int argc, char **argv);
+static CutJob *headless_build_cut(HeadlessRun *run, gchar **fields, GError **error);
+static gboolean headless_load_manifest(HeadlessRun *run, const gchar *path);
+static gchar **split_csv_line(const gchar *line);
+static gchar **manifest_json_fields(JsonParser *parser, const gchar *line, GError **error);
+static void headless_job_status(QueueJob *job, gpointer user_data);
+static void headless_job_line(QueueJob *job, const gchar *line, gpointer user_data);
+static void headless_tail_free(gpointer user_data);
+#ifdef G_OS_UNIX
+static gboolean headless_interrupted(gpointer user_data);
+#endif
+static WatchFolder *watch_folder_new(HeadlessRun *run, gchar **dirs, GError **error);
+static void watch_folder_free(WatchFolder *watch);
+static void on_watch_folder_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data);
+static void watch_folder_note(WatchFolder *watch, const gchar *path, gboolean closed);
+static gboolean watch_settle_tick(gpointer user_data);
+static gboolean watch_file_signature(const gchar *path, gint64 *size, gint64 *mtime);
+static void watch_batch_start(WatchFolder *watch, const gchar *sidecar_path);
+static GPtrArray *watch_parse_sidecar(HeadlessRun *run, const gchar *sidecar_path, const gchar *input_path, GError **error);
+static void watch_job_finished(WatchFolder *watch, QueueJob *job);
+static void watch_batch_finish(WatchFolder *watch, WatchBatch *batch);
+static gboolean watch_remove_finished(gpointer user_data);
+static void watch_batch_free(WatchBatch *batch);
+static RpcServer *rpc_server_new(JobScheduler *scheduler, GError **error);
+static void rpc_server_free(RpcServer *server);
+static gchar *rpc_socket_path(void);
+static gboolean on_rpc_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data);
+static void rpc_client_read_next(RpcClient *client);
+static void rpc_client_line_read(GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void rpc_client_handle(RpcClient *client, const gchar *line);
+static JsonObject *rpc_enqueue(RpcServer *server, JsonObject *request, QueueJob **job_out, GError **error);
+static void rpc_client_send(RpcClient *client, JsonObject *message, gboolean droppable);
+static void rpc_client_write_next(RpcClient *client);
+static void rpc_client_line_written(GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void rpc_client_close(RpcClient *client);
+static void rpc_client_unref(RpcClient *client);
+static QueueJob *rpc_find_job(RpcServer *server, guint id);
+static JsonObject *rpc_job_object(QueueJob *job);
+static void rpc_server_job_status(RpcServer *server, QueueJob *job);
+static void rpc_server_job_progress(RpcServer *server, QueueJob *job, const FfmpegProgress *progress);
+static void rpc_broadcast(RpcServer *server, QueueJob *job, JsonObject *event, gboolean droppable);
+static int run_benchmark(const gchar *dir, gboolean quick, const gchar *output_path, const gchar *baseline_path, gdouble threshold_pct, gboolean verbose);
+static gchar *bench_make_source(const gchar *dir, const BenchSource *source, const gchar *source_name, GError **error);
+static void bench_run_case(BenchRun *bench, const gchar *source_name, const gchar *source_path, gint range_s, const EncoderBackend *encoder, const gchar *preset, const gchar *mode_id);
+static void bench_case_line(const gchar *line, gpointer user_data);
+static GHashTable *bench_load_baseline(JsonParser *parser, const gchar *path, GError **error);
+static gdouble bench_member_double(JsonObject *object, const gchar *name);
+static gpointer bench_rss_sampler(gpointer data);
+static gint64 bench_child_rss_kib(void);
+static gint64 proc_status_kib(const gchar *pid, const gchar *field);
 static void append_log_line(AppWidgets *app, const gchar *line);
-static void append_log_block(AppWidgets *app, const gchar *block, const gchar *label);
+static LogPane *log_pane_new(GtkWidget *view, const gchar *spill_path);
+static void log_pane_free(LogPane *pane);
+static void log_pane_append(LogPane *pane, const gchar *line);
+static void log_pane_finish(LogPane *pane);
+static gboolean log_pane_flush(gpointer user_data);
+static gboolean log_line_is_stats(const gchar *line);
+static gchar *job_log_path(guint job_id);
+static void job_log_prune(const gchar *dir);
 static void set_output_default(AppWidgets *app, const gchar *input_path, gboolean force);
 static void set_input_file(AppWidgets *app, const gchar *path);
 static void on_open_file(GtkButton *button, gpointer user_data);
 static void on_drag_data_received(GtkWidget *widget, GdkDragContext *context, gint x, gint y, GtkSelectionData *data, guint info, guint time, gpointer user_data);
 static void on_output_changed(GtkEditable *editable, gpointer user_data);
+static void on_encoder_changed(GtkComboBox *combo, gpointer user_data);
+static void on_format_changed(GtkComboBox *combo, gpointer user_data);
+static void encoder_probe_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void encoder_probe_completed(GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void probe_prefetch_start(AppWidgets *app, const gchar *path);
+static void probe_prefetch_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void probe_prefetch_completed(GObject *source_object, GAsyncResult *result, gpointer user_data);
+static ThumbStrip *thumb_strip_new(void);
+static void thumb_strip_free(ThumbStrip *strip);
+static void thumb_strip_set_source(ThumbStrip *strip, const gchar *input_path, const ProbeIndex *index);
+static gdouble thumb_strip_keyframe_before(const ThumbStrip *strip, gdouble pts_s);
+static gboolean on_strip_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data);
+static gboolean on_strip_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user_data);
+static gboolean on_strip_button_release(GtkWidget *widget, GdkEventButton *event, gpointer user_data);
+static void on_time_entry_changed(GtkEditable *editable, gpointer user_data);
+static void thumb_request_thread(gpointer data, gpointer user_data);
+static gboolean thumb_render(const ThumbRequest *request);
+static gboolean thumb_request_deliver(gpointer user_data);
+static void thumb_request_free(ThumbRequest *request);
+static gint compare_thumb_requests(gconstpointer a, gconstpointer b, gpointer user_data);
+static void thumb_cache_insert(ThumbStrip *strip, const gchar *key, GdkPixbuf *pixbuf);
+static void thumb_entry_free(ThumbEntry *entry);
+static gint64 thumb_cache_default_limit_mb(void);
+static void set_time_entries(GtkEntry *hour_entry, GtkEntry *min_entry, GtkEntry *sec_entry, gint64 seconds);
+static gint64 time_entries_seconds(GtkEntry *hour_entry, GtkEntry *min_entry, GtkEntry *sec_entry);
+static const EncoderBackend *selected_encoder(AppWidgets *app);
 static gboolean on_window_delete(GtkWidget *widget, GdkEvent *event, gpointer user_data);
 static void on_start_clicked(GtkButton *button, gpointer user_data);
+static void on_cancel_clicked(GtkButton *button, gpointer user_data);
+static void on_remove_finished_clicked(GtkButton *button, gpointer user_data);
+static void on_limits_changed(GtkSpinButton *spin, gpointer user_data);
+static void on_job_selection_changed(GtkTreeSelection *selection, gpointer user_data);
+static void on_job_status(QueueJob *job, gpointer user_data);
+static void on_job_line(QueueJob *job, const gchar *line, gpointer user_data);
+static void on_job_progress(QueueJob *job, const FfmpegProgress *progress, gpointer user_data);
+static JobView *job_view_for(AppWidgets *app, QueueJob *job);
+static void job_view_free(gpointer user_data);
+static QueueJob *selected_job(AppWidgets *app);
+static void update_queue_summary(AppWidgets *app);
+static JobScheduler *job_scheduler_new(guint hardware_limit, guint software_limit, JobStatusFunc status_func, JobLineFunc line_func, JobProgressFunc progress_func, gpointer user_data);
+static void job_scheduler_free(JobScheduler *scheduler);
+static QueueJob *job_scheduler_add(JobScheduler *scheduler, CutJob *cut);
+static void job_scheduler_set_limits(JobScheduler *scheduler, guint hardware_limit, guint software_limit);
+static void job_scheduler_set_telemetry(JobScheduler *scheduler, const gchar *telemetry_path, const gchar *prometheus_path);
+static void job_scheduler_set_policy(JobScheduler *scheduler, const ResourcePolicy *policy, gdouble max_load, gint64 min_free_mib);
+static gchar *job_scheduler_throttle_reason(JobScheduler *scheduler);
+static gboolean job_scheduler_recheck(gpointer user_data);
+static gint64 system_available_mib(void);
+static gboolean parse_throttle(const gchar *load_text, const gchar *free_text, gdouble *max_load, gint64 *min_free_mib, GError **error);
+static void job_scheduler_set_prefetch(JobScheduler *scheduler, gint64 budget_mib);
+static void job_scheduler_set_verify(JobScheduler *scheduler, VerifyLevel level);
+static void job_scheduler_verify(QueueJob *job, FfmpegResult *result);
+static gboolean verify_level_from_id(const gchar *id, VerifyLevel *level);
+static void verify_task_run(gpointer data, gpointer user_data);
+static gboolean verify_task_deliver(gpointer user_data);
+static gboolean verify_cut_outputs(const CutJob *job, VerifyLevel level, GCancellable *cancellable, CutStepContext *step, GError **error);
+static gboolean verify_output(const CutJob *job, const gchar *output_path, gdouble from_s, gdouble to_s, VerifyLevel level, GCancellable *cancellable, CutStepContext *step, GError **error);
+static gboolean verify_scan_output(const gchar *output_path, GCancellable *cancellable, CutStepContext *step, ProbeScan *scan, GError **error);
+static void verify_scan_line(const gchar *line, gpointer user_data);
+static gboolean verify_decode_gop(const gchar *output_path, gdouble from_s, gdouble length_s, GCancellable *cancellable, CutStepContext *step, GError **error);
+static void job_scheduler_prefetch_next(JobScheduler *scheduler);
+static void prefetch_task_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void prefetch_task_completed(GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void prefetch_run_free(PrefetchRun *run);
+static gboolean prefetch_plan(const gchar *input_path, gdouble start_s, gdouble end_s, GCancellable *cancellable, gint64 *offset_out, gint64 *length_out);
+static gdouble probe_format_duration(const gchar *input_path, GCancellable *cancellable);
+static gint64 prefetch_range(const gchar *input_path, gint64 offset, gint64 length, GCancellable *cancellable);
+static gint64 prefetch_default_budget_mb(void);
+static void job_scheduler_dispatch(JobScheduler *scheduler);
+static void job_scheduler_start(QueueJob *job);
+static void job_scheduler_cancel(QueueJob *job);
+static void job_scheduler_cancel_all(JobScheduler *scheduler);
+static void job_scheduler_remove_finished(JobScheduler *scheduler);
+static guint job_scheduler_count(JobScheduler *scheduler, JobStatus status);
+static gboolean job_scheduler_busy(JobScheduler *scheduler);
+static void job_set_status(QueueJob *job, JobStatus status, const gchar *detail);
+static void queue_job_free(QueueJob *job);
+static const gchar *job_status_label(JobStatus status);
+static gboolean cut_job_uses_hardware(const CutJob *job);
+static gchar *telemetry_default_path(void);
+static void job_telemetry_progress(JobTelemetry *telemetry, const FfmpegProgress *progress);
+static void job_telemetry_record(QueueJob *job, const FfmpegResult *result);
+static void telemetry_append_line(const gchar *path, const gchar *line);
+static void telemetry_write_prometheus(JobScheduler *scheduler);
 static void ffmpeg_task_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
 static void ffmpeg_task_completed(GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void job_refresh_duration(QueueJob *job);
+static void ffmpeg_task_line(const gchar *line, gpointer user_data);
+static void ffmpeg_task_progress(const FfmpegProgress *progress, gpointer user_data);
+static gboolean ffmpeg_task_deliver(gpointer user_data);
+static void ffmpeg_task_message_free(gpointer user_data);
+static FfmpegResult *run_ffmpeg_process(gchar **argv, GCancellable *cancellable, const ResourcePolicy *policy, FfmpegLineFunc line_func, FfmpegProgressFunc progress_func, gpointer user_data, GError **error);
+static gboolean parse_progress_line(const gchar *line, FfmpegProgress *progress);
+static void sample_process_usage(const gchar *pid, gint64 *peak_rss_kib, gdouble *cpu_s);
+static gboolean resource_policy_parse(ResourcePolicy *policy, const gchar *nice_text, const gchar *io_text, const gchar *cpus_text, const gchar *threads_text, GError **error);
+static gboolean parse_cpu_list(const gchar *text, GArray **cpus_out, GError **error);
+static void resource_policy_copy(ResourcePolicy *target, const ResourcePolicy *source);
+static void resource_policy_clear(ResourcePolicy *policy);
+static guint resource_policy_cpu_count(const ResourcePolicy *policy);
+static guint chunk_threads(const CutJob *job);
+#ifdef G_OS_UNIX
+static gboolean child_setup_prepare(const ResourcePolicy *policy, ChildSetup *setup);
+static void child_setup_run(gpointer user_data);
+#endif
+#ifdef G_OS_WIN32
+static void resource_policy_apply_spawned(const ResourcePolicy *policy, GSubprocess *process);
+#endif
+static void on_ffmpeg_cancelled(GCancellable *cancellable, gpointer user_data);
+static gboolean ffmpeg_force_exit(gpointer user_data);
+static gchar *format_progress_details(const FfmpegProgress *progress, gint64 duration_us, gdouble *fraction_out);
+static FfmpegResult *run_cut_job(CutJob *job, GCancellable *cancellable, FfmpegLineFunc line_func, FfmpegProgressFunc progress_func, gpointer user_data, GError **error);
+static FfmpegResult *run_cut_job_steps(CutJob *job, GCancellable *cancellable, CutStepContext *step, GError **error);
+static FfmpegResult *run_smart_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error);
+static FfmpegResult *run_chunked_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error);
+static FfmpegResult *run_chunk_pool(ChunkedEncode *encode, guint parallelism, GCancellable *cancellable, gboolean *chunks_ok, GError **error);
+static gint64 chunk_pool_peak_rss_kib(ChunkedEncode *encode);
+static FfmpegResult *run_incremental_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error);
+static FfmpegResult *run_resumable_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error);
+static gchar *resume_dir_path(const gchar *output_path);
+static gchar *resume_partial_path(const gchar *output_path);
+static FfmpegResult *resume_commit_outputs(const CutJob *job, gchar **partial_paths, FfmpegResult *result, GError **error);
+static gchar *resume_journal_key(const CutJob *job);
+static GHashTable *resume_journal_load(const gchar *journal_path, const gchar *key);
+static gboolean resume_journal_append(const gchar *journal_path, JsonObject *record, GError **error);
+static void sync_file(const gchar *path);
+static FfmpegResult *run_join_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, GError **error);
+static gchar *join_clip_mismatch(const VideoStreamInfo *reference, const VideoStreamInfo *info);
+static gchar *join_audio_mismatch(const AudioStreamInfo *reference, const AudioStreamInfo *info);
+static gdouble join_clip_seconds(const JoinClip *clip);
+static gchar **build_join_piece_argv(const JoinClip *clip, gboolean copy, const EncoderBackend *encoder, const gchar *preset, const gchar *profile, const gchar *pix_fmt, const VideoStreamInfo *reference, guint threads, const gchar *output_path);
+static gchar **build_join_argv(const gchar *list_path, const CutJob *job);
+static gboolean write_join_list(const gchar *list_path, GPtrArray *clips, GError **error);
+static GArray *plan_segment_boundaries(GArray *keyframes, gdouble start_s, gdouble end_s, gdouble grid_s);
+static gchar *segment_store_dir(const CutJob *job, gchar **input_dir_out);
+static void segment_store_prepare(const gchar *input_dir, const gchar *store_dir, CutStepContext *step);
+static void segment_store_prune(const gchar *store_dir, GPtrArray *keep);
+static gboolean segment_store_acquire(const gchar *store_dir, GCancellable *cancellable, GError **error);
+static void segment_store_release(const gchar *store_dir);
+static gboolean segment_store_in_use(const gchar *path);
+static void remove_segment_input_dir(const gchar *path);
+static GArray *plan_chunk_boundaries(GArray *keyframes, gdouble start_s, gdouble end_s, guint chunk_count);
+static gint64 count_frames(GArray *frames, gdouble from_s, gdouble to_s);
+static void chunk_task_run(gpointer data, gpointer user_data);
+static void chunk_task_line(const gchar *line, gpointer user_data);
+static void chunk_task_progress(const FfmpegProgress *progress, gpointer user_data);
+static void chunk_task_free(ChunkTask *chunk);
+static void on_chunk_parent_cancelled(GCancellable *cancellable, gpointer user_data);
+static FfmpegResult *run_cut_step(gchar **argv, GCancellable *cancellable, CutStepContext *step, gint64 offset_us, GError **error);
+static void cut_step_account(CutStepContext *step, const FfmpegResult *result);
+static FfmpegResult *cut_step_finish(CutStepContext *step, FfmpegResult *result);
+static gchar *preset_tune(const CutJob *job, GCancellable *cancellable, CutStepContext *step);
+static gboolean preset_tune_trial(const CutJob *job, const gchar *preset, const gchar *work_dir, gdouble from_s, gdouble span_s, gdouble sample_s, guint samples, GCancellable *cancellable, CutStepContext *step, gdouble *speed_out, gdouble *kbps_out);
+static gpointer preset_tune_sample_thread(gpointer data);
+static gchar *preset_tune_results_path(void);
+static gchar *preset_tune_lookup(const gchar *key);
+static void preset_tune_store(const gchar *key, const gchar *preset, gdouble speed, gdouble kbps);
+static gdouble preset_tune_default_speed(void);
+#ifdef FAST_CUT_LIBAV
+static GQuark libav_error_quark(void);
+static void libav_set_error(GError **error, int code, const gchar *what);
+static gchar *libav_fallback_reason(int code, const gchar *what);
+static gboolean try_libav_cut(const gchar *input_path, gdouble from_s, gdouble to_s, const EncoderBackend *encoder, const gchar *preset, gboolean keep_audio, const gchar *format_name, const gchar *output_path, GCancellable *cancellable, CutStepContext *step, gint64 offset_us, FfmpegResult **result_out, GError **error);
+static FfmpegResult *run_libav_cut(const gchar *input_path, gdouble from_s, gdouble to_s, const EncoderBackend *encoder, const gchar *preset, gboolean keep_audio, const gchar *format_name, const gchar *output_path, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error);
+static enum AVPixelFormat libav_pick_pix_fmt(const AVCodec *codec, enum AVPixelFormat source);
+static int libav_decode_packet(LibavCut *cut, const AVPacket *packet, AVFrame *frame);
+static int libav_filter_frame(LibavCut *cut, AVFrame *frame);
+static int libav_build_format_graph(LibavCut *cut, const AVFrame *frame);
+static int libav_encode_frame(LibavCut *cut, const AVFrame *frame);
+static int libav_copy_video_packet(LibavCut *cut, AVPacket *packet);
+static int libav_copy_audio_packet(LibavCut *cut, AVPacket *packet, gboolean *audio_done);
+static void libav_shift_packet(AVPacket *packet, gint64 offset);
+static void libav_report_progress(LibavCut *cut, gboolean ended);
+static void libav_cut_clear(LibavCut *cut);
+#endif
+static void cut_step_line(const gchar *line, gpointer user_data);
+static void cut_step_progress(const FfmpegProgress *progress, gpointer user_data);
+static void cut_step_log(CutStepContext *step, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
+static gboolean run_capture_process(gchar **argv, GCancellable *cancellable, gchar **stdout_out, GError **error);
+static gboolean probe_video_stream(const gchar *input_path, GCancellable *cancellable, VideoStreamInfo *info, GError **error);
+static gboolean probe_audio_stream(const gchar *input_path, GCancellable *cancellable, AudioStreamInfo *info, GError **error);
+static gboolean probe_packets(const gchar *input_path, gdouble from_s, gdouble to_s, GCancellable *cancellable, GArray **keyframes_out, GArray **frames_out, GError **error);
+static gchar *probe_cache_key(const gchar *input_path, const GStatBuf *st);
+static const ProbeIndex *probe_index_lookup(const gchar *input_path, gboolean probe, GCancellable *cancellable, GError **error);
+static ProbeIndex *probe_index_map(const gchar *cache_path, const GStatBuf *st);
+static gboolean probe_index_build(const gchar *input_path, const GStatBuf *st, const gchar *cache_path, GCancellable *cancellable, GError **error);
+static void probe_scan_init(ProbeScan *scan);
+static void probe_scan_clear(ProbeScan *scan);
+static gboolean probe_scan_line(ProbeScan *scan, const gchar *line);
+static void probe_scan_finish(ProbeScan *scan);
+static gsize probe_index_keyframe_at(const ProbeIndex *index, gdouble pts_s);
+static gsize probe_index_frame_at(const ProbeIndex *index, gdouble pts_s);
+static gboolean check_time_within_duration(const gchar *input_path, const gchar *time_text, const gchar *label, GError **error);
+static gint compare_keyframes(gconstpointer a, gconstpointer b);
+static gboolean smart_cut_encoder_params(const VideoStreamInfo *info, const EncoderBackend *encoder, const gchar **profile, const gchar **pix_fmt, gchar **reason);
+static gchar **build_segment_argv(const gchar *input_path, gdouble from_s, gdouble duration_s, gint64 frame_count, gboolean copy, const EncoderBackend *encoder, const gchar *preset, const gchar *profile, const gchar *pix_fmt, guint threads, const gchar *output_path);
+static gchar **build_concat_argv(const gchar *list_path, const CutJob *job, const gchar *output_path);
+static gboolean write_concat_list(const gchar *list_path, GPtrArray *segment_names, GError **error);
+static gchar *make_work_dir(const gchar *output_path, GError **error);
+static void remove_work_dir(const gchar *path);
+static void output_cache_configure(const gchar *dir, gint64 limit_mb);
+static gchar *output_cache_default_dir(void);
+static gint64 output_cache_default_limit_mb(void);
+static gchar *output_cache_key(const CutJob *job);
+static gboolean output_cache_fingerprint(const gchar *path, GChecksum *checksum);
+static gboolean output_cache_fetch(const CutJob *job, const gchar *key, CutStepContext *step);
+static void output_cache_store(const CutJob *job, const gchar *key, CutStepContext *step);
+static void output_cache_drop(const CutJob *job);
+static gboolean output_cache_copy_file(const gchar *source, const gchar *target, GError **error);
+static GPtrArray *output_cache_scan(gint64 *total_bytes);
+static void output_cache_evict(gint64 limit_bytes);
+static int output_cache_list(void);
+static int output_cache_purge(void);
+static void output_cache_entry_free(OutputCacheEntry *entry);
+static gint compare_output_cache_entries(gconstpointer a, gconstpointer b);
+static void video_stream_info_clear(VideoStreamInfo *info);
+static void audio_stream_info_clear(AudioStreamInfo *info);
+static gint compare_doubles(gconstpointer a, gconstpointer b);
+static CutJob *cut_job_new(const gchar *input_path, const gchar *start_time, const gchar *end_time, const EncoderBackend *encoder, const gchar *preset, const gchar *output_path, CutMode mode);
+static void cut_job_free(CutJob *job);
+static void cut_job_add_range(CutJob *job, const gchar *start_time, const gchar *end_time, const gchar *output_path);
+static void cut_job_add_clip(CutJob *job, const gchar *input_path, const gchar *start_time, const gchar *end_time);
+static gboolean parse_join_clip(const gchar *text, gchar **input_out, gchar **start_out, gchar **end_out, GError **error);
+static void join_clip_free(JoinClip *clip);
+static guint cut_job_range_count(const CutJob *job);
+static const gchar *cut_job_output_path(const CutJob *job, guint index);
+static const gchar *path_extension(const gchar *path);
+static gint64 cut_job_duration_us(const CutJob *job);
+static gint64 cut_job_output_bytes(const CutJob *job);
+static void cut_range_free(CutRange *range);
+static gchar *build_range_output_path(const gchar *output_path, guint number);
 static void show_message(GtkWindow *parent, GtkMessageType type, const gchar *primary, const gchar *secondary);
+static gboolean confirm_message(GtkWindow *parent, const gchar *primary, const gchar *secondary);
 static gchar *format_command_for_log(gchar **argv);
 static GtkWidget *create_time_entry(const gchar *default_text);
 static gboolean collect_time_string(AppWidgets *app, GtkEntry *hour_entry, GtkEntry *min_entry, GtkEntry *sec_entry, gchar **out_time, const gchar *label);
 static gboolean normalize_time_entry(GtkEntry *entry, gint min_value, gint max_value, gint default_value, GtkWindow *parent, const gchar *time_label, const gchar *component_label, gint *value_out);
-static gchar **build_ffmpeg_argv(const gchar *input_path, const gchar *start_time, const gchar *end_time, const gchar *preset, const gchar *output_path);
+static gboolean parse_time_component(const gchar *text, gint min_value, gint max_value, gint default_value, const gchar *time_label, const gchar *component_label, gint *value_out, GError **error);
+static gboolean parse_time_string(const gchar *text, const gchar *label, gchar **out_time, GError **error);
+static gboolean parse_time_range(const gchar *text, gchar **start_out, gchar **end_out, GError **error);
+static GPtrArray *parse_range_list(const gchar *text, GError **error);
+static gboolean cut_mode_from_id(const gchar *id, CutMode *mode);
+static const gchar *cut_mode_id(CutMode mode);
+static const gchar *cut_mode_label(CutMode mode);
+static gboolean output_format_from_id(const gchar *id, OutputFormat *format);
+static const gchar *output_format_id(OutputFormat format);
+static const gchar *output_format_extension(OutputFormat format);
+static void append_output_format_args(GPtrArray *args, OutputFormat format);
+static gboolean output_is_stream(const gchar *output_path);
+static const gchar *output_url(const gchar *output_path);
+static gboolean output_stdout_claim(GError **error);
+static gchar *resolve_output_path(const gchar *input_path, const gchar *output_text);
+static const EncoderBackend *encoder_backend_lookup(const gchar *id, GError **error);
+static void probe_encoder_backends(void);
+static gboolean encoder_backend_usable(const gchar *encoder_name);
+static const EncoderBackend *encoder_backend_find(const gchar *id);
+static const EncoderBackend *encoder_backend_default(void);
+static void append_encoder_args(const EncoderBackend *encoder, GPtrArray *args, const gchar *preset, guint threads);
+static void append_x265_args(const EncoderBackend *encoder, GPtrArray *args, const gchar *preset, guint threads);
+static gchar **build_ffmpeg_argv(const gchar *input_path, const gchar *start_time, const gchar *end_time, const EncoderBackend *encoder, const gchar *preset, guint threads, OutputFormat format, const gchar *output_path);
+static gchar **build_multi_range_argv(const CutJob *job, gchar **output_paths);
 static void free_argv(gchar **argv);
-static gchar *build_default_output_path(const gchar *input_path);
+static gchar *build_default_output_path(const gchar *input_path, const gchar *codec, OutputFormat format);
 static void ffmpeg_result_free(FfmpegResult *result);
+static gint64 time_string_to_seconds(const gchar *time_string);
+static gchar *format_seconds(gint64 seconds);
+static gchar *format_seconds_arg(gdouble seconds);
 
 static const GtkTargetEntry DROP_TARGETS[] = {
     { "text/uri-list", 0, 0 }
 };
 
+static const gchar * const NVENC_PRESETS[] = { "p1", "p2", "p3", "p4", "p5", "p6", "p7", NULL };
+static const gchar * const QSV_PRESETS[] = { "veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow", NULL };
+static const gchar * const AMF_PRESETS[] = { "speed", "balanced", "quality", NULL };
+static const gchar * const X26X_PRESETS[] = { "ultrafast", "superfast", "veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow", NULL };
+
+/* NVENC keeps ffmpeg's defaults so existing cuts come out as before. */
+static const gchar * const NVENC_RATE_CONTROL[] = { NULL };
+static const gchar * const QSV_RATE_CONTROL[] = { "-global_quality", "25", NULL };
+static const gchar * const AMF_RATE_CONTROL[] = { "-rc", "cqp", "-qp_i", "22", "-qp_p", "24", NULL };
+static const gchar * const X264_RATE_CONTROL[] = { "-crf", "23", NULL };
+static const gchar * const X265_RATE_CONTROL[] = { "-crf", "28", NULL };
+
+static const EncoderBackend ENCODER_BACKENDS[] = {
+    { "nvenc", "NVIDIA NVENC (hevc_nvenc)", "hevc_nvenc", "hevc", TRUE, "-preset", NVENC_PRESETS, 4, NVENC_RATE_CONTROL, append_encoder_args },
+    { "qsv", "Intel Quick Sync (hevc_qsv)", "hevc_qsv", "hevc", TRUE, "-preset", QSV_PRESETS, 3, QSV_RATE_CONTROL, append_encoder_args },
+    { "amf", "AMD AMF (hevc_amf)", "hevc_amf", "hevc", TRUE, "-quality", AMF_PRESETS, 1, AMF_RATE_CONTROL, append_encoder_args },
+    { "libx264", "Software H.264 (libx264)", "libx264", "h264", FALSE, "-preset", X26X_PRESETS, 5, X264_RATE_CONTROL, append_encoder_args },
+    { "libx265", "Software HEVC (libx265)", "libx265", "hevc", FALSE, "-preset", X26X_PRESETS, 5, X265_RATE_CONTROL, append_x265_args }
+};
+
+static const gchar * const MANIFEST_FIELD_NAMES[MANIFEST_N_FIELDS] = { "input", "start", "end", "preset", "output", "encoder", "mode", "format" };
+
+/* The benchmark matrix; --bench-quick takes the first entry of each but the sources. */
+static const BenchSource BENCH_SOURCES[] = {
+    { "h264", "libx264", 640, 360, 30 },
+    { "hevc", "libx265", 640, 360, 30 },
+    { "h264", "libx264", 1280, 720, 250 },
+    { "hevc", "libx265", 1280, 720, 60 },
+    { "h264", "libx264", 1920, 1080, 60 }
+};
+static const gint BENCH_RANGE_SECONDS[] = { 3, 20 };
+static const gchar * const BENCH_PRESETS[] = { "ultrafast", "medium" };
+static const gchar * const BENCH_MODES[] = { "reencode", "smart", "chunked" };
+
+/* Filled once by probe_encoder_backends(). */
+static gboolean encoder_available[G_N_ELEMENTS(ENCODER_BACKENDS)];
+
+/* Probe indexes by cache key; probe_index_pending marks one being loaded or probed. */
+static GMutex probe_cache_lock;
+static GCond probe_cache_cond;
+static GHashTable *probe_cache_table;
+static ProbeIndex probe_index_pending;
+
+/* Set once at startup; output_cache_lock keeps stores and eviction of this process apart. */
+static gchar *output_cache_dir;
+static gint64 output_cache_limit;
+static GMutex output_cache_lock;
+
+/*
+ * segment_store_busy holds the store folders an incremental cut is using, so
+ * two jobs never rebuild one store at once while cuts of other stores run side
+ * by side. segment_store_lock guards it and the bookkeeping that removes
+ * stores; the encodes themselves run unlocked.
+ */
+static GMutex segment_store_lock;
+static GCond segment_store_cond;
+static GHashTable *segment_store_busy;
+
+/*
+ * Realtime factor the auto preset must reach. preset_tune_lock guards the
+ * results file and preset_tune_running, the keys being tuned right now; the
+ * trials themselves run unlocked.
+ */
+static gdouble preset_tune_speed = PRESET_TUNE_DEFAULT_SPEED;
+static GMutex preset_tune_lock;
+static GCond preset_tune_cond;
+static GHashTable *preset_tune_running;
+
+/* The real stdout once output_stdout_claim() has moved fast_cut's own messages to stderr. */
+static gint output_stdout_fd = -1;
+
 int main(int argc, char **argv) {
+#ifdef G_OS_UNIX
+    /* Cancelling writes "q" to ffmpeg's stdin, which may already be closed. */
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    /* Any argument selects the command-line mode, which never opens a display. */
+    if (argc > 1) {
+        return run_headless(argc, argv);
+    }
     gtk_init(&argc, &argv);
 
     AppWidgets *app = g_new0(AppWidgets, 1);
 
     app->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(app->window), APP_TITLE);
-    gtk_window_set_default_size(GTK_WINDOW(app->window), 800, 600);
+    gtk_window_set_default_size(GTK_WINDOW(app->window), 900, 720);
 
     GtkWidget *outer_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
     gtk_container_set_border_width(GTK_CONTAINER(outer_box), 12);
@@ -117,38 +1237,130 @@ int main(int argc, char **argv) {
     gtk_box_pack_start(GTK_BOX(end_box), app->end_sec_entry, FALSE, FALSE, 0);
     gtk_grid_attach(GTK_GRID(grid), end_box, 1, 2, 2, 1);
 
-    GtkWidget *preset_label = gtk_label_new("NVENC Preset:");
+    GtkWidget *strip_label = gtk_label_new("Timeline:");
+    gtk_widget_set_halign(strip_label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), strip_label, 0, 3, 1, 1);
+
+    /* Filled in once the file is indexed; see thumb_strip_set_source(). */
+    app->strip = thumb_strip_new();
+    gtk_widget_set_size_request(app->strip->area, -1, THUMB_HEIGHT);
+    gtk_widget_add_events(app->strip->area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK);
+    gtk_widget_set_tooltip_text(app->strip->area, "Click to set the start time, right-click to set the end time, or drag across the range");
+    gtk_grid_attach(GTK_GRID(grid), app->strip->area, 1, 3, 2, 1);
+
+    GtkWidget *ranges_label = gtk_label_new("More ranges:");
+    gtk_widget_set_halign(ranges_label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), ranges_label, 0, 4, 1, 1);
+
+    app->ranges_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(app->ranges_entry), "Optional, e.g. 00:10:00-00:12:00, 00:20:00-00:21:30 (cut in the same ffmpeg pass)");
+    gtk_grid_attach(GTK_GRID(grid), app->ranges_entry, 1, 4, 2, 1);
+
+    GtkWidget *encoder_label = gtk_label_new("Encoder:");
+    gtk_widget_set_halign(encoder_label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), encoder_label, 0, 5, 1, 1);
+
+    /* Filled in by encoder_probe_completed() once ffmpeg has been asked. */
+    app->encoder_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->encoder_combo), "", "Detecting encoders...");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(app->encoder_combo), 0);
+    gtk_widget_set_sensitive(app->encoder_combo, FALSE);
+    gtk_grid_attach(GTK_GRID(grid), app->encoder_combo, 1, 5, 2, 1);
+
+    GtkWidget *preset_label = gtk_label_new("Preset:");
     gtk_widget_set_halign(preset_label, GTK_ALIGN_START);
-    gtk_grid_attach(GTK_GRID(grid), preset_label, 0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), preset_label, 0, 6, 1, 1);
 
     app->preset_combo = gtk_combo_box_text_new();
-    // for nvenc
-    const gchar *presets[] = { "p1", "p2", "p3", "p4", "p5", "p6", "p7" }; // for nvenc
-    // for amf
-    //const gchar *presets[] = { "0", "1", "2", "3", "4", "5", "6", "7" }; // for amf
-    // for qsv
-    //const gchar *presets[] = { "veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow"}; // for qsv
+    gtk_grid_attach(GTK_GRID(grid), app->preset_combo, 1, 6, 2, 1);
 
-    for (size_t i = 0; i < G_N_ELEMENTS(presets); ++i) {
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->preset_combo), presets[i]);
-    }
-    gtk_combo_box_set_active(GTK_COMBO_BOX(app->preset_combo), 4);
-    gtk_grid_attach(GTK_GRID(grid), app->preset_combo, 1, 3, 2, 1);
+    GtkWidget *mode_label = gtk_label_new("Cut mode:");
+    gtk_widget_set_halign(mode_label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), mode_label, 0, 7, 1, 1);
+
+    app->mode_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->mode_combo), "reencode", "Re-encode the whole range");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->mode_combo), "smart", "Smart cut (re-encode only the GOPs at the cut points)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->mode_combo), "chunked", "Chunked (encode keyframe-aligned chunks in parallel)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->mode_combo), "incremental", "Incremental (reuse the previous encode when re-cutting)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->mode_combo), "resumable", "Resumable (continue an interrupted encode)");
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(app->mode_combo), "reencode");
+    app->format_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->format_combo), "mp4", "MP4");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->format_combo), "fmp4", "Fragmented MP4 (playable while encoding)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->format_combo), "ts", "MPEG-TS");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(app->format_combo), "mkv", "Matroska");
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(app->format_combo), "mp4");
+    GtkWidget *mode_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    gtk_box_pack_start(GTK_BOX(mode_box), app->mode_combo, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(mode_box), gtk_label_new("Container"), FALSE, FALSE, 8);
+    gtk_box_pack_start(GTK_BOX(mode_box), app->format_combo, FALSE, FALSE, 0);
+    gtk_grid_attach(GTK_GRID(grid), mode_box, 1, 7, 2, 1);
 
     GtkWidget *output_label = gtk_label_new("Output file:");
     gtk_widget_set_halign(output_label, GTK_ALIGN_START);
-    gtk_grid_attach(GTK_GRID(grid), output_label, 0, 4, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), output_label, 0, 8, 1, 1);
 
     app->output_entry = gtk_entry_new();
     gtk_entry_set_placeholder_text(GTK_ENTRY(app->output_entry), "Defaults to source folder");
-    gtk_grid_attach(GTK_GRID(grid), app->output_entry, 1, 4, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), app->output_entry, 1, 8, 2, 1);
 
-    app->start_button = gtk_button_new_with_label("Start");
+    GtkWidget *limits_label = gtk_label_new("Parallel jobs:");
+    gtk_widget_set_halign(limits_label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), limits_label, 0, 9, 1, 1);
+
+    GtkWidget *limits_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    app->hardware_spin = gtk_spin_button_new_with_range(1, 16, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->hardware_spin), DEFAULT_HARDWARE_SESSIONS);
+    app->software_spin = gtk_spin_button_new_with_range(1, 64, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->software_spin), DEFAULT_SOFTWARE_SLOTS);
+    gtk_box_pack_start(GTK_BOX(limits_box), gtk_label_new("Hardware encoder sessions"), FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(limits_box), app->hardware_spin, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(limits_box), gtk_label_new("Software encoder slots"), FALSE, FALSE, 8);
+    gtk_box_pack_start(GTK_BOX(limits_box), app->software_spin, FALSE, FALSE, 0);
+    gtk_grid_attach(GTK_GRID(grid), limits_box, 1, 9, 2, 1);
+
+    app->progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(app->progress_bar), TRUE);
+    gtk_widget_set_valign(app->progress_bar, GTK_ALIGN_CENTER);
+    gtk_grid_attach(GTK_GRID(grid), app->progress_bar, 0, 10, 2, 1);
+
+    GtkWidget *button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    app->start_button = gtk_button_new_with_label("Add to queue");
     gtk_widget_set_hexpand(app->start_button, FALSE);
-    gtk_grid_attach(GTK_GRID(grid), app->start_button, 2, 5, 1, 1);
+    gtk_widget_set_sensitive(app->start_button, FALSE);
+    app->cancel_button = gtk_button_new_with_label("Cancel job");
+    app->remove_button = gtk_button_new_with_label("Remove finished");
+    gtk_box_pack_start(GTK_BOX(button_box), app->start_button, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), app->cancel_button, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), app->remove_button, TRUE, TRUE, 0);
+    gtk_grid_attach(GTK_GRID(grid), button_box, 2, 10, 1, 1);
+
+    GtkWidget *paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
+    gtk_box_pack_start(GTK_BOX(outer_box), paned, TRUE, TRUE, 0);
+
+    GtkWidget *jobs_frame = gtk_frame_new("Jobs");
+    gtk_paned_pack1(GTK_PANED(paned), jobs_frame, TRUE, FALSE);
+
+    GtkWidget *jobs_scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(jobs_scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(jobs_scrolled, -1, 140);
+    gtk_container_add(GTK_CONTAINER(jobs_frame), jobs_scrolled);
+
+    app->job_store = gtk_list_store_new(JOB_N_COLUMNS, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING, G_TYPE_POINTER);
+    app->job_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(app->job_store));
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->job_view), -1, "#", gtk_cell_renderer_text_new(), "text", JOB_COL_ID, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->job_view), -1, "Input", gtk_cell_renderer_text_new(), "text", JOB_COL_INPUT, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->job_view), -1, "Range", gtk_cell_renderer_text_new(), "text", JOB_COL_RANGE, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->job_view), -1, "Output", gtk_cell_renderer_text_new(), "text", JOB_COL_OUTPUT, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->job_view), -1, "Status", gtk_cell_renderer_text_new(), "text", JOB_COL_STATUS, NULL);
+    GtkTreeViewColumn *progress_column = gtk_tree_view_column_new_with_attributes("Progress", gtk_cell_renderer_progress_new(), "value", JOB_COL_PROGRESS, "text", JOB_COL_DETAILS, NULL);
+    gtk_tree_view_column_set_expand(progress_column, TRUE);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(app->job_view), progress_column);
+    gtk_container_add(GTK_CONTAINER(jobs_scrolled), app->job_view);
 
     GtkWidget *log_frame = gtk_frame_new("Execution log");
-    gtk_box_pack_start(GTK_BOX(outer_box), log_frame, TRUE, TRUE, 0);
+    gtk_paned_pack2(GTK_PANED(paned), log_frame, TRUE, FALSE);
 
     GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
@@ -157,9 +1369,55 @@ int main(int argc, char **argv) {
     app->log_view = gtk_text_view_new();
     gtk_text_view_set_editable(GTK_TEXT_VIEW(app->log_view), FALSE);
     gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(app->log_view), FALSE);
-    app->log_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(app->log_view));
+    app->log_pane = log_pane_new(app->log_view, NULL);
+    gtk_text_view_set_buffer(GTK_TEXT_VIEW(app->log_view), app->log_pane->buffer);
     gtk_container_add(GTK_CONTAINER(scrolled), app->log_view);
 
+    app->scheduler = job_scheduler_new(DEFAULT_HARDWARE_SESSIONS, DEFAULT_SOFTWARE_SLOTS, on_job_status, on_job_line, on_job_progress, app);
+    gchar *telemetry_path = telemetry_default_path();
+    job_scheduler_set_telemetry(app->scheduler, telemetry_path, g_getenv("FAST_CUT_PROMETHEUS_FILE"));
+    g_free(telemetry_path);
+    gchar *cache_dir = output_cache_default_dir();
+    output_cache_configure(cache_dir, output_cache_default_limit_mb());
+    g_free(cache_dir);
+    ResourcePolicy policy = { 0 };
+    gdouble max_load = 0.0;
+    gint64 min_free_mib = 0;
+    GError *policy_error = NULL;
+    if (!resource_policy_parse(&policy, g_getenv("FAST_CUT_NICE"), g_getenv("FAST_CUT_IO_CLASS"), g_getenv("FAST_CUT_CPUS"), g_getenv("FAST_CUT_THREADS"), &policy_error) || !parse_throttle(g_getenv("FAST_CUT_MAX_LOAD"), g_getenv("FAST_CUT_MIN_FREE_MB"), &max_load, &min_free_mib, &policy_error)) {
+        /* A half-parsed policy would apply some of the settings and silently drop the rest. */
+        gchar *log_line = g_strdup_printf("%s; resource limits are not applied.", policy_error->message);
+        append_log_line(app, log_line);
+        g_free(log_line);
+        g_clear_error(&policy_error);
+        resource_policy_clear(&policy);
+        max_load = 0.0;
+        min_free_mib = 0;
+    }
+    job_scheduler_set_policy(app->scheduler, &policy, max_load, min_free_mib);
+    resource_policy_clear(&policy);
+    job_scheduler_set_prefetch(app->scheduler, prefetch_default_budget_mb());
+    VerifyLevel verify = VERIFY_OFF;
+    const gchar *verify_id = g_getenv("FAST_CUT_VERIFY");
+    if (verify_id && *verify_id && !verify_level_from_id(verify_id, &verify)) {
+        gchar *log_line = g_strdup_printf("Unknown verification level in FAST_CUT_VERIFY: %s", verify_id);
+        append_log_line(app, log_line);
+        g_free(log_line);
+    }
+    job_scheduler_set_verify(app->scheduler, verify);
+    preset_tune_speed = preset_tune_default_speed();
+    update_queue_summary(app);
+    GError *rpc_error = NULL;
+    app->rpc = rpc_server_new(app->scheduler, &rpc_error);
+    if (app->rpc) {
+        gchar *log_line = g_strdup_printf("Accepting jobs on %s", app->rpc->socket_path);
+        append_log_line(app, log_line);
+        g_free(log_line);
+    } else if (rpc_error) {
+        append_log_line(app, rpc_error->message);
+        g_clear_error(&rpc_error);
+    }
+
     gtk_drag_dest_set(app->window, GTK_DEST_DEFAULT_ALL, DROP_TARGETS, G_N_ELEMENTS(DROP_TARGETS), GDK_ACTION_COPY);
     gtk_drag_dest_set(app->file_entry, GTK_DEST_DEFAULT_ALL, DROP_TARGETS, G_N_ELEMENTS(DROP_TARGETS), GDK_ACTION_COPY);
 
@@ -169,297 +1427,7429 @@ int main(int argc, char **argv) {
     g_signal_connect(app->window, "drag-data-received", G_CALLBACK(on_drag_data_received), app);
     g_signal_connect(app->file_entry, "drag-data-received", G_CALLBACK(on_drag_data_received), app);
     g_signal_connect(app->output_entry, "changed", G_CALLBACK(on_output_changed), app);
+    g_signal_connect(app->encoder_combo, "changed", G_CALLBACK(on_encoder_changed), app);
+    g_signal_connect(app->format_combo, "changed", G_CALLBACK(on_format_changed), app);
     g_signal_connect(app->start_button, "clicked", G_CALLBACK(on_start_clicked), app);
+    g_signal_connect(app->cancel_button, "clicked", G_CALLBACK(on_cancel_clicked), app);
+    g_signal_connect(app->remove_button, "clicked", G_CALLBACK(on_remove_finished_clicked), app);
+    g_signal_connect(app->hardware_spin, "value-changed", G_CALLBACK(on_limits_changed), app);
+    g_signal_connect(app->software_spin, "value-changed", G_CALLBACK(on_limits_changed), app);
+    g_signal_connect(gtk_tree_view_get_selection(GTK_TREE_VIEW(app->job_view)), "changed", G_CALLBACK(on_job_selection_changed), app);
+    g_signal_connect(app->strip->area, "draw", G_CALLBACK(on_strip_draw), app);
+    g_signal_connect(app->strip->area, "button-press-event", G_CALLBACK(on_strip_button_press), app);
+    g_signal_connect(app->strip->area, "button-release-event", G_CALLBACK(on_strip_button_release), app);
+    GtkWidget *time_entries[] = { app->start_hour_entry, app->start_min_entry, app->start_sec_entry, app->end_hour_entry, app->end_min_entry, app->end_sec_entry };
+    for (guint i = 0; i < G_N_ELEMENTS(time_entries); ++i) {
+        g_signal_connect(time_entries[i], "changed", G_CALLBACK(on_time_entry_changed), app);
+    }
 
     gtk_widget_show_all(app->window);
+
+    GTask *probe_task = g_task_new(NULL, NULL, encoder_probe_completed, app);
+    g_task_run_in_thread(probe_task, encoder_probe_thread);
+    g_object_unref(probe_task);
+
     gtk_main();
 
+    thumb_strip_free(app->strip);
+    g_clear_pointer(&app->rpc, rpc_server_free);
+    job_scheduler_free(app->scheduler);
+    g_object_unref(app->job_store);
+    log_pane_free(app->log_pane);
     g_free(app->output_last_auto);
     g_free(app);
     return 0;
 }
 
-static void append_log_line(AppWidgets *app, const gchar *line) {
-    if (!line || !*line || !app->log_buffer) {
-        return;
+/*
+ * Runs one cut given as options, or every cut in a manifest, on the job
+ * scheduler without GTK. Exits with 0 when all cuts succeed, 1 when any cut
+ * fails or is rejected and 2 on a usage error.
+ */
+static int run_headless(int argc, char **argv) {
+#ifdef G_OS_WIN32
+    /* The executable is built for the GUI subsystem; write to the caller's console. */
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
     }
-    GtkTextIter end_iter;
-    gtk_text_buffer_get_end_iter(app->log_buffer, &end_iter);
-    gtk_text_buffer_insert(app->log_buffer, &end_iter, line, -1);
-    gtk_text_buffer_insert(app->log_buffer, &end_iter, "\n", -1);
-    gtk_text_buffer_get_end_iter(app->log_buffer, &end_iter);
-    gtk_text_view_scroll_to_iter(GTK_TEXT_VIEW(app->log_view), &end_iter, 0.0, FALSE, 0.0, 0.0);
-}
+#endif
+    gchar *input = NULL;
+    gchar *start = NULL;
+    gchar *end = NULL;
+    gchar *output = NULL;
+    gchar *encoder_id = NULL;
+    gchar *preset = NULL;
+    gchar *mode_id = NULL;
+    gchar *format_id = NULL;
+    gchar *manifest = NULL;
+    gchar **extra_ranges = NULL;
+    gint jobs = 1;
+    gboolean verbose = FALSE;
+    gboolean single_pass = FALSE;
+    gboolean bench = FALSE;
+    gboolean bench_quick = FALSE;
+    gchar *bench_dir = NULL;
+    gchar *bench_output = NULL;
+    gchar *bench_baseline = NULL;
+    gdouble bench_threshold = BENCH_DEFAULT_THRESHOLD_PCT;
+    gchar *telemetry = NULL;
+    gchar *prometheus = NULL;
+    gchar *cache_dir = NULL;
+    gint64 cache_mb = -1;
+    gboolean cache_list = FALSE;
+    gboolean cache_purge = FALSE;
+    gchar *nice_text = NULL;
+    gchar *io_text = NULL;
+    gchar *cpus_text = NULL;
+    gchar *threads_text = NULL;
+    gchar *load_text = NULL;
+    gchar *free_text = NULL;
+    gint64 prefetch_mb = -1;
+    gchar *join_output = NULL;
+    gchar **join_clips = NULL;
+    gdouble tune_speed = 0.0;
+    gchar **watch_dirs = NULL;
+    gchar *verify_id = NULL;
+    GOptionEntry entries[] = {
+        { "input", 'i', 0, G_OPTION_ARG_FILENAME, &input, "Video file to cut", "FILE" },
+        { "start", 's', 0, G_OPTION_ARG_STRING, &start, "Start time", "HH:MM:SS" },
+        { "end", 'e', 0, G_OPTION_ARG_STRING, &end, "End time", "HH:MM:SS" },
+        { "range", 'r', 0, G_OPTION_ARG_STRING_ARRAY, &extra_ranges, "Also cut this range in the same ffmpeg pass; may be repeated", "START-END" },
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Output file, relative to the input folder, " OUTPUT_STDOUT " for stdout, or a unix: or tcp:// URL (default: <input>_<codec>.mp4)", "FILE" },
+        { "encoder", 'c', 0, G_OPTION_ARG_STRING, &encoder_id, "nvenc, qsv, amf, libx264 or libx265 (default: fastest available)", "ID" },
+        { "preset", 'p', 0, G_OPTION_ARG_STRING, &preset, "Encoder preset, or " PRESET_AUTO " to pick one from sample encodes (default: the encoder's default)", "NAME" },
+        { "tune-speed", 0, 0, G_OPTION_ARG_DOUBLE, &tune_speed, "Realtime factor the " PRESET_AUTO " preset must reach (default: 4)", "FACTOR" },
+        { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode_id, "reencode, smart, chunked, incremental or resumable (default: reencode)", "MODE" },
+        { "format", 'f', 0, G_OPTION_ARG_STRING, &format_id, "Output container: mp4, fmp4 (fragmented MP4), ts or mkv (default: mp4, or fmp4 for a stream)", "FORMAT" },
+        { "manifest", 0, 0, G_OPTION_ARG_FILENAME, &manifest, "CSV or JSON-lines file with one cut per line", "FILE" },
+        { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of cuts to run at once (default: 1)", "N" },
+        { "join", 0, 0, G_OPTION_ARG_FILENAME, &join_output, "Join the --clip files into FILE, copying every clip that matches the first one", "FILE" },
+        { "clip", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &join_clips, "A clip of --join: a whole file, or FILE@START-END for a range; repeat in order", "FILE[@START-END]" },
+        { "watch", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &watch_dirs, "Keep running and cut every recording that appears in DIR with a " WATCH_SIDECAR_SUFFIX " sidecar; may be repeated", "DIR" },
+        { "verify", 0, 0, G_OPTION_ARG_STRING, &verify_id, "Check every output once it is written: probe (container, stream, duration and packet count) or decode (also decodes its first and last GOP) (default: off)", "LEVEL" },
+        { "single-pass", 0, 0, G_OPTION_ARG_NONE, &single_pass, "Cut manifest rows with the same input, encoder and preset in one ffmpeg pass", NULL },
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Print the output of every ffmpeg process", NULL },
+        { "telemetry", 0, 0, G_OPTION_ARG_FILENAME, &telemetry, "Append one JSON line of timings per cut to FILE (default: telemetry.jsonl in the user cache folder)", "FILE" },
+        { "prometheus-textfile", 0, 0, G_OPTION_ARG_FILENAME, &prometheus, "Keep FILE up to date with job metrics for the node exporter's textfile collector", "FILE" },
+        { "nice", 0, 0, G_OPTION_ARG_STRING, &nice_text, "Nice level of the ffmpeg processes (-20 to 19)", "N" },
+        { "io-class", 0, 0, G_OPTION_ARG_STRING, &io_text, "I/O scheduling class of the ffmpeg processes: idle, best-effort[:0-7] or realtime[:0-7] (Linux)", "CLASS" },
+        { "cpus", 0, 0, G_OPTION_ARG_STRING, &cpus_text, "Run the ffmpeg processes on these CPUs only, for example 0-3,6", "LIST" },
+        { "threads", 0, 0, G_OPTION_ARG_STRING, &threads_text, "Cap the encoder threads of each ffmpeg process", "N" },
+        { "max-load", 0, 0, G_OPTION_ARG_STRING, &load_text, "Do not start cuts while the 1-minute load average is above LOAD", "LOAD" },
+        { "min-free-mb", 0, 0, G_OPTION_ARG_STRING, &free_text, "Do not start cuts while less memory than MB is available", "MB" },
+        { "prefetch-mb", 0, 0, G_OPTION_ARG_INT64, &prefetch_mb, "Read ahead up to MB MiB of the inputs of queued cuts while others run; 0 turns it off (default: " G_STRINGIFY(PREFETCH_DEFAULT_MB) ")", "MB" },
+        { "output-cache", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir, "Folder of the output cache, which may be shared (default: the user cache folder)", "DIR" },
+        { "output-cache-mb", 0, 0, G_OPTION_ARG_INT64, &cache_mb, "Size limit of the output cache in MiB; the cache is off unless this is above 0 (default: " G_STRINGIFY(OUTPUT_CACHE_DEFAULT_MB) ")", "MB" },
+        { "cache-list", 0, 0, G_OPTION_ARG_NONE, &cache_list, "List the entries of the output cache and exit", NULL },
+        { "cache-purge", 0, 0, G_OPTION_ARG_NONE, &cache_purge, "Remove every entry of the output cache and exit", NULL },
+        { "bench", 0, 0, G_OPTION_ARG_NONE, &bench, "Run the benchmark suite with software encoders and print the results as JSON", NULL },
+        { "bench-quick", 0, 0, G_OPTION_ARG_NONE, &bench_quick, "Run a reduced benchmark matrix", NULL },
+        { "bench-dir", 0, 0, G_OPTION_ARG_FILENAME, &bench_dir, "Folder for the generated benchmark inputs (default: the user cache folder)", "DIR" },
+        { "bench-output", 0, 0, G_OPTION_ARG_FILENAME, &bench_output, "Write the benchmark results to FILE instead of stdout", "FILE" },
+        { "bench-baseline", 0, 0, G_OPTION_ARG_FILENAME, &bench_baseline, "Compare with the results of an earlier run and flag regressions", "FILE" },
+        { "bench-threshold", 0, 0, G_OPTION_ARG_DOUBLE, &bench_threshold, "Slowdown or memory growth in percent that counts as a regression (default: 10)", "PCT" },
+        { NULL }
+    };
+    GOptionContext *context = g_option_context_new("- cut video segments without the GUI");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_set_description(context, "Manifest columns: input,start,end[,preset[,output]], or a CSV header row naming any of input, start, end, preset, output, encoder, mode and format. JSON-lines manifests use the same names as object members. Encoder, preset, mode and format options are the defaults for manifest rows. Only --output and --join can write to stdout. With --single-pass, up to " G_STRINGIFY(MAX_RANGES_PER_PASS) " re-encode rows of the same input share one ffmpeg process. With --watch, a recording NAME is cut once NAME" WATCH_SIDECAR_SUFFIX " is complete; each of its lines is START-END with an optional output file.");
 
-static void append_log_block(AppWidgets *app, const gchar *block, const gchar *label) {
-    if (!block || !*block) {
-        return;
+    HeadlessRun run = { 0 };
+    int exit_code = 2;
+    GError *error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        goto cleanup;
     }
-    if (label && *label) {
-        append_log_line(app, label);
+    if (argc > 1) {
+        g_printerr("Unexpected argument: %s\n", argv[1]);
+        goto cleanup;
     }
-    gchar **lines = g_strsplit(block, "\n", -1);
-    if (!lines) {
-        return;
+    if (bench || bench_quick) {
+        gchar *dir = bench_dir ? g_strdup(bench_dir) : g_build_filename(g_get_user_cache_dir(), "fast_cut", "bench", NULL);
+        exit_code = run_benchmark(dir, bench_quick, bench_output, bench_baseline, bench_threshold, verbose);
+        g_free(dir);
+        goto cleanup;
     }
-    for (size_t i = 0; lines[i]; ++i) {
-        gchar *line = g_strchomp(lines[i]);
-        if (line && *line) {
-            append_log_line(app, line);
-        }
+    /* Configured after the benchmark, which must never be served from the cache. */
+    gchar *output_cache = cache_dir ? g_strdup(cache_dir) : output_cache_default_dir();
+    output_cache_configure(output_cache, cache_mb >= 0 ? cache_mb : output_cache_default_limit_mb());
+    g_free(output_cache);
+    if (cache_list || cache_purge) {
+        exit_code = cache_purge ? output_cache_purge() : output_cache_list();
+        goto cleanup;
     }
-    g_strfreev(lines);
-}
-
-static void set_output_default(AppWidgets *app, const gchar *input_path, gboolean force) {
-    if (!input_path || !*input_path) {
-        return;
+    gboolean usage_error = watch_dirs ? (manifest || input || join_output || join_clips)
+        : join_output ? (manifest || input || !join_clips || g_strv_length(join_clips) < 2) : (!manifest == !input || join_clips);
+    if (usage_error) {
+        g_printerr("Pass either --input with --start and --end, --manifest, --join with at least two --clip, or --watch. See --help.\n");
+        goto cleanup;
     }
-    if (!force && app->output_customized) {
-        return;
+    if (jobs < 1) {
+        g_printerr("--jobs must be at least 1.\n");
+        goto cleanup;
     }
-    gchar *default_path = build_default_output_path(input_path);
-    if (!default_path) {
-        return;
+    if (mode_id && !cut_mode_from_id(mode_id, &run.mode)) {
+        g_printerr("Unknown cut mode: %s\n", mode_id);
+        goto cleanup;
     }
-    app->suppress_output_changed = TRUE;
-    gtk_entry_set_text(GTK_ENTRY(app->output_entry), default_path);
-    app->suppress_output_changed = FALSE;
-    g_free(app->output_last_auto);
-    app->output_last_auto = g_strdup(default_path);
-    app->output_customized = FALSE;
-    g_free(default_path);
-}
-
-static void set_input_file(AppWidgets *app, const gchar *path) {
-    if (!path || !*path) {
-        return;
+    if (format_id && !output_format_from_id(format_id, &run.format)) {
+        g_printerr("Unknown output format: %s\n", format_id);
+        goto cleanup;
     }
-    app->suppress_output_changed = TRUE;
-    gtk_entry_set_text(GTK_ENTRY(app->file_entry), path);
-    app->suppress_output_changed = FALSE;
-    set_output_default(app, path, FALSE);
-}
+    VerifyLevel verify = VERIFY_OFF;
+    const gchar *verify_text = verify_id ? verify_id : g_getenv("FAST_CUT_VERIFY");
+    if (verify_text && *verify_text && !verify_level_from_id(verify_text, &verify)) {
+        g_printerr("Unknown verification level: %s\n", verify_text);
+        goto cleanup;
+    }
+    if ((g_strcmp0(output, OUTPUT_STDOUT) == 0 || g_strcmp0(join_output, OUTPUT_STDOUT) == 0) && !output_stdout_claim(&error)) {
+        g_printerr("%s\n", error->message);
+        goto cleanup;
+    }
+    run.encoder = encoder_id ? encoder_backend_lookup(encoder_id, &error) : encoder_backend_default();
+    if (!run.encoder) {
+        g_printerr("%s\n", error ? error->message : "No usable video encoder found; make sure ffmpeg is in PATH.");
+        goto cleanup;
+    }
+    run.preset = preset;
+    run.verbose = verbose;
+    run.single_pass = single_pass;
+    run.loop = g_main_loop_new(NULL, FALSE);
+    ResourcePolicy policy = { 0 };
+    gdouble max_load = 0.0;
+    gint64 min_free_mib = 0;
+    gboolean policy_ok = resource_policy_parse(&policy, nice_text ? nice_text : g_getenv("FAST_CUT_NICE"), io_text ? io_text : g_getenv("FAST_CUT_IO_CLASS"), cpus_text ? cpus_text : g_getenv("FAST_CUT_CPUS"), threads_text ? threads_text : g_getenv("FAST_CUT_THREADS"), &error)
+        && parse_throttle(load_text ? load_text : g_getenv("FAST_CUT_MAX_LOAD"), free_text ? free_text : g_getenv("FAST_CUT_MIN_FREE_MB"), &max_load, &min_free_mib, &error);
+    if (!policy_ok) {
+        g_printerr("%s\n", error->message);
+        resource_policy_clear(&policy);
+        goto cleanup;
+    }
+    run.scheduler = job_scheduler_new((guint)jobs, (guint)jobs, headless_job_status, headless_job_line, NULL, &run);
+    job_scheduler_set_policy(run.scheduler, &policy, max_load, min_free_mib);
+    resource_policy_clear(&policy);
+    job_scheduler_set_prefetch(run.scheduler, prefetch_mb >= 0 ? prefetch_mb : prefetch_default_budget_mb());
+    job_scheduler_set_verify(run.scheduler, verify);
+    preset_tune_speed = tune_speed > 0.0 ? tune_speed : preset_tune_default_speed();
+    gchar *telemetry_path = telemetry ? g_strdup(telemetry) : telemetry_default_path();
+    job_scheduler_set_telemetry(run.scheduler, telemetry_path, prometheus ? prometheus : g_getenv("FAST_CUT_PROMETHEUS_FILE"));
+    g_free(telemetry_path);
 
-static void on_open_file(GtkButton *button, gpointer user_data) {
-    AppWidgets *app = user_data;
-    GtkWidget *dialog = gtk_file_chooser_dialog_new("Select Video File", GTK_WINDOW(app->window), GTK_FILE_CHOOSER_ACTION_OPEN, "_Cancel", GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_ACCEPT, NULL);
+    if (join_output) {
+        CutJob *cut = NULL;
+        for (guint i = 0; join_clips[i]; ++i) {
+            gchar *clip_input = NULL;
+            gchar *clip_start = NULL;
+            gchar *clip_end = NULL;
+            if (!parse_join_clip(join_clips[i], &clip_input, &clip_start, &clip_end, &error)) {
+                g_printerr("%s\n", error->message);
+                cut_job_free(cut);
+                goto cleanup;
+            }
+            if (!cut) {
+                gchar *join_path = resolve_output_path(clip_input, join_output);
+                cut = cut_job_new(clip_input, "00:00:00", "00:00:00", run.encoder, preset ? preset : run.encoder->presets[run.encoder->default_preset], join_path, CUT_MODE_JOIN);
+                cut->format = run.format;
+                g_free(join_path);
+            }
+            cut_job_add_clip(cut, clip_input, clip_start, clip_end);
+            g_free(clip_input);
+            g_free(clip_start);
+            g_free(clip_end);
+        }
+        job_scheduler_add(run.scheduler, cut);
+    } else if (input) {
+        gchar *fields[MANIFEST_N_FIELDS] = { input, start, end, NULL, output, NULL, NULL };
+        CutJob *cut = headless_build_cut(&run, fields, &error);
+        if (!cut) {
+            g_printerr("%s\n", error->message);
+            goto cleanup;
+        }
+        if (extra_ranges && output_is_stream(cut->output_path)) {
+            g_printerr("--range needs file outputs; a stream carries a single range.\n");
+            cut_job_free(cut);
+            goto cleanup;
+        }
+        for (guint i = 0; extra_ranges && extra_ranges[i]; ++i) {
+            gchar *range_start = NULL;
+            gchar *range_end = NULL;
+            gboolean parsed = parse_time_range(extra_ranges[i], &range_start, &range_end, &error);
+            if (parsed) {
+                cut_job_add_range(cut, range_start, range_end, NULL);
+            }
+            g_free(range_start);
+            g_free(range_end);
+            if (!parsed) {
+                g_printerr("%s\n", error->message);
+                cut_job_free(cut);
+                goto cleanup;
+            }
+        }
+        if (cut_job_range_count(cut) > MAX_RANGES_PER_PASS) {
+            g_printerr("At most %d ranges can be cut in one pass.\n", MAX_RANGES_PER_PASS);
+            cut_job_free(cut);
+            goto cleanup;
+        }
+        job_scheduler_add(run.scheduler, cut);
+    } else if (watch_dirs) {
+        run.watch = watch_folder_new(&run, watch_dirs, &error);
+        if (!run.watch) {
+            g_printerr("%s\n", error->message);
+            goto cleanup;
+        }
+    } else if (!headless_load_manifest(&run, manifest)) {
+        goto cleanup;
+    }
 
-    GtkFileFilter *filter = gtk_file_filter_new();
-    gtk_file_filter_set_name(filter, "Video files");
-    gtk_file_filter_add_mime_type(filter, "video/*");
-    gtk_file_filter_add_pattern(filter, "*.mp4");
-    gtk_file_filter_add_pattern(filter, "*.mkv");
-    gtk_file_filter_add_pattern(filter, "*.mov");
-    gtk_file_filter_add_pattern(filter, "*.avi");
-    gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
+#ifdef G_OS_UNIX
+    guint sigint_source = g_unix_signal_add(SIGINT, headless_interrupted, &run);
+    guint sigterm_source = g_unix_signal_add(SIGTERM, headless_interrupted, &run);
+#endif
+    if (run.watch || job_scheduler_busy(run.scheduler)) {
+        g_main_loop_run(run.loop);
+    }
+#ifdef G_OS_UNIX
+    g_source_remove(sigint_source);
+    g_source_remove(sigterm_source);
+#endif
 
-    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
-        gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
-        set_input_file(app, filename);
-        g_free(filename);
+    if (run.watch) {
+        /* Interrupted cuts stay pending in their sidecars for the next start. */
+        g_print("%u done, %u failed\n", run.watch->done, run.watch->failed);
+        exit_code = 0;
+        goto cleanup;
     }
+    guint done = job_scheduler_count(run.scheduler, JOB_STATUS_DONE);
+    guint failed = job_scheduler_count(run.scheduler, JOB_STATUS_FAILED);
+    guint cancelled = job_scheduler_count(run.scheduler, JOB_STATUS_CANCELLED);
+    g_print("%u done, %u failed, %u cancelled, %u rejected\n", done, failed, cancelled, run.rejected);
+    exit_code = (failed + cancelled + run.rejected) > 0 ? 1 : 0;
 
-    gtk_widget_destroy(dialog);
+cleanup:
+    g_clear_pointer(&run.watch, watch_folder_free);
+    job_scheduler_free(run.scheduler);
+    if (run.loop) {
+        g_main_loop_unref(run.loop);
+    }
+    g_clear_error(&error);
+    g_option_context_free(context);
+    g_free(input);
+    g_free(start);
+    g_free(end);
+    g_free(output);
+    g_free(encoder_id);
+    g_free(preset);
+    g_free(mode_id);
+    g_free(format_id);
+    g_free(verify_id);
+    g_free(manifest);
+    g_strfreev(extra_ranges);
+    g_free(bench_dir);
+    g_free(bench_output);
+    g_free(bench_baseline);
+    g_free(telemetry);
+    g_free(prometheus);
+    g_free(cache_dir);
+    g_free(nice_text);
+    g_free(io_text);
+    g_free(cpus_text);
+    g_free(threads_text);
+    g_free(load_text);
+    g_free(free_text);
+    g_free(join_output);
+    g_strfreev(join_clips);
+    g_strfreev(watch_dirs);
+    return exit_code;
 }
 
-static void on_drag_data_received(GtkWidget *widget, GdkDragContext *context, gint x, gint y, GtkSelectionData *data, guint info, guint time, gpointer user_data) {
-    AppWidgets *app = user_data;
-    if (gtk_selection_data_get_length(data) <= 0) {
-        gtk_drag_finish(context, FALSE, FALSE, time);
-        return;
-    }
-    gchar **uris = g_uri_list_extract_uris((const gchar *)gtk_selection_data_get_data(data));
-    if (uris && uris[0]) {
-        GError *error = NULL;
-        gchar *filename = g_filename_from_uri(uris[0], NULL, &error);
-        if (filename) {
-            set_input_file(app, filename);
-            g_free(filename);
-        } else if (error) {
-            show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "Unable to read dropped file", error->message);
-            g_clear_error(&error);
+/*
+ * Benchmark mode: cuts every case of the matrix below from synthetic inputs,
+ * one case at a time on this thread so the timings do not disturb each
+ * other, and writes the measurements as JSON. With a baseline from an earlier
+ * run, cases that got slower or used more memory than threshold_pct allows
+ * are reported and make the exit status 1.
+ */
+static int run_benchmark(const gchar *dir, gboolean quick, const gchar *output_path, const gchar *baseline_path, gdouble threshold_pct, gboolean verbose) {
+    BenchRun bench = { 0 };
+    bench.dir = dir;
+    bench.threshold_pct = threshold_pct;
+    bench.verbose = verbose;
+    GError *error = NULL;
+    JsonParser *baseline_parser = NULL;
+    if (baseline_path) {
+        baseline_parser = json_parser_new();
+        bench.baseline = bench_load_baseline(baseline_parser, baseline_path, &error);
+        if (!bench.baseline) {
+            g_printerr("Cannot read the baseline %s: %s\n", baseline_path, error->message);
+            g_error_free(error);
+            g_object_unref(baseline_parser);
+            return 2;
         }
     }
-    g_strfreev(uris);
-    gtk_drag_finish(context, TRUE, FALSE, time);
-}
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        g_printerr("Cannot create %s: %s\n", dir, g_strerror(errno));
+        g_clear_pointer(&bench.baseline, g_hash_table_unref);
+        g_clear_object(&baseline_parser);
+        return 2;
+    }
 
-static void on_output_changed(GtkEditable *editable, gpointer user_data) {
-    AppWidgets *app = user_data;
-    if (app->suppress_output_changed) {
-        return;
+    probe_encoder_backends();
+    gchar *version_argv[] = { "ffmpeg", "-version", NULL };
+    gchar *version = NULL;
+    if (run_capture_process(version_argv, NULL, &version, NULL)) {
+        version[strcspn(version, "\r\n")] = '\0';
     }
-    const gchar *text = gtk_entry_get_text(GTK_ENTRY(editable));
-    if (!app->output_last_auto) {
-        app->output_customized = (text && *text);
-        return;
+    bench.builder = json_builder_new();
+    json_builder_begin_object(bench.builder);
+    json_builder_set_member_name(bench.builder, "ffmpeg");
+    json_builder_add_string_value(bench.builder, version ? version : "");
+    json_builder_set_member_name(bench.builder, "cpus");
+    json_builder_add_int_value(bench.builder, g_get_num_processors());
+    json_builder_set_member_name(bench.builder, "quick");
+    json_builder_add_boolean_value(bench.builder, quick);
+    json_builder_set_member_name(bench.builder, "results");
+    json_builder_begin_array(bench.builder);
+    g_free(version);
+
+    guint source_count = quick ? BENCH_QUICK_SOURCES : G_N_ELEMENTS(BENCH_SOURCES);
+    guint range_count = quick ? 1 : G_N_ELEMENTS(BENCH_RANGE_SECONDS);
+    guint preset_count = quick ? 1 : G_N_ELEMENTS(BENCH_PRESETS);
+    for (guint s = 0; s < source_count; ++s) {
+        const BenchSource *source = &BENCH_SOURCES[s];
+        gchar *source_name = g_strdup_printf("%s_%dx%d_g%d", source->codec, source->width, source->height, source->gop);
+        gchar *source_path = bench_make_source(dir, source, source_name, &error);
+        if (!source_path) {
+            g_printerr("Skipping %s: %s\n", source_name, error->message);
+            g_clear_error(&error);
+            g_free(source_name);
+            continue;
+        }
+        /* Smart and chunked cases should time the cut, not the first probe of the input. */
+        probe_index_lookup(source_path, TRUE, NULL, NULL);
+        for (guint r = 0; r < range_count; ++r) {
+            for (guint e = 0; e < G_N_ELEMENTS(ENCODER_BACKENDS); ++e) {
+                const EncoderBackend *encoder = &ENCODER_BACKENDS[e];
+                if (encoder->hardware || !encoder_available[e]) {
+                    continue;
+                }
+                for (guint p = 0; p < preset_count; ++p) {
+                    for (guint m = 0; m < G_N_ELEMENTS(BENCH_MODES); ++m) {
+                        /* A smart cut with a mismatched codec only measures its fallback. */
+                        if (g_strcmp0(BENCH_MODES[m], "smart") == 0 && g_strcmp0(encoder->codec, source->codec) != 0) {
+                            continue;
+                        }
+                        bench_run_case(&bench, source_name, source_path, BENCH_RANGE_SECONDS[r], encoder, BENCH_PRESETS[p], BENCH_MODES[m]);
+                    }
+                }
+            }
+        }
+        g_free(source_path);
+        g_free(source_name);
     }
-    if (g_strcmp0(text, app->output_last_auto) == 0) {
-        app->output_customized = FALSE;
+    json_builder_end_array(bench.builder);
+    json_builder_end_object(bench.builder);
+
+    JsonGenerator *generator = json_generator_new();
+    JsonNode *root = json_builder_get_root(bench.builder);
+    json_generator_set_root(generator, root);
+    json_generator_set_pretty(generator, TRUE);
+    int exit_code = 0;
+    if (output_path) {
+        if (!json_generator_to_file(generator, output_path, &error)) {
+            g_printerr("Cannot write %s: %s\n", output_path, error->message);
+            g_clear_error(&error);
+            exit_code = 2;
+        }
     } else {
-        app->output_customized = TRUE;
+        gchar *json = json_generator_to_data(generator, NULL);
+        g_print("%s\n", json);
+        g_free(json);
     }
-}
+    json_node_unref(root);
+    g_object_unref(generator);
+    g_object_unref(bench.builder);
 
-static gboolean on_window_delete(GtkWidget *widget, GdkEvent *event, gpointer user_data) {
-    AppWidgets *app = user_data;
-    if (app->task_running) {
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_INFO, "Encoding in progress", "FFmpeg is running; please wait before closing.");
-        return TRUE;
+    g_printerr("%u cases, %u failed, %u regressions\n", bench.cases, bench.failed, bench.regressions);
+    if (exit_code == 0 && (bench.cases == 0 || bench.failed + bench.regressions > 0)) {
+        exit_code = 1;
     }
-    return FALSE;
+    g_clear_pointer(&bench.baseline, g_hash_table_unref);
+    g_clear_object(&baseline_parser);
+    return exit_code;
 }
 
-static void on_start_clicked(GtkButton *button, gpointer user_data) {
-    AppWidgets *app = user_data;
-    if (app->task_running) {
-        return;
+/*
+ * Generates one test input with testsrc2 and a sine tone, unless an earlier
+ * run left it in dir. Scene-cut detection is off so the GOP size is exact,
+ * and bitexact flags keep the file the same from run to run.
+ */
+static gchar *bench_make_source(const gchar *dir, const BenchSource *source, const gchar *source_name, GError **error) {
+    const EncoderBackend *encoder = encoder_backend_lookup(source->encoder, error);
+    if (!encoder) {
+        return NULL;
+    }
+    gchar *name = g_strconcat(source_name, ".mp4", NULL);
+    gchar *path = g_build_filename(dir, name, NULL);
+    g_free(name);
+    if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        return path;
     }
+    g_printerr("Generating %s\n", path);
+    name = g_strconcat(source_name, ".part.mp4", NULL);
+    gchar *part_path = g_build_filename(dir, name, NULL);
+    g_free(name);
 
-    gchar *input_path = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(app->file_entry))));
-    gchar *start_time = NULL;
-    gchar *end_time = NULL;
-    gchar *output_text = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(app->output_entry))));
+    GPtrArray *args = g_ptr_array_new_with_free_func(g_free);
+    const gchar *fixed[] = { "ffmpeg", "-y", "-hide_banner", "-nostats", "-v", "error", "-f", "lavfi", "-i", NULL };
+    for (guint i = 0; fixed[i]; ++i) {
+        g_ptr_array_add(args, g_strdup(fixed[i]));
+    }
+    g_ptr_array_add(args, g_strdup_printf("testsrc2=size=%dx%d:rate=%d:duration=%d", source->width, source->height, BENCH_SOURCE_FPS, BENCH_SOURCE_SECONDS));
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup("lavfi"));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup_printf("sine=frequency=440:sample_rate=48000:duration=%d", BENCH_SOURCE_SECONDS));
+    encoder->append_args(encoder, args, "veryfast", 0);
+    g_ptr_array_add(args, g_strdup("-pix_fmt"));
+    g_ptr_array_add(args, g_strdup("yuv420p"));
+    g_ptr_array_add(args, g_strdup("-g"));
+    g_ptr_array_add(args, g_strdup_printf("%d", source->gop));
+    if (g_strcmp0(source->encoder, "libx264") == 0) {
+        g_ptr_array_add(args, g_strdup("-sc_threshold"));
+        g_ptr_array_add(args, g_strdup("0"));
+    } else {
+        g_ptr_array_add(args, g_strdup("-x265-params"));
+        g_ptr_array_add(args, g_strdup_printf("keyint=%d:min-keyint=%d:scenecut=0", source->gop, source->gop));
+    }
+    const gchar *tail[] = { "-c:a", "aac", "-b:a", "128k", "-map_metadata", "-1", "-fflags", "+bitexact", "-flags", "+bitexact", NULL };
+    for (guint i = 0; tail[i]; ++i) {
+        g_ptr_array_add(args, g_strdup(tail[i]));
+    }
+    g_ptr_array_add(args, g_strdup(part_path));
+    g_ptr_array_add(args, NULL);
 
-    if (!input_path || !*input_path) {
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please choose a video file", NULL);
-        goto cleanup_inputs;
+    gchar *output = NULL;
+    gboolean ok = run_capture_process((gchar **)args->pdata, NULL, &output, error);
+    g_free(output);
+    g_ptr_array_free(args, TRUE);
+    if (ok && g_rename(part_path, path) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Cannot rename %s: %s", part_path, g_strerror(saved_errno));
+        ok = FALSE;
     }
-    if (!g_file_test(input_path, G_FILE_TEST_EXISTS)) {
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "Video file not found", input_path);
-        goto cleanup_inputs;
+    if (!ok) {
+        g_remove(part_path);
+        g_clear_pointer(&path, g_free);
     }
-    if (!collect_time_string(app, GTK_ENTRY(app->start_hour_entry), GTK_ENTRY(app->start_min_entry), GTK_ENTRY(app->start_sec_entry), &start_time, "Start time")) {
-        goto cleanup_inputs;
+    g_free(part_path);
+    return path;
+}
+
+/* Cuts one case, appends its result object and compares it with the baseline. */
+static void bench_run_case(BenchRun *bench, const gchar *source_name, const gchar *source_path, gint range_s, const EncoderBackend *encoder, const gchar *preset, const gchar *mode_id) {
+    gchar *id = g_strdup_printf("%s/%ds/%s/%s/%s", source_name, range_s, encoder->id, preset, mode_id);
+    gchar *start = format_seconds(BENCH_RANGE_START_S);
+    gchar *end = format_seconds(BENCH_RANGE_START_S + range_s);
+    gchar *output = g_build_filename(bench->dir, "bench_output.mp4", NULL);
+    CutMode mode = CUT_MODE_REENCODE;
+    cut_mode_from_id(mode_id, &mode);
+    CutJob *cut = cut_job_new(source_path, start, end, encoder, preset, output, mode);
+
+    BenchRssSampler sampler = { 0 };
+    GThread *sampler_thread = g_thread_new("bench-rss", bench_rss_sampler, &sampler);
+    GError *error = NULL;
+    gint64 started_us = g_get_monotonic_time();
+    FfmpegResult *result = run_cut_job(cut, NULL, bench_case_line, NULL, bench, &error);
+    gdouble wall_s = (gdouble)(g_get_monotonic_time() - started_us) / G_USEC_PER_SEC;
+    g_atomic_int_set(&sampler.stop, TRUE);
+    g_thread_join(sampler_thread);
+
+    gboolean ok = result && result->exit_status == 0 && !result->cancelled;
+    GStatBuf st;
+    gint64 output_bytes = ok && g_stat(output, &st) == 0 ? (gint64)st.st_size : 0;
+    g_remove(output);
+    gdouble speed = wall_s > 0.0 ? range_s / wall_s : 0.0;
+    gdouble fps = speed * BENCH_SOURCE_FPS;
+    bench->cases++;
+
+    JsonBuilder *builder = bench->builder;
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "id");
+    json_builder_add_string_value(builder, id);
+    json_builder_set_member_name(builder, "source");
+    json_builder_add_string_value(builder, source_name);
+    json_builder_set_member_name(builder, "range_s");
+    json_builder_add_int_value(builder, range_s);
+    json_builder_set_member_name(builder, "encoder");
+    json_builder_add_string_value(builder, encoder->id);
+    json_builder_set_member_name(builder, "preset");
+    json_builder_add_string_value(builder, preset);
+    json_builder_set_member_name(builder, "mode");
+    json_builder_add_string_value(builder, mode_id);
+    json_builder_set_member_name(builder, "status");
+    json_builder_add_string_value(builder, ok ? "ok" : "failed");
+    json_builder_set_member_name(builder, "wall_s");
+    json_builder_add_double_value(builder, wall_s);
+    json_builder_set_member_name(builder, "fps");
+    json_builder_add_double_value(builder, fps);
+    json_builder_set_member_name(builder, "speed");
+    json_builder_add_double_value(builder, speed);
+    json_builder_set_member_name(builder, "output_bytes");
+    json_builder_add_int_value(builder, output_bytes);
+    json_builder_set_member_name(builder, "peak_child_rss_kib");
+    json_builder_add_int_value(builder, sampler.peak_kib);
+
+    if (ok) {
+        g_printerr("%-48s %8.2f s %8.1f fps %6.2fx %8" G_GINT64_FORMAT " KiB\n", id, wall_s, fps, speed, sampler.peak_kib);
+    } else {
+        bench->failed++;
+        g_printerr("%-48s FAILED: %s\n", id, error ? error->message : (result && result->stderr_tail ? result->stderr_tail : "unknown error"));
     }
-    if (!collect_time_string(app, GTK_ENTRY(app->end_hour_entry), GTK_ENTRY(app->end_min_entry), GTK_ENTRY(app->end_sec_entry), &end_time, "End time")) {
-        goto cleanup_inputs;
+
+    JsonObject *base = bench->baseline ? g_hash_table_lookup(bench->baseline, id) : NULL;
+    if (base) {
+        gboolean base_ok = g_strcmp0(json_object_get_string_member(base, "status"), "ok") == 0;
+        gdouble base_wall_s = bench_member_double(base, "wall_s");
+        gdouble base_rss_kib = bench_member_double(base, "peak_child_rss_kib");
+        gdouble limit = 1.0 + bench->threshold_pct / 100.0;
+        gboolean regression = FALSE;
+        if (base_ok && !ok) {
+            g_printerr("  REGRESSION: fails, but succeeded in the baseline\n");
+            regression = TRUE;
+        }
+        if (base_ok && ok && base_wall_s > 0.0 && wall_s > base_wall_s * limit) {
+            g_printerr("  REGRESSION: %.2f s against %.2f s in the baseline (%+.1f%%)\n", wall_s, base_wall_s, (wall_s / base_wall_s - 1.0) * 100.0);
+            regression = TRUE;
+        }
+        if (base_ok && ok && base_rss_kib > 0.0 && sampler.peak_kib > base_rss_kib * limit) {
+            g_printerr("  REGRESSION: %" G_GINT64_FORMAT " KiB peak RSS against %.0f KiB in the baseline\n", sampler.peak_kib, base_rss_kib);
+            regression = TRUE;
+        }
+        bench->regressions += regression ? 1 : 0;
+        json_builder_set_member_name(builder, "baseline_wall_s");
+        json_builder_add_double_value(builder, base_wall_s);
+        json_builder_set_member_name(builder, "regression");
+        json_builder_add_boolean_value(builder, regression);
     }
-    if (!output_text || !*output_text) {
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please enter an output file", NULL);
-        goto cleanup_inputs;
+    json_builder_end_object(builder);
+
+    g_clear_error(&error);
+    ffmpeg_result_free(result);
+    cut_job_free(cut);
+    g_free(output);
+    g_free(end);
+    g_free(start);
+    g_free(id);
+}
+
+static void bench_case_line(const gchar *line, gpointer user_data) {
+    BenchRun *bench = user_data;
+    if (bench->verbose) {
+        g_printerr("  %s\n", line);
     }
+}
 
-    gchar *preset = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->preset_combo));
+/* Maps the case ids of an earlier run's results to their objects, which the parser owns. */
+static GHashTable *bench_load_baseline(JsonParser *parser, const gchar *path, GError **error) {
+    if (!json_parser_load_from_file(parser, path, error)) {
+        return NULL;
+    }
+    JsonNode *root = json_parser_get_root(parser);
+    JsonObject *object = root && JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+    JsonArray *results = object && json_object_has_member(object, "results") ? json_object_get_array_member(object, "results") : NULL;
+    if (!results) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "not a benchmark result file");
+        return NULL;
+    }
+    GHashTable *baseline = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < json_array_get_length(results); ++i) {
+        JsonNode *node = json_array_get_element(results, i);
+        if (!JSON_NODE_HOLDS_OBJECT(node)) {
+            continue;
+        }
+        JsonObject *result = json_node_get_object(node);
+        JsonNode *id = json_object_get_member(result, "id");
+        if (id && json_node_get_value_type(id) == G_TYPE_STRING) {
+            g_hash_table_insert(baseline, (gpointer)json_node_get_string(id), result);
+        }
+    }
+    return baseline;
+}
+
+static gdouble bench_member_double(JsonObject *object, const gchar *name) {
+    JsonNode *member = json_object_get_member(object, name);
+    return member && JSON_NODE_HOLDS_VALUE(member) ? json_node_get_double(member) : 0.0;
+}
+
+static gpointer bench_rss_sampler(gpointer data) {
+    BenchRssSampler *sampler = data;
+    while (!g_atomic_int_get(&sampler->stop)) {
+        gint64 rss_kib = bench_child_rss_kib();
+        sampler->peak_kib = MAX(sampler->peak_kib, rss_kib);
+        g_usleep(BENCH_RSS_SAMPLE_US);
+    }
+    return NULL;
+}
+
+/*
+ * Sums the resident size of this process's children, so the parallel
+ * children of a chunked encode count together. Reads /proc, so it is 0 on
+ * anything but Linux.
+ */
+static gint64 bench_child_rss_kib(void) {
+    gint64 total = 0;
+#ifdef __linux__
+    GDir *dir = g_dir_open("/proc", 0, NULL);
+    if (!dir) {
+        return 0;
+    }
+    int self = (int)getpid();
+    const gchar *name = NULL;
+    while ((name = g_dir_read_name(dir))) {
+        if (!g_ascii_isdigit(name[0])) {
+            continue;
+        }
+        gchar *path = g_build_filename("/proc", name, "stat", NULL);
+        gchar *contents = NULL;
+        int parent = 0;
+        /* The parent pid follows the state after the parenthesised command name. */
+        if (g_file_get_contents(path, &contents, NULL, NULL)) {
+            const gchar *paren = strrchr(contents, ')');
+            if (!paren || sscanf(paren + 1, " %*c %d", &parent) != 1) {
+                parent = 0;
+            }
+        }
+        g_free(contents);
+        g_free(path);
+        if (parent != self) {
+            continue;
+        }
+        total += proc_status_kib(name, "VmRSS:");
+    }
+    g_dir_close(dir);
+#endif
+    return total;
+}
+
+/* Reads one "Field:   1234 kB" line of /proc/<pid>/status; 0 when it is missing. */
+static gint64 proc_status_kib(const gchar *pid, const gchar *field) {
+    gint64 value = 0;
+#ifdef __linux__
+    gchar *path = g_build_filename("/proc", pid, "status", NULL);
+    gchar *contents = NULL;
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        const gchar *line = strstr(contents, field);
+        if (line) {
+            value = g_ascii_strtoll(line + strlen(field), NULL, 10);
+        }
+        g_free(contents);
+    }
+    g_free(path);
+#endif
+    return value;
+}
+
+/*
+ * Validates one cut with the same rules as the GUI form. Empty fields fall
+ * back to the run's defaults, then to the encoder's own.
+ */
+static CutJob *headless_build_cut(HeadlessRun *run, gchar **fields, GError **error) {
+    const gchar *input = fields[MANIFEST_FIELD_INPUT];
+    if (!input || !*input) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "No input file given");
+        return NULL;
+    }
+    if (!g_file_test(input, G_FILE_TEST_EXISTS)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Video file not found: %s", input);
+        return NULL;
+    }
+    if (!fields[MANIFEST_FIELD_START] || !*fields[MANIFEST_FIELD_START] || !fields[MANIFEST_FIELD_END] || !*fields[MANIFEST_FIELD_END]) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Start and end times are required");
+        return NULL;
+    }
+
+    const EncoderBackend *encoder = run->encoder;
+    if (fields[MANIFEST_FIELD_ENCODER] && *fields[MANIFEST_FIELD_ENCODER]) {
+        encoder = encoder_backend_lookup(fields[MANIFEST_FIELD_ENCODER], error);
+        if (!encoder) {
+            return NULL;
+        }
+    }
+    CutMode mode = run->mode;
+    if (fields[MANIFEST_FIELD_MODE] && *fields[MANIFEST_FIELD_MODE] && !cut_mode_from_id(fields[MANIFEST_FIELD_MODE], &mode)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown cut mode: %s", fields[MANIFEST_FIELD_MODE]);
+        return NULL;
+    }
+    OutputFormat format = run->format;
+    if (fields[MANIFEST_FIELD_FORMAT] && *fields[MANIFEST_FIELD_FORMAT] && !output_format_from_id(fields[MANIFEST_FIELD_FORMAT], &format)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown output format: %s", fields[MANIFEST_FIELD_FORMAT]);
+        return NULL;
+    }
+    if (g_strcmp0(fields[MANIFEST_FIELD_OUTPUT], OUTPUT_STDOUT) == 0 && output_stdout_fd < 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Only --output and --join can write to stdout");
+        return NULL;
+    }
+    const gchar *preset = fields[MANIFEST_FIELD_PRESET];
     if (!preset || !*preset) {
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please choose an NVENC preset", NULL);
-        g_free(preset);
-        goto cleanup_inputs;
+        preset = run->preset && encoder == run->encoder ? run->preset : encoder->presets[encoder->default_preset];
+    }
+    if (!g_strv_contains(encoder->presets, preset) && g_strcmp0(preset, PRESET_AUTO) != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s has no preset named %s", encoder->encoder, preset);
+        return NULL;
     }
 
+    gchar *start_time = NULL;
+    gchar *end_time = NULL;
     gchar *output_path = NULL;
-    if (g_path_is_absolute(output_text)) {
-        output_path = g_strdup(output_text);
+    CutJob *cut = NULL;
+    if (!parse_time_string(fields[MANIFEST_FIELD_START], "Start time", &start_time, error)) {
+        goto cleanup;
+    }
+    if (!parse_time_string(fields[MANIFEST_FIELD_END], "End time", &end_time, error)) {
+        goto cleanup;
+    }
+    if (!check_time_within_duration(input, end_time, "End time", error)) {
+        goto cleanup;
+    }
+    if (fields[MANIFEST_FIELD_OUTPUT] && *fields[MANIFEST_FIELD_OUTPUT]) {
+        output_path = resolve_output_path(input, fields[MANIFEST_FIELD_OUTPUT]);
     } else {
-        gchar *input_dir = g_path_get_dirname(input_path);
-        output_path = g_build_filename(input_dir, output_text, NULL);
-        g_free(input_dir);
+        output_path = build_default_output_path(input, encoder->codec, format);
     }
+    cut = cut_job_new(input, start_time, end_time, encoder, preset, output_path, mode);
+    cut->format = format;
 
-    gchar **argv = build_ffmpeg_argv(input_path, start_time, end_time, preset, output_path);
-    if (!argv) {
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "Unable to build ffmpeg command", NULL);
-        g_free(preset);
-        g_free(output_path);
-        goto cleanup_inputs;
+cleanup:
+    g_free(start_time);
+    g_free(end_time);
+    g_free(output_path);
+    return cut;
+}
+
+/*
+ * Queues every row of a CSV or JSON-lines manifest. Bad rows are reported
+ * with their line number and counted as rejected; the rest still run. In
+ * single-pass mode, re-encode rows that share an input, encoder and preset
+ * are merged into one job of up to MAX_RANGES_PER_PASS ranges. Returns FALSE
+ * only if the file cannot be read.
+ */
+static gboolean headless_load_manifest(HeadlessRun *run, const gchar *path) {
+    gchar *contents = NULL;
+    GError *error = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    gint columns[MANIFEST_N_FIELDS] = { 0, 1, 2, 3, 4, -1, -1, -1 };
+    gboolean header_seen = FALSE;
+    GPtrArray *cuts = g_ptr_array_new();
+    GHashTable *open_groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    JsonParser *parser = json_parser_new();
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (guint i = 0; lines[i]; ++i) {
+        gchar *line = g_strstrip(lines[i]);
+        if (!*line || *line == '#') {
+            continue;
+        }
+        gchar **fields = NULL;
+        if (*line == '{') {
+            fields = manifest_json_fields(parser, line, &error);
+        } else {
+            gchar **cells = split_csv_line(line);
+            if (!header_seen && g_strv_contains((const gchar * const *)cells, "input")) {
+                for (guint f = 0; f < MANIFEST_N_FIELDS; ++f) {
+                    columns[f] = -1;
+                    for (guint c = 0; cells[c]; ++c) {
+                        if (g_ascii_strcasecmp(cells[c], MANIFEST_FIELD_NAMES[f]) == 0) {
+                            columns[f] = (gint)c;
+                        }
+                    }
+                }
+                header_seen = TRUE;
+                g_strfreev(cells);
+                continue;
+            }
+            header_seen = TRUE;
+            guint n_cells = g_strv_length(cells);
+            fields = g_new0(gchar *, MANIFEST_N_FIELDS + 1);
+            for (guint f = 0; f < MANIFEST_N_FIELDS; ++f) {
+                if (columns[f] >= 0 && (guint)columns[f] < n_cells) {
+                    fields[f] = g_strdup(cells[columns[f]]);
+                } else {
+                    fields[f] = g_strdup("");
+                }
+            }
+            g_strfreev(cells);
+        }
+        CutJob *cut = fields ? headless_build_cut(run, fields, &error) : NULL;
+        g_strfreev(fields);
+        if (!cut) {
+            g_printerr("%s:%u: %s\n", path, i + 1, error->message);
+            g_clear_error(&error);
+            run->rejected++;
+            continue;
+        }
+        if (!run->single_pass || cut->mode != CUT_MODE_REENCODE || output_is_stream(cut->output_path)) {
+            g_ptr_array_add(cuts, cut);
+            continue;
+        }
+        gchar *key = g_strjoin("\n", cut->input_path, cut->encoder->id, cut->preset, output_format_id(cut->format), NULL);
+        CutJob *group = g_hash_table_lookup(open_groups, key);
+        if (group) {
+            cut_job_add_range(group, cut->start_time, cut->end_time, cut->output_path);
+            cut_job_free(cut);
+            if (cut_job_range_count(group) >= MAX_RANGES_PER_PASS) {
+                g_hash_table_remove(open_groups, key);
+            }
+            g_free(key);
+        } else {
+            g_ptr_array_add(cuts, cut);
+            g_hash_table_insert(open_groups, key, cut);
+        }
+    }
+    for (guint i = 0; i < cuts->len; ++i) {
+        job_scheduler_add(run->scheduler, g_ptr_array_index(cuts, i));
     }
+    g_ptr_array_free(cuts, TRUE);
+    g_hash_table_destroy(open_groups);
+    g_strfreev(lines);
+    g_object_unref(parser);
+    g_free(contents);
+    return TRUE;
+}
 
-    gchar *log_line = g_strdup_printf("Input: %s", input_path);
-    append_log_line(app, "Starting ffmpeg...");
-    append_log_line(app, log_line);
-    g_free(log_line);
+/* Splits one CSV record; fields may be quoted, with "" for a literal quote. */
+static gchar **split_csv_line(const gchar *line) {
+    GPtrArray *fields = g_ptr_array_new();
+    GString *field = g_string_new(NULL);
+    gboolean quoted = FALSE;
+    const gchar *p = line;
+    while (TRUE) {
+        gchar c = *p;
+        if (quoted) {
+            if (c == '"' && p[1] == '"') {
+                g_string_append_c(field, '"');
+                p += 2;
+            } else if (c == '"' || c == '\0') {
+                quoted = FALSE;
+                p += c ? 1 : 0;
+            } else {
+                g_string_append_c(field, c);
+                p++;
+            }
+            continue;
+        }
+        if (c == '"') {
+            quoted = TRUE;
+            p++;
+        } else if (c == ',' || c == '\0') {
+            g_ptr_array_add(fields, g_strstrip(g_string_free(field, FALSE)));
+            if (c == '\0') {
+                break;
+            }
+            field = g_string_new(NULL);
+            p++;
+        } else {
+            g_string_append_c(field, c);
+            p++;
+        }
+    }
+    g_ptr_array_add(fields, NULL);
+    return (gchar **)g_ptr_array_free(fields, FALSE);
+}
 
-    log_line = g_strdup_printf("Output: %s", output_path);
-    append_log_line(app, log_line);
-    g_free(log_line);
+static gchar **manifest_json_fields(JsonParser *parser, const gchar *line, GError **error) {
+    if (!json_parser_load_from_data(parser, line, -1, error)) {
+        return NULL;
+    }
+    JsonNode *root = json_parser_get_root(parser);
+    if (!JSON_NODE_HOLDS_OBJECT(root)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Expected a JSON object");
+        return NULL;
+    }
+    JsonObject *object = json_node_get_object(root);
+    gchar **fields = g_new0(gchar *, MANIFEST_N_FIELDS + 1);
+    for (guint f = 0; f < MANIFEST_N_FIELDS; ++f) {
+        JsonNode *member = json_object_get_member(object, MANIFEST_FIELD_NAMES[f]);
+        if (member && !JSON_NODE_HOLDS_NULL(member) && json_node_get_value_type(member) != G_TYPE_STRING) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "\"%s\" must be a string", MANIFEST_FIELD_NAMES[f]);
+            g_strfreev(fields);
+            return NULL;
+        }
+        fields[f] = g_strdup(member && !JSON_NODE_HOLDS_NULL(member) ? json_node_get_string(member) : "");
+    }
+    return fields;
+}
 
-    gchar *command_line = format_command_for_log(argv);
-    if (command_line) {
-        append_log_line(app, "Command:");
-        append_log_line(app, command_line);
-        g_free(command_line);
+static void headless_job_status(QueueJob *job, gpointer user_data) {
+    HeadlessRun *run = user_data;
+    switch (job->status) {
+    case JOB_STATUS_QUEUED:
+        break;
+    case JOB_STATUS_RUNNING:
+        g_print("[job %u] %s %s-%s -> %s\n", job->id, job->cut->input_path, job->cut->start_time, job->cut->end_time, job->cut->output_path);
+        for (guint i = 0; job->cut->extra_ranges && i < job->cut->extra_ranges->len; ++i) {
+            CutRange *range = g_ptr_array_index(job->cut->extra_ranges, i);
+            g_print("[job %u]   and %s-%s -> %s\n", job->id, range->start_time, range->end_time, range->output_path);
+        }
+        break;
+    case JOB_STATUS_VERIFYING:
+        g_print("[job %u] Verifying %s\n", job->id, job->cut->output_path);
+        break;
+    case JOB_STATUS_DONE:
+        g_print("[job %u] Done: %s\n", job->id, job->cut->output_path);
+        break;
+    case JOB_STATUS_FAILED:
+    case JOB_STATUS_CANCELLED:
+        g_printerr("[job %u] %s: %s\n", job->id, job_status_label(job->status), job->status_detail ? job->status_detail : "");
+        if (job->view_data) {
+            for (GList *iter = ((GQueue *)job->view_data)->head; iter; iter = iter->next) {
+                g_printerr("[job %u]   %s\n", job->id, (const gchar *)iter->data);
+            }
+        }
+        break;
+    }
+    if (job->status > JOB_STATUS_VERIFYING) {
+        g_clear_pointer(&job->view_data, headless_tail_free);
+        if (run->watch) {
+            watch_job_finished(run->watch, job);
+        }
+        /* Watch mode keeps waiting for recordings until it is interrupted. */
+        if (!job_scheduler_busy(run->scheduler) && (!run->watch || run->watch->stopping)) {
+            g_main_loop_quit(run->loop);
+        }
     }
+}
 
-    app->task_running = TRUE;
-    gtk_widget_set_sensitive(app->start_button, FALSE);
+/* Prints ffmpeg output in verbose mode; otherwise keeps the tail for failures. */
+static void headless_job_line(QueueJob *job, const gchar *line, gpointer user_data) {
+    HeadlessRun *run = user_data;
+    if (run->verbose) {
+        g_print("[job %u] %s\n", job->id, line);
+        return;
+    }
+    if (!job->view_data) {
+        job->view_data = g_queue_new();
+        job->view_data_free = headless_tail_free;
+    }
+    GQueue *tail = job->view_data;
+    g_queue_push_tail(tail, g_strdup(line));
+    if (g_queue_get_length(tail) > FFMPEG_STDERR_TAIL_LINES) {
+        g_free(g_queue_pop_head(tail));
+    }
+}
 
-    GTask *task = g_task_new(app->window, NULL, ffmpeg_task_completed, app);
-    g_task_set_task_data(task, argv, (GDestroyNotify)free_argv);
-    g_task_run_in_thread(task, ffmpeg_task_thread);
-    g_object_unref(task);
+static void headless_tail_free(gpointer user_data) {
+    g_queue_free_full(user_data, g_free);
+}
 
-    g_free(preset);
-    g_free(output_path);
-    goto cleanup_inputs;
+#ifdef G_OS_UNIX
+static gboolean headless_interrupted(gpointer user_data) {
+    HeadlessRun *run = user_data;
+    g_printerr("Interrupted, cancelling all jobs...\n");
+    if (run->watch) {
+        run->watch->stopping = TRUE;
+    }
+    job_scheduler_cancel_all(run->scheduler);
+    if (run->watch && !job_scheduler_busy(run->scheduler)) {
+        g_main_loop_quit(run->loop);
+    }
+    return G_SOURCE_CONTINUE;
+}
+#endif
 
-cleanup_inputs:
-    g_free(input_path);
-    g_free(start_time);
-    g_free(end_time);
-    g_free(output_text);
+/*
+ * Starts monitoring the spool folders, which on Linux is an inotify watch, so
+ * an idle daemon sleeps in the main loop. Sidecars already in the folders are
+ * picked up first: the sidecars themselves are the queue, and one that was
+ * not finished before a restart is simply found again.
+ */
+static WatchFolder *watch_folder_new(HeadlessRun *run, gchar **dirs, GError **error) {
+    WatchFolder *watch = g_new0(WatchFolder, 1);
+    watch->run = run;
+    watch->monitors = g_ptr_array_new_with_free_func(g_object_unref);
+    watch->settling = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    watch->batches = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)watch_batch_free);
+    watch->jobs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (guint i = 0; dirs[i]; ++i) {
+        GFile *dir = g_file_new_for_path(dirs[i]);
+        GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, NULL, error);
+        g_object_unref(dir);
+        if (!monitor) {
+            watch_folder_free(watch);
+            return NULL;
+        }
+        g_signal_connect(monitor, "changed", G_CALLBACK(on_watch_folder_changed), watch);
+        g_ptr_array_add(watch->monitors, monitor);
+        g_print("Watching %s\n", dirs[i]);
+    }
+    for (guint i = 0; dirs[i]; ++i) {
+        GDir *dir = g_dir_open(dirs[i], 0, NULL);
+        const gchar *name = NULL;
+        while (dir && (name = g_dir_read_name(dir))) {
+            if (g_str_has_suffix(name, WATCH_SIDECAR_SUFFIX)) {
+                gchar *path = g_build_filename(dirs[i], name, NULL);
+                watch_folder_note(watch, path, FALSE);
+                g_free(path);
+            }
+        }
+        if (dir) {
+            g_dir_close(dir);
+        }
+    }
+    return watch;
 }
 
-static void ffmpeg_task_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
-    gchar **argv = task_data;
-    if (!argv) {
-        g_task_return_new_error(task, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "Argument list is empty");
+static void watch_folder_free(WatchFolder *watch) {
+    if (watch->settle_source) {
+        g_source_remove(watch->settle_source);
+    }
+    for (guint i = 0; i < watch->monitors->len; ++i) {
+        g_signal_handlers_disconnect_by_data(g_ptr_array_index(watch->monitors, i), watch);
+    }
+    g_ptr_array_unref(watch->monitors);
+    g_hash_table_unref(watch->jobs);
+    g_hash_table_unref(watch->batches);
+    g_hash_table_unref(watch->settling);
+    g_free(watch);
+}
+
+static void on_watch_folder_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data) {
+    WatchFolder *watch = user_data;
+    GFile *target = event_type == G_FILE_MONITOR_EVENT_RENAMED ? other_file : file;
+    if (!target) {
+        return;
+    }
+    switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_RENAMED: {
+        gchar *path = g_file_get_path(target);
+        if (path) {
+            /* The close after writing; a rename into the folder also arrives complete. */
+            gboolean closed = event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT || event_type == G_FILE_MONITOR_EVENT_MOVED_IN || event_type == G_FILE_MONITOR_EVENT_RENAMED;
+            watch_folder_note(watch, path, closed);
+        }
+        g_free(path);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/*
+ * Records activity on a sidecar or on the recording next to one and arms the
+ * settle timer. Files without a sidecar, such as outputs written into the
+ * spool folder, are ignored.
+ */
+static void watch_folder_note(WatchFolder *watch, const gchar *path, gboolean closed) {
+    if (watch->stopping) {
+        return;
+    }
+    gboolean is_sidecar = g_str_has_suffix(path, WATCH_SIDECAR_SUFFIX);
+    gchar *sidecar_path = is_sidecar ? g_strdup(path) : g_strconcat(path, WATCH_SIDECAR_SUFFIX, NULL);
+    if (g_hash_table_contains(watch->batches, sidecar_path) || (!is_sidecar && !g_file_test(sidecar_path, G_FILE_TEST_IS_REGULAR))) {
+        g_free(sidecar_path);
+        return;
+    }
+    WatchSettle *settle = g_hash_table_lookup(watch->settling, sidecar_path);
+    if (!settle) {
+        settle = g_new0(WatchSettle, 1);
+        g_hash_table_insert(watch->settling, g_strdup(sidecar_path), settle);
+    }
+    if (is_sidecar) {
+        settle->sidecar_closed = closed;
+    } else {
+        settle->input_closed = closed;
+    }
+    g_free(sidecar_path);
+    if (!watch->settle_source) {
+        watch->settle_source = g_timeout_add_seconds(WATCH_SETTLE_SECONDS, watch_settle_tick, watch);
+    }
+}
+
+/*
+ * Starts the batches whose sidecar and recording are both complete. A sidecar
+ * whose recording is not there yet is dropped; the recording's own events
+ * bring it back once it arrives.
+ */
+static gboolean watch_settle_tick(gpointer user_data) {
+    WatchFolder *watch = user_data;
+    GPtrArray *ready = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    g_hash_table_iter_init(&iter, watch->settling);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const gchar *sidecar_path = key;
+        WatchSettle *settle = value;
+        gchar *input_path = g_strndup(sidecar_path, strlen(sidecar_path) - strlen(WATCH_SIDECAR_SUFFIX));
+        gint64 sidecar_size = 0;
+        gint64 sidecar_mtime = 0;
+        gint64 input_size = 0;
+        gint64 input_mtime = 0;
+        gboolean present = watch_file_signature(sidecar_path, &sidecar_size, &sidecar_mtime) && watch_file_signature(input_path, &input_size, &input_mtime);
+        g_free(input_path);
+        if (!present) {
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+        gboolean sidecar_done = settle->sidecar_closed || (settle->sampled && sidecar_size == settle->sidecar_size && sidecar_mtime == settle->sidecar_mtime);
+        gboolean input_done = settle->input_closed || (settle->sampled && input_size == settle->input_size && input_mtime == settle->input_mtime);
+        if (sidecar_done && input_done) {
+            g_ptr_array_add(ready, g_strdup(sidecar_path));
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+        settle->sidecar_size = sidecar_size;
+        settle->sidecar_mtime = sidecar_mtime;
+        settle->input_size = input_size;
+        settle->input_mtime = input_mtime;
+        settle->sampled = TRUE;
+    }
+    for (guint i = 0; i < ready->len; ++i) {
+        watch_batch_start(watch, g_ptr_array_index(ready, i));
+    }
+    g_ptr_array_unref(ready);
+    if (g_hash_table_size(watch->settling) == 0) {
+        watch->settle_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean watch_file_signature(const gchar *path, gint64 *size, gint64 *mtime) {
+    GStatBuf st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return FALSE;
+    }
+    *size = (gint64)st.st_size;
+    *mtime = (gint64)st.st_mtime;
+    return TRUE;
+}
+
+/*
+ * Queues the cuts of a sidecar. Outputs listed in NAME.cuts.progress were
+ * finished before a restart and are not cut again. A sidecar that cannot be
+ * parsed fails as a whole.
+ */
+static void watch_batch_start(WatchFolder *watch, const gchar *sidecar_path) {
+    WatchBatch *batch = g_new0(WatchBatch, 1);
+    batch->sidecar_path = g_strdup(sidecar_path);
+    batch->input_path = g_strndup(sidecar_path, strlen(sidecar_path) - strlen(WATCH_SIDECAR_SUFFIX));
+    g_hash_table_insert(watch->batches, batch->sidecar_path, batch);
+
+    GError *error = NULL;
+    GPtrArray *cuts = watch_parse_sidecar(watch->run, sidecar_path, batch->input_path, &error);
+    if (!cuts) {
+        g_printerr("%s: %s\n", sidecar_path, error->message);
+        g_clear_error(&error);
+        watch->failed++;
+        batch->failed = 1;
+        watch_batch_finish(watch, batch);
+        return;
+    }
+    gchar *progress_path = g_strconcat(sidecar_path, ".progress", NULL);
+    gchar *progress = NULL;
+    g_file_get_contents(progress_path, &progress, NULL, NULL);
+    gchar **finished = g_strsplit(progress ? progress : "", "\n", -1);
+    g_free(progress);
+    g_free(progress_path);
+    guint skipped = 0;
+    for (guint i = 0; i < cuts->len; ++i) {
+        CutJob *cut = g_ptr_array_index(cuts, i);
+        if (g_strv_contains((const gchar * const *)finished, cut->output_path) && g_file_test(cut->output_path, G_FILE_TEST_IS_REGULAR)) {
+            ++skipped;
+            continue;
+        }
+        g_ptr_array_index(cuts, i) = NULL;
+        batch->pending++;
+        QueueJob *job = job_scheduler_add(watch->run->scheduler, cut);
+        g_hash_table_insert(watch->jobs, GUINT_TO_POINTER(job->id), batch);
+    }
+    g_strfreev(finished);
+    g_ptr_array_unref(cuts);
+    g_print("%s: queued %u cuts", batch->input_path, batch->pending);
+    if (skipped > 0) {
+        g_print(", %u already done", skipped);
+    }
+    g_print("\n");
+    if (batch->pending == 0) {
+        watch_batch_finish(watch, batch);
+    }
+}
+
+/*
+ * One cut per line: START-END, then optionally the output file, relative to
+ * the recording's folder. Blank lines and lines starting with # are skipped.
+ * Without an output, the first range gets the default output name and later
+ * ones are numbered like extra ranges.
+ */
+static GPtrArray *watch_parse_sidecar(HeadlessRun *run, const gchar *sidecar_path, const gchar *input_path, GError **error) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(sidecar_path, &contents, NULL, error)) {
+        return NULL;
+    }
+    GPtrArray *cuts = g_ptr_array_new_with_free_func((GDestroyNotify)cut_job_free);
+    gchar *default_output = build_default_output_path(input_path, run->encoder->codec, run->format);
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (guint i = 0; lines[i]; ++i) {
+        gchar *line = g_strstrip(lines[i]);
+        if (!*line || *line == '#') {
+            continue;
+        }
+        gchar **tokens = g_strsplit_set(line, " \t", 2);
+        gchar *start = NULL;
+        gchar *end = NULL;
+        gchar *output = tokens[1] && *g_strstrip(tokens[1]) ? g_strdup(tokens[1]) : (cuts->len == 0 ? g_strdup(default_output) : build_range_output_path(default_output, cuts->len + 1));
+        CutJob *cut = NULL;
+        GError *line_error = NULL;
+        if (parse_time_range(tokens[0], &start, &end, &line_error)) {
+            gchar *fields[MANIFEST_N_FIELDS] = { (gchar *)input_path, start, end, NULL, output, NULL, NULL };
+            cut = headless_build_cut(run, fields, &line_error);
+        }
+        g_free(output);
+        g_free(end);
+        g_free(start);
+        g_strfreev(tokens);
+        if (!cut) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Line %u: %s", i + 1, line_error->message);
+            g_error_free(line_error);
+            g_ptr_array_unref(cuts);
+            cuts = NULL;
+            break;
+        }
+        g_ptr_array_add(cuts, cut);
+    }
+    if (cuts && cuts->len == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "No cuts listed");
+        g_clear_pointer(&cuts, g_ptr_array_unref);
+    }
+    g_strfreev(lines);
+    g_free(default_output);
+    g_free(contents);
+    return cuts;
+}
+
+/* Notes a finished cut in its sidecar's progress file and closes the batch after its last cut. */
+static void watch_job_finished(WatchFolder *watch, QueueJob *job) {
+    WatchBatch *batch = g_hash_table_lookup(watch->jobs, GUINT_TO_POINTER(job->id));
+    if (!batch) {
+        return;
+    }
+    g_hash_table_remove(watch->jobs, GUINT_TO_POINTER(job->id));
+    if (job->status == JOB_STATUS_DONE) {
+        watch->done++;
+        gchar *progress_path = g_strconcat(batch->sidecar_path, ".progress", NULL);
+        /* The output reaches the disk before the line that says so, and the line before the next cut, as in the resume journal. */
+        sync_file(job->cut->output_path);
+        FILE *file = g_fopen(progress_path, "a");
+        gboolean ok = file && fprintf(file, "%s\n", job->cut->output_path) > 0 && fflush(file) == 0;
+#ifdef G_OS_UNIX
+        ok = ok && fsync(fileno(file)) == 0;
+#endif
+        int saved_errno = errno;
+        if (file && fclose(file) != 0) {
+            ok = FALSE;
+        }
+        if (!ok) {
+            g_printerr("Cannot append to %s: %s\n", progress_path, g_strerror(saved_errno));
+        }
+        g_free(progress_path);
+    } else if (job->status == JOB_STATUS_FAILED) {
+        watch->failed++;
+        batch->failed++;
+    } else {
+        batch->cancelled = TRUE;
+    }
+    batch->pending--;
+    if (batch->pending == 0) {
+        watch_batch_finish(watch, batch);
+    }
+    /* Finished jobs are dropped once the status callback has returned, so a long-running daemon does not keep them. */
+    g_idle_add(watch_remove_finished, watch->run->scheduler);
+}
+
+/*
+ * Renames the sidecar to NAME.cuts.done or NAME.cuts.failed so it is not
+ * picked up again. A batch cut short by an interrupt keeps its sidecar and
+ * progress file and resumes on the next start.
+ */
+static void watch_batch_finish(WatchFolder *watch, WatchBatch *batch) {
+    if (!batch->cancelled) {
+        const gchar *suffix = batch->failed > 0 ? ".failed" : ".done";
+        gchar *final_path = g_strconcat(batch->sidecar_path, suffix, NULL);
+        if (g_rename(batch->sidecar_path, final_path) != 0) {
+            g_printerr("Cannot rename %s: %s\n", batch->sidecar_path, g_strerror(errno));
+        }
+        g_free(final_path);
+        if (batch->failed == 0) {
+            gchar *progress_path = g_strconcat(batch->sidecar_path, ".progress", NULL);
+            g_remove(progress_path);
+            g_free(progress_path);
+        }
+        g_print("%s: %s\n", batch->input_path, batch->failed > 0 ? "failed" : "done");
+    }
+    g_hash_table_remove(watch->batches, batch->sidecar_path);
+}
+
+static gboolean watch_remove_finished(gpointer user_data) {
+    job_scheduler_remove_finished(user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void watch_batch_free(WatchBatch *batch) {
+    g_free(batch->sidecar_path);
+    g_free(batch->input_path);
+    g_free(batch);
+}
+
+/*
+ * Serves the local job API on a Unix socket in the user's runtime folder, or
+ * FAST_CUT_SOCKET; an empty FAST_CUT_SOCKET turns it off. A socket left by a
+ * crashed instance is replaced, one that still answers is not, and anything
+ * else at the path is an error. Returns NULL without an error when the API is
+ * off or the platform has no Unix sockets.
+ */
+static RpcServer *rpc_server_new(JobScheduler *scheduler, GError **error) {
+#ifdef G_OS_UNIX
+    gchar *socket_path = rpc_socket_path();
+    if (!socket_path) {
+        return NULL;
+    }
+    GStatBuf st;
+    if (g_lstat(socket_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_EXISTS, "%s exists and is not a socket", socket_path);
+            g_free(socket_path);
+            return NULL;
+        }
+        GSocketAddress *address = g_unix_socket_address_new(socket_path);
+        GSocketClient *probe = g_socket_client_new();
+        GSocketConnection *existing = g_socket_client_connect(probe, G_SOCKET_CONNECTABLE(address), NULL, NULL);
+        g_object_unref(probe);
+        g_object_unref(address);
+        if (existing) {
+            g_object_unref(existing);
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_EXISTS, "Another Fast Cut is already accepting jobs on %s", socket_path);
+            g_free(socket_path);
+            return NULL;
+        }
+        g_remove(socket_path);
+    }
+    /*
+     * Only this user may submit jobs, and FAST_CUT_SOCKET may point to a
+     * folder others can reach. The socket is therefore bound in a private
+     * folder next to its path, restricted there and only then renamed into
+     * place, so it is never reachable with looser permissions.
+     */
+    gchar *parent = g_path_get_dirname(socket_path);
+    gchar *private_dir = g_build_filename(parent, ".fast_cut-XXXXXX", NULL);
+    g_free(parent);
+    if (!g_mkdtemp_full(private_dir, 0700)) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Cannot create a folder for the job API socket next to %s: %s", socket_path, g_strerror(saved_errno));
+        g_free(private_dir);
+        g_free(socket_path);
+        return NULL;
+    }
+    gchar *bind_path = g_build_filename(private_dir, RPC_SOCKET_NAME, NULL);
+    GSocketAddress *address = g_unix_socket_address_new(bind_path);
+    GSocketService *service = g_socket_service_new();
+    gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, error);
+    g_object_unref(address);
+    if (listening && (g_chmod(bind_path, 0600) != 0 || g_rename(bind_path, socket_path) != 0)) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Cannot create the job API socket %s: %s", socket_path, g_strerror(saved_errno));
+        listening = FALSE;
+    }
+    g_remove(bind_path);
+    g_rmdir(private_dir);
+    g_free(bind_path);
+    g_free(private_dir);
+    if (!listening) {
+        g_socket_listener_close(G_SOCKET_LISTENER(service));
+        g_object_unref(service);
+        g_free(socket_path);
+        return NULL;
+    }
+
+    RpcServer *server = g_new0(RpcServer, 1);
+    server->scheduler = scheduler;
+    server->service = service;
+    server->socket_path = socket_path;
+    g_signal_connect(service, "incoming", G_CALLBACK(on_rpc_incoming), server);
+    g_socket_service_start(service);
+    return server;
+#else
+    (void)scheduler;
+    (void)error;
+    return NULL;
+#endif
+}
+
+static void rpc_server_free(RpcServer *server) {
+    g_socket_service_stop(server->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+    g_signal_handlers_disconnect_by_data(server->service, server);
+    g_object_unref(server->service);
+    while (server->clients) {
+        rpc_client_close(server->clients->data);
+    }
+    g_remove(server->socket_path);
+    g_free(server->socket_path);
+    g_free(server);
+}
+
+static gchar *rpc_socket_path(void) {
+    const gchar *path = g_getenv("FAST_CUT_SOCKET");
+    if (path) {
+        return *path ? g_strdup(path) : NULL;
+    }
+    return g_build_filename(g_get_user_runtime_dir(), RPC_SOCKET_NAME, NULL);
+}
+
+static gboolean on_rpc_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    RpcServer *server = user_data;
+    RpcClient *client = g_new0(RpcClient, 1);
+    client->refs = 1;
+    client->server = server;
+    client->connection = g_object_ref(connection);
+    client->input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    client->cancellable = g_cancellable_new();
+    g_queue_init(&client->outbox);
+    server->clients = g_list_prepend(server->clients, client);
+    rpc_client_read_next(client);
+    return TRUE;
+}
+
+static void rpc_client_read_next(RpcClient *client) {
+    client->refs++;
+    g_data_input_stream_read_line_async(client->input, G_PRIORITY_DEFAULT, client->cancellable, rpc_client_line_read, client);
+}
+
+static void rpc_client_line_read(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    RpcClient *client = user_data;
+    gchar *line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source_object), result, NULL, NULL);
+    if (!client->server) {
+        g_free(line);
+    } else if (!line) {
+        client->input_closed = TRUE;
+        if (!client->subscribed && !client->writing) {
+            rpc_client_close(client);
+        }
+    } else {
+        rpc_client_handle(client, g_strstrip(line));
+        g_free(line);
+        if (client->server) {
+            rpc_client_read_next(client);
+        }
+    }
+    rpc_client_unref(client);
+}
+
+/*
+ * Methods: enqueue (input, start, end and optionally preset, output, encoder,
+ * mode and subscribe), status (one job, or all without "job"), cancel and
+ * subscribe (one job, or all without "job"). Every reply has "ok" and repeats
+ * the request's "id" when it has one.
+ */
+static void rpc_client_handle(RpcClient *client, const gchar *line) {
+    if (!*line) {
+        return;
+    }
+    RpcServer *server = client->server;
+    JsonObject *reply = json_object_new();
+    GError *error = NULL;
+    JsonParser *parser = json_parser_new();
+    JsonObject *request = NULL;
+    if (!json_parser_load_from_data(parser, line, -1, &error)) {
+        goto done;
+    }
+    if (!JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+        g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "A request must be a JSON object");
+        goto done;
+    }
+    request = json_node_get_object(json_parser_get_root(parser));
+    if (json_object_has_member(request, "id")) {
+        json_object_set_member(reply, "id", json_node_copy(json_object_get_member(request, "id")));
+    }
+    const gchar *method = json_object_get_string_member_with_default(request, "method", "");
+    guint job_id = (guint)json_object_get_int_member_with_default(request, "job", 0);
+    QueueJob *job = job_id ? rpc_find_job(server, job_id) : NULL;
+    if (job_id && !job && g_strcmp0(method, "enqueue") != 0) {
+        g_set_error(&error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No job %u", job_id);
+    } else if (g_strcmp0(method, "enqueue") == 0) {
+        JsonObject *job_object = rpc_enqueue(server, request, &job, &error);
+        if (job_object) {
+            json_object_set_object_member(reply, "job", job_object);
+            if (json_object_get_boolean_member_with_default(request, "subscribe", FALSE)) {
+                client->subscribed = TRUE;
+                client->subscribed_job = job->id;
+            }
+        }
+    } else if (g_strcmp0(method, "status") == 0) {
+        JsonArray *jobs = json_array_new();
+        for (GList *iter = server->scheduler->jobs.head; iter; iter = iter->next) {
+            if (!job || iter->data == job) {
+                json_array_add_object_element(jobs, rpc_job_object(iter->data));
+            }
+        }
+        json_object_set_array_member(reply, "jobs", jobs);
+    } else if (g_strcmp0(method, "cancel") == 0) {
+        if (job) {
+            job_scheduler_cancel(job);
+        } else {
+            g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "cancel requires \"job\"");
+        }
+    } else if (g_strcmp0(method, "subscribe") == 0) {
+        client->subscribed = TRUE;
+        client->subscribed_job = job_id;
+    } else {
+        g_set_error(&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Unknown method \"%s\"", method);
+    }
+
+done:
+    json_object_set_boolean_member(reply, "ok", error == NULL);
+    if (error) {
+        json_object_set_string_member(reply, "error", error->message);
+        g_error_free(error);
+    }
+    g_object_unref(parser);
+    rpc_client_send(client, reply, FALSE);
+}
+
+/*
+ * Checks a request like a manifest row and queues it on the shared
+ * scheduler, so it runs within the same encoder limits as the GUI's jobs.
+ * The input must be an absolute path; a relative output is taken relative to
+ * the input's folder.
+ */
+static JsonObject *rpc_enqueue(RpcServer *server, JsonObject *request, QueueJob **job_out, GError **error) {
+    static const gchar * const members[MANIFEST_N_FIELDS] = { "input", "start", "end", "preset", "output", "encoder", "mode", "format" };
+    gchar *fields[MANIFEST_N_FIELDS] = { NULL };
+    for (guint i = 0; i < MANIFEST_N_FIELDS; ++i) {
+        fields[i] = (gchar *)json_object_get_string_member_with_default(request, members[i], NULL);
+    }
+    if (fields[MANIFEST_FIELD_INPUT] && !g_path_is_absolute(fields[MANIFEST_FIELD_INPUT])) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "The input must be an absolute path: %s", fields[MANIFEST_FIELD_INPUT]);
+        return NULL;
+    }
+    /* Resolved per request, since the GUI probes the encoders in the background at startup. */
+    if (!server->defaults.encoder) {
+        server->defaults.encoder = encoder_backend_default();
+    }
+    if (!server->defaults.encoder && !(fields[MANIFEST_FIELD_ENCODER] && *fields[MANIFEST_FIELD_ENCODER])) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "No usable video encoder found; make sure ffmpeg is in PATH.");
+        return NULL;
+    }
+    CutJob *cut = headless_build_cut(&server->defaults, fields, error);
+    if (!cut) {
+        return NULL;
+    }
+    *job_out = job_scheduler_add(server->scheduler, cut);
+    return rpc_job_object(*job_out);
+}
+
+/* Takes ownership of message. */
+static void rpc_client_send(RpcClient *client, JsonObject *message, gboolean droppable) {
+    if (!client->server || (droppable && client->outbox.length >= RPC_OUTBOX_LINES)) {
+        json_object_unref(message);
+        return;
+    }
+    JsonNode *node = json_node_init_object(json_node_alloc(), message);
+    gchar *text = json_to_string(node, FALSE);
+    json_node_unref(node);
+    json_object_unref(message);
+    g_queue_push_tail(&client->outbox, g_strconcat(text, "\n", NULL));
+    g_free(text);
+    if (client->outbox.length > RPC_OUTBOX_LINES * 4) {
+        /* Not even replies and status changes are being read. */
+        rpc_client_close(client);
+        return;
+    }
+    if (!client->writing) {
+        rpc_client_write_next(client);
+    }
+}
+
+static void rpc_client_write_next(RpcClient *client) {
+    client->writing = g_queue_pop_head(&client->outbox);
+    if (!client->writing) {
+        return;
+    }
+    client->refs++;
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(client->connection));
+    g_output_stream_write_all_async(output, client->writing, strlen(client->writing), G_PRIORITY_DEFAULT, client->cancellable, rpc_client_line_written, client);
+}
+
+static void rpc_client_line_written(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    RpcClient *client = user_data;
+    gboolean written = g_output_stream_write_all_finish(G_OUTPUT_STREAM(source_object), result, NULL, NULL);
+    g_clear_pointer(&client->writing, g_free);
+    if (client->server && !written) {
+        rpc_client_close(client);
+    } else if (client->server) {
+        rpc_client_write_next(client);
+        if (!client->writing && client->input_closed && !client->subscribed) {
+            rpc_client_close(client);
+        }
+    }
+    rpc_client_unref(client);
+}
+
+/* Detaches the client from the server; pending reads and writes finish as cancelled. */
+static void rpc_client_close(RpcClient *client) {
+    if (!client->server) {
+        return;
+    }
+    client->server->clients = g_list_remove(client->server->clients, client);
+    client->server = NULL;
+    g_cancellable_cancel(client->cancellable);
+    g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+    rpc_client_unref(client);
+}
+
+static void rpc_client_unref(RpcClient *client) {
+    if (--client->refs > 0) {
+        return;
+    }
+    g_queue_clear_full(&client->outbox, g_free);
+    g_free(client->writing);
+    g_object_unref(client->cancellable);
+    g_object_unref(client->input);
+    g_object_unref(client->connection);
+    g_free(client);
+}
+
+static QueueJob *rpc_find_job(RpcServer *server, guint id) {
+    for (GList *iter = server->scheduler->jobs.head; iter; iter = iter->next) {
+        QueueJob *job = iter->data;
+        if (job->id == id) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static JsonObject *rpc_job_object(QueueJob *job) {
+    JsonObject *object = json_object_new();
+    gchar *status = g_ascii_strdown(job_status_label(job->status), -1);
+    gdouble fraction = 0.0;
+    if (job->status == JOB_STATUS_DONE || job->status == JOB_STATUS_VERIFYING) {
+        fraction = 1.0;
+    } else if (job->status == JOB_STATUS_RUNNING) {
+        g_free(format_progress_details(&job->progress, job->duration_us, &fraction));
+    }
+    json_object_set_int_member(object, "id", job->id);
+    json_object_set_string_member(object, "status", status);
+    json_object_set_string_member(object, "input", job->cut->input_path);
+    json_object_set_string_member(object, "start", job->cut->start_time);
+    json_object_set_string_member(object, "end", job->cut->end_time);
+    json_object_set_string_member(object, "output", job->cut->output_path);
+    json_object_set_string_member(object, "encoder", job->cut->encoder->id);
+    json_object_set_string_member(object, "preset", job->cut->preset);
+    json_object_set_string_member(object, "mode", cut_mode_id(job->cut->mode));
+    json_object_set_double_member(object, "progress", fraction);
+    if (job->status_detail) {
+        json_object_set_string_member(object, "detail", job->status_detail);
+    }
+    g_free(status);
+    return object;
+}
+
+/* Called by the GUI for every status change; NULL server when the API is off. */
+static void rpc_server_job_status(RpcServer *server, QueueJob *job) {
+    if (!server) {
+        return;
+    }
+    JsonObject *event = json_object_new();
+    json_object_set_string_member(event, "event", "status");
+    json_object_set_object_member(event, "job", rpc_job_object(job));
+    rpc_broadcast(server, job, event, FALSE);
+}
+
+static void rpc_server_job_progress(RpcServer *server, QueueJob *job, const FfmpegProgress *progress) {
+    if (!server) {
+        return;
+    }
+    gdouble fraction = 0.0;
+    g_free(format_progress_details(progress, job->duration_us, &fraction));
+    JsonObject *event = json_object_new();
+    json_object_set_string_member(event, "event", "progress");
+    json_object_set_int_member(event, "job", job->id);
+    json_object_set_double_member(event, "progress", fraction);
+    json_object_set_int_member(event, "frame", progress->frame);
+    json_object_set_double_member(event, "fps", progress->fps);
+    json_object_set_double_member(event, "speed", progress->speed);
+    json_object_set_double_member(event, "out_time", (gdouble)progress->out_time_us / G_USEC_PER_SEC);
+    rpc_broadcast(server, job, event, TRUE);
+}
+
+/* Takes ownership of event. */
+static void rpc_broadcast(RpcServer *server, QueueJob *job, JsonObject *event, gboolean droppable) {
+    /* Sending may close a client and remove it from the list. */
+    GList *clients = g_list_copy(server->clients);
+    for (GList *iter = clients; iter; iter = iter->next) {
+        RpcClient *client = iter->data;
+        if (client->subscribed && (client->subscribed_job == 0 || client->subscribed_job == job->id)) {
+            rpc_client_send(client, json_object_ref(event), droppable);
+        }
+    }
+    g_list_free(clients);
+    json_object_unref(event);
+}
+
+static void append_log_line(AppWidgets *app, const gchar *line) {
+    log_pane_append(app->log_pane, line);
+}
+
+/*
+ * Creates a log pane for the shared log view. With spill_path set, every line
+ * is also appended to that file, which keeps the full log when the pane only
+ * shows the newest LOG_PANE_LINES lines.
+ */
+static LogPane *log_pane_new(GtkWidget *view, const gchar *spill_path) {
+    LogPane *pane = g_new0(LogPane, 1);
+    pane->view = view;
+    pane->buffer = gtk_text_buffer_new(NULL);
+    GtkTextIter end_iter;
+    gtk_text_buffer_get_end_iter(pane->buffer, &end_iter);
+    /* Right gravity keeps the mark after text inserted at the end. */
+    pane->end_mark = gtk_text_buffer_create_mark(pane->buffer, NULL, &end_iter, FALSE);
+    g_queue_init(&pane->pending);
+    if (spill_path) {
+        pane->spill = g_fopen(spill_path, "w");
+        pane->spill_path = pane->spill ? g_strdup(spill_path) : NULL;
+    }
+    return pane;
+}
+
+static void log_pane_free(LogPane *pane) {
+    if (pane->flush_source) {
+        g_source_remove(pane->flush_source);
+    }
+    if (pane->spill) {
+        fclose(pane->spill);
+    }
+    if (pane->remove_spill && pane->spill_path) {
+        g_remove(pane->spill_path);
+    }
+    g_queue_clear_full(&pane->pending, g_free);
+    g_free(pane->last_line);
+    g_free(pane->spill_path);
+    g_object_unref(pane->buffer);
+    g_free(pane);
+}
+
+/*
+ * Queues one line for the next flush. Runs of the same line are shown once
+ * with a repeat count, and consecutive ffmpeg stats lines replace each other,
+ * so a noisy child cannot flood the pane. The spill file gets every line.
+ */
+static void log_pane_append(LogPane *pane, const gchar *line) {
+    if (!line || !*line) {
+        return;
+    }
+    if (pane->spill) {
+        fputs(line, pane->spill);
+        fputc('\n', pane->spill);
+    }
+    if (g_strcmp0(line, pane->last_line) == 0) {
+        pane->repeats++;
+        return;
+    }
+    if (pane->repeats > 0) {
+        g_queue_push_tail(&pane->pending, g_strdup_printf("(previous line repeated %u more times)", pane->repeats));
+        pane->repeats = 0;
+    }
+    g_free(pane->last_line);
+    pane->last_line = g_strdup(line);
+
+    const gchar *tail = g_queue_peek_tail(&pane->pending);
+    if (tail && log_line_is_stats(tail) && log_line_is_stats(line)) {
+        g_free(g_queue_pop_tail(&pane->pending));
+    }
+    g_queue_push_tail(&pane->pending, g_strdup(line));
+    /* Lines that would scroll out before they are shown are only kept in the spill file. */
+    while (g_queue_get_length(&pane->pending) > LOG_PANE_LINES) {
+        g_free(g_queue_pop_head(&pane->pending));
+    }
+    if (!pane->flush_source) {
+        pane->flush_source = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, LOG_FLUSH_INTERVAL_MS, log_pane_flush, pane, NULL);
+    }
+}
+
+/*
+ * Ends a job's log: a pending repeat count is queued, since no further line
+ * will come to push it out, and the spill file is written through.
+ */
+static void log_pane_finish(LogPane *pane) {
+    if (pane->repeats > 0) {
+        g_queue_push_tail(&pane->pending, g_strdup_printf("(previous line repeated %u more times)", pane->repeats));
+        pane->repeats = 0;
+        if (!pane->flush_source) {
+            pane->flush_source = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, LOG_FLUSH_INTERVAL_MS, log_pane_flush, pane, NULL);
+        }
+    }
+    g_clear_pointer(&pane->last_line, g_free);
+    if (pane->spill) {
+        fflush(pane->spill);
+    }
+}
+
+/* Moves the pending lines into the text buffer with one insert, trims it and scrolls once. */
+static gboolean log_pane_flush(gpointer user_data) {
+    LogPane *pane = user_data;
+    pane->flush_source = 0;
+    if (g_queue_is_empty(&pane->pending)) {
+        return G_SOURCE_REMOVE;
+    }
+    GtkTextIter start_iter;
+    GtkTextIter end_iter;
+    if (pane->ends_with_stats && log_line_is_stats(g_queue_peek_head(&pane->pending))) {
+        /* The buffer's last line is the previous ffmpeg stats line; replace it. */
+        gint lines = gtk_text_buffer_get_line_count(pane->buffer);
+        gtk_text_buffer_get_iter_at_line(pane->buffer, &start_iter, MAX(lines - 2, 0));
+        gtk_text_buffer_get_end_iter(pane->buffer, &end_iter);
+        gtk_text_buffer_delete(pane->buffer, &start_iter, &end_iter);
+    }
+    pane->ends_with_stats = log_line_is_stats(g_queue_peek_tail(&pane->pending));
+    GString *text = g_string_new(NULL);
+    gchar *line = NULL;
+    while ((line = g_queue_pop_head(&pane->pending))) {
+        g_string_append(text, line);
+        g_string_append_c(text, '\n');
+        g_free(line);
+    }
+    gtk_text_buffer_get_end_iter(pane->buffer, &end_iter);
+    gtk_text_buffer_insert(pane->buffer, &end_iter, text->str, (gint)text->len);
+    g_string_free(text, TRUE);
+
+    gint excess = gtk_text_buffer_get_line_count(pane->buffer) - 1 - LOG_PANE_LINES;
+    if (excess > 0) {
+        gtk_text_buffer_get_start_iter(pane->buffer, &start_iter);
+        gtk_text_buffer_get_iter_at_line(pane->buffer, &end_iter, excess);
+        gtk_text_buffer_delete(pane->buffer, &start_iter, &end_iter);
+    }
+    if (pane->spill) {
+        fflush(pane->spill);
+    }
+    if (gtk_text_view_get_buffer(GTK_TEXT_VIEW(pane->view)) == pane->buffer) {
+        gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(pane->view), pane->end_mark, 0.0, FALSE, 0.0, 0.0);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* ffmpeg's periodic "frame= ... fps= ... time=" status lines, when stats are not disabled. */
+static gboolean log_line_is_stats(const gchar *line) {
+    return line && (g_str_has_prefix(line, "frame=") || g_str_has_prefix(line, "size=")) && strstr(line, "time=") != NULL;
+}
+
+/*
+ * Per-job log files live in the user cache folder, named by start time and job
+ * id. The first call of a session also deletes the logs left from earlier ones.
+ */
+static gchar *job_log_path(guint job_id) {
+    static gboolean pruned = FALSE;
+    gchar *dir = g_build_filename(g_get_user_cache_dir(), "fast_cut", "logs", NULL);
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        g_free(dir);
+        return NULL;
+    }
+    if (!pruned) {
+        job_log_prune(dir);
+        pruned = TRUE;
+    }
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *name = g_strdup_printf("%s-job%u.log", stamp, job_id);
+    gchar *path = g_build_filename(dir, name, NULL);
+    g_free(name);
+    g_free(stamp);
+    g_date_time_unref(now);
+    g_free(dir);
+    return path;
+}
+
+/* Deletes job logs not written to for JOB_LOG_MAX_AGE_DAYS. */
+static void job_log_prune(const gchar *dir) {
+    GDir *handle = g_dir_open(dir, 0, NULL);
+    if (!handle) {
+        return;
+    }
+    gint64 cutoff = g_get_real_time() / G_USEC_PER_SEC - (gint64)JOB_LOG_MAX_AGE_DAYS * 24 * 60 * 60;
+    const gchar *name = NULL;
+    while ((name = g_dir_read_name(handle))) {
+        if (!g_str_has_suffix(name, ".log")) {
+            continue;
+        }
+        gchar *path = g_build_filename(dir, name, NULL);
+        GStatBuf st;
+        if (g_stat(path, &st) == 0 && (gint64)st.st_mtime < cutoff) {
+            g_remove(path);
+        }
+        g_free(path);
+    }
+    g_dir_close(handle);
+}
+
+static void set_output_default(AppWidgets *app, const gchar *input_path, gboolean force) {
+    if (!input_path || !*input_path) {
+        return;
+    }
+    if (!force && app->output_customized) {
+        return;
+    }
+    const EncoderBackend *encoder = selected_encoder(app);
+    OutputFormat format = OUTPUT_FORMAT_MP4;
+    output_format_from_id(gtk_combo_box_get_active_id(GTK_COMBO_BOX(app->format_combo)), &format);
+    gchar *default_path = build_default_output_path(input_path, encoder ? encoder->codec : "hevc", format);
+    if (!default_path) {
+        return;
+    }
+    app->suppress_output_changed = TRUE;
+    gtk_entry_set_text(GTK_ENTRY(app->output_entry), default_path);
+    app->suppress_output_changed = FALSE;
+    g_free(app->output_last_auto);
+    app->output_last_auto = g_strdup(default_path);
+    app->output_customized = FALSE;
+    g_free(default_path);
+}
+
+static void set_input_file(AppWidgets *app, const gchar *path) {
+    if (!path || !*path) {
+        return;
+    }
+    app->suppress_output_changed = TRUE;
+    gtk_entry_set_text(GTK_ENTRY(app->file_entry), path);
+    app->suppress_output_changed = FALSE;
+    set_output_default(app, path, FALSE);
+    thumb_strip_set_source(app->strip, NULL, NULL);
+    probe_prefetch_start(app, path);
+}
+
+static void on_open_file(GtkButton *button, gpointer user_data) {
+    AppWidgets *app = user_data;
+    GtkWidget *dialog = gtk_file_chooser_dialog_new("Select Video File", GTK_WINDOW(app->window), GTK_FILE_CHOOSER_ACTION_OPEN, "_Cancel", GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_ACCEPT, NULL);
+
+    GtkFileFilter *filter = gtk_file_filter_new();
+    gtk_file_filter_set_name(filter, "Video files");
+    gtk_file_filter_add_mime_type(filter, "video/*");
+    gtk_file_filter_add_pattern(filter, "*.mp4");
+    gtk_file_filter_add_pattern(filter, "*.mkv");
+    gtk_file_filter_add_pattern(filter, "*.mov");
+    gtk_file_filter_add_pattern(filter, "*.avi");
+    gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        set_input_file(app, filename);
+        g_free(filename);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+static void on_drag_data_received(GtkWidget *widget, GdkDragContext *context, gint x, gint y, GtkSelectionData *data, guint info, guint time, gpointer user_data) {
+    AppWidgets *app = user_data;
+    if (gtk_selection_data_get_length(data) <= 0) {
+        gtk_drag_finish(context, FALSE, FALSE, time);
+        return;
+    }
+    gchar **uris = g_uri_list_extract_uris((const gchar *)gtk_selection_data_get_data(data));
+    if (uris && uris[0]) {
+        GError *error = NULL;
+        gchar *filename = g_filename_from_uri(uris[0], NULL, &error);
+        if (filename) {
+            set_input_file(app, filename);
+            g_free(filename);
+        } else if (error) {
+            show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "Unable to read dropped file", error->message);
+            g_clear_error(&error);
+        }
+    }
+    g_strfreev(uris);
+    gtk_drag_finish(context, TRUE, FALSE, time);
+}
+
+static void on_output_changed(GtkEditable *editable, gpointer user_data) {
+    AppWidgets *app = user_data;
+    if (app->suppress_output_changed) {
+        return;
+    }
+    const gchar *text = gtk_entry_get_text(GTK_ENTRY(editable));
+    if (!app->output_last_auto) {
+        app->output_customized = (text && *text);
+        return;
+    }
+    if (g_strcmp0(text, app->output_last_auto) == 0) {
+        app->output_customized = FALSE;
+    } else {
+        app->output_customized = TRUE;
+    }
+}
+
+/* Swaps in the presets of the new encoder and renames an untouched default output. */
+static void on_encoder_changed(GtkComboBox *combo, gpointer user_data) {
+    AppWidgets *app = user_data;
+    const EncoderBackend *encoder = selected_encoder(app);
+    gtk_combo_box_text_remove_all(GTK_COMBO_BOX_TEXT(app->preset_combo));
+    if (!encoder) {
+        return;
+    }
+    for (guint i = 0; encoder->presets[i]; ++i) {
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->preset_combo), encoder->presets[i]);
+    }
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->preset_combo), PRESET_AUTO);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(app->preset_combo), (gint)encoder->default_preset);
+    set_output_default(app, gtk_entry_get_text(GTK_ENTRY(app->file_entry)), FALSE);
+}
+
+/* Gives an untouched default output the extension of the new container. */
+static void on_format_changed(GtkComboBox *combo, gpointer user_data) {
+    AppWidgets *app = user_data;
+    set_output_default(app, gtk_entry_get_text(GTK_ENTRY(app->file_entry)), FALSE);
+}
+
+static void encoder_probe_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    probe_encoder_backends();
+    g_task_return_boolean(task, TRUE);
+}
+
+static void encoder_probe_completed(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    AppWidgets *app = user_data;
+    GtkComboBoxText *combo = GTK_COMBO_BOX_TEXT(app->encoder_combo);
+    gtk_combo_box_text_remove_all(combo);
+    for (guint i = 0; i < G_N_ELEMENTS(ENCODER_BACKENDS); ++i) {
+        if (encoder_available[i]) {
+            gtk_combo_box_text_append(combo, ENCODER_BACKENDS[i].id, ENCODER_BACKENDS[i].label);
+        }
+    }
+    const EncoderBackend *encoder = encoder_backend_default();
+    if (!encoder) {
+        append_log_line(app, "No usable video encoder was found.");
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "No usable video encoder found", "Make sure ffmpeg is in PATH and provides hevc_nvenc, hevc_qsv, hevc_amf, libx264 or libx265.");
+        return;
+    }
+    gchar *log_line = g_strdup_printf("Using %s by default.", encoder->label);
+    append_log_line(app, log_line);
+    g_free(log_line);
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(combo), encoder->id);
+    gtk_widget_set_sensitive(app->encoder_combo, TRUE);
+    gtk_widget_set_sensitive(app->start_button, TRUE);
+}
+
+/* Indexes a newly chosen input in the background so its cuts find the probe ready. */
+static void probe_prefetch_start(AppWidgets *app, const gchar *path) {
+    GTask *task = g_task_new(NULL, NULL, probe_prefetch_completed, app);
+    g_task_set_task_data(task, g_strdup(path), g_free);
+    g_task_run_in_thread(task, probe_prefetch_thread);
+    g_object_unref(task);
+}
+
+static void probe_prefetch_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    GError *error = NULL;
+    const ProbeIndex *index = probe_index_lookup(task_data, TRUE, cancellable, &error);
+    if (index) {
+        g_task_return_pointer(task, (gpointer)index, NULL);
+    } else {
+        g_task_return_error(task, error);
+    }
+}
+
+static void probe_prefetch_completed(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    AppWidgets *app = user_data;
+    gchar *name = g_path_get_basename(g_task_get_task_data(G_TASK(result)));
+    GError *error = NULL;
+    const ProbeIndex *index = g_task_propagate_pointer(G_TASK(result), &error);
+    gchar *log_line = NULL;
+    if (index) {
+        const ProbeIndexHeader *header = index->header;
+        gchar *duration = format_seconds((gint64)header->duration_s);
+        log_line = g_strdup_printf("Indexed %s: %s, %.*s %dx%d, %" G_GUINT64_FORMAT " keyframes.", name, duration, (int)sizeof(header->codec_name), header->codec_name, header->width, header->height, header->keyframe_count);
+        g_free(duration);
+        /* Only if the user has not picked another file meanwhile. */
+        const gchar *path = g_task_get_task_data(G_TASK(result));
+        if (g_strcmp0(path, gtk_entry_get_text(GTK_ENTRY(app->file_entry))) == 0) {
+            thumb_strip_set_source(app->strip, path, index);
+        }
+    } else {
+        log_line = g_strdup_printf("Could not index %s: %s", name, error->message);
+        g_error_free(error);
+    }
+    append_log_line(app, log_line);
+    g_free(log_line);
+    g_free(name);
+}
+
+static ThumbStrip *thumb_strip_new(void) {
+    ThumbStrip *strip = g_new0(ThumbStrip, 1);
+    strip->area = gtk_drawing_area_new();
+    strip->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    strip->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)thumb_entry_free);
+    g_queue_init(&strip->lru);
+    strip->limit = (gsize)MAX(thumb_cache_default_limit_mb(), 1) * 1024 * 1024;
+    strip->cancellable = g_cancellable_new();
+    strip->pool = g_thread_pool_new(thumb_request_thread, NULL, THUMB_WORKERS, FALSE, NULL);
+    g_thread_pool_set_sort_function(strip->pool, compare_thumb_requests, NULL);
+    return strip;
+}
+
+/* Called after the main loop has ended, so results still queued for it are dropped with it. */
+static void thumb_strip_free(ThumbStrip *strip) {
+    g_cancellable_cancel(strip->cancellable);
+    g_atomic_int_inc(&strip->generation);
+    g_thread_pool_free(strip->pool, TRUE, TRUE);
+    g_object_unref(strip->cancellable);
+    g_hash_table_unref(strip->pending);
+    g_queue_clear(&strip->lru);
+    g_hash_table_unref(strip->entries);
+    g_free(strip->input_path);
+    g_free(strip->file_key);
+    g_free(strip->disk_dir);
+    g_free(strip);
+}
+
+/*
+ * Shows the thumbnails of another file, or none when index is NULL. Requests
+ * for the old file are cancelled; thumbnails already in memory stay, keyed by
+ * file, so switching back is instant.
+ */
+static void thumb_strip_set_source(ThumbStrip *strip, const gchar *input_path, const ProbeIndex *index) {
+    g_cancellable_cancel(strip->cancellable);
+    g_object_unref(strip->cancellable);
+    strip->cancellable = g_cancellable_new();
+    g_atomic_int_inc(&strip->generation);
+    g_hash_table_remove_all(strip->pending);
+    g_clear_pointer(&strip->input_path, g_free);
+    g_clear_pointer(&strip->file_key, g_free);
+    g_clear_pointer(&strip->disk_dir, g_free);
+    strip->index = index;
+    if (index) {
+        /* The index was made for this size and mtime, so the probe cache key needs no stat of its own. */
+        GStatBuf st;
+        memset(&st, 0, sizeof(st));
+        st.st_size = index->header->file_size;
+        st.st_mtime = index->header->file_mtime;
+        strip->input_path = g_strdup(input_path);
+        strip->file_key = probe_cache_key(input_path, &st);
+        strip->disk_dir = g_build_filename(g_get_user_cache_dir(), "fast_cut", "thumbs", strip->file_key, NULL);
+    }
+    gtk_widget_queue_draw(strip->area);
+}
+
+/* Keyframe at or before pts_s, which is the frame a thumbnail of that moment shows. */
+static gdouble thumb_strip_keyframe_before(const ThumbStrip *strip, gdouble pts_s) {
+    const ProbeIndex *index = strip->index;
+    gsize k = probe_index_keyframe_at(index, pts_s + FRAME_EPSILON_S);
+    return index->keyframes[k > 0 ? k - 1 : 0].pts_s;
+}
+
+/*
+ * Splits the width into slots of one thumbnail each and draws the ones in
+ * memory. The others get a placeholder and are requested from the workers,
+ * so drawing never waits for a decode. The range set in the time entries is
+ * shaded on top.
+ */
+static gboolean on_strip_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+    AppWidgets *app = user_data;
+    ThumbStrip *strip = app->strip;
+    gint width = gtk_widget_get_allocated_width(widget);
+    gint height = gtk_widget_get_allocated_height(widget);
+    cairo_set_source_rgb(cr, 0.12, 0.12, 0.12);
+    cairo_paint(cr);
+    if (!strip->index || strip->index->header->keyframe_count == 0 || strip->index->header->duration_s <= 0.0 || width <= 0) {
+        return FALSE;
+    }
+    const ProbeIndexHeader *header = strip->index->header;
+    gint slot_width = header->width > 0 && header->height > 0 ? MAX(16, THUMB_HEIGHT * header->width / header->height) : THUMB_HEIGHT * 16 / 9;
+    guint slots = (guint)MAX(1, width / slot_width);
+    gdouble slot_px = (gdouble)width / slots;
+    strip->draw_id++;
+    for (guint i = 0; i < slots; ++i) {
+        gdouble pts_s = thumb_strip_keyframe_before(strip, (i + 0.5) * header->duration_s / slots);
+        gchar *key = g_strdup_printf("%s/%" G_GINT64_FORMAT, strip->file_key, (gint64)(pts_s * 1000.0));
+        ThumbEntry *entry = g_hash_table_lookup(strip->entries, key);
+        cairo_save(cr);
+        cairo_rectangle(cr, i * slot_px, 0, slot_px - 1.0, height);
+        cairo_clip(cr);
+        if (entry) {
+            g_queue_unlink(&strip->lru, entry->link);
+            g_queue_push_head_link(&strip->lru, entry->link);
+            gdouble x = i * slot_px + (slot_px - gdk_pixbuf_get_width(entry->pixbuf)) / 2.0;
+            gdk_cairo_set_source_pixbuf(cr, entry->pixbuf, x, (height - gdk_pixbuf_get_height(entry->pixbuf)) / 2.0);
+            cairo_paint(cr);
+        } else {
+            cairo_set_source_rgb(cr, 0.22, 0.22, 0.22);
+            cairo_paint(cr);
+            if (!g_hash_table_contains(strip->pending, key)) {
+                ThumbRequest *request = g_new0(ThumbRequest, 1);
+                request->strip = strip;
+                request->generation = strip->generation;
+                request->draw_id = strip->draw_id;
+                request->slot = i;
+                request->key = g_strdup(key);
+                request->input_path = g_strdup(strip->input_path);
+                request->disk_dir = g_strdup(strip->disk_dir);
+                gchar *name = g_strdup_printf("%" G_GINT64_FORMAT ".jpg", (gint64)(pts_s * 1000.0));
+                request->disk_path = g_build_filename(strip->disk_dir, name, NULL);
+                g_free(name);
+                request->pts_s = pts_s;
+                request->cancellable = g_object_ref(strip->cancellable);
+                g_hash_table_add(strip->pending, g_strdup(key));
+                g_thread_pool_push(strip->pool, request, NULL);
+            }
+        }
+        cairo_restore(cr);
+        g_free(key);
+    }
+
+    gdouble start_s = (gdouble)time_entries_seconds(GTK_ENTRY(app->start_hour_entry), GTK_ENTRY(app->start_min_entry), GTK_ENTRY(app->start_sec_entry));
+    gdouble end_s = (gdouble)time_entries_seconds(GTK_ENTRY(app->end_hour_entry), GTK_ENTRY(app->end_min_entry), GTK_ENTRY(app->end_sec_entry));
+    if (end_s > start_s) {
+        gdouble x0 = CLAMP(start_s / header->duration_s, 0.0, 1.0) * width;
+        gdouble x1 = CLAMP(end_s / header->duration_s, 0.0, 1.0) * width;
+        cairo_set_source_rgba(cr, 0.25, 0.55, 1.0, 0.3);
+        cairo_rectangle(cr, x0, 0, x1 - x0, height);
+        cairo_fill(cr);
+        cairo_set_source_rgb(cr, 0.25, 0.55, 1.0);
+        cairo_set_line_width(cr, 2.0);
+        cairo_move_to(cr, x0, 0);
+        cairo_line_to(cr, x0, height);
+        cairo_move_to(cr, x1, 0);
+        cairo_line_to(cr, x1, height);
+        cairo_stroke(cr);
+    }
+    return FALSE;
+}
+
+static gboolean on_strip_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+    AppWidgets *app = user_data;
+    app->strip->press_x = event->x;
+    return TRUE;
+}
+
+/* A click sets the start (or the end, with the right button); a drag sets both. */
+static gboolean on_strip_button_release(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+    AppWidgets *app = user_data;
+    ThumbStrip *strip = app->strip;
+    gint width = gtk_widget_get_allocated_width(widget);
+    if (!strip->index || width <= 0) {
+        return TRUE;
+    }
+    gdouble duration_s = strip->index->header->duration_s;
+    gint64 press_s = (gint64)(CLAMP(strip->press_x / width, 0.0, 1.0) * duration_s);
+    gint64 release_s = (gint64)(CLAMP(event->x / width, 0.0, 1.0) * duration_s);
+    if (ABS(event->x - strip->press_x) > 4.0) {
+        set_time_entries(GTK_ENTRY(app->start_hour_entry), GTK_ENTRY(app->start_min_entry), GTK_ENTRY(app->start_sec_entry), MIN(press_s, release_s));
+        set_time_entries(GTK_ENTRY(app->end_hour_entry), GTK_ENTRY(app->end_min_entry), GTK_ENTRY(app->end_sec_entry), MAX(press_s, release_s));
+    } else if (event->button == 3) {
+        set_time_entries(GTK_ENTRY(app->end_hour_entry), GTK_ENTRY(app->end_min_entry), GTK_ENTRY(app->end_sec_entry), release_s);
+    } else {
+        set_time_entries(GTK_ENTRY(app->start_hour_entry), GTK_ENTRY(app->start_min_entry), GTK_ENTRY(app->start_sec_entry), release_s);
+    }
+    return TRUE;
+}
+
+static void on_time_entry_changed(GtkEditable *editable, gpointer user_data) {
+    AppWidgets *app = user_data;
+    gtk_widget_queue_draw(app->strip->area);
+}
+
+/* Runs on a pool thread: loads the thumbnail from disk, making it first if needed. */
+static void thumb_request_thread(gpointer data, gpointer user_data) {
+    ThumbRequest *request = data;
+    if (request->generation == g_atomic_int_get(&request->strip->generation) && !g_cancellable_is_cancelled(request->cancellable)) {
+        if (g_file_test(request->disk_path, G_FILE_TEST_EXISTS) || thumb_render(request)) {
+            request->pixbuf = gdk_pixbuf_new_from_file(request->disk_path, NULL);
+        }
+    }
+    g_idle_add(thumb_request_deliver, request);
+}
+
+/*
+ * Decodes the one keyframe with ffmpeg into a JPEG THUMB_HEIGHT pixels high.
+ * The seek lands on the keyframe itself and -skip_frame nokey keeps the
+ * decoder off every other frame. Written under a temporary name, so a
+ * cancelled decode never leaves a broken thumbnail behind.
+ */
+static gboolean thumb_render(const ThumbRequest *request) {
+    if (g_mkdir_with_parents(request->disk_dir, 0755) != 0) {
+        return FALSE;
+    }
+    gchar *part_path = g_strconcat(request->disk_path, ".part", NULL);
+    gchar *seek = format_seconds_arg(request->pts_s + FRAME_EPSILON_S);
+    gchar *scale = g_strdup_printf("scale=-2:%d", THUMB_HEIGHT);
+    const gchar *argv[] = { "ffmpeg", "-v", "error", "-y", "-skip_frame", "nokey", "-noaccurate_seek", "-ss", seek, "-i", request->input_path, "-frames:v", "1", "-vf", scale, "-q:v", "5", "-f", "image2", "-c:v", "mjpeg", part_path, NULL };
+    GSubprocess *process = g_subprocess_newv(argv, G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_SILENCE, NULL);
+    gboolean ok = process && g_subprocess_wait_check(process, request->cancellable, NULL) && g_rename(part_path, request->disk_path) == 0;
+    if (process && !ok) {
+        g_subprocess_force_exit(process);
+    }
+    if (!ok) {
+        g_remove(part_path);
+    }
+    g_clear_object(&process);
+    g_free(scale);
+    g_free(seek);
+    g_free(part_path);
+    return ok;
+}
+
+/*
+ * Runs on the main loop. A key whose thumbnail could not be made stays
+ * pending, so it is not retried on every draw until the file changes.
+ */
+static gboolean thumb_request_deliver(gpointer user_data) {
+    ThumbRequest *request = user_data;
+    ThumbStrip *strip = request->strip;
+    if (request->generation == strip->generation && request->pixbuf) {
+        g_hash_table_remove(strip->pending, request->key);
+        thumb_cache_insert(strip, request->key, request->pixbuf);
+        gtk_widget_queue_draw(strip->area);
+    }
+    thumb_request_free(request);
+    return G_SOURCE_REMOVE;
+}
+
+static void thumb_request_free(ThumbRequest *request) {
+    g_free(request->key);
+    g_free(request->input_path);
+    g_free(request->disk_dir);
+    g_free(request->disk_path);
+    g_clear_object(&request->cancellable);
+    g_clear_object(&request->pixbuf);
+    g_free(request);
+}
+
+static gint compare_thumb_requests(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const ThumbRequest *left = a;
+    const ThumbRequest *right = b;
+    if (left->draw_id != right->draw_id) {
+        return left->draw_id > right->draw_id ? -1 : 1;
+    }
+    return left->slot < right->slot ? -1 : (left->slot > right->slot ? 1 : 0);
+}
+
+/* Adds a thumbnail as the most recently used and evicts from the tail down to the limit. */
+static void thumb_cache_insert(ThumbStrip *strip, const gchar *key, GdkPixbuf *pixbuf) {
+    ThumbEntry *entry = g_new0(ThumbEntry, 1);
+    entry->key = g_strdup(key);
+    entry->pixbuf = g_object_ref(pixbuf);
+    entry->bytes = gdk_pixbuf_get_byte_length(pixbuf);
+    g_queue_push_head(&strip->lru, entry);
+    entry->link = strip->lru.head;
+    g_hash_table_replace(strip->entries, entry->key, entry);
+    strip->bytes += entry->bytes;
+    while (strip->bytes > strip->limit && strip->lru.length > 1) {
+        ThumbEntry *oldest = g_queue_pop_tail(&strip->lru);
+        strip->bytes -= oldest->bytes;
+        g_hash_table_remove(strip->entries, oldest->key);
+    }
+}
+
+static void thumb_entry_free(ThumbEntry *entry) {
+    g_object_unref(entry->pixbuf);
+    g_free(entry->key);
+    g_free(entry);
+}
+
+static gint64 thumb_cache_default_limit_mb(void) {
+    const gchar *limit = g_getenv("FAST_CUT_THUMB_CACHE_MB");
+    return limit && *limit ? g_ascii_strtoll(limit, NULL, 10) : THUMB_CACHE_DEFAULT_MB;
+}
+
+static const EncoderBackend *selected_encoder(AppWidgets *app) {
+    return encoder_backend_find(gtk_combo_box_get_active_id(GTK_COMBO_BOX(app->encoder_combo)));
+}
+
+static gboolean on_window_delete(GtkWidget *widget, GdkEvent *event, gpointer user_data) {
+    AppWidgets *app = user_data;
+    if (!job_scheduler_busy(app->scheduler)) {
+        return FALSE;
+    }
+    if (app->quit_when_idle) {
+        return TRUE;
+    }
+    if (!confirm_message(GTK_WINDOW(app->window), "Encoding in progress", "Jobs are still queued or running. Stop them and close Fast Cut?")) {
+        return TRUE;
+    }
+    /* The window is destroyed from on_job_status once the last job has stopped. */
+    app->quit_when_idle = TRUE;
+    job_scheduler_cancel_all(app->scheduler);
+    return TRUE;
+}
+
+static void on_cancel_clicked(GtkButton *button, gpointer user_data) {
+    AppWidgets *app = user_data;
+    QueueJob *job = selected_job(app);
+    if (!job) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_INFO, "Please select a job to cancel", NULL);
+        return;
+    }
+    if (job->status == JOB_STATUS_RUNNING) {
+        on_job_line(job, "Stopping ffmpeg...", app);
+    }
+    job_scheduler_cancel(job);
+}
+
+static void on_remove_finished_clicked(GtkButton *button, gpointer user_data) {
+    AppWidgets *app = user_data;
+    /* Removing a job from the list also discards its log file. */
+    for (GList *iter = app->scheduler->jobs.head; iter; iter = iter->next) {
+        QueueJob *job = iter->data;
+        if (job->status > JOB_STATUS_VERIFYING && job->view_data) {
+            ((JobView *)job->view_data)->log->remove_spill = TRUE;
+        }
+    }
+    job_scheduler_remove_finished(app->scheduler);
+    update_queue_summary(app);
+}
+
+static void on_limits_changed(GtkSpinButton *spin, gpointer user_data) {
+    AppWidgets *app = user_data;
+    guint hardware_limit = (guint)gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(app->hardware_spin));
+    guint software_limit = (guint)gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(app->software_spin));
+    job_scheduler_set_limits(app->scheduler, hardware_limit, software_limit);
+}
+
+static void on_job_selection_changed(GtkTreeSelection *selection, gpointer user_data) {
+    AppWidgets *app = user_data;
+    QueueJob *job = selected_job(app);
+    LogPane *pane = job ? job_view_for(app, job)->log : app->log_pane;
+    gtk_text_view_set_buffer(GTK_TEXT_VIEW(app->log_view), pane->buffer);
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(app->log_view), pane->end_mark, 0.0, FALSE, 0.0, 0.0);
+}
+
+static void on_job_status(QueueJob *job, gpointer user_data) {
+    AppWidgets *app = user_data;
+    rpc_server_job_status(app->rpc, job);
+    JobView *view = job_view_for(app, job);
+    GtkTreePath *path = gtk_tree_row_reference_get_path(view->row);
+    GtkTreeIter iter;
+    if (path && gtk_tree_model_get_iter(GTK_TREE_MODEL(app->job_store), &iter, path)) {
+        gtk_list_store_set(app->job_store, &iter, JOB_COL_STATUS, job_status_label(job->status), -1);
+        if (job->status == JOB_STATUS_DONE) {
+            gtk_list_store_set(app->job_store, &iter, JOB_COL_PROGRESS, 100, -1);
+        }
+        if (job->status != JOB_STATUS_RUNNING && job->status_detail) {
+            gtk_list_store_set(app->job_store, &iter, JOB_COL_DETAILS, job->status_detail, -1);
+        }
+    }
+    gtk_tree_path_free(path);
+    if (job->status > JOB_STATUS_VERIFYING) {
+        if (job->status_detail) {
+            on_job_line(job, job->status_detail, app);
+        }
+        log_pane_finish(view->log);
+    }
+    update_queue_summary(app);
+
+    if (job_scheduler_busy(app->scheduler) || job->status <= JOB_STATUS_VERIFYING) {
+        return;
+    }
+    if (app->quit_when_idle) {
+        gtk_widget_destroy(app->window);
+        return;
+    }
+    guint failed = job_scheduler_count(app->scheduler, JOB_STATUS_FAILED);
+    if (failed > 0) {
+        gchar *summary = g_strdup_printf("%u job(s) failed; select a job to see its log.", failed);
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Queue finished with errors", summary);
+        g_free(summary);
+    } else if (job_scheduler_count(app->scheduler, JOB_STATUS_DONE) > 0) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_INFO, "Done", "All queued jobs finished.");
+    }
+}
+
+static void on_job_line(QueueJob *job, const gchar *line, gpointer user_data) {
+    AppWidgets *app = user_data;
+    log_pane_append(job_view_for(app, job)->log, line);
+}
+
+static void on_job_progress(QueueJob *job, const FfmpegProgress *progress, gpointer user_data) {
+    AppWidgets *app = user_data;
+    if (job->status != JOB_STATUS_RUNNING) {
+        return;
+    }
+    rpc_server_job_progress(app->rpc, job, progress);
+    gdouble fraction = 0.0;
+    gchar *details = format_progress_details(progress, job->duration_us, &fraction);
+    GtkTreePath *path = gtk_tree_row_reference_get_path(job_view_for(app, job)->row);
+    GtkTreeIter iter;
+    if (path && gtk_tree_model_get_iter(GTK_TREE_MODEL(app->job_store), &iter, path)) {
+        gtk_list_store_set(app->job_store, &iter, JOB_COL_PROGRESS, (gint)(fraction * 100.0), JOB_COL_DETAILS, details, -1);
+    }
+    gtk_tree_path_free(path);
+    g_free(details);
+}
+
+/* Jobs get their row and log buffer the first time the GUI sees them. */
+static JobView *job_view_for(AppWidgets *app, QueueJob *job) {
+    if (job->view_data) {
+        return job->view_data;
+    }
+    JobView *view = g_new0(JobView, 1);
+    gchar *log_path = job_log_path(job->id);
+    view->log = log_pane_new(app->log_view, log_path);
+    g_free(log_path);
+    if (view->log->spill_path) {
+        gchar *log_line = g_strdup_printf("Full log: %s", view->log->spill_path);
+        log_pane_append(view->log, log_line);
+        g_free(log_line);
+    }
+
+    gchar *input_name = g_path_get_basename(job->cut->input_path);
+    gchar *output_name = g_path_get_basename(job->cut->output_path);
+    guint range_count = cut_job_range_count(job->cut);
+    gchar *range = range_count > 1 ? g_strdup_printf("%s - %s (+%u)", job->cut->start_time, job->cut->end_time, range_count - 1) : g_strdup_printf("%s - %s", job->cut->start_time, job->cut->end_time);
+    GtkTreeIter iter;
+    gtk_list_store_append(app->job_store, &iter);
+    gtk_list_store_set(app->job_store, &iter, JOB_COL_ID, job->id, JOB_COL_INPUT, input_name, JOB_COL_RANGE, range, JOB_COL_OUTPUT, output_name, JOB_COL_STATUS, job_status_label(job->status), JOB_COL_PROGRESS, 0, JOB_COL_DETAILS, "", JOB_COL_JOB, job, -1);
+    GtkTreePath *path = gtk_tree_model_get_path(GTK_TREE_MODEL(app->job_store), &iter);
+    view->row = gtk_tree_row_reference_new(GTK_TREE_MODEL(app->job_store), path);
+    gtk_tree_path_free(path);
+    g_free(range);
+    g_free(output_name);
+    g_free(input_name);
+
+    job->view_data = view;
+    job->view_data_free = job_view_free;
+    return view;
+}
+
+/* Called when the scheduler drops a finished job; removes its row as well. */
+static void job_view_free(gpointer user_data) {
+    JobView *view = user_data;
+    GtkTreePath *path = gtk_tree_row_reference_get_path(view->row);
+    if (path) {
+        GtkTreeModel *model = gtk_tree_row_reference_get_model(view->row);
+        GtkTreeIter iter;
+        if (gtk_tree_model_get_iter(model, &iter, path)) {
+            gtk_list_store_remove(GTK_LIST_STORE(model), &iter);
+        }
+        gtk_tree_path_free(path);
+    }
+    gtk_tree_row_reference_free(view->row);
+    log_pane_free(view->log);
+    g_free(view);
+}
+
+static QueueJob *selected_job(AppWidgets *app) {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(app->job_view));
+    GtkTreeModel *model = NULL;
+    GtkTreeIter iter;
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        return NULL;
+    }
+    QueueJob *job = NULL;
+    gtk_tree_model_get(model, &iter, JOB_COL_JOB, &job, -1);
+    return job;
+}
+
+static void update_queue_summary(AppWidgets *app) {
+    guint queued = job_scheduler_count(app->scheduler, JOB_STATUS_QUEUED);
+    guint running = job_scheduler_count(app->scheduler, JOB_STATUS_RUNNING) + job_scheduler_count(app->scheduler, JOB_STATUS_VERIFYING);
+    guint done = job_scheduler_count(app->scheduler, JOB_STATUS_DONE);
+    guint failed = job_scheduler_count(app->scheduler, JOB_STATUS_FAILED);
+    guint cancelled = job_scheduler_count(app->scheduler, JOB_STATUS_CANCELLED);
+    guint total = queued + running + done + failed + cancelled;
+    gchar *text = total == 0 ? g_strdup("Idle") : g_strdup_printf("%u queued, %u running, %u done, %u failed, %u cancelled", queued, running, done, failed, cancelled);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->progress_bar), total == 0 ? 0.0 : (gdouble)(done + failed + cancelled) / (gdouble)total);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->progress_bar), text);
+    g_free(text);
+}
+
+static void on_start_clicked(GtkButton *button, gpointer user_data) {
+    AppWidgets *app = user_data;
+
+    gchar *input_path = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(app->file_entry))));
+    gchar *start_time = NULL;
+    gchar *end_time = NULL;
+    gchar *output_text = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(app->output_entry))));
+    GPtrArray *ranges = NULL;
+    GError *error = NULL;
+
+    if (!input_path || !*input_path) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please choose a video file", NULL);
+        goto cleanup_inputs;
+    }
+    if (!g_file_test(input_path, G_FILE_TEST_EXISTS)) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "Video file not found", input_path);
+        goto cleanup_inputs;
+    }
+    if (!collect_time_string(app, GTK_ENTRY(app->start_hour_entry), GTK_ENTRY(app->start_min_entry), GTK_ENTRY(app->start_sec_entry), &start_time, "Start time")) {
+        goto cleanup_inputs;
+    }
+    if (!collect_time_string(app, GTK_ENTRY(app->end_hour_entry), GTK_ENTRY(app->end_min_entry), GTK_ENTRY(app->end_sec_entry), &end_time, "End time")) {
+        goto cleanup_inputs;
+    }
+    ranges = parse_range_list(gtk_entry_get_text(GTK_ENTRY(app->ranges_entry)), &error);
+    if (!ranges) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Invalid additional range", error->message);
+        g_error_free(error);
+        goto cleanup_inputs;
+    }
+    gboolean within = check_time_within_duration(input_path, end_time, "End time", &error);
+    for (guint i = 0; within && i < ranges->len; ++i) {
+        CutRange *range = g_ptr_array_index(ranges, i);
+        within = check_time_within_duration(input_path, range->end_time, "Range end", &error);
+    }
+    if (!within) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Invalid end time", error->message);
+        g_error_free(error);
+        goto cleanup_inputs;
+    }
+    if (ranges->len + 1 > MAX_RANGES_PER_PASS) {
+        gchar *message = g_strdup_printf("At most %d ranges can be cut in one pass.", MAX_RANGES_PER_PASS);
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, message, "Every range runs its own encoder, and hardware encoders limit the number of open sessions.");
+        g_free(message);
+        goto cleanup_inputs;
+    }
+    if (!output_text || !*output_text) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please enter an output file", NULL);
+        goto cleanup_inputs;
+    }
+
+    const EncoderBackend *encoder = selected_encoder(app);
+    if (!encoder) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please choose an encoder", NULL);
+        goto cleanup_inputs;
+    }
+    gchar *preset = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->preset_combo));
+    if (!preset || !*preset) {
+        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "Please choose an encoder preset", NULL);
+        g_free(preset);
+        goto cleanup_inputs;
+    }
+
+    gchar *output_path = resolve_output_path(input_path, output_text);
+    CutMode mode = CUT_MODE_REENCODE;
+    cut_mode_from_id(gtk_combo_box_get_active_id(GTK_COMBO_BOX(app->mode_combo)), &mode);
+    CutJob *cut = cut_job_new(input_path, start_time, end_time, encoder, preset, output_path, mode);
+    output_format_from_id(gtk_combo_box_get_active_id(GTK_COMBO_BOX(app->format_combo)), &cut->format);
+    for (guint i = 0; i < ranges->len; ++i) {
+        CutRange *range = g_ptr_array_index(ranges, i);
+        cut_job_add_range(cut, range->start_time, range->end_time, NULL);
+    }
+    QueueJob *job = job_scheduler_add(app->scheduler, cut);
+
+    GtkTreePath *path = gtk_tree_row_reference_get_path(job_view_for(app, job)->row);
+    if (path) {
+        gtk_tree_selection_select_path(gtk_tree_view_get_selection(GTK_TREE_VIEW(app->job_view)), path);
+        gtk_tree_path_free(path);
+    }
+
+    gchar *log_line = g_strdup_printf("Input: %s", input_path);
+    on_job_line(job, log_line, app);
+    g_free(log_line);
+
+    log_line = g_strdup_printf("Output: %s", output_path);
+    on_job_line(job, log_line, app);
+    g_free(log_line);
+
+    for (guint i = 0; cut->extra_ranges && i < cut->extra_ranges->len; ++i) {
+        CutRange *range = g_ptr_array_index(cut->extra_ranges, i);
+        log_line = g_strdup_printf("Output: %s (%s - %s)", range->output_path, range->start_time, range->end_time);
+        on_job_line(job, log_line, app);
+        g_free(log_line);
+    }
+
+    log_line = g_strdup_printf("Encoder: %s, preset %s", encoder->label, preset);
+    on_job_line(job, log_line, app);
+    g_free(log_line);
+
+    g_free(preset);
+    g_free(output_path);
+    goto cleanup_inputs;
+
+cleanup_inputs:
+    if (ranges) {
+        g_ptr_array_free(ranges, TRUE);
+    }
+    g_free(input_path);
+    g_free(start_time);
+    g_free(end_time);
+    g_free(output_text);
+}
+
+static void ffmpeg_task_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    QueueJob *job = task_data;
+    if (!job || !job->cut) {
+        g_task_return_new_error(task, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "Argument list is empty");
+        return;
+    }
+
+    GError *error = NULL;
+    FfmpegResult *result = run_cut_job(job->cut, cancellable, ffmpeg_task_line, ffmpeg_task_progress, job, &error);
+    if (!result) {
+        g_task_return_error(task, error);
+        return;
+    }
+    g_task_return_pointer(task, result, (GDestroyNotify)ffmpeg_result_free);
+}
+
+static void ffmpeg_task_completed(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    QueueJob *job = user_data;
+    JobScheduler *scheduler = job->scheduler;
+    if (job->hardware) {
+        scheduler->hardware_running--;
+    } else {
+        scheduler->software_running--;
+    }
+    job->telemetry.finished_us = g_get_monotonic_time();
+    job_refresh_duration(job);
+
+    GError *error = NULL;
+    FfmpegResult *ff_result = g_task_propagate_pointer(G_TASK(result), &error);
+    if (error) {
+        gchar *detail = g_strdup_printf("ffmpeg failed: %s", error->message);
+        job_set_status(job, JOB_STATUS_FAILED, detail);
+        g_free(detail);
+        g_error_free(error);
+    } else if (ff_result->cancelled) {
+        gchar *detail = g_strdup_printf("ffmpeg stopped by user (exit code %d).", ff_result->exit_status);
+        job_set_status(job, JOB_STATUS_CANCELLED, detail);
+        g_free(detail);
+    } else if (ff_result->exit_status == 0 && scheduler->verify != VERIFY_OFF && !output_is_stream(job->cut->output_path)) {
+        /* The encoder slot is free again; the next job starts while this one is checked. */
+        job_scheduler_verify(job, ff_result);
+        job_scheduler_dispatch(scheduler);
+        return;
+    } else if (ff_result->exit_status == 0) {
+        job_set_status(job, JOB_STATUS_DONE, "ffmpeg completed with exit code 0.");
+    } else {
+        gchar *detail = g_strdup_printf("ffmpeg exit code %d", ff_result->exit_status);
+        job_set_status(job, JOB_STATUS_FAILED, detail);
+        g_free(detail);
+    }
+    job_telemetry_record(job, ff_result);
+    ffmpeg_result_free(ff_result);
+    job_scheduler_dispatch(scheduler);
+}
+
+/*
+ * A whole-file join clip counts 0 s until it is indexed, which it rarely is
+ * when the job is queued. run_join_cut probes every clip before its first
+ * ffmpeg run, so the length is taken again at the first progress report, or
+ * at the end for a join that never reported any. Runs on the main thread.
+ */
+static void job_refresh_duration(QueueJob *job) {
+    if (!job->cut->join_clips || job->duration_probed) {
+        return;
+    }
+    job->duration_us = cut_job_duration_us(job->cut);
+    job->duration_probed = TRUE;
+}
+
+static void ffmpeg_task_line(const gchar *line, gpointer user_data) {
+    FfmpegTaskMessage *message = g_new0(FfmpegTaskMessage, 1);
+    message->job = user_data;
+    message->line = g_strdup(line);
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, ffmpeg_task_deliver, message, ffmpeg_task_message_free);
+}
+
+static void ffmpeg_task_progress(const FfmpegProgress *progress, gpointer user_data) {
+    job_telemetry_progress(&((QueueJob *)user_data)->telemetry, progress);
+    FfmpegTaskMessage *message = g_new0(FfmpegTaskMessage, 1);
+    message->job = user_data;
+    message->progress = *progress;
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, ffmpeg_task_deliver, message, ffmpeg_task_message_free);
+}
+
+static gboolean ffmpeg_task_deliver(gpointer user_data) {
+    FfmpegTaskMessage *message = user_data;
+    JobScheduler *scheduler = message->job->scheduler;
+    if (message->line) {
+        if (scheduler->line_func) {
+            scheduler->line_func(message->job, message->line, scheduler->user_data);
+        }
+    } else {
+        job_refresh_duration(message->job);
+        message->job->progress = message->progress;
+        if (scheduler->progress_func) {
+            scheduler->progress_func(message->job, &message->progress, scheduler->user_data);
+        }
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void ffmpeg_task_message_free(gpointer user_data) {
+    FfmpegTaskMessage *message = user_data;
+    g_free(message->line);
+    g_free(message);
+}
+
+/* Takes ownership of result and queues the job's outputs on the verify pool. */
+static void job_scheduler_verify(QueueJob *job, FfmpegResult *result) {
+    JobScheduler *scheduler = job->scheduler;
+    if (!scheduler->verify_pool) {
+        scheduler->verify_pool = g_thread_pool_new(verify_task_run, NULL, VERIFY_WORKERS, FALSE, NULL);
+    }
+    VerifyTask *task = g_new0(VerifyTask, 1);
+    task->job = job;
+    task->level = scheduler->verify;
+    task->result = result;
+    job_set_status(job, JOB_STATUS_VERIFYING, "Verifying the output...");
+    g_thread_pool_push(scheduler->verify_pool, task, NULL);
+}
+
+static void verify_task_run(gpointer data, gpointer user_data) {
+    VerifyTask *task = data;
+    QueueJob *job = task->job;
+    CutStepContext step = { ffmpeg_task_line, NULL, job, 0, 0, 0, 0.0, &job->cut->policy };
+    if (!verify_cut_outputs(job->cut, task->level, job->cancellable, &step, &task->error) && !g_cancellable_is_cancelled(job->cancellable)) {
+        /* A bad output must not be handed out again as a cache hit. */
+        output_cache_drop(job->cut);
+    }
+    /* Queued after the log lines above, so they reach the job's log first. */
+    g_main_context_invoke(NULL, verify_task_deliver, task);
+}
+
+static gboolean verify_task_deliver(gpointer user_data) {
+    VerifyTask *task = user_data;
+    QueueJob *job = task->job;
+    job->telemetry.verified_us = g_get_monotonic_time();
+    if (task->error && g_cancellable_is_cancelled(job->cancellable)) {
+        job_set_status(job, JOB_STATUS_CANCELLED, "Verification stopped by user; the output was kept unverified.");
+    } else if (task->error) {
+        gchar *detail = g_strdup_printf("Verification failed: %s", task->error->message);
+        job_set_status(job, JOB_STATUS_FAILED, detail);
+        g_free(detail);
+    } else if (task->level == VERIFY_DECODE) {
+        job_set_status(job, JOB_STATUS_DONE, "ffmpeg completed with exit code 0; the output passed verification and its first and last GOPs decode cleanly.");
+    } else {
+        job_set_status(job, JOB_STATUS_DONE, "ffmpeg completed with exit code 0; the output passed verification.");
+    }
+    job_telemetry_record(job, task->result);
+    ffmpeg_result_free(task->result);
+    g_clear_error(&task->error);
+    g_free(task);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean verify_level_from_id(const gchar *id, VerifyLevel *level) {
+    if (g_strcmp0(id, "off") == 0) {
+        *level = VERIFY_OFF;
+    } else if (g_strcmp0(id, "probe") == 0) {
+        *level = VERIFY_PROBE;
+    } else if (g_strcmp0(id, "decode") == 0) {
+        *level = VERIFY_DECODE;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Checks every output of the job in turn and stops at the first bad one. */
+static gboolean verify_cut_outputs(const CutJob *job, VerifyLevel level, GCancellable *cancellable, CutStepContext *step, GError **error) {
+    gint64 started_us = g_get_monotonic_time();
+    for (guint i = 0; i < cut_job_range_count(job); ++i) {
+        const CutRange *range = i == 0 ? NULL : g_ptr_array_index(job->extra_ranges, i - 1);
+        /* A join has no single source range; only its total length is known. */
+        gdouble from_s = job->join_clips ? -1.0 : (gdouble)time_string_to_seconds(range ? range->start_time : job->start_time);
+        gdouble to_s = job->join_clips ? -1.0 : (gdouble)time_string_to_seconds(range ? range->end_time : job->end_time);
+        if (!verify_output(job, cut_job_output_path(job, i), from_s, to_s, level, cancellable, step, error)) {
+            return FALSE;
+        }
+    }
+    cut_step_log(step, "Verification took %.1f s.", (gdouble)(g_get_monotonic_time() - started_us) / G_USEC_PER_SEC);
+    return TRUE;
+}
+
+/*
+ * Verifies one output against the range it was cut from. One ffprobe run
+ * lists every packet of its video stream without decoding any; the scan is
+ * kept in memory only, as an output is checked once and has no place in the
+ * probe cache. It checks the container, the stream parameters, that the first
+ * packet is a keyframe, the length against the range and, when the source has
+ * a probe index already, the packet count against the source frames in the
+ * range, all within VERIFY_TOLERANCE_S. The source is never probed for this.
+ * The decode level then decodes the first and the last GOP, located from the
+ * scan.
+ */
+static gboolean verify_output(const CutJob *job, const gchar *output_path, gdouble from_s, gdouble to_s, VerifyLevel level, GCancellable *cancellable, CutStepContext *step, GError **error) {
+    ProbeScan scan;
+    probe_scan_init(&scan);
+    if (!verify_scan_output(output_path, cancellable, step, &scan, error)) {
+        probe_scan_clear(&scan);
+        return FALSE;
+    }
+    const ProbeIndexHeader *header = &scan.header;
+    const ProbeKeyframe *keyframes = (const ProbeKeyframe *)(const void *)scan.keyframes->data;
+    const gdouble *frames = (const gdouble *)(const void *)scan.frames->data;
+    gchar *codec = g_strndup(header->codec_name, sizeof(header->codec_name));
+    gboolean ok = FALSE;
+    if (!job->join_clips && g_strcmp0(codec, job->encoder->codec) != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s holds %s video instead of %s", output_path, codec, job->encoder->codec);
+        goto done;
+    }
+    if (header->width <= 0 || header->height <= 0 || header->frame_count == 0 || header->keyframe_count == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s has no usable video stream", output_path);
+        goto done;
+    }
+    gdouble first_pts = frames[0];
+    gdouble last_pts = frames[header->frame_count - 1];
+    if (keyframes[0].pts_s > first_pts + FRAME_EPSILON_S) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s does not start on a keyframe", output_path);
+        goto done;
+    }
+    gdouble frame_s = header->frame_count > 1 ? (last_pts - first_pts) / (gdouble)(header->frame_count - 1) : 0.0;
+    gdouble video_s = last_pts - first_pts + frame_s;
+    gdouble expected_s = from_s >= 0.0 ? to_s - from_s : (gdouble)cut_job_duration_us(job) / G_USEC_PER_SEC;
+    if (ABS(video_s - expected_s) > VERIFY_TOLERANCE_S || ABS(header->duration_s - expected_s) > VERIFY_TOLERANCE_S) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is %.3f s long with %.3f s of video, but %.3f s were cut", output_path, header->duration_s, video_s, expected_s);
+        goto done;
+    }
+    const ProbeIndex *source = from_s >= 0.0 && frame_s > 0.0 ? probe_index_lookup(job->input_path, FALSE, NULL, NULL) : NULL;
+    if (source) {
+        gint64 expected = (gint64)(probe_index_frame_at(source, to_s - FRAME_EPSILON_S) - probe_index_frame_at(source, from_s - FRAME_EPSILON_S));
+        gint64 slack = (gint64)(VERIFY_TOLERANCE_S / frame_s) + 1;
+        if (ABS((gint64)header->frame_count - expected) > slack) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s has %" G_GUINT64_FORMAT " video packets, but the range holds %" G_GINT64_FORMAT " frames", output_path, header->frame_count, expected);
+            goto done;
+        }
+    }
+    cut_step_log(step, "Verified %s: %s %dx%d, %" G_GUINT64_FORMAT " packets, %.3f s.", output_path, codec, header->width, header->height, header->frame_count, video_s);
+
+    if (level == VERIFY_DECODE) {
+        gdouble second_key = header->keyframe_count > 1 ? keyframes[1].pts_s : last_pts + frame_s;
+        gdouble last_key = keyframes[header->keyframe_count - 1].pts_s;
+        if (!verify_decode_gop(output_path, 0.0, second_key - first_pts, cancellable, step, error)) {
+            goto done;
+        }
+        if (header->keyframe_count > 1 && !verify_decode_gop(output_path, last_key - first_pts + FRAME_EPSILON_S, 0.0, cancellable, step, error)) {
+            goto done;
+        }
+        cut_step_log(step, "Decoded the first and last GOP of %s.", output_path);
+    }
+    ok = TRUE;
+
+done:
+    g_free(codec);
+    probe_scan_clear(&scan);
+    return ok;
+}
+
+/*
+ * Lists the output's video packets with ffprobe, under the job's resource
+ * policy like its other children. Packet, stream and format lines fill scan;
+ * any other line goes to the job's log.
+ */
+static gboolean verify_scan_output(const gchar *output_path, GCancellable *cancellable, CutStepContext *step, ProbeScan *scan, GError **error) {
+    gchar *argv[] = { "ffprobe", "-v", "error", "-select_streams", "v:0", "-show_entries", PROBE_INDEX_ENTRIES, "-of", "compact", (gchar *)output_path, NULL };
+    VerifyScan verify_scan = { scan, step };
+    FfmpegResult *result = run_ffmpeg_process(argv, cancellable, step->policy, verify_scan_line, NULL, &verify_scan, error);
+    if (!result) {
+        return FALSE;
+    }
+    gboolean ok = FALSE;
+    if (result->cancelled) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Verification was cancelled");
+    } else if (result->exit_status != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s cannot be read: %s", output_path, scan->messages->len ? scan->messages->str : "unknown error");
+    } else if (!scan->have_stream) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s has no video stream", output_path);
+    } else {
+        probe_scan_finish(scan);
+        ok = TRUE;
+    }
+    ffmpeg_result_free(result);
+    return ok;
+}
+
+static void verify_scan_line(const gchar *line, gpointer user_data) {
+    VerifyScan *verify_scan = user_data;
+    if (!probe_scan_line(verify_scan->scan, line)) {
+        cut_step_log(verify_scan->step, "%s", line);
+    }
+}
+
+/*
+ * Decodes the video of an output from from_s for length_s, or to the end when
+ * length_s is 0, with -xerror so any decode error fails the check. An input
+ * seek lands on the keyframe before from_s, so a GOP is decoded whole. It runs
+ * under the job's resource policy, and the verify workers split the CPUs the
+ * policy allows between them, within its thread cap.
+ */
+static gboolean verify_decode_gop(const gchar *output_path, gdouble from_s, gdouble length_s, GCancellable *cancellable, CutStepContext *step, GError **error) {
+    guint threads = MAX(resource_policy_cpu_count(step->policy) / VERIFY_WORKERS, 1u);
+    if (step->policy && step->policy->threads > 0) {
+        threads = MIN(threads, step->policy->threads);
+    }
+    GPtrArray *args = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-v"));
+    g_ptr_array_add(args, g_strdup("error"));
+    g_ptr_array_add(args, g_strdup("-xerror"));
+    g_ptr_array_add(args, g_strdup("-nostdin"));
+    g_ptr_array_add(args, g_strdup("-threads"));
+    g_ptr_array_add(args, g_strdup_printf("%u", threads));
+    if (from_s > 0.0) {
+        g_ptr_array_add(args, g_strdup("-ss"));
+        g_ptr_array_add(args, format_seconds_arg(from_s));
+    }
+    if (length_s > 0.0) {
+        g_ptr_array_add(args, g_strdup("-t"));
+        g_ptr_array_add(args, format_seconds_arg(length_s));
+    }
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(output_path));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:v:0"));
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup("null"));
+    g_ptr_array_add(args, g_strdup("-"));
+    g_ptr_array_add(args, NULL);
+    FfmpegResult *result = run_ffmpeg_process((gchar **)args->pdata, cancellable, step->policy, cut_step_line, NULL, step, error);
+    g_ptr_array_free(args, TRUE);
+    if (!result) {
+        return FALSE;
+    }
+    gboolean ok = FALSE;
+    if (result->cancelled) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Verification was cancelled");
+    } else if (result->exit_status != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s does not decode cleanly: %s", output_path, result->stderr_tail && *result->stderr_tail ? result->stderr_tail : "unknown error");
+    } else {
+        ok = TRUE;
+    }
+    ffmpeg_result_free(result);
+    return ok;
+}
+
+/*
+ * Runs ffmpeg with stdout and stderr merged into one pipe and hands every line
+ * to the callbacks as it arrives, so nothing but a short stderr tail is kept in
+ * memory. The policy, if any, is applied to the child as it starts. The argv
+ * is expected to contain "-nostats -progress pipe:1"; the
+ * key=value progress blocks are parsed here and reported once per block.
+ * Cancelling asks ffmpeg to quit through its stdin ("q") so the output file is
+ * finalized, and kills the child if it has not exited after a grace period.
+ * Called from worker threads; the callbacks run on the calling thread.
+ */
+static FfmpegResult *run_ffmpeg_process(gchar **argv, GCancellable *cancellable, const ResourcePolicy *policy, FfmpegLineFunc line_func, FfmpegProgressFunc progress_func, gpointer user_data, GError **error) {
+    gint64 spawn_started_us = g_get_monotonic_time();
+    GSubprocessLauncher *launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_MERGE);
+#ifdef G_OS_UNIX
+    /* The launcher runs the setup synchronously during the spawn, so the stack copy outlives it. */
+    ChildSetup setup;
+    if (child_setup_prepare(policy, &setup)) {
+        g_subprocess_launcher_set_child_setup(launcher, child_setup_run, &setup, NULL);
+    }
+    if (output_stdout_fd >= 0 && g_strv_contains((const gchar * const *)argv, OUTPUT_STDOUT_URL)) {
+        /* ffmpeg's own stdout carries -progress, so the cut goes to another descriptor. */
+        g_subprocess_launcher_take_fd(launcher, dup(output_stdout_fd), OUTPUT_STDOUT_FD);
+    }
+#endif
+    GSubprocess *process = g_subprocess_launcher_spawnv(launcher, (const gchar * const *)argv, error);
+    g_object_unref(launcher);
+    if (!process) {
+        return NULL;
+    }
+#ifdef G_OS_WIN32
+    resource_policy_apply_spawned(policy, process);
+#endif
+    gint64 spawn_us = g_get_monotonic_time() - spawn_started_us;
+    /* The identifier goes away once the child is reaped, so keep a copy. */
+    gchar *pid = g_strdup(g_subprocess_get_identifier(process));
+    gint64 peak_rss_kib = 0;
+    gdouble cpu_s = 0.0;
+
+    gulong cancel_handler = 0;
+    if (cancellable) {
+        cancel_handler = g_cancellable_connect(cancellable, G_CALLBACK(on_ffmpeg_cancelled), g_object_ref(process), g_object_unref);
+    }
+
+    GDataInputStream *reader = g_data_input_stream_new(g_subprocess_get_stdout_pipe(process));
+    g_data_input_stream_set_newline_type(reader, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+    GQueue tail = G_QUEUE_INIT;
+    FfmpegProgress progress = { 0 };
+    GError *read_error = NULL;
+    gchar *raw_line = NULL;
+    while ((raw_line = g_data_input_stream_read_line(reader, NULL, NULL, &read_error))) {
+        gchar *line = g_utf8_make_valid(g_strchomp(raw_line), -1);
+        g_free(raw_line);
+        if (parse_progress_line(line, &progress)) {
+            if (g_str_has_prefix(line, "progress=")) {
+                sample_process_usage(pid, &peak_rss_kib, &cpu_s);
+                if (progress_func) {
+                    progress_func(&progress, user_data);
+                }
+            }
+            g_free(line);
+            continue;
+        }
+        if (!*line) {
+            g_free(line);
+            continue;
+        }
+        if (line_func) {
+            line_func(line, user_data);
+        }
+        g_queue_push_tail(&tail, line);
+        if (g_queue_get_length(&tail) > FFMPEG_STDERR_TAIL_LINES) {
+            g_free(g_queue_pop_head(&tail));
+        }
+    }
+    if (read_error) {
+        if (line_func) {
+            line_func(read_error->message, user_data);
+        }
+        g_clear_error(&read_error);
+    }
+    g_object_unref(reader);
+    /* The pipe closes just before exit, so this usually still sees the child. */
+    sample_process_usage(pid, &peak_rss_kib, &cpu_s);
+    g_free(pid);
+
+    GError *wait_error = NULL;
+    gboolean waited = g_subprocess_wait(process, NULL, &wait_error);
+    if (cancel_handler) {
+        g_cancellable_disconnect(cancellable, cancel_handler);
+    }
+    if (!waited) {
+        g_propagate_error(error, wait_error);
+        g_queue_clear_full(&tail, g_free);
+        g_object_unref(process);
+        return NULL;
+    }
+
+    FfmpegResult *result = g_new0(FfmpegResult, 1);
+    result->exit_status = g_subprocess_get_if_exited(process) ? g_subprocess_get_exit_status(process) : -1;
+    result->cancelled = g_cancellable_is_cancelled(cancellable);
+    result->spawn_us = spawn_us;
+    result->peak_rss_kib = peak_rss_kib;
+    result->cpu_s = cpu_s;
+
+    GString *tail_text = g_string_new(NULL);
+    for (GList *iter = tail.head; iter; iter = iter->next) {
+        if (tail_text->len > 0) {
+            g_string_append_c(tail_text, '\n');
+        }
+        g_string_append(tail_text, iter->data);
+    }
+    result->stderr_tail = g_string_free(tail_text, FALSE);
+    g_queue_clear_full(&tail, g_free);
+    g_object_unref(process);
+    return result;
+}
+
+/* Returns TRUE when the line belongs to a -progress key=value block. */
+static gboolean parse_progress_line(const gchar *line, FfmpegProgress *progress) {
+    const gchar *equals = strchr(line, '=');
+    if (!equals || equals == line) {
+        return FALSE;
+    }
+    for (const gchar *p = line; p < equals; ++p) {
+        if (!g_ascii_islower(*p) && !g_ascii_isdigit(*p) && *p != '_') {
+            return FALSE;
+        }
+    }
+    const gchar *value = equals + 1;
+    gsize key_len = (gsize)(equals - line);
+    if (key_len == 5 && strncmp(line, "frame", key_len) == 0) {
+        progress->frame = g_ascii_strtoll(value, NULL, 10);
+    } else if (key_len == 3 && strncmp(line, "fps", key_len) == 0) {
+        progress->fps = g_ascii_strtod(value, NULL);
+    } else if (key_len == 7 && strncmp(line, "bitrate", key_len) == 0) {
+        progress->bitrate_kbps = g_ascii_strtod(value, NULL);
+    } else if ((key_len == 11 && strncmp(line, "out_time_us", key_len) == 0) || (key_len == 11 && strncmp(line, "out_time_ms", key_len) == 0)) {
+        /* Older ffmpeg builds report microseconds under the out_time_ms key. */
+        progress->out_time_us = MAX(g_ascii_strtoll(value, NULL, 10), 0);
+    } else if (key_len == 5 && strncmp(line, "speed", key_len) == 0) {
+        progress->speed = g_ascii_strtod(value, NULL);
+    } else if (key_len == 8 && strncmp(line, "progress", key_len) == 0) {
+        progress->ended = g_strcmp0(value, "end") == 0;
+    }
+    return TRUE;
+}
+
+/*
+ * Updates the peak resident size (VmHWM) and the CPU time of a running child.
+ * Only Linux has /proc; elsewhere the figures stay 0.
+ */
+static void sample_process_usage(const gchar *pid, gint64 *peak_rss_kib, gdouble *cpu_s) {
+#ifdef __linux__
+    if (!pid) {
+        return;
+    }
+    *peak_rss_kib = MAX(*peak_rss_kib, proc_status_kib(pid, "VmHWM:"));
+    gchar *path = g_build_filename("/proc", pid, "stat", NULL);
+    gchar *contents = NULL;
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        const gchar *paren = strrchr(contents, ')');
+        unsigned long long utime = 0;
+        unsigned long long stime = 0;
+        /* utime and stime are the 12th and 13th fields after the command name. */
+        if (paren && sscanf(paren + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) == 2) {
+            *cpu_s = (gdouble)(utime + stime) / (gdouble)sysconf(_SC_CLK_TCK);
+        }
+        g_free(contents);
+    }
+    g_free(path);
+#endif
+}
+
+/*
+ * Fills the policy from text settings, given as command-line options or
+ * environment variables; NULL leaves a field as it is. io_text is "idle",
+ * "best-effort[:LEVEL]" or "realtime[:LEVEL]" with LEVEL 0 (highest) to 7.
+ */
+static gboolean resource_policy_parse(ResourcePolicy *policy, const gchar *nice_text, const gchar *io_text, const gchar *cpus_text, const gchar *threads_text, GError **error) {
+    gint64 value = 0;
+    if (nice_text && *nice_text) {
+        if (!g_ascii_string_to_signed(nice_text, 10, -20, 19, &value, NULL)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Nice level must be between -20 and 19: %s", nice_text);
+            return FALSE;
+        }
+        policy->nice_level = (gint)value;
+    }
+    if (io_text && *io_text) {
+        gchar **parts = g_strsplit(io_text, ":", 2);
+        gboolean ok = TRUE;
+        if (g_strcmp0(parts[0], "idle") == 0) {
+            policy->io_class = IO_CLASS_IDLE;
+        } else if (g_strcmp0(parts[0], "best-effort") == 0) {
+            policy->io_class = IO_CLASS_BEST_EFFORT;
+        } else if (g_strcmp0(parts[0], "realtime") == 0) {
+            policy->io_class = IO_CLASS_REALTIME;
+        } else {
+            ok = FALSE;
+        }
+        policy->io_level = 4;
+        if (ok && parts[1]) {
+            ok = policy->io_class != IO_CLASS_IDLE && g_ascii_string_to_signed(parts[1], 10, 0, 7, &value, NULL);
+            policy->io_level = (gint)value;
+        }
+        g_strfreev(parts);
+        if (!ok) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "I/O class must be idle, best-effort[:0-7] or realtime[:0-7]: %s", io_text);
+            return FALSE;
+        }
+    }
+    if (cpus_text && *cpus_text) {
+        GArray *cpus = NULL;
+        if (!parse_cpu_list(cpus_text, &cpus, error)) {
+            return FALSE;
+        }
+        g_clear_pointer(&policy->cpus, g_array_unref);
+        policy->cpus = cpus;
+    }
+    if (threads_text && *threads_text) {
+        guint64 threads = 0;
+        if (!g_ascii_string_to_unsigned(threads_text, 10, 0, 1024, &threads, NULL)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Thread cap must be a number from 0 to 1024: %s", threads_text);
+            return FALSE;
+        }
+        policy->threads = (guint)threads;
+    }
+    return TRUE;
+}
+
+/* Parses a list such as "0-3,6" into sorted, distinct CPU numbers. */
+static gboolean parse_cpu_list(const gchar *text, GArray **cpus_out, GError **error) {
+    GArray *cpus = g_array_new(FALSE, FALSE, sizeof(guint));
+    gchar **items = g_strsplit(text, ",", -1);
+    gboolean ok = TRUE;
+    for (guint i = 0; ok && items[i]; ++i) {
+        gchar **bounds = g_strsplit(g_strstrip(items[i]), "-", 2);
+        guint64 first = 0;
+        guint64 last = 0;
+        ok = g_ascii_string_to_unsigned(bounds[0], 10, 0, 1023, &first, NULL) && (!bounds[1] || g_ascii_string_to_unsigned(bounds[1], 10, first, 1023, &last, NULL));
+        for (guint64 cpu = first; ok && cpu <= (bounds[1] ? last : first); ++cpu) {
+            gboolean seen = FALSE;
+            for (guint k = 0; k < cpus->len && !seen; ++k) {
+                seen = g_array_index(cpus, guint, k) == cpu;
+            }
+            if (!seen) {
+                guint value = (guint)cpu;
+                g_array_append_val(cpus, value);
+            }
+        }
+        g_strfreev(bounds);
+    }
+    g_strfreev(items);
+    if (!ok || cpus->len == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "CPU list must look like 0-3,6: %s", text);
+        g_array_unref(cpus);
+        return FALSE;
+    }
+    *cpus_out = cpus;
+    return TRUE;
+}
+
+static void resource_policy_copy(ResourcePolicy *target, const ResourcePolicy *source) {
+    resource_policy_clear(target);
+    *target = *source;
+    if (target->cpus) {
+        g_array_ref(target->cpus);
+    }
+}
+
+static void resource_policy_clear(ResourcePolicy *policy) {
+    g_clear_pointer(&policy->cpus, g_array_unref);
+    memset(policy, 0, sizeof(*policy));
+}
+
+/* The CPUs the policy lets the children use, which bounds how many chunks run at once. */
+static guint resource_policy_cpu_count(const ResourcePolicy *policy) {
+    return policy && policy->cpus ? policy->cpus->len : g_get_num_processors();
+}
+
+/* Threads of one chunk's encoder: CHUNK_THREADS_PER_CHILD, or less under a thread cap. */
+static guint chunk_threads(const CutJob *job) {
+    return job->policy.threads > 0 ? MIN(job->policy.threads, CHUNK_THREADS_PER_CHILD) : CHUNK_THREADS_PER_CHILD;
+}
+
+#ifdef G_OS_UNIX
+/* Returns FALSE when the policy changes nothing, so plain spawns keep GLib's posix_spawn path. */
+static gboolean child_setup_prepare(const ResourcePolicy *policy, ChildSetup *setup) {
+    memset(setup, 0, sizeof(*setup));
+    if (!policy) {
+        return FALSE;
+    }
+    setup->nice_level = policy->nice_level;
+    setup->io_class = policy->io_class;
+    setup->io_level = policy->io_level;
+    gboolean active = setup->nice_level != 0 || setup->io_class != IO_CLASS_DEFAULT;
+#ifdef __linux__
+    if (policy->cpus) {
+        CPU_ZERO(&setup->cpus);
+        for (guint i = 0; i < policy->cpus->len; ++i) {
+            guint cpu = g_array_index(policy->cpus, guint, i);
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &setup->cpus);
+            }
+        }
+        setup->has_affinity = TRUE;
+        active = TRUE;
+    }
+#endif
+    return active;
+}
+
+/*
+ * Runs in the forked child before exec, so it only makes system calls.
+ * Failures are ignored: an unprivileged user cannot lower the nice level or
+ * pick the realtime I/O class, and the cut should run anyway.
+ */
+static void child_setup_run(gpointer user_data) {
+    const ChildSetup *setup = user_data;
+    if (setup->nice_level != 0) {
+        setpriority(PRIO_PROCESS, 0, setup->nice_level);
+    }
+#ifdef __linux__
+    if (setup->io_class != IO_CLASS_DEFAULT) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ((gint)setup->io_class << IOPRIO_CLASS_SHIFT) | setup->io_level);
+    }
+    if (setup->has_affinity) {
+        sched_setaffinity(0, sizeof(setup->cpus), &setup->cpus);
+    }
+#endif
+}
+#endif
+
+#ifdef G_OS_WIN32
+/*
+ * Windows has no child setup hook, so the priority class and affinity are set
+ * right after the spawn. There is no per-process I/O class to set.
+ */
+static void resource_policy_apply_spawned(const ResourcePolicy *policy, GSubprocess *process) {
+    if (!policy || (policy->nice_level == 0 && !policy->cpus)) {
+        return;
+    }
+    const gchar *identifier = g_subprocess_get_identifier(process);
+    HANDLE handle = identifier ? OpenProcess(PROCESS_SET_INFORMATION | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)g_ascii_strtoull(identifier, NULL, 10)) : NULL;
+    if (!handle) {
+        return;
+    }
+    if (policy->nice_level != 0) {
+        DWORD priority = policy->nice_level >= 10 ? IDLE_PRIORITY_CLASS : (policy->nice_level > 0 ? BELOW_NORMAL_PRIORITY_CLASS : ABOVE_NORMAL_PRIORITY_CLASS);
+        SetPriorityClass(handle, priority);
+    }
+    if (policy->cpus) {
+        DWORD_PTR mask = 0;
+        for (guint i = 0; i < policy->cpus->len; ++i) {
+            guint cpu = g_array_index(policy->cpus, guint, i);
+            if (cpu < sizeof(DWORD_PTR) * 8) {
+                mask |= (DWORD_PTR)1 << cpu;
+            }
+        }
+        if (mask) {
+            SetProcessAffinityMask(handle, mask);
+        }
+    }
+    CloseHandle(handle);
+}
+#endif
+
+/* Runs on the thread that cancelled; ffmpeg exits cleanly on "q". */
+static void on_ffmpeg_cancelled(GCancellable *cancellable, gpointer user_data) {
+    GSubprocess *process = user_data;
+    GOutputStream *input = g_subprocess_get_stdin_pipe(process);
+    if (input) {
+        g_output_stream_write_all(input, "q\n", 2, NULL, NULL, NULL);
+        g_output_stream_close(input, NULL, NULL);
+    }
+    g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, FFMPEG_CANCEL_GRACE_SECONDS, ffmpeg_force_exit, g_object_ref(process), g_object_unref);
+}
+
+static gboolean ffmpeg_force_exit(gpointer user_data) {
+    g_subprocess_force_exit(G_SUBPROCESS(user_data));
+    return G_SOURCE_REMOVE;
+}
+
+/* Formats one progress block for display; fraction is 0 when the duration is unknown. */
+static gchar *format_progress_details(const FfmpegProgress *progress, gint64 duration_us, gdouble *fraction_out) {
+    gint64 position_s = progress->out_time_us / G_USEC_PER_SEC;
+    gchar *position = format_seconds(position_s);
+    GString *text = g_string_new(NULL);
+    g_string_append_printf(text, "%s  frame %" G_GINT64_FORMAT "  %.1f fps  %.2fx", position, progress->frame, progress->fps, progress->speed);
+    if (progress->bitrate_kbps > 0.0) {
+        g_string_append_printf(text, "  %.0f kbit/s", progress->bitrate_kbps);
+    }
+    gdouble fraction = 0.0;
+    if (duration_us > 0) {
+        fraction = CLAMP((gdouble)progress->out_time_us / (gdouble)duration_us, 0.0, 1.0);
+        if (progress->speed > 0.0 && progress->out_time_us < duration_us) {
+            gint64 remaining_s = (gint64)((duration_us - progress->out_time_us) / G_USEC_PER_SEC / progress->speed);
+            gchar *eta = format_seconds(remaining_s);
+            g_string_append_printf(text, "  ETA %s", eta);
+            g_free(eta);
+        }
+    }
+    if (fraction_out) {
+        *fraction_out = fraction;
+    }
+    g_free(position);
+    return g_string_free(text, FALSE);
+}
+
+static JobScheduler *job_scheduler_new(guint hardware_limit, guint software_limit, JobStatusFunc status_func, JobLineFunc line_func, JobProgressFunc progress_func, gpointer user_data) {
+    JobScheduler *scheduler = g_new0(JobScheduler, 1);
+    g_queue_init(&scheduler->jobs);
+    scheduler->next_id = 1;
+    scheduler->hardware_limit = MAX(hardware_limit, 1);
+    scheduler->software_limit = MAX(software_limit, 1);
+    scheduler->status_func = status_func;
+    scheduler->line_func = line_func;
+    scheduler->progress_func = progress_func;
+    scheduler->user_data = user_data;
+    scheduler->telemetry_totals = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    return scheduler;
+}
+
+/*
+ * Only call once no job is running; worker threads still reference their
+ * jobs. A read-ahead still in flight is cancelled and left to finish alone.
+ */
+static void job_scheduler_free(JobScheduler *scheduler) {
+    if (!scheduler) {
+        return;
+    }
+    if (scheduler->verify_pool) {
+        g_thread_pool_free(scheduler->verify_pool, FALSE, TRUE);
+    }
+    g_queue_clear_full(&scheduler->jobs, (GDestroyNotify)queue_job_free);
+    g_hash_table_unref(scheduler->telemetry_totals);
+    if (scheduler->throttle_source) {
+        g_source_remove(scheduler->throttle_source);
+    }
+    if (scheduler->prefetch) {
+        scheduler->prefetch->scheduler = NULL;
+        g_cancellable_cancel(scheduler->prefetch->cancellable);
+    }
+    resource_policy_clear(&scheduler->policy);
+    g_free(scheduler->telemetry_path);
+    g_free(scheduler->prometheus_path);
+    g_free(scheduler);
+}
+
+/* Takes ownership of the cut and starts it right away if a slot is free. */
+static QueueJob *job_scheduler_add(JobScheduler *scheduler, CutJob *cut) {
+    QueueJob *job = g_new0(QueueJob, 1);
+    job->id = scheduler->next_id++;
+    job->cut = cut;
+    job->status = JOB_STATUS_QUEUED;
+    job->hardware = cut_job_uses_hardware(cut);
+    job->duration_us = cut_job_duration_us(cut);
+    job->scheduler = scheduler;
+    job->telemetry.queued_us = g_get_monotonic_time();
+    resource_policy_copy(&cut->policy, &scheduler->policy);
+    g_queue_push_tail(&scheduler->jobs, job);
+    if (scheduler->status_func) {
+        scheduler->status_func(job, scheduler->user_data);
+    }
+    job_scheduler_dispatch(scheduler);
+    return job;
+}
+
+static void job_scheduler_set_limits(JobScheduler *scheduler, guint hardware_limit, guint software_limit) {
+    scheduler->hardware_limit = MAX(hardware_limit, 1);
+    scheduler->software_limit = MAX(software_limit, 1);
+    job_scheduler_dispatch(scheduler);
+}
+
+/* Either path may be NULL or empty to turn that output off. */
+static void job_scheduler_set_telemetry(JobScheduler *scheduler, const gchar *telemetry_path, const gchar *prometheus_path) {
+    g_free(scheduler->telemetry_path);
+    g_free(scheduler->prometheus_path);
+    scheduler->telemetry_path = telemetry_path && *telemetry_path ? g_strdup(telemetry_path) : NULL;
+    scheduler->prometheus_path = prometheus_path && *prometheus_path ? g_strdup(prometheus_path) : NULL;
+}
+
+/* Applies to jobs queued from now on; a max_load or min_free_mib of 0 leaves that check off. */
+static void job_scheduler_set_policy(JobScheduler *scheduler, const ResourcePolicy *policy, gdouble max_load, gint64 min_free_mib) {
+    resource_policy_copy(&scheduler->policy, policy);
+    scheduler->max_load = max_load;
+    scheduler->min_free_mib = min_free_mib;
+}
+
+/* Returns why new jobs have to wait, or NULL when they may start. */
+static gchar *job_scheduler_throttle_reason(JobScheduler *scheduler) {
+#ifdef G_OS_UNIX
+    gdouble load = 0.0;
+    if (scheduler->max_load > 0.0 && getloadavg(&load, 1) == 1 && load > scheduler->max_load) {
+        return g_strdup_printf("Waiting: load average %.2f is above %.2f.", load, scheduler->max_load);
+    }
+#endif
+    if (scheduler->min_free_mib > 0) {
+        gint64 available = system_available_mib();
+        if (available >= 0 && available < scheduler->min_free_mib) {
+            return g_strdup_printf("Waiting: %" G_GINT64_FORMAT " MiB of memory available, below %" G_GINT64_FORMAT " MiB.", available, scheduler->min_free_mib);
+        }
+    }
+    return NULL;
+}
+
+static gboolean job_scheduler_recheck(gpointer user_data) {
+    JobScheduler *scheduler = user_data;
+    scheduler->throttle_source = 0;
+    job_scheduler_dispatch(scheduler);
+    return G_SOURCE_REMOVE;
+}
+
+/* Memory available to new processes without swapping, or -1 where it is not known. */
+static gint64 system_available_mib(void) {
+#ifdef __linux__
+    gint64 available = -1;
+    gchar *contents = NULL;
+    if (g_file_get_contents("/proc/meminfo", &contents, NULL, NULL)) {
+        const gchar *line = strstr(contents, "MemAvailable:");
+        if (line) {
+            available = g_ascii_strtoll(line + strlen("MemAvailable:"), NULL, 10) / 1024;
+        }
+        g_free(contents);
+    }
+    return available;
+#elif defined(G_OS_WIN32)
+    MEMORYSTATUSEX status = { 0 };
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? (gint64)(status.ullAvailPhys / (1024 * 1024)) : -1;
+#else
+    return -1;
+#endif
+}
+
+static gboolean parse_throttle(const gchar *load_text, const gchar *free_text, gdouble *max_load, gint64 *min_free_mib, GError **error) {
+    if (load_text && *load_text) {
+        gchar *end = NULL;
+        *max_load = g_ascii_strtod(load_text, &end);
+        if (*end || *max_load < 0.0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Load threshold must be a positive number: %s", load_text);
+            return FALSE;
+        }
+    }
+    if (free_text && *free_text) {
+        guint64 value = 0;
+        if (!g_ascii_string_to_unsigned(free_text, 10, 0, G_MAXINT64, &value, NULL)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Free memory threshold must be a number of MiB: %s", free_text);
+            return FALSE;
+        }
+        *min_free_mib = (gint64)value;
+    }
+    return TRUE;
+}
+
+/* Caps the bytes read ahead for jobs that have not started; 0 turns read-ahead off. */
+static void job_scheduler_set_prefetch(JobScheduler *scheduler, gint64 budget_mib) {
+    scheduler->prefetch_budget = MAX(budget_mib, 0) * 1024 * 1024;
+}
+
+static void job_scheduler_set_verify(JobScheduler *scheduler, VerifyLevel level) {
+    scheduler->verify = level;
+}
+
+/*
+ * While a job runs, warms the page cache for the byte range the next queued
+ * job will read, one job at a time in queue order. Bytes already read ahead
+ * for queued jobs count against the budget, which is further held to a
+ * quarter of the available memory, so read-ahead cannot push the running
+ * job's own data out of the cache.
+ */
+static void job_scheduler_prefetch_next(JobScheduler *scheduler) {
+    if (scheduler->prefetch || scheduler->prefetch_budget <= 0 || scheduler->hardware_running + scheduler->software_running == 0) {
+        return;
+    }
+    gint64 held = 0;
+    QueueJob *next = NULL;
+    for (GList *iter = scheduler->jobs.head; iter; iter = iter->next) {
+        QueueJob *job = iter->data;
+        if (job->status != JOB_STATUS_QUEUED) {
+            continue;
+        }
+        held += job->prefetch_bytes;
+        if (!next && !job->prefetched) {
+            next = job;
+        }
+    }
+    gint64 budget = scheduler->prefetch_budget - held;
+    gint64 available = system_available_mib();
+    if (available >= 0) {
+        budget = MIN(budget, available * 1024 * 1024 / 4 - held);
+    }
+    if (!next || budget < PREFETCH_STEP_BYTES) {
+        return;
+    }
+    next->prefetched = TRUE;
+
+    PrefetchRun *run = g_new0(PrefetchRun, 1);
+    run->scheduler = scheduler;
+    run->job_id = next->id;
+    run->input_path = g_strdup(next->cut->input_path);
+    run->start_s = (gdouble)time_string_to_seconds(next->cut->start_time);
+    run->end_s = (gdouble)time_string_to_seconds(next->cut->end_time);
+    run->budget = budget;
+    run->cancellable = g_cancellable_new();
+    scheduler->prefetch = run;
+
+    GTask *task = g_task_new(NULL, run->cancellable, prefetch_task_completed, run);
+    g_task_set_task_data(task, run, NULL);
+    g_task_run_in_thread(task, prefetch_task_thread);
+    g_object_unref(task);
+}
+
+static void prefetch_task_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    PrefetchRun *run = task_data;
+    gint64 offset = 0;
+    gint64 length = 0;
+    if (!prefetch_plan(run->input_path, run->start_s, run->end_s, cancellable, &offset, &length)) {
+        g_task_return_int(task, 0);
+        return;
+    }
+    g_task_return_int(task, prefetch_range(run->input_path, offset, MIN(length, run->budget), cancellable));
+}
+
+static void prefetch_task_completed(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    PrefetchRun *run = user_data;
+    gint64 bytes = (gint64)g_task_propagate_int(G_TASK(result), NULL);
+    JobScheduler *scheduler = run->scheduler;
+    if (scheduler) {
+        scheduler->prefetch = NULL;
+        for (GList *iter = scheduler->jobs.head; iter; iter = iter->next) {
+            QueueJob *job = iter->data;
+            if (job->id != run->job_id || bytes <= 0) {
+                continue;
+            }
+            if (job->status == JOB_STATUS_QUEUED) {
+                job->prefetch_bytes = bytes;
+            }
+            if (scheduler->line_func) {
+                gchar *line = g_strdup_printf("Read ahead %.1f MiB of the input while waiting.", (gdouble)bytes / (1024.0 * 1024.0));
+                scheduler->line_func(job, line, scheduler->user_data);
+                g_free(line);
+            }
+        }
+        job_scheduler_prefetch_next(scheduler);
+    }
+    prefetch_run_free(run);
+}
+
+static void prefetch_run_free(PrefetchRun *run) {
+    g_free(run->input_path);
+    g_clear_object(&run->cancellable);
+    g_free(run);
+}
+
+/*
+ * Byte range a cut of start to end reads: from the keyframe ffmpeg seeks to
+ * up to the first keyframe after the end, taken from the packet positions in
+ * the probe index. Inputs whose index has no positions get a range
+ * proportional to the duration. Only an index that already exists is used;
+ * read-ahead never indexes a whole input. Inputs without one, as in headless
+ * batches, get the proportional range from the file size and the duration in
+ * the container header, widened by a step on each side for the seek.
+ */
+static gboolean prefetch_plan(const gchar *input_path, gdouble start_s, gdouble end_s, GCancellable *cancellable, gint64 *offset_out, gint64 *length_out) {
+    const ProbeIndex *index = probe_index_lookup(input_path, FALSE, NULL, NULL);
+    if (!index) {
+        GStatBuf st;
+        gdouble duration_s = g_stat(input_path, &st) == 0 ? probe_format_duration(input_path, cancellable) : 0.0;
+        if (duration_s <= 0.0) {
+            return FALSE;
+        }
+        gint64 from = (gint64)((gdouble)st.st_size * CLAMP(start_s / duration_s, 0.0, 1.0)) - PREFETCH_STEP_BYTES;
+        gint64 to = (gint64)((gdouble)st.st_size * CLAMP(end_s / duration_s, 0.0, 1.0)) + PREFETCH_STEP_BYTES;
+        from = MAX(from, 0);
+        to = MIN(to, (gint64)st.st_size);
+        if (to <= from) {
+            return FALSE;
+        }
+        *offset_out = from;
+        *length_out = to - from;
+        return TRUE;
+    }
+    const ProbeIndexHeader *header = index->header;
+    gint64 file_size = header->file_size;
+    gsize count = header->keyframe_count;
+    gsize first = probe_index_keyframe_at(index, start_s + SMART_CUT_EPSILON_S);
+    if (first > 0) {
+        first--;
+    }
+    gsize last = probe_index_keyframe_at(index, end_s + SMART_CUT_EPSILON_S);
+    gint64 from = first < count ? index->keyframes[first].pos : -1;
+    gint64 to = last < count ? index->keyframes[last].pos : file_size;
+    if (from < 0 || to < 0) {
+        if (header->duration_s <= 0.0) {
+            return FALSE;
+        }
+        from = (gint64)((gdouble)file_size * CLAMP(start_s / header->duration_s, 0.0, 1.0));
+        to = (gint64)((gdouble)file_size * CLAMP(end_s / header->duration_s, 0.0, 1.0));
+    }
+    if (to <= from) {
+        return FALSE;
+    }
+    *offset_out = from;
+    *length_out = to - from;
+    return TRUE;
+}
+
+/* Duration from the container header alone, which ffprobe reads without scanning the packets; 0 if unknown. */
+static gdouble probe_format_duration(const gchar *input_path, GCancellable *cancellable) {
+    gchar *argv[] = { "ffprobe", "-v", "error", "-show_entries", "format=duration", "-of", "default=noprint_wrappers=1:nokey=1", (gchar *)input_path, NULL };
+    gchar *output = NULL;
+    if (!run_capture_process(argv, cancellable, &output, NULL)) {
+        return 0.0;
+    }
+    gdouble duration_s = g_ascii_strtod(g_strstrip(output), NULL);
+    g_free(output);
+    return duration_s;
+}
+
+/*
+ * Pulls length bytes at offset into the page cache in PREFETCH_STEP_BYTES
+ * steps and returns how many were requested before a cancel. On Linux the
+ * thread drops to the idle I/O class meanwhile, so the reads of running jobs
+ * go first; readahead() blocks until the data is queued, which keeps the
+ * budget honest. Other Unix systems get posix_fadvise(WILLNEED), and the rest
+ * read the bytes and throw them away.
+ */
+static gint64 prefetch_range(const gchar *input_path, gint64 offset, gint64 length, GCancellable *cancellable) {
+    gint64 done = 0;
+#ifdef G_OS_UNIX
+    int fd = g_open(input_path, O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+#ifdef __linux__
+    long saved_priority = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (gint)IO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+    while (done < length && !g_cancellable_is_cancelled(cancellable)) {
+        gint64 step = MIN(length - done, PREFETCH_STEP_BYTES);
+#ifdef __linux__
+        if (readahead(fd, (off_t)(offset + done), (size_t)step) != 0) {
+            break;
+        }
+#else
+        if (posix_fadvise(fd, (off_t)(offset + done), (off_t)step, POSIX_FADV_WILLNEED) != 0) {
+            break;
+        }
+#endif
+        done += step;
+    }
+#ifdef __linux__
+    if (saved_priority >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (int)saved_priority);
+    }
+#endif
+    close(fd);
+#else
+    GFile *file = g_file_new_for_path(input_path);
+    GFileInputStream *stream = g_file_read(file, cancellable, NULL);
+    g_object_unref(file);
+    if (!stream) {
+        return 0;
+    }
+    if (g_seekable_seek(G_SEEKABLE(stream), offset, G_SEEK_SET, cancellable, NULL)) {
+        guint8 *buffer = g_malloc(PREFETCH_STEP_BYTES);
+        while (done < length) {
+            gssize count = g_input_stream_read(G_INPUT_STREAM(stream), buffer, (gsize)MIN(length - done, PREFETCH_STEP_BYTES), cancellable, NULL);
+            if (count <= 0) {
+                break;
+            }
+            done += count;
+        }
+        g_free(buffer);
+    }
+    g_object_unref(stream);
+#endif
+    return done;
+}
+
+static gint64 prefetch_default_budget_mb(void) {
+    const gchar *budget = g_getenv("FAST_CUT_PREFETCH_MB");
+    return budget && *budget ? g_ascii_strtoll(budget, NULL, 10) : PREFETCH_DEFAULT_MB;
+}
+
+/*
+ * Starts queued jobs in order; a job blocked on its class does not hold back
+ * the other class. While the machine is over the load or memory threshold no
+ * job starts, and the queue is looked at again every THROTTLE_RECHECK_SECONDS.
+ */
+static void job_scheduler_dispatch(JobScheduler *scheduler) {
+    gboolean throttle_checked = FALSE;
+    gchar *throttle = NULL;
+    for (GList *iter = scheduler->jobs.head; iter; iter = iter->next) {
+        QueueJob *job = iter->data;
+        if (job->status != JOB_STATUS_QUEUED) {
+            continue;
+        }
+        if (job->hardware && scheduler->hardware_running >= scheduler->hardware_limit) {
+            continue;
+        }
+        if (!job->hardware && scheduler->software_running >= scheduler->software_limit) {
+            continue;
+        }
+        if (!throttle_checked) {
+            throttle = job_scheduler_throttle_reason(scheduler);
+            throttle_checked = TRUE;
+        }
+        if (throttle) {
+            if (g_strcmp0(job->status_detail, throttle) != 0) {
+                job_set_status(job, JOB_STATUS_QUEUED, throttle);
+            }
+            continue;
+        }
+        job_scheduler_start(job);
+    }
+    if (throttle && !scheduler->throttle_source) {
+        scheduler->throttle_source = g_timeout_add_seconds(THROTTLE_RECHECK_SECONDS, job_scheduler_recheck, scheduler);
+    }
+    g_free(throttle);
+    job_scheduler_prefetch_next(scheduler);
+}
+
+static void job_scheduler_start(QueueJob *job) {
+    JobScheduler *scheduler = job->scheduler;
+    if (job->hardware) {
+        scheduler->hardware_running++;
+    } else {
+        scheduler->software_running++;
+    }
+    g_clear_object(&job->cancellable);
+    job->cancellable = g_cancellable_new();
+    job->telemetry.started_us = g_get_monotonic_time();
+    /* Its read-ahead is now the running job's working set and no longer counts against the budget. */
+    job->prefetch_bytes = 0;
+    if (scheduler->prefetch && scheduler->prefetch->job_id == job->id) {
+        g_cancellable_cancel(scheduler->prefetch->cancellable);
+    }
+    job_set_status(job, JOB_STATUS_RUNNING, NULL);
+
+    GTask *task = g_task_new(NULL, job->cancellable, ffmpeg_task_completed, job);
+    g_task_set_task_data(task, job, NULL);
+    g_task_set_check_cancellable(task, FALSE);
+    g_task_run_in_thread(task, ffmpeg_task_thread);
+    g_object_unref(task);
+}
+
+static void job_scheduler_cancel(QueueJob *job) {
+    if (job->status == JOB_STATUS_QUEUED) {
+        job_set_status(job, JOB_STATUS_CANCELLED, "Removed from the queue before it started.");
+    } else if ((job->status == JOB_STATUS_RUNNING || job->status == JOB_STATUS_VERIFYING) && job->cancellable) {
+        g_cancellable_cancel(job->cancellable);
+    }
+}
+
+static void job_scheduler_cancel_all(JobScheduler *scheduler) {
+    /* Cancel queued jobs first so finishing ones cannot dispatch them. */
+    for (GList *iter = scheduler->jobs.head; iter; iter = iter->next) {
+        QueueJob *job = iter->data;
+        if (job->status == JOB_STATUS_QUEUED) {
+            job_scheduler_cancel(job);
+        }
+    }
+    for (GList *iter = scheduler->jobs.head; iter; iter = iter->next) {
+        job_scheduler_cancel(iter->data);
+    }
+}
+
+static void job_scheduler_remove_finished(JobScheduler *scheduler) {
+    GList *iter = scheduler->jobs.head;
+    while (iter) {
+        GList *next = iter->next;
+        QueueJob *job = iter->data;
+        if (job->status > JOB_STATUS_VERIFYING) {
+            g_queue_delete_link(&scheduler->jobs, iter);
+            queue_job_free(job);
+        }
+        iter = next;
+    }
+}
+
+static guint job_scheduler_count(JobScheduler *scheduler, JobStatus status) {
+    guint count = 0;
+    for (GList *iter = scheduler->jobs.head; iter; iter = iter->next) {
+        if (((QueueJob *)iter->data)->status == status) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static gboolean job_scheduler_busy(JobScheduler *scheduler) {
+    return scheduler->hardware_running + scheduler->software_running > 0 || job_scheduler_count(scheduler, JOB_STATUS_QUEUED) > 0 || job_scheduler_count(scheduler, JOB_STATUS_VERIFYING) > 0;
+}
+
+static void job_set_status(QueueJob *job, JobStatus status, const gchar *detail) {
+    job->status = status;
+    g_free(job->status_detail);
+    job->status_detail = g_strdup(detail);
+    if (job->scheduler->status_func) {
+        job->scheduler->status_func(job, job->scheduler->user_data);
+    }
+}
+
+static void queue_job_free(QueueJob *job) {
+    if (!job) {
+        return;
+    }
+    if (job->view_data && job->view_data_free) {
+        job->view_data_free(job->view_data);
+    }
+    cut_job_free(job->cut);
+    g_clear_object(&job->cancellable);
+    g_free(job->status_detail);
+    g_free(job);
+}
+
+static const gchar *job_status_label(JobStatus status) {
+    switch (status) {
+    case JOB_STATUS_QUEUED:
+        return "Queued";
+    case JOB_STATUS_RUNNING:
+        return "Running";
+    case JOB_STATUS_VERIFYING:
+        return "Verifying";
+    case JOB_STATUS_DONE:
+        return "Done";
+    case JOB_STATUS_FAILED:
+        return "Failed";
+    case JOB_STATUS_CANCELLED:
+        return "Cancelled";
+    }
+    return "";
+}
+
+static gboolean cut_job_uses_hardware(const CutJob *job) {
+    return job->encoder->hardware;
+}
+
+/* FAST_CUT_TELEMETRY_FILE overrides the default; set it empty to turn telemetry off. */
+static gchar *telemetry_default_path(void) {
+    const gchar *path = g_getenv("FAST_CUT_TELEMETRY_FILE");
+    if (path) {
+        return g_strdup(path);
+    }
+    return g_build_filename(g_get_user_cache_dir(), "fast_cut", "telemetry.jsonl", NULL);
+}
+
+/*
+ * Runs on the worker for every progress block. The frame counter restarts at
+ * 0 with each step of a smart cut, so a lower count starts a new step rather
+ * than going back. The slowest interval after the first frame gives min fps.
+ */
+static void job_telemetry_progress(JobTelemetry *telemetry, const FfmpegProgress *progress) {
+    gint64 now = g_get_monotonic_time();
+    gint64 delta = progress->frame >= telemetry->last_frame ? progress->frame - telemetry->last_frame : progress->frame;
+    if (telemetry->first_frame_us && !progress->ended && now > telemetry->last_progress_us) {
+        gdouble fps = (gdouble)delta * G_USEC_PER_SEC / (gdouble)(now - telemetry->last_progress_us);
+        telemetry->min_fps = telemetry->intervals == 0 ? fps : MIN(telemetry->min_fps, fps);
+        telemetry->intervals++;
+    }
+    if (!telemetry->first_frame_us && delta > 0) {
+        telemetry->first_frame_us = now;
+    }
+    telemetry->frames += delta;
+    telemetry->last_frame = progress->frame;
+    telemetry->last_progress_us = now;
+}
+
+/*
+ * Appends one JSON line for a finished job and refreshes the Prometheus
+ * textfile. Runs on the main thread after the worker has let go of the job.
+ * result is NULL when ffmpeg could not be started.
+ */
+static void job_telemetry_record(QueueJob *job, const FfmpegResult *result) {
+    JobScheduler *scheduler = job->scheduler;
+    if (!scheduler->telemetry_path && !scheduler->prometheus_path) {
+        return;
+    }
+    const JobTelemetry *telemetry = &job->telemetry;
+    CutJob *cut = job->cut;
+    gint64 finished_us = telemetry->finished_us;
+    gdouble wall_s = (gdouble)(finished_us - telemetry->started_us) / G_USEC_PER_SEC;
+    gdouble encode_s = telemetry->first_frame_us ? (gdouble)(finished_us - telemetry->first_frame_us) / G_USEC_PER_SEC : 0.0;
+    gdouble avg_fps = encode_s > 0.0 ? (gdouble)telemetry->frames / encode_s : 0.0;
+    gdouble media_s = job->status == JOB_STATUS_DONE ? (gdouble)job->duration_us / G_USEC_PER_SEC : 0.0;
+    gdouble speed = wall_s > 0.0 ? media_s / wall_s : 0.0;
+    GStatBuf st;
+    gint64 input_bytes = g_stat(cut->input_path, &st) == 0 ? (gint64)st.st_size : 0;
+    gint64 output_bytes = job->status == JOB_STATUS_DONE ? cut_job_output_bytes(cut) : 0;
+
+    if (scheduler->telemetry_path) {
+        GDateTime *stamp = g_date_time_new_now_utc();
+        gchar *time_text = g_date_time_format(stamp, "%Y-%m-%dT%H:%M:%SZ");
+        g_date_time_unref(stamp);
+
+        JsonBuilder *builder = json_builder_new();
+        json_builder_begin_object(builder);
+        json_builder_set_member_name(builder, "time");
+        json_builder_add_string_value(builder, time_text);
+        json_builder_set_member_name(builder, "host");
+        json_builder_add_string_value(builder, g_get_host_name());
+        json_builder_set_member_name(builder, "job");
+        json_builder_add_int_value(builder, job->id);
+        json_builder_set_member_name(builder, "input");
+        json_builder_add_string_value(builder, cut->input_path);
+        json_builder_set_member_name(builder, "output");
+        json_builder_add_string_value(builder, cut->output_path);
+        json_builder_set_member_name(builder, "ranges");
+        json_builder_add_int_value(builder, cut_job_range_count(cut));
+        json_builder_set_member_name(builder, "encoder");
+        json_builder_add_string_value(builder, cut->encoder->id);
+        json_builder_set_member_name(builder, "preset");
+        json_builder_add_string_value(builder, cut->preset ? cut->preset : "");
+        json_builder_set_member_name(builder, "mode");
+        json_builder_add_string_value(builder, cut_mode_id(cut->mode));
+        json_builder_set_member_name(builder, "status");
+        json_builder_add_string_value(builder, job->status == JOB_STATUS_DONE ? "done" : (job->status == JOB_STATUS_CANCELLED ? "cancelled" : "failed"));
+        json_builder_set_member_name(builder, "queue_wait_s");
+        json_builder_add_double_value(builder, (gdouble)(telemetry->started_us - telemetry->queued_us) / G_USEC_PER_SEC);
+        json_builder_set_member_name(builder, "spawn_s");
+        json_builder_add_double_value(builder, result ? (gdouble)result->spawn_us / G_USEC_PER_SEC : 0.0);
+        json_builder_set_member_name(builder, "first_frame_s");
+        json_builder_add_double_value(builder, telemetry->first_frame_us ? (gdouble)(telemetry->first_frame_us - telemetry->started_us) / G_USEC_PER_SEC : 0.0);
+        json_builder_set_member_name(builder, "wall_s");
+        json_builder_add_double_value(builder, wall_s);
+        json_builder_set_member_name(builder, "verify_s");
+        json_builder_add_double_value(builder, telemetry->verified_us ? (gdouble)(telemetry->verified_us - finished_us) / G_USEC_PER_SEC : 0.0);
+        json_builder_set_member_name(builder, "frames");
+        json_builder_add_int_value(builder, telemetry->frames);
+        json_builder_set_member_name(builder, "avg_fps");
+        json_builder_add_double_value(builder, avg_fps);
+        json_builder_set_member_name(builder, "min_fps");
+        json_builder_add_double_value(builder, telemetry->min_fps);
+        json_builder_set_member_name(builder, "speed");
+        json_builder_add_double_value(builder, speed);
+        json_builder_set_member_name(builder, "input_bytes");
+        json_builder_add_int_value(builder, input_bytes);
+        json_builder_set_member_name(builder, "output_bytes");
+        json_builder_add_int_value(builder, output_bytes);
+        json_builder_set_member_name(builder, "peak_rss_kib");
+        json_builder_add_int_value(builder, result ? result->peak_rss_kib : 0);
+        json_builder_set_member_name(builder, "cpu_s");
+        json_builder_add_double_value(builder, result ? result->cpu_s : 0.0);
+        json_builder_end_object(builder);
+
+        JsonGenerator *generator = json_generator_new();
+        JsonNode *root = json_builder_get_root(builder);
+        json_generator_set_root(generator, root);
+        gchar *line = json_generator_to_data(generator, NULL);
+        telemetry_append_line(scheduler->telemetry_path, line);
+        g_free(line);
+        json_node_unref(root);
+        g_object_unref(generator);
+        g_object_unref(builder);
+        g_free(time_text);
+    }
+
+    TelemetryTotals *totals = g_hash_table_lookup(scheduler->telemetry_totals, cut->encoder->id);
+    if (!totals) {
+        totals = g_new0(TelemetryTotals, 1);
+        g_hash_table_insert(scheduler->telemetry_totals, (gpointer)cut->encoder->id, totals);
+    }
+    if (job->status == JOB_STATUS_DONE) {
+        totals->done++;
+        totals->media_s += media_s;
+        totals->last_fps = avg_fps;
+        totals->last_speed = speed;
+        totals->last_peak_rss_bytes = result ? (gdouble)result->peak_rss_kib * 1024.0 : 0.0;
+    } else if (job->status == JOB_STATUS_CANCELLED) {
+        totals->cancelled++;
+    } else {
+        totals->failed++;
+    }
+    totals->frames += (gdouble)telemetry->frames;
+    totals->wall_s += wall_s;
+    totals->cpu_s += result ? result->cpu_s : 0.0;
+    if (scheduler->prometheus_path) {
+        telemetry_write_prometheus(scheduler);
+    }
+}
+
+/* One short write per line keeps lines from concurrent processes whole in an O_APPEND file. */
+static void telemetry_append_line(const gchar *path, const gchar *line) {
+    gchar *dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0755);
+    g_free(dir);
+    FILE *file = g_fopen(path, "a");
+    if (!file) {
+        g_printerr("Cannot append to %s: %s\n", path, g_strerror(errno));
+        return;
+    }
+    gchar *text = g_strconcat(line, "\n", NULL);
+    fputs(text, file);
+    fclose(file);
+    g_free(text);
+}
+
+/*
+ * Rewrites the textfile for the node exporter's textfile collector. The file
+ * is replaced atomically, so the collector never reads half of it; the
+ * counters start over when this process does, which Prometheus treats as a
+ * counter reset.
+ */
+static void telemetry_write_prometheus(JobScheduler *scheduler) {
+    static const struct {
+        const gchar *name;
+        const gchar *type;
+        const gchar *help;
+        gsize offset;
+    } METRICS[] = {
+        { "fast_cut_frames_total", "counter", "Frames encoded by finished cuts.", G_STRUCT_OFFSET(TelemetryTotals, frames) },
+        { "fast_cut_wall_seconds_total", "counter", "Wall time of finished cuts from start to end.", G_STRUCT_OFFSET(TelemetryTotals, wall_s) },
+        { "fast_cut_media_seconds_total", "counter", "Seconds of video cut successfully.", G_STRUCT_OFFSET(TelemetryTotals, media_s) },
+        { "fast_cut_child_cpu_seconds_total", "counter", "CPU time used by the ffmpeg children.", G_STRUCT_OFFSET(TelemetryTotals, cpu_s) },
+        { "fast_cut_last_fps", "gauge", "Average encode fps of the last successful cut.", G_STRUCT_OFFSET(TelemetryTotals, last_fps) },
+        { "fast_cut_last_speed", "gauge", "Speed factor of the last successful cut.", G_STRUCT_OFFSET(TelemetryTotals, last_speed) },
+        { "fast_cut_last_peak_rss_bytes", "gauge", "Largest child's peak resident size in the last successful cut.", G_STRUCT_OFFSET(TelemetryTotals, last_peak_rss_bytes) },
+    };
+    GString *text = g_string_new("# HELP fast_cut_jobs_total Cuts finished by this process, by encoder and status.\n# TYPE fast_cut_jobs_total counter\n");
+    for (guint e = 0; e < G_N_ELEMENTS(ENCODER_BACKENDS); ++e) {
+        const TelemetryTotals *totals = g_hash_table_lookup(scheduler->telemetry_totals, ENCODER_BACKENDS[e].id);
+        if (totals) {
+            g_string_append_printf(text, "fast_cut_jobs_total{encoder=\"%s\",status=\"done\"} %u\n", ENCODER_BACKENDS[e].id, totals->done);
+            g_string_append_printf(text, "fast_cut_jobs_total{encoder=\"%s\",status=\"failed\"} %u\n", ENCODER_BACKENDS[e].id, totals->failed);
+            g_string_append_printf(text, "fast_cut_jobs_total{encoder=\"%s\",status=\"cancelled\"} %u\n", ENCODER_BACKENDS[e].id, totals->cancelled);
+        }
+    }
+    gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+    for (guint m = 0; m < G_N_ELEMENTS(METRICS); ++m) {
+        g_string_append_printf(text, "# HELP %s %s\n# TYPE %s %s\n", METRICS[m].name, METRICS[m].help, METRICS[m].name, METRICS[m].type);
+        for (guint e = 0; e < G_N_ELEMENTS(ENCODER_BACKENDS); ++e) {
+            TelemetryTotals *totals = g_hash_table_lookup(scheduler->telemetry_totals, ENCODER_BACKENDS[e].id);
+            if (totals) {
+                g_ascii_dtostr(number, sizeof(number), G_STRUCT_MEMBER(gdouble, totals, METRICS[m].offset));
+                g_string_append_printf(text, "%s{encoder=\"%s\"} %s\n", METRICS[m].name, ENCODER_BACKENDS[e].id, number);
+            }
+        }
+    }
+    GError *error = NULL;
+    if (!g_file_set_contents(scheduler->prometheus_path, text->str, (gssize)text->len, &error)) {
+        g_printerr("Cannot write %s: %s\n", scheduler->prometheus_path, error->message);
+        g_clear_error(&error);
+    }
+    g_string_free(text, TRUE);
+}
+
+/*
+ * Runs one cut on the calling thread. The auto preset is resolved first, so
+ * the rest of the cut sees a real one. A cut whose outputs are already in the
+ * output cache is copied from there instead of encoded, and a successful
+ * encode is added to it. A cut to a stream is never cached and is written as
+ * fragmented MP4 unless another streamable container was asked for.
+ */
+static FfmpegResult *run_cut_job(CutJob *job, GCancellable *cancellable, FfmpegLineFunc line_func, FfmpegProgressFunc progress_func, gpointer user_data, GError **error) {
+    CutStepContext step = { line_func, progress_func, user_data, 0, 0, 0, 0.0, &job->policy };
+    if (g_strcmp0(job->preset, PRESET_AUTO) == 0) {
+        gchar *preset = preset_tune(job, cancellable, &step);
+        g_free(job->preset);
+        job->preset = preset;
+    }
+    if (output_is_stream(job->output_path)) {
+        if (cut_job_range_count(job) > 1) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "%s carries a single range; give the other ranges file outputs", job->output_path);
+            return NULL;
+        }
+        if (g_strcmp0(job->output_path, OUTPUT_STDOUT) == 0 && output_stdout_fd < 0) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Only --output and --join can write to stdout");
+            return NULL;
+        }
+        if (job->format == OUTPUT_FORMAT_MP4) {
+            /* A plain MP4 needs a seekable output to write its index at the end. */
+            cut_step_log(&step, "Writing fragmented MP4 to %s.", job->output_path);
+            job->format = OUTPUT_FORMAT_FMP4;
+        }
+    }
+    gchar *cache_key = output_cache_key(job);
+    if (cache_key && output_cache_fetch(job, cache_key, &step)) {
+        g_free(cache_key);
+        return g_new0(FfmpegResult, 1);
+    }
+    FfmpegResult *result = run_cut_job_steps(job, cancellable, &step, error);
+    if (cache_key && result && result->exit_status == 0 && !result->cancelled) {
+        output_cache_store(job, cache_key, &step);
+    }
+    g_free(cache_key);
+    return cut_step_finish(&step, result);
+}
+
+/*
+ * Picks the slowest preset of the job's encoder that still encodes at
+ * preset_tune_speed times realtime. Each preset is tried on
+ * PRESET_TUNE_SAMPLES short samples spread over the range, fastest preset
+ * first, and the trials stop at the first preset that misses the target. The
+ * samples of a software encoder run in parallel and the speed is their total
+ * length over the wall time, which is the throughput a full cut gets from all
+ * cores; hardware samples run one at a time. The choice is kept per encoder,
+ * source codec and resolution, so later cuts skip the trials. On any failure
+ * the encoder's default preset is used.
+ */
+static gchar *preset_tune(const CutJob *job, GCancellable *cancellable, CutStepContext *step) {
+    const EncoderBackend *encoder = job->encoder;
+    const gchar *fallback = encoder->presets[encoder->default_preset];
+    gdouble start_s = (gdouble)time_string_to_seconds(job->start_time);
+    gdouble span_s = (gdouble)time_string_to_seconds(job->end_time) - start_s;
+    if (span_s < 1.0) {
+        cut_step_log(step, "Auto preset: the range is too short to sample; using %s.", fallback);
+        return g_strdup(fallback);
+    }
+    VideoStreamInfo info = { 0 };
+    GError *probe_error = NULL;
+    if (!probe_video_stream(job->input_path, cancellable, &info, &probe_error)) {
+        cut_step_log(step, "Auto preset: %s; using %s.", probe_error->message, fallback);
+        g_clear_error(&probe_error);
+        video_stream_info_clear(&info);
+        return g_strdup(fallback);
+    }
+    gchar speed[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_dtostr(speed, sizeof(speed), preset_tune_speed);
+    gchar *key = g_strdup_printf("%s %s %dx%d %sx", encoder->id, info.codec_name, info.width, info.height, speed);
+    video_stream_info_clear(&info);
+
+    g_mutex_lock(&preset_tune_lock);
+    if (!preset_tune_running) {
+        preset_tune_running = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    /* Another job is tuning the same kind of source; wait and reuse its result rather than tuning twice. */
+    while (g_hash_table_contains(preset_tune_running, key)) {
+        if (g_cancellable_is_cancelled(cancellable)) {
+            g_mutex_unlock(&preset_tune_lock);
+            g_free(key);
+            return g_strdup(fallback);
+        }
+        g_cond_wait_until(&preset_tune_cond, &preset_tune_lock, g_get_monotonic_time() + G_USEC_PER_SEC / 10);
+    }
+    gchar *chosen = preset_tune_lookup(key);
+    if (chosen) {
+        g_mutex_unlock(&preset_tune_lock);
+        cut_step_log(step, "Auto preset: %s, as tuned before for %s.", chosen, key);
+        g_free(key);
+        return chosen;
+    }
+    g_hash_table_add(preset_tune_running, g_strdup(key));
+    g_mutex_unlock(&preset_tune_lock);
+
+    GError *error = NULL;
+    gchar *work_dir = make_work_dir(job->output_path, &error);
+    if (!work_dir) {
+        cut_step_log(step, "Auto preset: %s; using %s.", error->message, fallback);
+        g_clear_error(&error);
+        chosen = g_strdup(fallback);
+        g_mutex_lock(&preset_tune_lock);
+        goto done;
+    }
+    guint samples = span_s >= PRESET_TUNE_SAMPLES * PRESET_TUNE_SAMPLE_SECONDS ? PRESET_TUNE_SAMPLES : 1;
+    gdouble sample_s = MIN(PRESET_TUNE_SAMPLE_SECONDS, span_s);
+    gdouble best_speed = 0.0;
+    gdouble best_kbps = 0.0;
+    for (guint i = 0; encoder->presets[i]; ++i) {
+        gdouble trial_speed = 0.0;
+        gdouble trial_kbps = 0.0;
+        if (!preset_tune_trial(job, encoder->presets[i], work_dir, start_s, span_s, sample_s, samples, cancellable, step, &trial_speed, &trial_kbps)) {
+            break;
+        }
+        cut_step_log(step, "Auto preset: %s runs at %.1fx realtime, %.0f kbit/s.", encoder->presets[i], trial_speed, trial_kbps);
+        if (chosen && trial_speed < preset_tune_speed) {
+            break;
+        }
+        g_free(chosen);
+        chosen = g_strdup(encoder->presets[i]);
+        best_speed = trial_speed;
+        best_kbps = trial_kbps;
+        if (trial_speed < preset_tune_speed) {
+            /* Even the fastest preset misses the target; it is still the best there is. */
+            break;
+        }
+    }
+    remove_work_dir(work_dir);
+    g_free(work_dir);
+    g_mutex_lock(&preset_tune_lock);
+    if (chosen && !g_cancellable_is_cancelled(cancellable)) {
+        preset_tune_store(key, chosen, best_speed, best_kbps);
+        cut_step_log(step, "Auto preset: picked %s for %s.", chosen, key);
+    } else {
+        g_free(chosen);
+        chosen = g_strdup(fallback);
+        cut_step_log(step, "Auto preset: the trials did not finish; using %s.", fallback);
+    }
+
+done:
+    g_hash_table_remove(preset_tune_running, key);
+    g_cond_broadcast(&preset_tune_cond);
+    g_mutex_unlock(&preset_tune_lock);
+    g_free(key);
+    return chosen;
+}
+
+/* Encodes the samples of one preset and reports their combined speed and bitrate. */
+static gboolean preset_tune_trial(const CutJob *job, const gchar *preset, const gchar *work_dir, gdouble from_s, gdouble span_s, gdouble sample_s, guint samples, GCancellable *cancellable, CutStepContext *step, gdouble *speed_out, gdouble *kbps_out) {
+    PresetTuneSample trials[PRESET_TUNE_SAMPLES] = { { 0 } };
+    GThread *threads[PRESET_TUNE_SAMPLES] = { 0 };
+    gchar *paths[PRESET_TUNE_SAMPLES] = { 0 };
+    gint64 started_us = g_get_monotonic_time();
+    for (guint k = 0; k < samples; ++k) {
+        gchar *name = g_strdup_printf("%s-%u.ts", preset, k);
+        paths[k] = g_build_filename(work_dir, name, NULL);
+        g_free(name);
+        /* Centred in equal slices of the range, so the samples see its start, middle and end. */
+        gdouble sample_from = from_s + (k + 0.5) * span_s / samples - sample_s / 2.0;
+        trials[k].argv = build_segment_argv(job->input_path, MAX(sample_from, from_s), sample_s, 0, FALSE, job->encoder, preset, NULL, NULL, job->policy.threads, paths[k]);
+        trials[k].policy = &job->policy;
+        trials[k].cancellable = cancellable;
+        if (job->encoder->hardware) {
+            preset_tune_sample_thread(&trials[k]);
+        } else {
+            threads[k] = g_thread_new("preset-tune", preset_tune_sample_thread, &trials[k]);
+        }
+    }
+    gboolean ok = TRUE;
+    gint64 bytes = 0;
+    for (guint k = 0; k < samples; ++k) {
+        if (threads[k]) {
+            g_thread_join(threads[k]);
+        }
+        GStatBuf st;
+        FfmpegResult *result = trials[k].result;
+        cut_step_account(step, result);
+        if (!result || result->exit_status != 0 || result->cancelled || g_stat(paths[k], &st) != 0) {
+            if (ok && !g_cancellable_is_cancelled(cancellable)) {
+                cut_step_log(step, "Auto preset: a sample encode with %s failed: %s", preset, trials[k].error ? trials[k].error->message : (result && result->stderr_tail ? result->stderr_tail : "no output"));
+            }
+            ok = FALSE;
+        } else {
+            bytes += (gint64)st.st_size;
+        }
+        ffmpeg_result_free(result);
+        g_clear_error(&trials[k].error);
+        free_argv(trials[k].argv);
+        g_remove(paths[k]);
+        g_free(paths[k]);
+    }
+    gdouble wall_s = (gdouble)(g_get_monotonic_time() - started_us) / G_USEC_PER_SEC;
+    *speed_out = wall_s > 0.0 ? samples * sample_s / wall_s : 0.0;
+    *kbps_out = (gdouble)bytes * 8.0 / 1000.0 / (samples * sample_s);
+    return ok;
+}
+
+static gpointer preset_tune_sample_thread(gpointer data) {
+    PresetTuneSample *sample = data;
+    sample->result = run_ffmpeg_process(sample->argv, sample->cancellable, sample->policy, NULL, NULL, NULL, &sample->error);
+    return NULL;
+}
+
+static gchar *preset_tune_results_path(void) {
+    return g_build_filename(g_get_user_cache_dir(), "fast_cut", "presets.json", NULL);
+}
+
+/* Returns the preset tuned before for key, or NULL. Call with preset_tune_lock held. */
+static gchar *preset_tune_lookup(const gchar *key) {
+    gchar *path = preset_tune_results_path();
+    JsonParser *parser = json_parser_new();
+    gchar *preset = NULL;
+    if (json_parser_load_from_file(parser, path, NULL)) {
+        JsonNode *root = json_parser_get_root(parser);
+        JsonObject *results = root && JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+        JsonObject *entry = results && json_object_has_member(results, key) ? json_object_get_object_member(results, key) : NULL;
+        const gchar *name = entry && json_object_has_member(entry, "preset") ? json_object_get_string_member(entry, "preset") : NULL;
+        if (name) {
+            preset = g_strdup(name);
+        }
+    }
+    g_object_unref(parser);
+    g_free(path);
+    return preset;
+}
+
+/* Adds or replaces the result for key in the results file. Call with preset_tune_lock held. */
+static void preset_tune_store(const gchar *key, const gchar *preset, gdouble speed, gdouble kbps) {
+    gchar *path = preset_tune_results_path();
+    JsonParser *parser = json_parser_new();
+    JsonNode *root = NULL;
+    if (json_parser_load_from_file(parser, path, NULL) && json_parser_get_root(parser) && JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+        root = json_node_copy(json_parser_get_root(parser));
+    } else {
+        root = json_node_init_object(json_node_alloc(), json_object_new());
+    }
+    g_object_unref(parser);
+
+    JsonObject *entry = json_object_new();
+    json_object_set_string_member(entry, "preset", preset);
+    json_object_set_double_member(entry, "speed", speed);
+    json_object_set_double_member(entry, "kbps", kbps);
+    json_object_set_int_member(entry, "tuned", g_get_real_time() / G_USEC_PER_SEC);
+    json_object_set_object_member(json_node_get_object(root), key, entry);
+
+    JsonGenerator *generator = json_generator_new();
+    json_generator_set_root(generator, root);
+    json_generator_set_pretty(generator, TRUE);
+    gsize length = 0;
+    gchar *contents = json_generator_to_data(generator, &length);
+    gchar *dir = g_path_get_dirname(path);
+    GError *error = NULL;
+    if (g_mkdir_with_parents(dir, 0755) != 0 || !g_file_set_contents(path, contents, (gssize)length, &error)) {
+        g_printerr("Cannot save the tuned preset to %s: %s\n", path, error ? error->message : g_strerror(errno));
+        g_clear_error(&error);
+    }
+    g_free(dir);
+    g_free(contents);
+    g_object_unref(generator);
+    json_node_unref(root);
+    g_free(path);
+}
+
+/* FAST_CUT_TUNE_SPEED overrides the realtime factor the auto preset aims for. */
+static gdouble preset_tune_default_speed(void) {
+    const gchar *speed = g_getenv("FAST_CUT_TUNE_SPEED");
+    gdouble value = speed && *speed ? g_ascii_strtod(speed, NULL) : 0.0;
+    return value > 0.0 ? value : PRESET_TUNE_DEFAULT_SPEED;
+}
+
+/* Smart, chunked, incremental or resumable when the mode asks for it and the source allows, otherwise one full re-encode. */
+static FfmpegResult *run_cut_job_steps(CutJob *job, GCancellable *cancellable, CutStepContext *step, GError **error) {
+    if (job->join_clips) {
+        return run_join_cut(job, cancellable, step, error);
+    }
+    gboolean multi_range = cut_job_range_count(job) > 1;
+    if (multi_range && job->mode != CUT_MODE_REENCODE) {
+        cut_step_log(step, "%s works on a single range; re-encoding all %u ranges in one pass instead.", cut_mode_label(job->mode), cut_job_range_count(job));
+    } else if (job->mode != CUT_MODE_REENCODE) {
+        gchar *fallback_reason = NULL;
+        FfmpegResult *result = NULL;
+        if (job->mode == CUT_MODE_SMART) {
+            result = run_smart_cut(job, cancellable, step, &fallback_reason, error);
+        } else if (job->mode == CUT_MODE_CHUNKED) {
+            result = run_chunked_cut(job, cancellable, step, &fallback_reason, error);
+        } else if (job->mode == CUT_MODE_RESUMABLE) {
+            result = run_resumable_cut(job, cancellable, step, &fallback_reason, error);
+        } else {
+            result = run_incremental_cut(job, cancellable, step, &fallback_reason, error);
+        }
+        if (!fallback_reason) {
+            return result;
+        }
+        cut_step_log(step, "%s unavailable: %s", cut_mode_label(job->mode), fallback_reason);
+        cut_step_log(step, "Falling back to re-encoding the whole range.");
+        g_free(fallback_reason);
+        if (g_cancellable_is_cancelled(cancellable)) {
+            result = g_new0(FfmpegResult, 1);
+            result->exit_status = -1;
+            result->cancelled = TRUE;
+            return result;
+        }
+    }
+
+    /* A resumable cut promises never to leave a partial file at the destination, even when it falls back. */
+    gboolean partial = job->mode == CUT_MODE_RESUMABLE && !output_is_stream(job->output_path);
+    guint count = cut_job_range_count(job);
+    gchar **output_paths = g_new0(gchar *, count + 1);
+    for (guint i = 0; i < count; ++i) {
+        output_paths[i] = partial ? resume_partial_path(cut_job_output_path(job, i)) : g_strdup(output_url(cut_job_output_path(job, i)));
+    }
+    FfmpegResult *result = NULL;
+    gboolean handled = FALSE;
+#ifdef FAST_CUT_LIBAV
+    /* The in-process cut writes plain MP4 files only. */
+    if (!multi_range && job->format == OUTPUT_FORMAT_MP4) {
+        gdouble start_s = (gdouble)time_string_to_seconds(job->start_time);
+        gdouble end_s = (gdouble)time_string_to_seconds(job->end_time);
+        handled = try_libav_cut(job->input_path, start_s, end_s, job->encoder, job->preset, TRUE, NULL, output_paths[0], cancellable, step, 0, &result, error);
+    }
+#endif
+    if (!handled) {
+        gchar **argv = multi_range ? build_multi_range_argv(job, output_paths) : build_ffmpeg_argv(job->input_path, job->start_time, job->end_time, job->encoder, job->preset, job->policy.threads, job->format, partial ? output_paths[0] : job->output_path);
+        if (!argv) {
+            g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "Unable to build ffmpeg command");
+            g_strfreev(output_paths);
+            return NULL;
+        }
+        result = run_cut_step(argv, cancellable, step, 0, error);
+        free_argv(argv);
+    }
+    if (partial) {
+        result = resume_commit_outputs(job, output_paths, result, error);
+    }
+    g_strfreev(output_paths);
+    return result;
+}
+
+/*
+ * Smart cut: only the partial GOPs before the first and after the last keyframe
+ * inside the range are re-encoded; everything between them is stream-copied.
+ * The video pieces are written as MPEG-TS so each keeps its parameter sets
+ * in-band, then joined with the concat demuxer while the audio is re-encoded
+ * straight from the source range. Returns NULL with *fallback_reason set when
+ * the source cannot be matched and the caller should re-encode instead.
+ */
+static FfmpegResult *run_smart_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error) {
+    gdouble start_s = (gdouble)time_string_to_seconds(job->start_time);
+    gdouble end_s = (gdouble)time_string_to_seconds(job->end_time);
+    if (end_s <= start_s) {
+        *fallback_reason = g_strdup("the end time is not after the start time");
+        return NULL;
+    }
+
+    VideoStreamInfo info = { 0 };
+    GError *probe_error = NULL;
+    if (!probe_video_stream(job->input_path, cancellable, &info, &probe_error)) {
+        *fallback_reason = g_strdup(probe_error->message);
+        g_clear_error(&probe_error);
+        video_stream_info_clear(&info);
+        return NULL;
+    }
+    const gchar *profile = NULL;
+    const gchar *pix_fmt = NULL;
+    gboolean matched = smart_cut_encoder_params(&info, job->encoder, &profile, &pix_fmt, fallback_reason);
+    video_stream_info_clear(&info);
+    if (!matched) {
+        return NULL;
+    }
+
+    GArray *keyframes = NULL;
+    if (!probe_packets(job->input_path, start_s, end_s, cancellable, &keyframes, NULL, &probe_error)) {
+        *fallback_reason = g_strdup(probe_error->message);
+        g_clear_error(&probe_error);
+        return NULL;
+    }
+    gdouble first_key = -1.0;
+    gdouble last_key = -1.0;
+    for (guint i = 0; i < keyframes->len; ++i) {
+        gdouble key = g_array_index(keyframes, gdouble, i);
+        if (first_key < 0.0 && key >= start_s - SMART_CUT_EPSILON_S) {
+            first_key = key;
+        }
+        if (key <= end_s + SMART_CUT_EPSILON_S) {
+            last_key = key;
+        }
+    }
+    g_array_unref(keyframes);
+    if (first_key < 0.0 || last_key <= first_key) {
+        *fallback_reason = g_strdup("the range does not contain a complete GOP");
+        return NULL;
+    }
+    first_key = MAX(first_key, start_s);
+    last_key = MIN(last_key, end_s);
+    cut_step_log(step, "Smart cut: copying %.3f s to %.3f s, re-encoding %.3f s at the edges.", first_key, last_key, (first_key - start_s) + (end_s - last_key));
+
+    gchar *work_dir = make_work_dir(job->output_path, error);
+    if (!work_dir) {
+        return NULL;
+    }
+
+    GPtrArray *segment_names = g_ptr_array_new_with_free_func(g_free);
+    FfmpegResult *result = NULL;
+    for (guint piece = 0; piece < 3; ++piece) {
+        gdouble from_s = piece == 0 ? start_s : (piece == 1 ? first_key : last_key);
+        gdouble to_s = piece == 0 ? first_key : (piece == 1 ? last_key : end_s);
+        if (to_s - from_s < SMART_CUT_EPSILON_S) {
+            continue;
+        }
+        gchar *name = g_strdup_printf("segment%u.ts", piece);
+        gchar *segment_path = g_build_filename(work_dir, name, NULL);
+        gint64 offset_us = (gint64)((from_s - start_s) * G_USEC_PER_SEC);
+        g_ptr_array_add(segment_names, name);
+
+        ffmpeg_result_free(result);
+        result = NULL;
+        gboolean handled = FALSE;
+#ifdef FAST_CUT_LIBAV
+        /* The copied piece is pure packet passing, which needs no child process. */
+        handled = piece == 1 && try_libav_cut(job->input_path, from_s, to_s, NULL, NULL, FALSE, "mpegts", segment_path, cancellable, step, offset_us, &result, error);
+#endif
+        if (!handled) {
+            /* The middle piece starts and ends on keyframes, so it is copied as-is. */
+            gchar **argv = build_segment_argv(job->input_path, from_s, to_s - from_s, 0, piece == 1, job->encoder, job->preset, profile, pix_fmt, job->policy.threads, segment_path);
+            result = run_cut_step(argv, cancellable, step, offset_us, error);
+            free_argv(argv);
+        }
+        g_free(segment_path);
+        if (!result || result->exit_status != 0 || result->cancelled) {
+            goto cleanup;
+        }
+    }
+
+    gchar *list_path = g_build_filename(work_dir, "segments.txt", NULL);
+    if (write_concat_list(list_path, segment_names, error)) {
+        gchar **argv = build_concat_argv(list_path, job, job->output_path);
+        ffmpeg_result_free(result);
+        result = run_cut_step(argv, cancellable, step, 0, error);
+        free_argv(argv);
+    } else {
+        g_clear_pointer(&result, ffmpeg_result_free);
+    }
+    g_free(list_path);
+
+cleanup:
+    g_ptr_array_free(segment_names, TRUE);
+    remove_work_dir(work_dir);
+    g_free(work_dir);
+    return result;
+}
+
+/*
+ * Chunked encode: the range is split at keyframes into sub-ranges that are
+ * encoded by parallel ffmpeg children and joined with the concat demuxer.
+ * Every chunk is given an exact frame count taken from the packet list, so the
+ * chunks tile the range without duplicated or dropped frames at the seams.
+ */
+static FfmpegResult *run_chunked_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error) {
+    gdouble start_s = (gdouble)time_string_to_seconds(job->start_time);
+    gdouble end_s = (gdouble)time_string_to_seconds(job->end_time);
+    if (end_s <= start_s) {
+        *fallback_reason = g_strdup("the end time is not after the start time");
+        return NULL;
+    }
+    if (job->encoder->hardware) {
+        /* Extra sessions on one GPU share the same encoder engine. */
+        *fallback_reason = g_strdup_printf("%s is a hardware encoder; chunking only speeds up software encoders", job->encoder->encoder);
+        return NULL;
+    }
+
+    GArray *keyframes = NULL;
+    GArray *frames = NULL;
+    GError *probe_error = NULL;
+    if (!probe_packets(job->input_path, start_s, end_s, cancellable, &keyframes, &frames, &probe_error)) {
+        *fallback_reason = g_strdup(probe_error->message);
+        g_clear_error(&probe_error);
+        return NULL;
+    }
+    guint parallelism = MAX(1, resource_policy_cpu_count(&job->policy) / chunk_threads(job));
+    GArray *bounds = plan_chunk_boundaries(keyframes, start_s, end_s, parallelism);
+    g_array_unref(keyframes);
+    if (bounds->len < 3) {
+        *fallback_reason = g_strdup("the range has too few keyframes to split");
+        g_array_unref(bounds);
+        g_array_unref(frames);
+        return NULL;
+    }
+
+    gchar *work_dir = make_work_dir(job->output_path, error);
+    if (!work_dir) {
+        g_array_unref(bounds);
+        g_array_unref(frames);
+        return NULL;
+    }
+
+    ChunkedEncode encode = { 0 };
+    encode.job = job;
+    encode.step = step;
+    encode.cancellable = g_cancellable_new();
+    encode.chunks = g_ptr_array_new_with_free_func((GDestroyNotify)chunk_task_free);
+    g_mutex_init(&encode.lock);
+    GPtrArray *segment_names = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i + 1 < bounds->len; ++i) {
+        gdouble from_s = g_array_index(bounds, gdouble, i);
+        gdouble to_s = g_array_index(bounds, gdouble, i + 1);
+        gint64 frame_count = count_frames(frames, from_s, to_s);
+        if (frame_count <= 0) {
+            continue;
+        }
+        ChunkTask *chunk = g_new0(ChunkTask, 1);
+        chunk->encode = &encode;
+        chunk->index = i;
+        chunk->from_s = from_s;
+        chunk->duration_s = to_s - from_s;
+        chunk->frame_count = frame_count;
+        gchar *name = g_strdup_printf("chunk%03u.ts", i);
+        chunk->output_path = g_build_filename(work_dir, name, NULL);
+        g_ptr_array_add(segment_names, name);
+        g_ptr_array_add(encode.chunks, chunk);
+    }
+    g_array_unref(bounds);
+    g_array_unref(frames);
+    cut_step_log(step, "Chunked encode: %u chunks on up to %u parallel ffmpeg processes.", encode.chunks->len, parallelism);
+
+    gboolean chunks_ok = FALSE;
+    FfmpegResult *result = run_chunk_pool(&encode, parallelism, cancellable, &chunks_ok, error);
+
+    if (chunks_ok) {
+        gchar *list_path = g_build_filename(work_dir, "segments.txt", NULL);
+        if (write_concat_list(list_path, segment_names, error)) {
+            gchar **argv = build_concat_argv(list_path, job, job->output_path);
+            result = run_cut_step(argv, cancellable, step, 0, error);
+            free_argv(argv);
+        }
+        g_free(list_path);
+    }
+
+    g_ptr_array_free(segment_names, TRUE);
+    g_ptr_array_free(encode.chunks, TRUE);
+    g_mutex_clear(&encode.lock);
+    g_object_unref(encode.cancellable);
+    remove_work_dir(work_dir);
+    g_free(work_dir);
+    return result;
+}
+
+/*
+ * Encodes every chunk of the encode on up to parallelism children. Sets
+ * *chunks_ok when all of them succeeded; otherwise returns the result or sets
+ * the error that ends the cut.
+ */
+static FfmpegResult *run_chunk_pool(ChunkedEncode *encode, guint parallelism, GCancellable *cancellable, gboolean *chunks_ok, GError **error) {
+    gulong parent_handler = 0;
+    if (cancellable) {
+        parent_handler = g_cancellable_connect(cancellable, G_CALLBACK(on_chunk_parent_cancelled), g_object_ref(encode->cancellable), g_object_unref);
+    }
+    encode->step->offset_us = 0;
+    GThreadPool *pool = g_thread_pool_new(chunk_task_run, encode, (gint)parallelism, FALSE, NULL);
+    for (guint i = 0; i < encode->chunks->len; ++i) {
+        g_thread_pool_push(pool, g_ptr_array_index(encode->chunks, i), NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+    if (parent_handler) {
+        g_cancellable_disconnect(cancellable, parent_handler);
+    }
+
+    FfmpegResult *result = NULL;
+    *chunks_ok = TRUE;
+    for (guint i = 0; i < encode->chunks->len; ++i) {
+        cut_step_account(encode->step, ((ChunkTask *)g_ptr_array_index(encode->chunks, i))->result);
+    }
+    encode->step->peak_rss_kib = MAX(encode->step->peak_rss_kib, chunk_pool_peak_rss_kib(encode));
+    for (guint i = 0; i < encode->chunks->len; ++i) {
+        ChunkTask *chunk = g_ptr_array_index(encode->chunks, i);
+        if (chunk->error) {
+            g_propagate_error(error, chunk->error);
+            chunk->error = NULL;
+            *chunks_ok = FALSE;
+            break;
+        }
+        if (chunk->result && chunk->result->exit_status != 0 && !chunk->result->cancelled) {
+            result = chunk->result;
+            chunk->result = NULL;
+            *chunks_ok = FALSE;
+            break;
+        }
+        if (!chunk->result || chunk->result->cancelled) {
+            *chunks_ok = FALSE;
+        }
+    }
+    if (!*chunks_ok && !result && !(error && *error)) {
+        result = g_new0(FfmpegResult, 1);
+        result->exit_status = -1;
+        result->cancelled = TRUE;
+    }
+    return result;
+}
+
+/*
+ * The chunks run side by side, so the memory the cut needs is the sum of the
+ * peaks of the chunks that overlapped in time, not the largest single peak.
+ * The most memory is in use just as some chunk starts, so only those moments
+ * are checked.
+ */
+static gint64 chunk_pool_peak_rss_kib(ChunkedEncode *encode) {
+    gint64 peak = 0;
+    for (guint i = 0; i < encode->chunks->len; ++i) {
+        const ChunkTask *chunk = g_ptr_array_index(encode->chunks, i);
+        if (!chunk->result) {
+            continue;
+        }
+        gint64 total = 0;
+        for (guint j = 0; j < encode->chunks->len; ++j) {
+            const ChunkTask *other = g_ptr_array_index(encode->chunks, j);
+            if (other->result && other->started_us <= chunk->started_us && other->finished_us >= chunk->started_us) {
+                total += other->result->peak_rss_kib;
+            }
+        }
+        peak = MAX(peak, total);
+    }
+    return peak;
+}
+
+/*
+ * Incremental encode: the range is encoded as pieces that end on the first
+ * keyframe after every multiple of SEGMENT_GRID_SECONDS of the source, so the
+ * pieces inside the range stay the same when only its ends move. The pieces
+ * are kept in a store per input and encoder settings and named after their
+ * source times; a re-cut encodes only the pieces it does not find there,
+ * usually the two at the changed ends, and joins all of them with a
+ * stream-copy concat. Changed encoder settings discard the store.
+ */
+static FfmpegResult *run_incremental_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error) {
+    gdouble start_s = (gdouble)time_string_to_seconds(job->start_time);
+    gdouble end_s = (gdouble)time_string_to_seconds(job->end_time);
+    if (end_s <= start_s) {
+        *fallback_reason = g_strdup("the end time is not after the start time");
+        return NULL;
+    }
+    GArray *keyframes = NULL;
+    GArray *frames = NULL;
+    GError *probe_error = NULL;
+    if (!probe_packets(job->input_path, start_s, end_s, cancellable, &keyframes, &frames, &probe_error)) {
+        *fallback_reason = g_strdup(probe_error->message);
+        g_clear_error(&probe_error);
+        return NULL;
+    }
+    gchar *input_dir = NULL;
+    gchar *store_dir = segment_store_dir(job, &input_dir);
+    if (!store_dir) {
+        *fallback_reason = g_strdup("the input cannot be fingerprinted");
+        g_array_unref(keyframes);
+        g_array_unref(frames);
+        return NULL;
+    }
+    GArray *bounds = plan_segment_boundaries(keyframes, start_s, end_s, SEGMENT_GRID_SECONDS);
+    g_array_unref(keyframes);
+
+    if (!segment_store_acquire(store_dir, cancellable, error)) {
+        g_array_unref(bounds);
+        g_array_unref(frames);
+        g_free(store_dir);
+        g_free(input_dir);
+        return NULL;
+    }
+    g_mutex_lock(&segment_store_lock);
+    if (g_mkdir_with_parents(store_dir, 0755) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to create the segment store %s: %s", store_dir, g_strerror(saved_errno));
+        g_mutex_unlock(&segment_store_lock);
+        segment_store_release(store_dir);
+        g_array_unref(bounds);
+        g_array_unref(frames);
+        g_free(store_dir);
+        g_free(input_dir);
+        return NULL;
+    }
+    segment_store_prepare(input_dir, store_dir, step);
+    g_mutex_unlock(&segment_store_lock);
+
+    ChunkedEncode encode = { 0 };
+    encode.job = job;
+    encode.step = step;
+    encode.cancellable = g_cancellable_new();
+    encode.chunks = g_ptr_array_new_with_free_func((GDestroyNotify)chunk_task_free);
+    g_mutex_init(&encode.lock);
+    GPtrArray *segment_names = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i + 1 < bounds->len; ++i) {
+        gdouble from_s = g_array_index(bounds, gdouble, i);
+        gdouble to_s = g_array_index(bounds, gdouble, i + 1);
+        gint64 frame_count = count_frames(frames, from_s, to_s);
+        if (frame_count <= 0) {
+            continue;
+        }
+        /* Source times in milliseconds name the piece, so the same piece of a later cut finds it. */
+        gchar *name = g_strdup_printf("%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT ".ts", (gint64)(from_s * 1000.0 + 0.5), (gint64)(to_s * 1000.0 + 0.5));
+        gchar *path = g_build_filename(store_dir, name, NULL);
+        g_ptr_array_add(segment_names, name);
+        if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+            g_free(path);
+            continue;
+        }
+        ChunkTask *chunk = g_new0(ChunkTask, 1);
+        chunk->encode = &encode;
+        chunk->index = i;
+        chunk->from_s = from_s;
+        chunk->duration_s = to_s - from_s;
+        chunk->frame_count = frame_count;
+        /* Written under a temporary name so an interrupted encode is never reused. */
+        chunk->output_path = g_strconcat(path, ".part", NULL);
+        g_ptr_array_add(encode.chunks, chunk);
+        g_free(path);
+    }
+    g_array_unref(bounds);
+    g_array_unref(frames);
+
+    /* A GPU runs one session per piece at a time; software pieces run side by side like chunks. */
+    guint parallelism = job->encoder->hardware ? 1 : MAX(1, resource_policy_cpu_count(&job->policy) / chunk_threads(job));
+    cut_step_log(step, "Incremental encode: reusing %u of %u pieces, encoding %u.", segment_names->len - encode.chunks->len, segment_names->len, encode.chunks->len);
+    gboolean chunks_ok = TRUE;
+    FfmpegResult *result = encode.chunks->len > 0 ? run_chunk_pool(&encode, parallelism, cancellable, &chunks_ok, error) : NULL;
+    for (guint i = 0; i < encode.chunks->len; ++i) {
+        ChunkTask *chunk = g_ptr_array_index(encode.chunks, i);
+        gchar *path = g_strndup(chunk->output_path, strlen(chunk->output_path) - strlen(".part"));
+        if (!chunks_ok || g_rename(chunk->output_path, path) != 0) {
+            g_remove(chunk->output_path);
+        }
+        g_free(path);
+    }
+
+    if (chunks_ok) {
+        g_mutex_lock(&segment_store_lock);
+        segment_store_prune(store_dir, segment_names);
+        g_mutex_unlock(&segment_store_lock);
+        gchar *list_path = g_build_filename(store_dir, "segments.txt", NULL);
+        if (write_concat_list(list_path, segment_names, error)) {
+            gchar **argv = build_concat_argv(list_path, job, job->output_path);
+            result = run_cut_step(argv, cancellable, step, 0, error);
+            free_argv(argv);
+        }
+        g_free(list_path);
+    }
+    segment_store_release(store_dir);
+
+    g_ptr_array_free(segment_names, TRUE);
+    g_ptr_array_free(encode.chunks, TRUE);
+    g_mutex_clear(&encode.lock);
+    g_object_unref(encode.cancellable);
+    g_free(store_dir);
+    g_free(input_dir);
+    return result;
+}
+
+/*
+ * Resumable encode: the range is encoded one piece at a time into a folder
+ * next to the output, with pieces ending on the first keyframe after every
+ * RESUME_SEGMENT_SECONDS of the source. Each finished piece is synced and
+ * recorded in a journal in that folder, so a cut of the same job after a
+ * crash or reboot skips the recorded pieces and starts at the first missing
+ * one. The pieces are joined with a stream-copy concat into a file in the
+ * folder, which is then renamed over the output; the output path never holds
+ * a partial file. The folder is removed only once the output is in place.
+ */
+static FfmpegResult *run_resumable_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error) {
+    gdouble start_s = (gdouble)time_string_to_seconds(job->start_time);
+    gdouble end_s = (gdouble)time_string_to_seconds(job->end_time);
+    if (end_s <= start_s) {
+        *fallback_reason = g_strdup("the end time is not after the start time");
+        return NULL;
+    }
+    if (output_is_stream(job->output_path)) {
+        *fallback_reason = g_strdup("a stream cannot be resumed");
+        return NULL;
+    }
+    gchar *key = resume_journal_key(job);
+    if (!key) {
+        *fallback_reason = g_strdup("the input cannot be fingerprinted");
+        return NULL;
+    }
+    GArray *keyframes = NULL;
+    GArray *frames = NULL;
+    GError *probe_error = NULL;
+    if (!probe_packets(job->input_path, start_s, end_s, cancellable, &keyframes, &frames, &probe_error)) {
+        *fallback_reason = g_strdup(probe_error->message);
+        g_clear_error(&probe_error);
+        g_free(key);
+        return NULL;
+    }
+    GArray *bounds = plan_segment_boundaries(keyframes, start_s, end_s, RESUME_SEGMENT_SECONDS);
+    g_array_unref(keyframes);
+
+    FfmpegResult *result = NULL;
+    gchar *resume_dir = resume_dir_path(job->output_path);
+    gchar *journal_path = g_build_filename(resume_dir, "journal.jsonl", NULL);
+    GHashTable *done = resume_journal_load(journal_path, key);
+    if (!done) {
+        if (g_file_test(resume_dir, G_FILE_TEST_IS_DIR)) {
+            cut_step_log(step, "Discarding the pieces of an interrupted encode of another job to %s.", job->output_path);
+            remove_work_dir(resume_dir);
+        }
+        done = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+    GPtrArray *segment_names = g_ptr_array_new_with_free_func(g_free);
+    if (g_mkdir_with_parents(resume_dir, 0755) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to create %s: %s", resume_dir, g_strerror(saved_errno));
+        goto cleanup;
+    }
+    if (g_hash_table_size(done) == 0) {
+        JsonObject *header = json_object_new();
+        json_object_set_int_member(header, "version", RESUME_JOURNAL_VERSION);
+        json_object_set_string_member(header, "key", key);
+        gboolean written = g_remove(journal_path) == 0 || errno == ENOENT;
+        written = written && resume_journal_append(journal_path, header, error);
+        json_object_unref(header);
+        if (!written) {
+            goto cleanup;
+        }
+    }
+
+    guint reused = 0;
+    for (guint i = 0; i + 1 < bounds->len; ++i) {
+        gdouble from_s = g_array_index(bounds, gdouble, i);
+        gdouble to_s = g_array_index(bounds, gdouble, i + 1);
+        gint64 frame_count = count_frames(frames, from_s, to_s);
+        if (frame_count <= 0) {
+            continue;
+        }
+        gchar *name = g_strdup_printf("%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT ".ts", (gint64)(from_s * 1000.0 + 0.5), (gint64)(to_s * 1000.0 + 0.5));
+        gchar *path = g_build_filename(resume_dir, name, NULL);
+        g_ptr_array_add(segment_names, name);
+        /* A piece counts only if the journal has it and the file still has the recorded size. */
+        const gint64 *recorded = g_hash_table_lookup(done, name);
+        GStatBuf st;
+        if (recorded && g_stat(path, &st) == 0 && (gint64)st.st_size == *recorded) {
+            ++reused;
+            g_free(path);
+            continue;
+        }
+        gchar *part_path = g_strconcat(path, ".part", NULL);
+        gchar **argv = build_segment_argv(job->input_path, from_s - FRAME_EPSILON_S, to_s - from_s, frame_count, FALSE, job->encoder, job->preset, NULL, NULL, job->policy.threads, part_path);
+        ffmpeg_result_free(result);
+        result = run_cut_step(argv, cancellable, step, (gint64)((from_s - start_s) * G_USEC_PER_SEC), error);
+        free_argv(argv);
+        gboolean ok = result && result->exit_status == 0 && !result->cancelled;
+        if (ok) {
+            sync_file(part_path);
+            ok = g_rename(part_path, path) == 0 && g_stat(path, &st) == 0;
+            if (!ok) {
+                int saved_errno = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to keep the piece %s: %s", path, g_strerror(saved_errno));
+                g_clear_pointer(&result, ffmpeg_result_free);
+            }
+        }
+        if (ok) {
+            JsonObject *record = json_object_new();
+            json_object_set_string_member(record, "piece", name);
+            json_object_set_int_member(record, "bytes", (gint64)st.st_size);
+            ok = resume_journal_append(journal_path, record, error);
+            json_object_unref(record);
+            if (!ok) {
+                g_clear_pointer(&result, ffmpeg_result_free);
+            }
+        } else {
+            g_remove(part_path);
+        }
+        g_free(part_path);
+        g_free(path);
+        if (!ok) {
+            cut_step_log(step, "Resumable encode stopped; %s keeps the finished pieces for the next attempt.", resume_dir);
+            goto cleanup;
+        }
+    }
+    if (reused > 0) {
+        cut_step_log(step, "Resumable encode: resumed with %u of %u pieces already done.", reused, segment_names->len);
+    }
+
+    gchar *list_path = g_build_filename(resume_dir, "segments.txt", NULL);
+    gchar *output_name = g_strdup_printf("output%s", path_extension(job->output_path));
+    gchar *joined_path = g_build_filename(resume_dir, output_name, NULL);
+    g_free(output_name);
+    if (write_concat_list(list_path, segment_names, error)) {
+        gchar **argv = build_concat_argv(list_path, job, joined_path);
+        ffmpeg_result_free(result);
+        result = run_cut_step(argv, cancellable, step, 0, error);
+        free_argv(argv);
+        if (result && result->exit_status == 0 && !result->cancelled) {
+            sync_file(joined_path);
+            if (g_rename(joined_path, job->output_path) == 0) {
+                remove_work_dir(resume_dir);
+            } else {
+                int saved_errno = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to move the joined output to %s: %s", job->output_path, g_strerror(saved_errno));
+                g_clear_pointer(&result, ffmpeg_result_free);
+            }
+        }
+    } else {
+        g_clear_pointer(&result, ffmpeg_result_free);
+    }
+    g_free(joined_path);
+    g_free(list_path);
+
+cleanup:
+    g_ptr_array_free(segment_names, TRUE);
+    g_hash_table_unref(done);
+    g_array_unref(bounds);
+    g_array_unref(frames);
+    g_free(journal_path);
+    g_free(resume_dir);
+    g_free(key);
+    return result;
+}
+
+/* Hidden and named after the output, so the next cut to the same output finds it. */
+static gchar *resume_dir_path(const gchar *output_path) {
+    gchar *output_dir = g_path_get_dirname(output_path);
+    gchar *output_name = g_path_get_basename(output_path);
+    gchar *name = g_strdup_printf(".%s.fast_cut-resume", output_name);
+    gchar *path = g_build_filename(output_dir, name, NULL);
+    g_free(name);
+    g_free(output_name);
+    g_free(output_dir);
+    return path;
+}
+
+/* Where a resumable cut writes an output it does not build from pieces: a one-pass fallback or a cache hit. The extension is kept for ffmpeg. */
+static gchar *resume_partial_path(const gchar *output_path) {
+    gchar *output_dir = g_path_get_dirname(output_path);
+    gchar *output_name = g_path_get_basename(output_path);
+    gchar *name = g_strdup_printf(".%s.fast_cut-part%s", output_name, path_extension(output_path));
+    gchar *path = g_build_filename(output_dir, name, NULL);
+    g_free(name);
+    g_free(output_name);
+    g_free(output_dir);
+    return path;
+}
+
+/*
+ * Renames the outputs of a successful one-pass fallback over the job's outputs
+ * after syncing them, and removes whatever is left of the partial files.
+ */
+static FfmpegResult *resume_commit_outputs(const CutJob *job, gchar **partial_paths, FfmpegResult *result, GError **error) {
+    gboolean ok = result && result->exit_status == 0 && !result->cancelled;
+    for (guint i = 0; ok && partial_paths[i]; ++i) {
+        sync_file(partial_paths[i]);
+        if (g_rename(partial_paths[i], cut_job_output_path(job, i)) != 0) {
+            int saved_errno = errno;
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to move the output to %s: %s", cut_job_output_path(job, i), g_strerror(saved_errno));
+            g_clear_pointer(&result, ffmpeg_result_free);
+            ok = FALSE;
+        }
+    }
+    for (guint i = 0; partial_paths[i]; ++i) {
+        g_remove(partial_paths[i]);
+    }
+    return result;
+}
+
+/*
+ * What the pieces depend on: the input's fingerprint, the range and the
+ * encoder arguments. A journal with another key belongs to a different job
+ * and its pieces are not reused. NULL when the input cannot be read.
+ */
+static gchar *resume_journal_key(const CutJob *job) {
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    if (!output_cache_fingerprint(job->input_path, checksum)) {
+        g_checksum_free(checksum);
+        return NULL;
+    }
+    GPtrArray *args = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(args, g_strdup_printf("resume %d", RESUME_JOURNAL_VERSION));
+    g_ptr_array_add(args, g_strdup_printf("%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT, time_string_to_seconds(job->start_time), time_string_to_seconds(job->end_time)));
+    job->encoder->append_args(job->encoder, args, job->preset, job->policy.threads);
+    for (guint i = 0; i < args->len; ++i) {
+        const gchar *arg = g_ptr_array_index(args, i);
+        g_checksum_update(checksum, (const guchar *)arg, (gssize)strlen(arg) + 1);
+    }
+    g_ptr_array_unref(args);
+    gchar *key = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+    return key;
+}
+
+/*
+ * Reads the journal: a header line with the version and key, then one line
+ * per finished piece. Returns the recorded sizes by piece name, or NULL when
+ * there is no journal or it belongs to another job. A line cut short by a
+ * crash fails to parse and ends the list.
+ */
+static GHashTable *resume_journal_load(const gchar *journal_path, const gchar *key) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(journal_path, &contents, NULL, NULL)) {
+        return NULL;
+    }
+    GHashTable *done = NULL;
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    JsonParser *parser = json_parser_new();
+    for (guint i = 0; lines[i] && *lines[i]; ++i) {
+        if (!json_parser_load_from_data(parser, lines[i], -1, NULL) || !JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+            break;
+        }
+        JsonObject *record = json_node_get_object(json_parser_get_root(parser));
+        if (i == 0) {
+            if (json_object_get_int_member_with_default(record, "version", 0) != RESUME_JOURNAL_VERSION || g_strcmp0(json_object_get_string_member_with_default(record, "key", NULL), key) != 0) {
+                break;
+            }
+            done = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+            continue;
+        }
+        const gchar *piece = json_object_get_string_member_with_default(record, "piece", NULL);
+        if (piece) {
+            gint64 *bytes = g_new(gint64, 1);
+            *bytes = json_object_get_int_member_with_default(record, "bytes", -1);
+            g_hash_table_replace(done, g_strdup(piece), bytes);
+        }
+    }
+    g_object_unref(parser);
+    g_strfreev(lines);
+    g_free(contents);
+    return done;
+}
+
+/* Appends one line and syncs it, so a recorded piece survives a power loss. */
+static gboolean resume_journal_append(const gchar *journal_path, JsonObject *record, GError **error) {
+    JsonNode *node = json_node_init_object(json_node_alloc(), record);
+    gchar *line = json_to_string(node, FALSE);
+    json_node_unref(node);
+    FILE *file = g_fopen(journal_path, "a");
+    gboolean ok = file && fprintf(file, "%s\n", line) > 0 && fflush(file) == 0;
+#ifdef G_OS_UNIX
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    int saved_errno = errno;
+    if (file && fclose(file) != 0) {
+        ok = FALSE;
+    }
+    if (!ok) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to write the journal %s: %s", journal_path, g_strerror(saved_errno));
+    }
+    g_free(line);
+    return ok;
+}
+
+/* Flushes a file ffmpeg wrote to disk before it is renamed into place. */
+static void sync_file(const gchar *path) {
+#ifdef G_OS_UNIX
+    int fd = g_open(path, O_RDONLY, 0);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+/*
+ * Join: the clips are checked against the first one's video parameters
+ * (codec, resolution, pixel format and profile) and its first audio stream
+ * (codec, sample rate and channel layout). When every clip matches and
+ * every range starts on a keyframe, one concat demuxer pass copies them all
+ * straight from their sources. Otherwise each clip is first written as an
+ * MPEG-TS piece, copied where it matches and re-encoded to the first clip's
+ * parameters where it does not, with the audio of every piece made AAC so the
+ * pieces line up, and the pieces are then copied into the output.
+ */
+static FfmpegResult *run_join_cut(CutJob *job, GCancellable *cancellable, CutStepContext *step, GError **error) {
+    GPtrArray *clips = job->join_clips;
+    VideoStreamInfo *infos = g_new0(VideoStreamInfo, clips->len);
+    AudioStreamInfo *audio_infos = g_new0(AudioStreamInfo, clips->len);
+    gboolean *copy = g_new0(gboolean, clips->len);
+    gboolean all_copy = TRUE;
+    FfmpegResult *result = NULL;
+    for (guint i = 0; i < clips->len; ++i) {
+        JoinClip *clip = g_ptr_array_index(clips, i);
+        if (!probe_video_stream(clip->input_path, cancellable, &infos[i], error) || !probe_audio_stream(clip->input_path, cancellable, &audio_infos[i], error)) {
+            goto cleanup;
+        }
+        gchar *audio_reason = join_audio_mismatch(&audio_infos[0], &audio_infos[i]);
+        if (audio_reason) {
+            /* The pieces make every clip's audio AAC, so the video can still be copied. */
+            cut_step_log(step, "Join: clip %u (%s) cannot be joined in one pass because %s.", i + 1, clip->input_path, audio_reason);
+            all_copy = FALSE;
+            g_free(audio_reason);
+        }
+        gchar *reason = join_clip_mismatch(&infos[0], &infos[i]);
+        if (!reason && clip->start_time) {
+            gdouble start_s = (gdouble)time_string_to_seconds(clip->start_time);
+            GArray *keyframes = NULL;
+            if (!probe_packets(clip->input_path, start_s, start_s, cancellable, &keyframes, NULL, error)) {
+                goto cleanup;
+            }
+            if (keyframes->len == 0) {
+                reason = g_strdup_printf("it starts between keyframes at %s", clip->start_time);
+            }
+            g_array_unref(keyframes);
+        }
+        copy[i] = reason == NULL;
+        all_copy = all_copy && copy[i];
+        if (reason) {
+            cut_step_log(step, "Join: clip %u (%s) is re-encoded because %s.", i + 1, clip->input_path, reason);
+            g_free(reason);
+        }
+    }
+
+    if (all_copy) {
+        cut_step_log(step, "Join: all %u clips match; copying them in one pass.", clips->len);
+        gchar *work_dir = make_work_dir(job->output_path, error);
+        if (!work_dir) {
+            goto cleanup;
+        }
+        gchar *list_path = g_build_filename(work_dir, "join.txt", NULL);
+        if (write_join_list(list_path, clips, error)) {
+            gchar **argv = build_join_argv(list_path, job);
+            result = run_cut_step(argv, cancellable, step, 0, error);
+            free_argv(argv);
+        }
+        g_free(list_path);
+        remove_work_dir(work_dir);
+        g_free(work_dir);
+        goto cleanup;
+    }
+
+    const gchar *profile = NULL;
+    const gchar *pix_fmt = NULL;
+    gchar *reason = NULL;
+    if (!smart_cut_encoder_params(&infos[0], job->encoder, &profile, &pix_fmt, &reason)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Cannot re-encode clips to match the first one: %s", reason);
+        g_free(reason);
+        goto cleanup;
+    }
+    gchar *work_dir = make_work_dir(job->output_path, error);
+    if (!work_dir) {
+        goto cleanup;
+    }
+    GPtrArray *piece_names = g_ptr_array_new_with_free_func(g_free);
+    gint64 offset_us = 0;
+    for (guint i = 0; i < clips->len; ++i) {
+        JoinClip *clip = g_ptr_array_index(clips, i);
+        gchar *name = g_strdup_printf("piece%u.ts", i);
+        gchar *piece_path = g_build_filename(work_dir, name, NULL);
+        g_ptr_array_add(piece_names, name);
+        gchar **argv = build_join_piece_argv(clip, copy[i], job->encoder, job->preset, profile, pix_fmt, &infos[0], job->policy.threads, piece_path);
+        ffmpeg_result_free(result);
+        result = run_cut_step(argv, cancellable, step, offset_us, error);
+        free_argv(argv);
+        g_free(piece_path);
+        offset_us += (gint64)(join_clip_seconds(clip) * G_USEC_PER_SEC);
+        if (!result || result->exit_status != 0 || result->cancelled) {
+            goto pieces_done;
+        }
+    }
+    gchar *list_path = g_build_filename(work_dir, "pieces.txt", NULL);
+    if (write_concat_list(list_path, piece_names, error)) {
+        gchar **argv = build_join_argv(list_path, job);
+        ffmpeg_result_free(result);
+        result = run_cut_step(argv, cancellable, step, 0, error);
+        free_argv(argv);
+    } else {
+        g_clear_pointer(&result, ffmpeg_result_free);
+    }
+    g_free(list_path);
+
+pieces_done:
+    g_ptr_array_free(piece_names, TRUE);
+    remove_work_dir(work_dir);
+    g_free(work_dir);
+cleanup:
+    for (guint i = 0; i < clips->len; ++i) {
+        video_stream_info_clear(&infos[i]);
+        audio_stream_info_clear(&audio_infos[i]);
+    }
+    g_free(infos);
+    g_free(audio_infos);
+    g_free(copy);
+    return result;
+}
+
+/*
+ * Returns why a clip cannot be stream-copied next to the reference, or NULL.
+ * The time base is not compared: the concat demuxer rescales every file's
+ * timestamps, and the MPEG-TS pieces all use 90 kHz.
+ */
+static gchar *join_clip_mismatch(const VideoStreamInfo *reference, const VideoStreamInfo *info) {
+    if (g_strcmp0(reference->codec_name, info->codec_name) != 0) {
+        return g_strdup_printf("its codec is %s, not %s", info->codec_name, reference->codec_name);
+    }
+    if (reference->width != info->width || reference->height != info->height) {
+        return g_strdup_printf("it is %dx%d, not %dx%d", info->width, info->height, reference->width, reference->height);
+    }
+    if (g_strcmp0(reference->pix_fmt, info->pix_fmt) != 0) {
+        return g_strdup_printf("its pixel format is %s, not %s", info->pix_fmt ? info->pix_fmt : "(unknown)", reference->pix_fmt ? reference->pix_fmt : "(unknown)");
+    }
+    if (g_strcmp0(reference->profile, info->profile) != 0) {
+        return g_strdup_printf("its profile is %s, not %s", info->profile ? info->profile : "(unknown)", reference->profile ? reference->profile : "(unknown)");
+    }
+    return NULL;
+}
+
+/*
+ * The single-pass join copies the audio too, so clips whose first audio
+ * streams differ, or where only some have one, cannot share it.
+ */
+static gchar *join_audio_mismatch(const AudioStreamInfo *reference, const AudioStreamInfo *info) {
+    if (!reference->codec_name != !info->codec_name) {
+        return g_strdup(info->codec_name ? "it has an audio stream and the first clip has none" : "it has no audio stream and the first clip has one");
+    }
+    if (!reference->codec_name) {
+        return NULL;
+    }
+    if (g_strcmp0(reference->codec_name, info->codec_name) != 0) {
+        return g_strdup_printf("its audio codec is %s, not %s", info->codec_name, reference->codec_name);
+    }
+    if (reference->sample_rate != info->sample_rate) {
+        return g_strdup_printf("its audio is %d Hz, not %d Hz", info->sample_rate, reference->sample_rate);
+    }
+    if (reference->channels != info->channels || g_strcmp0(reference->channel_layout, info->channel_layout) != 0) {
+        return g_strdup_printf("its audio has %d channels (%s), not %d (%s)", info->channels, info->channel_layout ? info->channel_layout : "unknown layout", reference->channels, reference->channel_layout ? reference->channel_layout : "unknown layout");
+    }
+    return NULL;
+}
+
+/* A whole-file clip takes its length from the probe index, and counts 0 until it is indexed. */
+static gdouble join_clip_seconds(const JoinClip *clip) {
+    if (clip->start_time) {
+        return (gdouble)(time_string_to_seconds(clip->end_time) - time_string_to_seconds(clip->start_time));
+    }
+    const ProbeIndex *index = probe_index_lookup(clip->input_path, FALSE, NULL, NULL);
+    return index ? index->header->duration_s : 0.0;
+}
+
+/*
+ * Splits the range at the first keyframe after every grid point of the
+ * source timeline. The split points depend on the source alone, never on
+ * where the range starts or ends.
+ */
+static GArray *plan_segment_boundaries(GArray *keyframes, gdouble start_s, gdouble end_s, gdouble grid_s) {
+    GArray *bounds = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    g_array_append_val(bounds, start_s);
+    gdouble last = start_s;
+    for (gdouble grid = (gint64)(start_s / grid_s + 1) * grid_s; grid < end_s; grid += grid_s) {
+        for (guint k = 0; k < keyframes->len; ++k) {
+            gdouble key = g_array_index(keyframes, gdouble, k);
+            if (key >= grid) {
+                if (key > last + FRAME_EPSILON_S && key < end_s - FRAME_EPSILON_S) {
+                    g_array_append_val(bounds, key);
+                    last = key;
+                }
+                break;
+            }
+        }
+    }
+    g_array_append_val(bounds, end_s);
+    return bounds;
+}
+
+/*
+ * Store of one input under one set of encoder settings:
+ * <cache>/fast_cut/segments/<input fingerprint>/<settings hash>. The settings
+ * hash covers the encoder arguments the pieces are made with. NULL when the
+ * input cannot be read.
+ */
+static gchar *segment_store_dir(const CutJob *job, gchar **input_dir_out) {
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    if (!output_cache_fingerprint(job->input_path, checksum)) {
+        g_checksum_free(checksum);
+        return NULL;
+    }
+    gchar *input_dir = g_build_filename(g_get_user_cache_dir(), "fast_cut", "segments", g_checksum_get_string(checksum), NULL);
+    g_checksum_free(checksum);
+
+    GPtrArray *args = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(args, g_strdup_printf("segments %d", SEGMENT_STORE_VERSION));
+    job->encoder->append_args(job->encoder, args, job->preset, chunk_threads(job));
+    checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    for (guint i = 0; i < args->len; ++i) {
+        const gchar *arg = g_ptr_array_index(args, i);
+        g_checksum_update(checksum, (const guchar *)arg, (gssize)strlen(arg) + 1);
+    }
+    g_ptr_array_unref(args);
+    gchar *store_dir = g_build_filename(input_dir, g_checksum_get_string(checksum), NULL);
+    g_checksum_free(checksum);
+    *input_dir_out = input_dir;
+    return store_dir;
+}
+
+/*
+ * Drops the stores of this input made with other encoder settings, since
+ * their pieces cannot be joined with new ones, and all but the
+ * SEGMENT_STORE_INPUTS most recently cut inputs. Stores another job is
+ * cutting from are left alone. Call with segment_store_lock held.
+ */
+static void segment_store_prepare(const gchar *input_dir, const gchar *store_dir, CutStepContext *step) {
+    GDir *dir = g_dir_open(input_dir, 0, NULL);
+    if (dir) {
+        const gchar *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            gchar *path = g_build_filename(input_dir, name, NULL);
+            if (strcmp(path, store_dir) != 0 && !segment_store_in_use(path)) {
+                cut_step_log(step, "Encoder settings changed; discarding the pieces of the previous encode.");
+                remove_work_dir(path);
+            }
+            g_free(path);
+        }
+        g_dir_close(dir);
+    }
+    /* The input folder's mtime records when it was last cut. */
+    g_utime(input_dir, NULL);
+
+    gchar *root = g_path_get_dirname(input_dir);
+    dir = g_dir_open(root, 0, NULL);
+    if (dir) {
+        GPtrArray *inputs = g_ptr_array_new_with_free_func((GDestroyNotify)output_cache_entry_free);
+        const gchar *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            OutputCacheEntry *entry = g_new0(OutputCacheEntry, 1);
+            entry->path = g_build_filename(root, name, NULL);
+            GStatBuf st;
+            entry->last_used = g_stat(entry->path, &st) == 0 ? (gint64)st.st_mtime : 0;
+            g_ptr_array_add(inputs, entry);
+        }
+        g_dir_close(dir);
+        g_ptr_array_sort(inputs, compare_output_cache_entries);
+        for (guint i = 0; i + SEGMENT_STORE_INPUTS < inputs->len; ++i) {
+            OutputCacheEntry *entry = g_ptr_array_index(inputs, i);
+            if (strcmp(entry->path, input_dir) != 0 && !segment_store_in_use(entry->path)) {
+                remove_segment_input_dir(entry->path);
+            }
+        }
+        g_ptr_array_unref(inputs);
+    }
+    g_free(root);
+}
+
+/* Keeps only the pieces of the latest cut, so the store holds one encode per input. Call with segment_store_lock held. */
+static void segment_store_prune(const gchar *store_dir, GPtrArray *keep) {
+    GDir *dir = g_dir_open(store_dir, 0, NULL);
+    if (!dir) {
+        return;
+    }
+    const gchar *name = NULL;
+    while ((name = g_dir_read_name(dir))) {
+        gboolean kept = FALSE;
+        for (guint i = 0; !kept && i < keep->len; ++i) {
+            kept = strcmp(name, g_ptr_array_index(keep, i)) == 0;
+        }
+        if (!kept) {
+            gchar *path = g_build_filename(store_dir, name, NULL);
+            g_remove(path);
+            g_free(path);
+        }
+    }
+    g_dir_close(dir);
+}
+
+/*
+ * Marks the store as in use, first waiting for a job already cutting from it.
+ * The wait wakes up every 100 ms to notice a cancelled job.
+ */
+static gboolean segment_store_acquire(const gchar *store_dir, GCancellable *cancellable, GError **error) {
+    g_mutex_lock(&segment_store_lock);
+    if (!segment_store_busy) {
+        segment_store_busy = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    while (g_hash_table_contains(segment_store_busy, store_dir)) {
+        if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            g_mutex_unlock(&segment_store_lock);
+            return FALSE;
+        }
+        g_cond_wait_until(&segment_store_cond, &segment_store_lock, g_get_monotonic_time() + G_USEC_PER_SEC / 10);
+    }
+    g_hash_table_add(segment_store_busy, g_strdup(store_dir));
+    g_mutex_unlock(&segment_store_lock);
+    return TRUE;
+}
+
+static void segment_store_release(const gchar *store_dir) {
+    g_mutex_lock(&segment_store_lock);
+    g_hash_table_remove(segment_store_busy, store_dir);
+    g_cond_broadcast(&segment_store_cond);
+    g_mutex_unlock(&segment_store_lock);
+}
+
+/* Whether path is a store in use or a folder holding one. Call with segment_store_lock held. */
+static gboolean segment_store_in_use(const gchar *path) {
+    gsize length = strlen(path);
+    GHashTableIter iter;
+    gpointer key = NULL;
+    g_hash_table_iter_init(&iter, segment_store_busy);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const gchar *busy = key;
+        if (strncmp(busy, path, length) == 0 && (busy[length] == '\0' || G_IS_DIR_SEPARATOR(busy[length]))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void remove_segment_input_dir(const gchar *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            gchar *child = g_build_filename(path, name, NULL);
+            remove_work_dir(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+/* Picks the first keyframe after each evenly spaced split point. */
+static GArray *plan_chunk_boundaries(GArray *keyframes, gdouble start_s, gdouble end_s, guint chunk_count) {
+    GArray *bounds = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    g_array_append_val(bounds, start_s);
+    gdouble last = start_s;
+    for (guint i = 1; i < chunk_count; ++i) {
+        gdouble target = start_s + (end_s - start_s) * i / chunk_count;
+        for (guint k = 0; k < keyframes->len; ++k) {
+            gdouble key = g_array_index(keyframes, gdouble, k);
+            if (key >= target && key - last >= CHUNK_MIN_SECONDS && end_s - key >= CHUNK_MIN_SECONDS) {
+                g_array_append_val(bounds, key);
+                last = key;
+                break;
+            }
+        }
+    }
+    g_array_append_val(bounds, end_s);
+    return bounds;
+}
+
+/* Counts frames in [from, to) the same way ffmpeg selects them after -ss. */
+static gint64 count_frames(GArray *frames, gdouble from_s, gdouble to_s) {
+    gint64 count = 0;
+    for (guint i = 0; i < frames->len; ++i) {
+        gdouble pts = g_array_index(frames, gdouble, i);
+        if (pts >= from_s - FRAME_EPSILON_S && pts < to_s - FRAME_EPSILON_S) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void chunk_task_run(gpointer data, gpointer user_data) {
+    ChunkTask *chunk = data;
+    ChunkedEncode *encode = user_data;
+    if (g_cancellable_is_cancelled(encode->cancellable)) {
+        return;
+    }
+    gchar **argv = build_segment_argv(encode->job->input_path, chunk->from_s - FRAME_EPSILON_S, chunk->duration_s, chunk->frame_count, FALSE, encode->job->encoder, encode->job->preset, NULL, NULL, chunk_threads(encode->job), chunk->output_path);
+    gchar *command_line = format_command_for_log(argv);
+    cut_step_log(encode->step, "[chunk %u] %s", chunk->index, command_line);
+    g_free(command_line);
+    chunk->started_us = g_get_monotonic_time();
+    chunk->result = run_ffmpeg_process(argv, encode->cancellable, &encode->job->policy, chunk_task_line, chunk_task_progress, chunk, &chunk->error);
+    chunk->finished_us = g_get_monotonic_time();
+    free_argv(argv);
+    if (chunk->error || (chunk->result && chunk->result->exit_status != 0)) {
+        /* One failed chunk fails the cut; stop the others early. */
+        g_cancellable_cancel(encode->cancellable);
+    }
+}
+
+static void chunk_task_line(const gchar *line, gpointer user_data) {
+    ChunkTask *chunk = user_data;
+    cut_step_log(chunk->encode->step, "[chunk %u] %s", chunk->index, line);
+}
+
+/* Reports the sum over all chunks so the job shows one overall position. */
+static void chunk_task_progress(const FfmpegProgress *progress, gpointer user_data) {
+    ChunkTask *chunk = user_data;
+    ChunkedEncode *encode = chunk->encode;
+    FfmpegProgress total = { 0 };
+    g_mutex_lock(&encode->lock);
+    chunk->progress = *progress;
+    for (guint i = 0; i < encode->chunks->len; ++i) {
+        const FfmpegProgress *part = &((ChunkTask *)g_ptr_array_index(encode->chunks, i))->progress;
+        total.frame += part->frame;
+        total.fps += part->fps;
+        total.speed += part->ended ? 0.0 : part->speed;
+        total.out_time_us += part->out_time_us;
+        total.bitrate_kbps = MAX(total.bitrate_kbps, part->bitrate_kbps);
+    }
+    cut_step_progress(&total, encode->step);
+    g_mutex_unlock(&encode->lock);
+}
+
+static void chunk_task_free(ChunkTask *chunk) {
+    if (!chunk) {
+        return;
+    }
+    g_free(chunk->output_path);
+    ffmpeg_result_free(chunk->result);
+    g_clear_error(&chunk->error);
+    g_free(chunk);
+}
+
+static void on_chunk_parent_cancelled(GCancellable *cancellable, gpointer user_data) {
+    g_cancellable_cancel(G_CANCELLABLE(user_data));
+}
+
+#ifdef FAST_CUT_LIBAV
+static GQuark libav_error_quark(void) {
+    return g_quark_from_static_string("fast-cut-libav-error-quark");
+}
+
+static void libav_set_error(GError **error, int code, const gchar *what) {
+    gchar message[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+    av_strerror(code, message, sizeof(message));
+    g_set_error(error, libav_error_quark(), code, "%s: %s", what, message);
+}
+
+/* Same message as libav_set_error, for a failure the executable may not share. */
+static gchar *libav_fallback_reason(int code, const gchar *what) {
+    gchar message[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+    av_strerror(code, message, sizeof(message));
+    return g_strdup_printf("%s: %s", what, message);
+}
+
+/*
+ * Runs the in-process engine and reports whether it took the cut. FALSE means
+ * it declined (the reason is logged) and the caller should spawn ffmpeg.
+ */
+static gboolean try_libav_cut(const gchar *input_path, gdouble from_s, gdouble to_s, const EncoderBackend *encoder, const gchar *preset, gboolean keep_audio, const gchar *format_name, const gchar *output_path, GCancellable *cancellable, CutStepContext *step, gint64 offset_us, FfmpegResult **result_out, GError **error) {
+    const ResourcePolicy *policy = step->policy;
+    if (policy && (policy->nice_level != 0 || policy->io_class != IO_CLASS_DEFAULT || policy->cpus)) {
+        /* These are set on a child as it starts; the engine would run at the app's own priority on every CPU. */
+        cut_step_log(step, "In-process engine skipped: the nice level, I/O class and CPU list only apply to ffmpeg children; running the ffmpeg executable instead.");
+        return FALSE;
+    }
+    gchar *fallback_reason = NULL;
+    step->offset_us = offset_us;
+    *result_out = run_libav_cut(input_path, from_s, to_s, encoder, preset, keep_audio, format_name, output_path, cancellable, step, &fallback_reason, error);
+    if (!fallback_reason) {
+        return TRUE;
+    }
+    cut_step_log(step, "In-process engine unavailable: %s; running the ffmpeg executable instead.", fallback_reason);
+    g_free(fallback_reason);
+    return FALSE;
+}
+
+/*
+ * Cuts [from_s, to_s) of the input inside this process. With an encoder the
+ * video is decoded, trimmed to the exact frames and re-encoded; without one
+ * the packets from the keyframe at from_s are handed to the muxer as they
+ * are. Audio, if kept, is always stream-copied. Seeking follows the ffmpeg
+ * executable, so times count from the start of the file. Returns NULL with
+ * *fallback_reason set when the cut needs something only the executable
+ * does, such as re-encoding audio for the target container.
+ */
+static FfmpegResult *run_libav_cut(const gchar *input_path, gdouble from_s, gdouble to_s, const EncoderBackend *encoder, const gchar *preset, gboolean keep_audio, const gchar *format_name, const gchar *output_path, GCancellable *cancellable, CutStepContext *step, gchar **fallback_reason, GError **error) {
+    LibavCut cut = { 0 };
+    cut.step = step;
+    cut.video_index = -1;
+    cut.audio_index = -1;
+    FfmpegResult *result = NULL;
+    AVPacket *packet = NULL;
+    AVFrame *frame = NULL;
+    int ret = avformat_open_input(&cut.input, input_path, NULL, NULL);
+    if (ret < 0) {
+        libav_set_error(error, ret, "Cannot open the input");
+        goto cleanup;
+    }
+    ret = avformat_find_stream_info(cut.input, NULL);
+    if (ret < 0) {
+        libav_set_error(error, ret, "Cannot read the input streams");
+        goto cleanup;
+    }
+    cut.video_index = av_find_best_stream(cut.input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (cut.video_index < 0) {
+        *fallback_reason = g_strdup("the input has no video stream");
+        goto cleanup;
+    }
+    if (keep_audio) {
+        cut.audio_index = av_find_best_stream(cut.input, AVMEDIA_TYPE_AUDIO, -1, cut.video_index, NULL, 0);
+        cut.audio_index = MAX(cut.audio_index, -1);
+    }
+
+    ret = avformat_alloc_output_context2(&cut.output, NULL, format_name, output_path);
+    if (ret < 0) {
+        libav_set_error(error, ret, "Cannot choose an output format");
+        goto cleanup;
+    }
+    AVStream *video_in = cut.input->streams[cut.video_index];
+    if (cut.audio_index >= 0) {
+        AVCodecParameters *audio_par = cut.input->streams[cut.audio_index]->codecpar;
+        if (avformat_query_codec(cut.output->oformat, audio_par->codec_id, FF_COMPLIANCE_NORMAL) != 1) {
+            *fallback_reason = g_strdup_printf("%s audio cannot be copied into %s", avcodec_get_name(audio_par->codec_id), cut.output->oformat->name);
+            goto cleanup;
+        }
+    }
+
+    if (encoder) {
+        const AVCodec *decoder_codec = avcodec_find_decoder(video_in->codecpar->codec_id);
+        const AVCodec *encoder_codec = avcodec_find_encoder_by_name(encoder->encoder);
+        if (!decoder_codec) {
+            *fallback_reason = g_strdup_printf("the linked libavcodec cannot decode %s", avcodec_get_name(video_in->codecpar->codec_id));
+            goto cleanup;
+        }
+        if (!encoder_codec) {
+            *fallback_reason = g_strdup_printf("the linked libavcodec has no %s encoder", encoder->encoder);
+            goto cleanup;
+        }
+        cut.decoder = avcodec_alloc_context3(decoder_codec);
+        ret = cut.decoder ? avcodec_parameters_to_context(cut.decoder, video_in->codecpar) : AVERROR(ENOMEM);
+        if (ret < 0) {
+            *fallback_reason = libav_fallback_reason(ret, "cannot set up the video decoder");
+            goto cleanup;
+        }
+        cut.decoder->pkt_timebase = video_in->time_base;
+        /* The thread cap covers the whole cut here, since decoding shares the process with encoding. */
+        cut.decoder->thread_count = step->policy ? (int)step->policy->threads : 0;
+        ret = avcodec_open2(cut.decoder, decoder_codec, NULL);
+        if (ret < 0) {
+            libav_set_error(error, ret, "Cannot open the video decoder");
+            goto cleanup;
+        }
+
+        cut.encoder = avcodec_alloc_context3(encoder_codec);
+        if (!cut.encoder) {
+            *fallback_reason = g_strdup("cannot allocate the video encoder");
+            goto cleanup;
+        }
+        cut.encoder->width = cut.decoder->width;
+        cut.encoder->height = cut.decoder->height;
+        cut.encoder->sample_aspect_ratio = cut.decoder->sample_aspect_ratio;
+        cut.encoder->pix_fmt = libav_pick_pix_fmt(encoder_codec, cut.decoder->pix_fmt);
+        cut.encoder->color_range = cut.decoder->color_range;
+        cut.encoder->color_primaries = cut.decoder->color_primaries;
+        cut.encoder->color_trc = cut.decoder->color_trc;
+        cut.encoder->colorspace = cut.decoder->colorspace;
+        cut.encoder->time_base = video_in->time_base;
+        cut.encoder->framerate = av_guess_frame_rate(cut.input, video_in, NULL);
+        cut.encoder->thread_count = cut.decoder->thread_count;
+        if (cut.output->oformat->flags & AVFMT_GLOBALHEADER) {
+            cut.encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        /* The backend's command-line options map one to one onto encoder options. */
+        AVDictionary *options = NULL;
+        av_dict_set(&options, encoder->preset_option + 1, preset, 0);
+        for (guint i = 0; encoder->rate_control[i] && encoder->rate_control[i + 1]; i += 2) {
+            av_dict_set(&options, encoder->rate_control[i] + 1, encoder->rate_control[i + 1], 0);
+        }
+        ret = avcodec_open2(cut.encoder, encoder_codec, &options);
+        av_dict_free(&options);
+        if (ret < 0) {
+            libav_set_error(error, ret, "Cannot open the video encoder");
+            goto cleanup;
+        }
+        cut.video_out = avformat_new_stream(cut.output, NULL);
+        ret = cut.video_out ? avcodec_parameters_from_context(cut.video_out->codecpar, cut.encoder) : AVERROR(ENOMEM);
+        if (ret < 0) {
+            *fallback_reason = libav_fallback_reason(ret, "cannot add the video stream to the output");
+            goto cleanup;
+        }
+        cut.video_out->time_base = cut.encoder->time_base;
+        cut.video_out->avg_frame_rate = cut.encoder->framerate;
+    } else {
+        cut.video_out = avformat_new_stream(cut.output, NULL);
+        ret = cut.video_out ? avcodec_parameters_copy(cut.video_out->codecpar, video_in->codecpar) : AVERROR(ENOMEM);
+        if (ret < 0) {
+            *fallback_reason = libav_fallback_reason(ret, "cannot add the video stream to the output");
+            goto cleanup;
+        }
+        cut.video_out->codecpar->codec_tag = 0;
+        cut.video_out->time_base = video_in->time_base;
+    }
+    if (cut.audio_index >= 0) {
+        AVStream *audio_in = cut.input->streams[cut.audio_index];
+        cut.audio_out = avformat_new_stream(cut.output, NULL);
+        ret = cut.audio_out ? avcodec_parameters_copy(cut.audio_out->codecpar, audio_in->codecpar) : AVERROR(ENOMEM);
+        if (ret < 0) {
+            *fallback_reason = libav_fallback_reason(ret, "cannot add the audio stream to the output");
+            goto cleanup;
+        }
+        cut.audio_out->codecpar->codec_tag = 0;
+        cut.audio_out->time_base = audio_in->time_base;
+    }
+
+    if (!(cut.output->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&cut.output->pb, output_path, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            libav_set_error(error, ret, "Cannot create the output file");
+            goto cleanup;
+        }
+    }
+    cut.output->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+    ret = avformat_write_header(cut.output, NULL);
+    if (ret < 0) {
+        libav_set_error(error, ret, "Cannot write the output header");
+        goto cleanup;
+    }
+
+    gint64 origin = cut.input->start_time != AV_NOPTS_VALUE ? cut.input->start_time : 0;
+    gint64 from_ts = origin + (gint64)(from_s * AV_TIME_BASE);
+    gint64 to_ts = origin + (gint64)(to_s * AV_TIME_BASE);
+    ret = avformat_seek_file(cut.input, -1, INT64_MIN, from_ts, from_ts, 0);
+    if (ret < 0) {
+        libav_set_error(error, ret, "Cannot seek in the input");
+        goto cleanup;
+    }
+    cut.video_start = av_rescale_q(from_ts, AV_TIME_BASE_Q, video_in->time_base);
+    cut.video_end = av_rescale_q(to_ts, AV_TIME_BASE_Q, video_in->time_base);
+    cut.video_tolerance = av_rescale_q((gint64)(SMART_CUT_EPSILON_S * AV_TIME_BASE), AV_TIME_BASE_Q, video_in->time_base);
+    if (cut.audio_index >= 0) {
+        AVRational audio_base = cut.input->streams[cut.audio_index]->time_base;
+        cut.audio_start = av_rescale_q(from_ts, AV_TIME_BASE_Q, audio_base);
+        cut.audio_end = av_rescale_q(to_ts, AV_TIME_BASE_Q, audio_base);
+    }
+    cut_step_log(step, "In-process %s of %s, %.3f s to %.3f s.", encoder ? "re-encode" : "stream copy", input_path, from_s, to_s);
+
+    packet = av_packet_alloc();
+    frame = av_frame_alloc();
+    cut.started_us = g_get_monotonic_time();
+    gboolean audio_done = cut.audio_index < 0;
+    while (!(cut.video_done && audio_done)) {
+        if (g_cancellable_is_cancelled(cancellable)) {
+            result = g_new0(FfmpegResult, 1);
+            result->exit_status = -1;
+            result->cancelled = TRUE;
+            goto cleanup;
+        }
+        ret = av_read_frame(cut.input, packet);
+        if (ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            libav_set_error(error, ret, "Cannot read the input");
+            goto cleanup;
+        }
+        if (packet->stream_index == cut.video_index && !cut.video_done) {
+            ret = encoder ? libav_decode_packet(&cut, packet, frame) : libav_copy_video_packet(&cut, packet);
+        } else if (packet->stream_index == cut.audio_index && !audio_done) {
+            ret = libav_copy_audio_packet(&cut, packet, &audio_done);
+        }
+        av_packet_unref(packet);
+        if (ret < 0) {
+            libav_set_error(error, ret, "Cannot cut the video");
+            goto cleanup;
+        }
+    }
+
+    if (encoder) {
+        /* Drain the decoder unless the range ended early, then the encoder. */
+        ret = cut.video_done ? 0 : libav_decode_packet(&cut, NULL, frame);
+        if (ret >= 0) {
+            ret = libav_filter_frame(&cut, NULL);
+        }
+        if (ret < 0) {
+            libav_set_error(error, ret, "Cannot flush the video encoder");
+            goto cleanup;
+        }
+    }
+    ret = av_write_trailer(cut.output);
+    if (ret < 0) {
+        libav_set_error(error, ret, "Cannot finish the output");
+        goto cleanup;
+    }
+    libav_report_progress(&cut, TRUE);
+    result = g_new0(FfmpegResult, 1);
+
+cleanup:
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    libav_cut_clear(&cut);
+    return result;
+}
+
+/* Prefers the source format, otherwise the closest software format the encoder takes. */
+static enum AVPixelFormat libav_pick_pix_fmt(const AVCodec *codec, enum AVPixelFormat source) {
+    const enum AVPixelFormat *formats = NULL;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+    avcodec_get_supported_config(NULL, codec, AV_CODEC_CONFIG_PIX_FORMAT, 0, (const void **)&formats, NULL);
+#else
+    formats = codec->pix_fmts;
+#endif
+    if (!formats) {
+        return source;
+    }
+    GArray *software = g_array_new(FALSE, FALSE, sizeof(enum AVPixelFormat));
+    for (guint i = 0; formats[i] != AV_PIX_FMT_NONE; ++i) {
+        if (formats[i] == source) {
+            g_array_unref(software);
+            return source;
+        }
+        const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(formats[i]);
+        if (descriptor && !(descriptor->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            g_array_append_val(software, formats[i]);
+        }
+    }
+    enum AVPixelFormat none = AV_PIX_FMT_NONE;
+    g_array_append_val(software, none);
+    enum AVPixelFormat best = avcodec_find_best_pix_fmt_of_list((const enum AVPixelFormat *)(void *)software->data, source, 0, NULL);
+    g_array_unref(software);
+    return best;
+}
+
+/* Sends one packet (NULL to drain) and passes the frames inside the range on. */
+static int libav_decode_packet(LibavCut *cut, const AVPacket *packet, AVFrame *frame) {
+    int ret = avcodec_send_packet(cut->decoder, packet);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        return ret;
+    }
+    while (!cut->video_done) {
+        ret = avcodec_receive_frame(cut->decoder, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return 0;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        gint64 pts = frame->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE && pts >= cut->video_end) {
+            cut->video_done = TRUE;
+        } else if (pts != AV_NOPTS_VALUE && pts >= cut->video_start) {
+            frame->pts = pts - cut->video_start;
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            ret = libav_filter_frame(cut, frame);
+        } else {
+            ret = 0;
+        }
+        av_frame_unref(frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Converts the frame to the encoder's pixel format if needed and encodes it;
+ * NULL flushes. The format filter graph is built from the first frame.
+ */
+static int libav_filter_frame(LibavCut *cut, AVFrame *frame) {
+    if (frame && !cut->graph && frame->format != cut->encoder->pix_fmt) {
+        int ret = libav_build_format_graph(cut, frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (!cut->graph) {
+        return libav_encode_frame(cut, frame);
+    }
+    int ret = av_buffersrc_add_frame_flags(cut->buffersrc, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (ret < 0) {
+        return ret;
+    }
+    AVFrame *converted = av_frame_alloc();
+    while ((ret = av_buffersink_get_frame(cut->buffersink, converted)) >= 0) {
+        ret = libav_encode_frame(cut, converted);
+        av_frame_unref(converted);
+        if (ret < 0) {
+            break;
+        }
+    }
+    av_frame_free(&converted);
+    if (ret == AVERROR(EAGAIN)) {
+        return 0;
+    }
+    if (ret == AVERROR_EOF) {
+        return libav_encode_frame(cut, NULL);
+    }
+    return ret;
+}
+
+static int libav_build_format_graph(LibavCut *cut, const AVFrame *frame) {
+    AVRational time_base = cut->encoder->time_base;
+    AVRational aspect = frame->sample_aspect_ratio.num ? frame->sample_aspect_ratio : (AVRational){ 1, 1 };
+    gchar *source_args = g_strdup_printf("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d", frame->width, frame->height, frame->format, time_base.num, time_base.den, aspect.num, aspect.den);
+    gchar *format_args = g_strdup_printf("pix_fmts=%s", av_get_pix_fmt_name(cut->encoder->pix_fmt));
+    AVFilterContext *format = NULL;
+    cut->graph = avfilter_graph_alloc();
+    int ret = avfilter_graph_create_filter(&cut->buffersrc, avfilter_get_by_name("buffer"), "in", source_args, NULL, cut->graph);
+    if (ret >= 0) {
+        ret = avfilter_graph_create_filter(&format, avfilter_get_by_name("format"), "format", format_args, NULL, cut->graph);
+    }
+    if (ret >= 0) {
+        ret = avfilter_graph_create_filter(&cut->buffersink, avfilter_get_by_name("buffersink"), "out", NULL, NULL, cut->graph);
+    }
+    if (ret >= 0) {
+        ret = avfilter_link(cut->buffersrc, 0, format, 0);
+    }
+    if (ret >= 0) {
+        ret = avfilter_link(format, 0, cut->buffersink, 0);
+    }
+    if (ret >= 0) {
+        ret = avfilter_graph_config(cut->graph, NULL);
+    }
+    g_free(format_args);
+    g_free(source_args);
+    return ret;
+}
+
+/* Encodes one frame (NULL flushes) and hands the packets to the muxer. */
+static int libav_encode_frame(LibavCut *cut, const AVFrame *frame) {
+    int ret = avcodec_send_frame(cut->encoder, frame);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        return ret;
+    }
+    if (frame) {
+        cut->frames++;
+        cut->out_time_us = av_rescale_q(frame->pts, cut->encoder->time_base, AV_TIME_BASE_Q);
+    }
+    AVPacket *packet = av_packet_alloc();
+    while ((ret = avcodec_receive_packet(cut->encoder, packet)) >= 0) {
+        packet->stream_index = cut->video_out->index;
+        av_packet_rescale_ts(packet, cut->encoder->time_base, cut->video_out->time_base);
+        ret = av_interleaved_write_frame(cut->output, packet);
+        if (ret < 0) {
+            break;
+        }
+    }
+    av_packet_free(&packet);
+    libav_report_progress(cut, FALSE);
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/*
+ * Stream copy: starts at the first keyframe of the range and stops at the
+ * first keyframe at or after its end. The muxer takes over the packet's
+ * buffer reference, so the data is never copied.
+ */
+static int libav_copy_video_packet(LibavCut *cut, AVPacket *packet) {
+    gint64 pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    gboolean key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+    if (!cut->video_started) {
+        if (!key || pts == AV_NOPTS_VALUE || pts < cut->video_start - cut->video_tolerance) {
+            return 0;
+        }
+        cut->video_started = TRUE;
+    } else if (key && pts != AV_NOPTS_VALUE && pts >= cut->video_end - cut->video_tolerance) {
+        cut->video_done = TRUE;
+        return 0;
+    }
+    AVRational time_base = cut->input->streams[cut->video_index]->time_base;
+    if (pts != AV_NOPTS_VALUE) {
+        cut->frames++;
+        cut->out_time_us = MAX(cut->out_time_us, av_rescale_q(pts - cut->video_start, time_base, AV_TIME_BASE_Q));
+    }
+    libav_shift_packet(packet, cut->video_start);
+    av_packet_rescale_ts(packet, time_base, cut->video_out->time_base);
+    packet->stream_index = cut->video_out->index;
+    packet->pos = -1;
+    int ret = av_interleaved_write_frame(cut->output, packet);
+    libav_report_progress(cut, FALSE);
+    return ret;
+}
+
+static int libav_copy_audio_packet(LibavCut *cut, AVPacket *packet, gboolean *audio_done) {
+    if (packet->pts == AV_NOPTS_VALUE || packet->pts < cut->audio_start) {
+        return 0;
+    }
+    if (packet->pts >= cut->audio_end) {
+        *audio_done = TRUE;
+        return 0;
+    }
+    libav_shift_packet(packet, cut->audio_start);
+    av_packet_rescale_ts(packet, cut->input->streams[cut->audio_index]->time_base, cut->audio_out->time_base);
+    packet->stream_index = cut->audio_out->index;
+    packet->pos = -1;
+    return av_interleaved_write_frame(cut->output, packet);
+}
+
+static void libav_shift_packet(AVPacket *packet, gint64 offset) {
+    if (packet->pts != AV_NOPTS_VALUE) {
+        packet->pts -= offset;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+        packet->dts -= offset;
+    }
+}
+
+/* Reports the same fields as ffmpeg's -progress output, at most twice a second. */
+static void libav_report_progress(LibavCut *cut, gboolean ended) {
+    gint64 now = g_get_monotonic_time();
+    if (!ended && now - cut->last_report_us < G_USEC_PER_SEC / 2) {
+        return;
+    }
+    cut->last_report_us = now;
+    gdouble elapsed_s = (gdouble)(now - cut->started_us) / G_USEC_PER_SEC;
+    gdouble out_s = (gdouble)cut->out_time_us / G_USEC_PER_SEC;
+    gint64 bytes = cut->output->pb ? avio_tell(cut->output->pb) : 0;
+    FfmpegProgress progress = { 0 };
+    progress.frame = cut->frames;
+    progress.fps = elapsed_s > 0.0 ? cut->frames / elapsed_s : 0.0;
+    progress.speed = elapsed_s > 0.0 ? out_s / elapsed_s : 0.0;
+    progress.out_time_us = cut->out_time_us;
+    progress.bitrate_kbps = out_s > 0.0 ? bytes * 8.0 / 1000.0 / out_s : 0.0;
+    progress.ended = ended;
+    cut_step_progress(&progress, cut->step);
+}
+
+static void libav_cut_clear(LibavCut *cut) {
+    avfilter_graph_free(&cut->graph);
+    avcodec_free_context(&cut->encoder);
+    avcodec_free_context(&cut->decoder);
+    if (cut->output) {
+        if (cut->output->pb && !(cut->output->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&cut->output->pb);
+        }
+        avformat_free_context(cut->output);
+        cut->output = NULL;
+    }
+    avformat_close_input(&cut->input);
+}
+#endif
+
+static FfmpegResult *run_cut_step(gchar **argv, GCancellable *cancellable, CutStepContext *step, gint64 offset_us, GError **error) {
+    gchar *command_line = format_command_for_log(argv);
+    if (command_line) {
+        cut_step_log(step, "Command:");
+        cut_step_log(step, "%s", command_line);
+        g_free(command_line);
+    }
+    step->offset_us = offset_us;
+    FfmpegResult *result = run_ffmpeg_process(argv, cancellable, step->policy, cut_step_line, cut_step_progress, step, error);
+    cut_step_account(step, result);
+    return result;
+}
+
+/*
+ * Adds one child to the cut's figures: the first spawn, the largest peak and
+ * the summed CPU time. Children that run one after another never add up their
+ * memory; the chunk pool accounts for its concurrent ones itself.
+ */
+static void cut_step_account(CutStepContext *step, const FfmpegResult *result) {
+    if (!result) {
+        return;
+    }
+    if (step->spawn_us == 0) {
+        step->spawn_us = result->spawn_us;
+    }
+    step->peak_rss_kib = MAX(step->peak_rss_kib, result->peak_rss_kib);
+    step->cpu_s += result->cpu_s;
+}
+
+/* Reports the figures of every child of the cut on its final result. */
+static FfmpegResult *cut_step_finish(CutStepContext *step, FfmpegResult *result) {
+    if (result) {
+        result->spawn_us = step->spawn_us;
+        result->peak_rss_kib = step->peak_rss_kib;
+        result->cpu_s = step->cpu_s;
+    }
+    return result;
+}
+
+static void cut_step_line(const gchar *line, gpointer user_data) {
+    CutStepContext *step = user_data;
+    if (step->line_func) {
+        step->line_func(line, step->user_data);
+    }
+}
+
+static void cut_step_progress(const FfmpegProgress *progress, gpointer user_data) {
+    CutStepContext *step = user_data;
+    if (!step->progress_func) {
+        return;
+    }
+    FfmpegProgress shifted = *progress;
+    shifted.out_time_us += step->offset_us;
+    step->progress_func(&shifted, step->user_data);
+}
+
+static void cut_step_log(CutStepContext *step, const gchar *format, ...) {
+    if (!step->line_func) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    gchar *line = g_strdup_vprintf(format, args);
+    va_end(args);
+    step->line_func(line, step->user_data);
+    g_free(line);
+}
+
+/* Runs a short helper such as ffprobe and returns its whole stdout. */
+static gboolean run_capture_process(gchar **argv, GCancellable *cancellable, gchar **stdout_out, GError **error) {
+    GSubprocess *process = g_subprocess_newv((const gchar * const *)argv, G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_PIPE, error);
+    if (!process) {
+        return FALSE;
+    }
+    gchar *stderr_buf = NULL;
+    gboolean ok = g_subprocess_communicate_utf8(process, NULL, cancellable, stdout_out, &stderr_buf, error);
+    if (ok && !g_subprocess_get_successful(process)) {
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "%s failed: %s", argv[0], stderr_buf && *stderr_buf ? g_strstrip(stderr_buf) : "unknown error");
+        g_clear_pointer(stdout_out, g_free);
+        ok = FALSE;
+    }
+    g_free(stderr_buf);
+    g_object_unref(process);
+    return ok;
+}
+
+/* Stream parameters come from the probe index, so later jobs on the same input skip ffprobe. */
+static gboolean probe_video_stream(const gchar *input_path, GCancellable *cancellable, VideoStreamInfo *info, GError **error) {
+    const ProbeIndex *index = probe_index_lookup(input_path, TRUE, cancellable, error);
+    if (!index) {
+        return FALSE;
+    }
+    const ProbeIndexHeader *header = index->header;
+    info->codec_name = g_strndup(header->codec_name, sizeof(header->codec_name));
+    info->profile = *header->profile ? g_strndup(header->profile, sizeof(header->profile)) : NULL;
+    info->pix_fmt = *header->pix_fmt ? g_strndup(header->pix_fmt, sizeof(header->pix_fmt)) : NULL;
+    info->width = header->width;
+    info->height = header->height;
+    return TRUE;
+}
+
+/*
+ * The probe index covers the video only, so the audio parameters come from a
+ * separate ffprobe run, which reads just the stream headers.
+ */
+static gboolean probe_audio_stream(const gchar *input_path, GCancellable *cancellable, AudioStreamInfo *info, GError **error) {
+    gchar *argv[] = { "ffprobe", "-v", "error", "-select_streams", "a:0", "-show_entries", "stream=codec_name,sample_rate,channels,channel_layout", "-of", "compact", (gchar *)input_path, NULL };
+    gchar *output = NULL;
+    if (!run_capture_process(argv, cancellable, &output, error)) {
+        return FALSE;
+    }
+    gchar **lines = g_strsplit(output, "\n", -1);
+    for (guint i = 0; lines[i]; ++i) {
+        gchar **fields = g_strsplit(g_strchomp(lines[i]), "|", -1);
+        for (guint k = 1; g_strcmp0(fields[0], "stream") == 0 && fields[k]; ++k) {
+            gchar *value = strchr(fields[k], '=');
+            if (!value) {
+                continue;
+            }
+            *value++ = '\0';
+            if (g_strcmp0(fields[k], "codec_name") == 0) {
+                g_free(info->codec_name);
+                info->codec_name = g_strdup(value);
+            } else if (g_strcmp0(fields[k], "channel_layout") == 0) {
+                g_free(info->channel_layout);
+                info->channel_layout = g_strdup(value);
+            } else if (g_strcmp0(fields[k], "sample_rate") == 0) {
+                info->sample_rate = (gint)g_ascii_strtoll(value, NULL, 10);
+            } else if (g_strcmp0(fields[k], "channels") == 0) {
+                info->channels = (gint)g_ascii_strtoll(value, NULL, 10);
+            }
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+    g_free(output);
+    return TRUE;
+}
+
+/*
+ * Returns the sorted keyframe timestamps between from and to and, if
+ * requested, every frame timestamp, sliced out of the probe index with two
+ * binary searches each.
+ */
+static gboolean probe_packets(const gchar *input_path, gdouble from_s, gdouble to_s, GCancellable *cancellable, GArray **keyframes_out, GArray **frames_out, GError **error) {
+    const ProbeIndex *index = probe_index_lookup(input_path, TRUE, cancellable, error);
+    if (!index) {
+        return FALSE;
+    }
+    gsize first = probe_index_keyframe_at(index, from_s - SMART_CUT_EPSILON_S);
+    gsize last = probe_index_keyframe_at(index, to_s + SMART_CUT_EPSILON_S);
+    GArray *keyframes = g_array_sized_new(FALSE, FALSE, sizeof(gdouble), (guint)(last - first));
+    for (gsize i = first; i < last; ++i) {
+        g_array_append_val(keyframes, index->keyframes[i].pts_s);
+    }
+    *keyframes_out = keyframes;
+    if (frames_out) {
+        first = probe_index_frame_at(index, from_s - SMART_CUT_EPSILON_S);
+        last = probe_index_frame_at(index, to_s + SMART_CUT_EPSILON_S);
+        GArray *frames = g_array_sized_new(FALSE, FALSE, sizeof(gdouble), (guint)(last - first));
+        g_array_append_vals(frames, index->frames + first, (guint)(last - first));
+        *frames_out = frames;
+    }
+    return TRUE;
+}
+
+/* Cache file name for one version of an input: a hash of its path, size and mtime. */
+static gchar *probe_cache_key(const gchar *input_path, const GStatBuf *st) {
+    gchar *absolute = g_canonicalize_filename(input_path, NULL);
+    gchar *identity = g_strdup_printf("%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT, absolute, (gint64)st->st_size, (gint64)st->st_mtime);
+    gchar *key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, identity, -1);
+    g_free(identity);
+    g_free(absolute);
+    return key;
+}
+
+/*
+ * Returns the probe index of the input, loading it from the disk cache or, if
+ * probe is TRUE, running ffprobe over the whole file to build it. With probe
+ * FALSE it only returns an index that is already available and never blocks
+ * on ffprobe; NULL without an error then means "not probed yet". Indexes stay
+ * mapped for the life of the process, so callers never free them.
+ */
+static const ProbeIndex *probe_index_lookup(const gchar *input_path, gboolean probe, GCancellable *cancellable, GError **error) {
+    GStatBuf st;
+    if (g_stat(input_path, &st) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Cannot read %s: %s", input_path, g_strerror(saved_errno));
+        return NULL;
+    }
+    gchar *key = probe_cache_key(input_path, &st);
+    ProbeIndex *index = NULL;
+    g_mutex_lock(&probe_cache_lock);
+    if (!probe_cache_table) {
+        probe_cache_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    /* Another thread is loading or probing the same file; wait for it rather than probing twice. */
+    while ((index = g_hash_table_lookup(probe_cache_table, key)) == &probe_index_pending) {
+        if (!probe || g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            g_mutex_unlock(&probe_cache_lock);
+            g_free(key);
+            return NULL;
+        }
+        g_cond_wait_until(&probe_cache_cond, &probe_cache_lock, g_get_monotonic_time() + G_USEC_PER_SEC / 10);
+    }
+    if (index) {
+        g_mutex_unlock(&probe_cache_lock);
+        g_free(key);
+        return index;
+    }
+    g_hash_table_insert(probe_cache_table, g_strdup(key), &probe_index_pending);
+    g_mutex_unlock(&probe_cache_lock);
+
+    gchar *cache_dir = g_build_filename(g_get_user_cache_dir(), "fast_cut", "probe", NULL);
+    gchar *name = g_strconcat(key, ".idx", NULL);
+    gchar *cache_path = g_build_filename(cache_dir, name, NULL);
+    index = probe_index_map(cache_path, &st);
+    if (!index && probe) {
+        if (g_mkdir_with_parents(cache_dir, 0755) != 0) {
+            int saved_errno = errno;
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Cannot create the probe cache folder: %s", g_strerror(saved_errno));
+        } else if (probe_index_build(input_path, &st, cache_path, cancellable, error)) {
+            index = probe_index_map(cache_path, &st);
+            if (!index) {
+                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "The probe index written to %s cannot be read back", cache_path);
+            }
+        }
+    }
+    g_free(cache_path);
+    g_free(name);
+    g_free(cache_dir);
+
+    g_mutex_lock(&probe_cache_lock);
+    if (index) {
+        g_hash_table_insert(probe_cache_table, key, index);
+    } else {
+        g_hash_table_remove(probe_cache_table, key);
+        g_free(key);
+    }
+    g_cond_broadcast(&probe_cache_cond);
+    g_mutex_unlock(&probe_cache_lock);
+    return index;
+}
+
+/*
+ * Maps a cache file and points the index straight into the mapping. Only the
+ * header is checked; a file that is missing, truncated, written by another
+ * version or for another size or mtime of the input is treated as absent.
+ */
+static ProbeIndex *probe_index_map(const gchar *cache_path, const GStatBuf *st) {
+    GMappedFile *file = g_mapped_file_new(cache_path, FALSE, NULL);
+    if (!file) {
+        return NULL;
+    }
+    gsize length = g_mapped_file_get_length(file);
+    const gchar *contents = g_mapped_file_get_contents(file);
+    const ProbeIndexHeader *header = (const ProbeIndexHeader *)(const void *)contents;
+    if (length < sizeof(ProbeIndexHeader)
+        || memcmp(header->magic, PROBE_INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version != PROBE_INDEX_VERSION
+        || header->byte_order != PROBE_INDEX_BYTE_ORDER
+        || header->file_size != (gint64)st->st_size
+        || header->file_mtime != (gint64)st->st_mtime
+        || header->keyframe_count > length / sizeof(ProbeKeyframe)
+        || header->frame_count > length / sizeof(gdouble)
+        || length != sizeof(ProbeIndexHeader) + header->keyframe_count * sizeof(ProbeKeyframe) + header->frame_count * sizeof(gdouble)) {
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+    ProbeIndex *index = g_new0(ProbeIndex, 1);
+    index->file = file;
+    index->header = header;
+    index->keyframes = (const ProbeKeyframe *)(const void *)(contents + sizeof(ProbeIndexHeader));
+    index->frames = (const gdouble *)(const void *)(contents + sizeof(ProbeIndexHeader) + header->keyframe_count * sizeof(ProbeKeyframe));
+    return index;
+}
+
+/*
+ * Lists every packet of the first video stream with ffprobe and writes the
+ * index file: the header, the keyframes (pts and byte offset) and the pts of
+ * every frame, both sorted by pts. ffprobe reports absolute timestamps, while
+ * -ss counts from the container's start_time, which is not 0 for MPEG-TS and
+ * some other inputs; the start time is subtracted so the index can be compared
+ * with -ss directly. The output is read line by line, so even long inputs
+ * never sit in memory as text.
+ */
+static gboolean probe_index_build(const gchar *input_path, const GStatBuf *st, const gchar *cache_path, GCancellable *cancellable, GError **error) {
+    const gchar *argv[] = { "ffprobe", "-v", "error", "-select_streams", "v:0", "-show_entries", PROBE_INDEX_ENTRIES, "-of", "compact", input_path, NULL };
+    GSubprocess *process = g_subprocess_newv(argv, G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_MERGE, error);
+    if (!process) {
+        return FALSE;
+    }
+    ProbeScan scan;
+    probe_scan_init(&scan);
+    scan.header.file_size = (gint64)st->st_size;
+    scan.header.file_mtime = (gint64)st->st_mtime;
+
+    GDataInputStream *lines = g_data_input_stream_new(g_subprocess_get_stdout_pipe(process));
+    gchar *line = NULL;
+    GError *read_error = NULL;
+    while ((line = g_data_input_stream_read_line_utf8(lines, NULL, cancellable, &read_error))) {
+        probe_scan_line(&scan, g_strchomp(line));
+        g_free(line);
+    }
+    g_object_unref(lines);
+
+    gboolean ok = FALSE;
+    if (read_error) {
+        g_propagate_error(error, read_error);
+        g_subprocess_force_exit(process);
+    } else if (!g_subprocess_wait(process, cancellable, error)) {
+        g_subprocess_force_exit(process);
+    } else if (!g_subprocess_get_successful(process)) {
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "ffprobe failed: %s", scan.messages->len ? scan.messages->str : "unknown error");
+    } else if (!scan.have_stream) {
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "no video stream found");
+    } else {
+        probe_scan_finish(&scan);
+        GArray *keyframes = scan.keyframes;
+        GArray *frames = scan.frames;
+        GString *contents = g_string_sized_new(sizeof(scan.header) + keyframes->len * sizeof(ProbeKeyframe) + frames->len * sizeof(gdouble));
+        g_string_append_len(contents, (const gchar *)&scan.header, sizeof(scan.header));
+        g_string_append_len(contents, keyframes->data, (gssize)(keyframes->len * sizeof(ProbeKeyframe)));
+        g_string_append_len(contents, frames->data, (gssize)(frames->len * sizeof(gdouble)));
+        /* Written to a temporary file and renamed, so readers never map half an index. */
+        ok = g_file_set_contents(cache_path, contents->str, (gssize)contents->len, error);
+        g_string_free(contents, TRUE);
+    }
+    probe_scan_clear(&scan);
+    g_object_unref(process);
+    return ok;
+}
+
+static void probe_scan_init(ProbeScan *scan) {
+    memset(scan, 0, sizeof(*scan));
+    memcpy(scan->header.magic, PROBE_INDEX_MAGIC, sizeof(scan->header.magic));
+    scan->header.version = PROBE_INDEX_VERSION;
+    scan->header.byte_order = PROBE_INDEX_BYTE_ORDER;
+    scan->keyframes = g_array_new(FALSE, FALSE, sizeof(ProbeKeyframe));
+    scan->frames = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    scan->messages = g_string_new(NULL);
+}
+
+static void probe_scan_clear(ProbeScan *scan) {
+    g_clear_pointer(&scan->keyframes, g_array_unref);
+    g_clear_pointer(&scan->frames, g_array_unref);
+    if (scan->messages) {
+        g_string_free(scan->messages, TRUE);
+        scan->messages = NULL;
+    }
+}
+
+/*
+ * Takes one line of ffprobe's compact output. Packet, stream and format lines
+ * fill the scan and return TRUE; anything else, such as an error message, is
+ * kept in the first 4 KiB of messages and returns FALSE.
+ */
+static gboolean probe_scan_line(ProbeScan *scan, const gchar *line) {
+    gchar **fields = g_strsplit(line, "|", -1);
+    gboolean is_packet = g_strcmp0(fields[0], "packet") == 0;
+    gboolean is_stream = g_strcmp0(fields[0], "stream") == 0;
+    gboolean is_format = g_strcmp0(fields[0], "format") == 0;
+    ProbeIndexHeader *header = &scan->header;
+    ProbeKeyframe packet = { -1.0, -1 };
+    gboolean key = FALSE;
+    gboolean have_pts = FALSE;
+    for (guint i = 1; fields[0] && fields[i]; ++i) {
+        gchar *value = strchr(fields[i], '=');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        const gchar *name = fields[i];
+        gchar *end = NULL;
+        if (is_packet && g_strcmp0(name, "pts_time") == 0) {
+            packet.pts_s = g_ascii_strtod(value, &end);
+            have_pts = end && end != value;
+        } else if (is_packet && g_strcmp0(name, "pos") == 0) {
+            packet.pos = g_ascii_strtoll(value, &end, 10);
+            packet.pos = end && end != value ? packet.pos : -1;
+        } else if (is_packet && g_strcmp0(name, "flags") == 0) {
+            key = strchr(value, 'K') != NULL;
+        } else if (is_stream && g_strcmp0(name, "codec_name") == 0) {
+            g_strlcpy(header->codec_name, value, sizeof(header->codec_name));
+            scan->have_stream = TRUE;
+        } else if (is_stream && g_strcmp0(name, "profile") == 0) {
+            g_strlcpy(header->profile, value, sizeof(header->profile));
+        } else if (is_stream && g_strcmp0(name, "pix_fmt") == 0) {
+            g_strlcpy(header->pix_fmt, value, sizeof(header->pix_fmt));
+        } else if (is_stream && g_strcmp0(name, "width") == 0) {
+            header->width = (gint32)g_ascii_strtoll(value, NULL, 10);
+        } else if (is_stream && g_strcmp0(name, "height") == 0) {
+            header->height = (gint32)g_ascii_strtoll(value, NULL, 10);
+        } else if (is_format && g_strcmp0(name, "duration") == 0) {
+            header->duration_s = g_ascii_strtod(value, NULL);
+        } else if (is_format && g_strcmp0(name, "start_time") == 0) {
+            /* "N/A" leaves it at 0. */
+            scan->start_s = g_ascii_strtod(value, NULL);
+        }
+    }
+    if (have_pts) {
+        g_array_append_val(scan->frames, packet.pts_s);
+        if (key) {
+            g_array_append_val(scan->keyframes, packet);
+        }
+    } else if (!is_packet && !is_stream && !is_format && *line && scan->messages->len < 4096) {
+        g_string_append_printf(scan->messages, "%s%s", scan->messages->len ? "\n" : "", line);
+    }
+    g_strfreev(fields);
+    return is_packet || is_stream || is_format;
+}
+
+/*
+ * Makes the timestamps relative to the start time and sorts them by pts. The
+ * format section comes after the packets, so this waits for the whole run.
+ */
+static void probe_scan_finish(ProbeScan *scan) {
+    for (guint i = 0; i < scan->keyframes->len; ++i) {
+        g_array_index(scan->keyframes, ProbeKeyframe, i).pts_s -= scan->start_s;
+    }
+    for (guint i = 0; i < scan->frames->len; ++i) {
+        g_array_index(scan->frames, gdouble, i) -= scan->start_s;
+    }
+    g_array_sort(scan->keyframes, compare_keyframes);
+    g_array_sort(scan->frames, compare_doubles);
+    scan->header.keyframe_count = scan->keyframes->len;
+    scan->header.frame_count = scan->frames->len;
+}
+
+/* Binary search for the first keyframe at or after pts_s. */
+static gsize probe_index_keyframe_at(const ProbeIndex *index, gdouble pts_s) {
+    gsize low = 0;
+    gsize high = index->header->keyframe_count;
+    while (low < high) {
+        gsize mid = low + (high - low) / 2;
+        if (index->keyframes[mid].pts_s < pts_s) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/* Binary search for the first frame at or after pts_s. */
+static gsize probe_index_frame_at(const ProbeIndex *index, gdouble pts_s) {
+    gsize low = 0;
+    gsize high = index->header->frame_count;
+    while (low < high) {
+        gsize mid = low + (high - low) / 2;
+        if (index->frames[mid] < pts_s) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * Rejects a time past the end of the input, but only when the input has
+ * already been probed; an input that has not is accepted as before.
+ */
+static gboolean check_time_within_duration(const gchar *input_path, const gchar *time_text, const gchar *label, GError **error) {
+    const ProbeIndex *index = probe_index_lookup(input_path, FALSE, NULL, NULL);
+    if (!index || index->header->duration_s <= 0.0) {
+        return TRUE;
+    }
+    if ((gdouble)time_string_to_seconds(time_text) <= index->header->duration_s + SMART_CUT_EPSILON_S) {
+        return TRUE;
+    }
+    gchar *duration = format_seconds((gint64)index->header->duration_s);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s %s is past the end of the video (%s)", label, time_text, duration);
+    g_free(duration);
+    return FALSE;
+}
+
+static gint compare_keyframes(gconstpointer a, gconstpointer b) {
+    gdouble lhs = ((const ProbeKeyframe *)a)->pts_s;
+    gdouble rhs = ((const ProbeKeyframe *)b)->pts_s;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/*
+ * The re-encoded edges must be bitstream-compatible with the copied middle:
+ * same codec as the encoder, same chroma layout and bit depth, and no scaling.
+ */
+static gboolean smart_cut_encoder_params(const VideoStreamInfo *info, const EncoderBackend *encoder, const gchar **profile, const gchar **pix_fmt, gchar **reason) {
+    if (g_strcmp0(info->codec_name, encoder->codec) != 0) {
+        *reason = g_strdup_printf("the source codec is %s but %s produces %s", info->codec_name, encoder->encoder, encoder->codec);
+        return FALSE;
+    }
+    if (info->width <= 0 || info->height <= 0) {
+        *reason = g_strdup("the source resolution is unknown");
+        return FALSE;
+    }
+    gboolean hevc = g_strcmp0(encoder->codec, "hevc") == 0;
+    if (g_strcmp0(info->pix_fmt, "yuv420p") == 0) {
+        *profile = hevc ? "main" : "high";
+        *pix_fmt = "yuv420p";
+    } else if (g_strcmp0(info->pix_fmt, "yuv420p10le") == 0) {
+        /* Hardware encoders take 10-bit input as P010. */
+        *profile = hevc ? "main10" : "high10";
+        *pix_fmt = encoder->hardware ? "p010le" : "yuv420p10le";
+    } else {
+        *reason = g_strdup_printf("the pixel format %s cannot be matched by the encoder", info->pix_fmt ? info->pix_fmt : "(unknown)");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Builds the command for one video-only piece written as MPEG-TS. A positive
+ * frame_count replaces the duration and keeps the frame timing untouched so
+ * adjacent pieces line up exactly.
+ */
+static gchar **build_segment_argv(const gchar *input_path, gdouble from_s, gdouble duration_s, gint64 frame_count, gboolean copy, const EncoderBackend *encoder, const gchar *preset, const gchar *profile, const gchar *pix_fmt, guint threads, const gchar *output_path) {
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-y"));
+    g_ptr_array_add(args, g_strdup("-nostats"));
+    g_ptr_array_add(args, g_strdup("-progress"));
+    g_ptr_array_add(args, g_strdup("pipe:1"));
+    g_ptr_array_add(args, g_strdup("-ss"));
+    g_ptr_array_add(args, format_seconds_arg(from_s));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(input_path));
+    if (frame_count > 0) {
+        g_ptr_array_add(args, g_strdup("-frames:v"));
+        g_ptr_array_add(args, g_strdup_printf("%" G_GINT64_FORMAT, frame_count));
+        g_ptr_array_add(args, g_strdup("-fps_mode"));
+        g_ptr_array_add(args, g_strdup("passthrough"));
+    } else {
+        g_ptr_array_add(args, g_strdup("-t"));
+        g_ptr_array_add(args, format_seconds_arg(duration_s));
+    }
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:v:0"));
+    g_ptr_array_add(args, g_strdup("-an"));
+    g_ptr_array_add(args, g_strdup("-sn"));
+    g_ptr_array_add(args, g_strdup("-dn"));
+    if (copy) {
+        g_ptr_array_add(args, g_strdup("-c:v"));
+        g_ptr_array_add(args, g_strdup("copy"));
+    } else {
+        encoder->append_args(encoder, args, preset, threads);
+        if (profile) {
+            g_ptr_array_add(args, g_strdup("-profile:v"));
+            g_ptr_array_add(args, g_strdup(profile));
+        }
+        if (pix_fmt) {
+            g_ptr_array_add(args, g_strdup("-pix_fmt"));
+            g_ptr_array_add(args, g_strdup(pix_fmt));
+        }
+    }
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup("mpegts"));
+    g_ptr_array_add(args, g_strdup(output_path));
+    g_ptr_array_add(args, NULL);
+    return (gchar **)g_ptr_array_free(args, FALSE);
+}
+
+static gchar **build_concat_argv(const gchar *list_path, const CutJob *job, const gchar *output_path) {
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-y"));
+    g_ptr_array_add(args, g_strdup("-nostats"));
+    g_ptr_array_add(args, g_strdup("-progress"));
+    g_ptr_array_add(args, g_strdup("pipe:1"));
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup("concat"));
+    g_ptr_array_add(args, g_strdup("-safe"));
+    g_ptr_array_add(args, g_strdup("0"));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(list_path));
+    g_ptr_array_add(args, g_strdup("-ss"));
+    g_ptr_array_add(args, g_strdup(job->start_time));
+    g_ptr_array_add(args, g_strdup("-to"));
+    g_ptr_array_add(args, g_strdup(job->end_time));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(job->input_path));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:v:0"));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("1:a?"));
+    g_ptr_array_add(args, g_strdup("-c:v"));
+    g_ptr_array_add(args, g_strdup("copy"));
+    g_ptr_array_add(args, g_strdup("-shortest"));
+    append_output_format_args(args, job->format);
+    g_ptr_array_add(args, g_strdup(output_url(output_path)));
+    g_ptr_array_add(args, NULL);
+    return (gchar **)g_ptr_array_free(args, FALSE);
+}
+
+/* One clip of a join as MPEG-TS; a re-encoded clip is scaled to the first clip's size. */
+static gchar **build_join_piece_argv(const JoinClip *clip, gboolean copy, const EncoderBackend *encoder, const gchar *preset, const gchar *profile, const gchar *pix_fmt, const VideoStreamInfo *reference, guint threads, const gchar *output_path) {
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-y"));
+    g_ptr_array_add(args, g_strdup("-nostats"));
+    g_ptr_array_add(args, g_strdup("-progress"));
+    g_ptr_array_add(args, g_strdup("pipe:1"));
+    if (clip->start_time) {
+        g_ptr_array_add(args, g_strdup("-ss"));
+        g_ptr_array_add(args, g_strdup(clip->start_time));
+        g_ptr_array_add(args, g_strdup("-to"));
+        g_ptr_array_add(args, g_strdup(clip->end_time));
+    }
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(clip->input_path));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:v:0"));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:a:0?"));
+    if (copy) {
+        g_ptr_array_add(args, g_strdup("-c:v"));
+        g_ptr_array_add(args, g_strdup("copy"));
+    } else {
+        g_ptr_array_add(args, g_strdup("-vf"));
+        g_ptr_array_add(args, g_strdup_printf("scale=%d:%d", reference->width, reference->height));
+        encoder->append_args(encoder, args, preset, threads);
+        g_ptr_array_add(args, g_strdup("-profile:v"));
+        g_ptr_array_add(args, g_strdup(profile));
+        g_ptr_array_add(args, g_strdup("-pix_fmt"));
+        g_ptr_array_add(args, g_strdup(pix_fmt));
+    }
+    g_ptr_array_add(args, g_strdup("-c:a"));
+    g_ptr_array_add(args, g_strdup("aac"));
+    g_ptr_array_add(args, g_strdup("-ar"));
+    g_ptr_array_add(args, g_strdup("48000"));
+    g_ptr_array_add(args, g_strdup("-ac"));
+    g_ptr_array_add(args, g_strdup("2"));
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup("mpegts"));
+    g_ptr_array_add(args, g_strdup(output_path));
+    g_ptr_array_add(args, NULL);
+    return (gchar **)g_ptr_array_free(args, FALSE);
+}
+
+static gchar **build_join_argv(const gchar *list_path, const CutJob *job) {
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-y"));
+    g_ptr_array_add(args, g_strdup("-nostats"));
+    g_ptr_array_add(args, g_strdup("-progress"));
+    g_ptr_array_add(args, g_strdup("pipe:1"));
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup("concat"));
+    g_ptr_array_add(args, g_strdup("-safe"));
+    g_ptr_array_add(args, g_strdup("0"));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(list_path));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:v:0"));
+    g_ptr_array_add(args, g_strdup("-map"));
+    g_ptr_array_add(args, g_strdup("0:a:0?"));
+    g_ptr_array_add(args, g_strdup("-c"));
+    g_ptr_array_add(args, g_strdup("copy"));
+    append_output_format_args(args, job->format);
+    g_ptr_array_add(args, g_strdup(output_url(job->output_path)));
+    g_ptr_array_add(args, NULL);
+    return (gchar **)g_ptr_array_free(args, FALSE);
+}
+
+static gboolean write_concat_list(const gchar *list_path, GPtrArray *segment_names, GError **error) {
+    GString *contents = g_string_new(NULL);
+    for (guint i = 0; i < segment_names->len; ++i) {
+        /* Segment names are plain relative names, so no quoting is needed. */
+        g_string_append_printf(contents, "file '%s'\n", (const gchar *)g_ptr_array_index(segment_names, i));
+    }
+    gboolean ok = g_file_set_contents(list_path, contents->str, (gssize)contents->len, error);
+    g_string_free(contents, TRUE);
+    return ok;
+}
+
+/* Lists the clips by absolute path with their in and out points for a direct copy. */
+static gboolean write_join_list(const gchar *list_path, GPtrArray *clips, GError **error) {
+    GString *contents = g_string_new("ffconcat version 1.0\n");
+    for (guint i = 0; i < clips->len; ++i) {
+        JoinClip *clip = g_ptr_array_index(clips, i);
+        gchar *absolute = g_canonicalize_filename(clip->input_path, NULL);
+        g_string_append(contents, "file '");
+        for (const gchar *c = absolute; *c; ++c) {
+            if (*c == '\'') {
+                g_string_append(contents, "'\\''");
+            } else {
+                g_string_append_c(contents, *c);
+            }
+        }
+        g_string_append(contents, "'\n");
+        g_free(absolute);
+        if (clip->start_time) {
+            g_string_append_printf(contents, "inpoint %" G_GINT64_FORMAT "\noutpoint %" G_GINT64_FORMAT "\n", time_string_to_seconds(clip->start_time), time_string_to_seconds(clip->end_time));
+        }
+    }
+    gboolean ok = g_file_set_contents(list_path, contents->str, (gssize)contents->len, error);
+    g_string_free(contents, TRUE);
+    return ok;
+}
+
+/* Intermediate pieces live next to the output so large copies stay on its volume; a stream's go to the temp folder. */
+static gchar *make_work_dir(const gchar *output_path, GError **error) {
+    gchar *output_dir = output_is_stream(output_path) ? g_strdup(g_get_tmp_dir()) : g_path_get_dirname(output_path);
+    gchar *work_dir = g_build_filename(output_dir, ".fast_cut-XXXXXX", NULL);
+    g_free(output_dir);
+    if (!g_mkdtemp(work_dir)) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to create a work folder next to the output: %s", g_strerror(saved_errno));
+        g_free(work_dir);
+        return NULL;
+    }
+    return work_dir;
+}
+
+static void remove_work_dir(const gchar *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            gchar *child = g_build_filename(path, name, NULL);
+            g_remove(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+/* A NULL dir or a limit of 0 turns the output cache off. */
+static void output_cache_configure(const gchar *dir, gint64 limit_mb) {
+    g_free(output_cache_dir);
+    output_cache_dir = dir && *dir && limit_mb > 0 ? g_strdup(dir) : NULL;
+    output_cache_limit = limit_mb * 1024 * 1024;
+}
+
+static gchar *output_cache_default_dir(void) {
+    const gchar *dir = g_getenv("FAST_CUT_OUTPUT_CACHE_DIR");
+    if (dir && *dir) {
+        return g_strdup(dir);
+    }
+    return g_build_filename(g_get_user_cache_dir(), "fast_cut", "outputs", NULL);
+}
+
+static gint64 output_cache_default_limit_mb(void) {
+    const gchar *limit = g_getenv("FAST_CUT_OUTPUT_CACHE_MB");
+    return limit && *limit ? g_ascii_strtoll(limit, NULL, 10) : OUTPUT_CACHE_DEFAULT_MB;
+}
+
+/*
+ * Key of a cut in the output cache: a hash over a fingerprint of the input,
+ * the mode and the ffmpeg argv of a copy of the job whose times are
+ * normalized and whose paths are placeholders. The argv covers the ranges,
+ * encoder, preset and rate control; the input path is left out so the same
+ * file reached through another mount point still hits. Returns NULL when the
+ * cache is off, the job is a join or a stream or the input cannot be read.
+ */
+static gchar *output_cache_key(const CutJob *job) {
+    if (!output_cache_dir || job->join_clips || output_is_stream(job->output_path)) {
+        return NULL;
+    }
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    if (!output_cache_fingerprint(job->input_path, checksum)) {
+        g_checksum_free(checksum);
+        return NULL;
+    }
+
+    gchar *start = format_seconds(time_string_to_seconds(job->start_time));
+    gchar *end = format_seconds(time_string_to_seconds(job->end_time));
+    gchar *output = g_strdup_printf("output0%s", path_extension(job->output_path));
+    CutJob *normalized = cut_job_new("input", start, end, job->encoder, job->preset, output, job->mode);
+    normalized->format = job->format;
+    normalized->policy.threads = job->policy.threads;
+    g_free(output);
+    g_free(end);
+    g_free(start);
+    for (guint i = 1; i < cut_job_range_count(job); ++i) {
+        const CutRange *range = g_ptr_array_index(job->extra_ranges, i - 1);
+        start = format_seconds(time_string_to_seconds(range->start_time));
+        end = format_seconds(time_string_to_seconds(range->end_time));
+        output = g_strdup_printf("output%u%s", i, path_extension(range->output_path));
+        cut_job_add_range(normalized, start, end, output);
+        g_free(output);
+        g_free(end);
+        g_free(start);
+    }
+    gchar **argv = cut_job_range_count(normalized) > 1 ? build_multi_range_argv(normalized, NULL) : build_ffmpeg_argv(normalized->input_path, normalized->start_time, normalized->end_time, normalized->encoder, normalized->preset, normalized->policy.threads, normalized->format, normalized->output_path);
+    if (!argv) {
+        cut_job_free(normalized);
+        g_checksum_free(checksum);
+        return NULL;
+    }
+
+#ifdef FAST_CUT_LIBAV
+    const gchar *engine = "libav";
+#else
+    const gchar *engine = "ffmpeg";
+#endif
+    gchar *header = g_strdup_printf("fast_cut output cache %d\n%s\n%s\n", OUTPUT_CACHE_VERSION, engine, cut_mode_id(job->mode));
+    g_checksum_update(checksum, (const guchar *)header, -1);
+    g_free(header);
+    for (guint i = 0; argv[i]; ++i) {
+        /* Include the terminating NUL so argument boundaries are part of the key. */
+        g_checksum_update(checksum, (const guchar *)argv[i], (gssize)strlen(argv[i]) + 1);
+    }
+    gchar *key = g_strdup(g_checksum_get_string(checksum));
+    free_argv(argv);
+    cut_job_free(normalized);
+    g_checksum_free(checksum);
+    return key;
+}
+
+/*
+ * Adds the input's size, mtime and its first and last
+ * OUTPUT_CACHE_FINGERPRINT_BYTES to the checksum, which tells versions of a
+ * file apart without reading all of it.
+ */
+static gboolean output_cache_fingerprint(const gchar *path, GChecksum *checksum) {
+    GStatBuf st;
+    if (g_stat(path, &st) != 0) {
+        return FALSE;
+    }
+    GFile *file = g_file_new_for_path(path);
+    GFileInputStream *stream = g_file_read(file, NULL, NULL);
+    g_object_unref(file);
+    if (!stream) {
+        return FALSE;
+    }
+    gchar *identity = g_strdup_printf("%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT "\n", (gint64)st.st_size, (gint64)st.st_mtime);
+    g_checksum_update(checksum, (const guchar *)identity, -1);
+    g_free(identity);
+
+    guchar *buffer = g_malloc(OUTPUT_CACHE_FINGERPRINT_BYTES);
+    gsize length = 0;
+    gboolean ok = g_input_stream_read_all(G_INPUT_STREAM(stream), buffer, OUTPUT_CACHE_FINGERPRINT_BYTES, &length, NULL, NULL);
+    g_checksum_update(checksum, buffer, (gssize)length);
+    if (ok && (gint64)st.st_size > OUTPUT_CACHE_FINGERPRINT_BYTES) {
+        /* The tail starts where the head ended when the two would overlap, so no byte goes unhashed. */
+        goffset tail_start = MAX((goffset)length, (goffset)st.st_size - OUTPUT_CACHE_FINGERPRINT_BYTES);
+        ok = g_seekable_seek(G_SEEKABLE(stream), tail_start, G_SEEK_SET, NULL, NULL) && g_input_stream_read_all(G_INPUT_STREAM(stream), buffer, OUTPUT_CACHE_FINGERPRINT_BYTES, &length, NULL, NULL);
+        g_checksum_update(checksum, buffer, (gssize)length);
+    }
+    g_free(buffer);
+    g_object_unref(stream);
+    return ok;
+}
+
+/*
+ * Copies every output of the cut out of its cache entry; FALSE sends the cut
+ * to the encoder. A resumable cut copies to its partial path and renames the
+ * synced copy into place, so a crash never leaves half an output behind.
+ */
+static gboolean output_cache_fetch(const CutJob *job, const gchar *key, CutStepContext *step) {
+    gchar *entry = g_build_filename(output_cache_dir, key, NULL);
+    gchar *metadata = g_build_filename(entry, "entry.json", NULL);
+    gboolean hit = g_file_test(metadata, G_FILE_TEST_IS_REGULAR);
+    for (guint i = 0; hit && i < cut_job_range_count(job); ++i) {
+        const gchar *output = cut_job_output_path(job, i);
+        gchar *name = g_strdup_printf("%u%s", i, path_extension(output));
+        gchar *cached = g_build_filename(entry, name, NULL);
+        gchar *target = job->mode == CUT_MODE_RESUMABLE ? resume_partial_path(output) : g_strdup(output);
+        GError *error = NULL;
+        hit = output_cache_copy_file(cached, target, &error);
+        if (hit && strcmp(target, output) != 0) {
+            sync_file(target);
+            if (g_rename(target, output) != 0) {
+                int saved_errno = errno;
+                g_set_error(&error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to move the output to %s: %s", output, g_strerror(saved_errno));
+                hit = FALSE;
+            }
+        }
+        if (!hit && strcmp(target, output) != 0) {
+            g_remove(target);
+        }
+        g_free(target);
+        if (!hit) {
+            /* Evicted by another process in the meantime, most likely. */
+            cut_step_log(step, "Output cache entry %s is unusable: %s", key, error->message);
+            g_clear_error(&error);
+        }
+        g_free(cached);
+        g_free(name);
+    }
+    if (hit) {
+        /* The mtime of entry.json is the entry's last use for eviction. */
+        g_utime(metadata, NULL);
+        cut_step_log(step, "Output cache hit: copied from %s instead of encoding.", entry);
+    }
+    g_free(metadata);
+    g_free(entry);
+    return hit;
+}
+
+/*
+ * Copies the outputs of a successful cut into a new cache entry, then evicts
+ * the least recently used entries beyond the size limit. The entry is filled
+ * under a temporary name and renamed into place, so other processes sharing
+ * the folder never see half of one.
+ */
+static void output_cache_store(const CutJob *job, const gchar *key, CutStepContext *step) {
+    gint64 bytes = cut_job_output_bytes(job);
+    if (bytes > output_cache_limit) {
+        cut_step_log(step, "Output not cached: %" G_GINT64_FORMAT " MiB is more than the cache holds.", bytes / (1024 * 1024));
+        return;
+    }
+    gchar *entry = g_build_filename(output_cache_dir, key, NULL);
+    if (g_file_test(entry, G_FILE_TEST_IS_DIR) || g_mkdir_with_parents(output_cache_dir, 0755) != 0) {
+        g_free(entry);
+        return;
+    }
+    gchar *temp = g_strdup_printf("%s.tmp-XXXXXX", entry);
+    if (!g_mkdtemp(temp)) {
+        cut_step_log(step, "Output not cached: cannot create %s: %s", temp, g_strerror(errno));
+        g_free(temp);
+        g_free(entry);
         return;
     }
 
-    gchar *stdout_buf = NULL;
-    gchar *stderr_buf = NULL;
-    gint exit_status = 0;
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "input");
+    json_builder_add_string_value(builder, job->input_path);
+    json_builder_set_member_name(builder, "encoder");
+    json_builder_add_string_value(builder, job->encoder->id);
+    json_builder_set_member_name(builder, "preset");
+    json_builder_add_string_value(builder, job->preset);
+    json_builder_set_member_name(builder, "mode");
+    json_builder_add_string_value(builder, cut_mode_id(job->mode));
+    json_builder_set_member_name(builder, "ranges");
+    json_builder_begin_array(builder);
+    gboolean ok = TRUE;
     GError *error = NULL;
+    for (guint i = 0; ok && i < cut_job_range_count(job); ++i) {
+        const CutRange *range = i == 0 ? NULL : g_ptr_array_index(job->extra_ranges, i - 1);
+        gchar *text = g_strdup_printf("%s-%s", range ? range->start_time : job->start_time, range ? range->end_time : job->end_time);
+        json_builder_add_string_value(builder, text);
+        g_free(text);
+        const gchar *output = cut_job_output_path(job, i);
+        gchar *name = g_strdup_printf("%u%s", i, path_extension(output));
+        gchar *cached = g_build_filename(temp, name, NULL);
+        ok = output_cache_copy_file(output, cached, &error);
+        g_free(cached);
+        g_free(name);
+    }
+    json_builder_end_array(builder);
+    json_builder_set_member_name(builder, "bytes");
+    json_builder_add_int_value(builder, bytes);
+    json_builder_end_object(builder);
 
-    gboolean ok = g_spawn_sync(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &stdout_buf, &stderr_buf, &exit_status, &error);
-    if (!ok) {
-        g_task_return_error(task, error);
-        g_free(stdout_buf);
-        g_free(stderr_buf);
+    if (ok) {
+        JsonGenerator *generator = json_generator_new();
+        JsonNode *root = json_builder_get_root(builder);
+        json_generator_set_root(generator, root);
+        gchar *metadata = g_build_filename(temp, "entry.json", NULL);
+        ok = json_generator_to_file(generator, metadata, &error);
+        g_free(metadata);
+        json_node_unref(root);
+        g_object_unref(generator);
+    }
+    g_object_unref(builder);
+    if (ok && g_rename(temp, entry) == 0) {
+        cut_step_log(step, "Stored the output in the cache as %s.", key);
+    } else {
+        /* A failed rename means another process stored the same cut first. */
+        if (error) {
+            cut_step_log(step, "Output not cached: %s", error->message);
+            g_clear_error(&error);
+        }
+        remove_work_dir(temp);
+    }
+    g_free(temp);
+    g_free(entry);
+
+    g_mutex_lock(&output_cache_lock);
+    output_cache_evict(output_cache_limit);
+    g_mutex_unlock(&output_cache_lock);
+}
+
+/* Removes the cache entry of a cut whose outputs turned out to be bad. */
+static void output_cache_drop(const CutJob *job) {
+    gchar *key = output_cache_key(job);
+    if (!key) {
         return;
     }
+    gchar *entry = g_build_filename(output_cache_dir, key, NULL);
+    g_mutex_lock(&output_cache_lock);
+    if (g_file_test(entry, G_FILE_TEST_IS_DIR)) {
+        remove_work_dir(entry);
+    }
+    g_mutex_unlock(&output_cache_lock);
+    g_free(entry);
+    g_free(key);
+}
 
-    FfmpegResult *result = g_new0(FfmpegResult, 1);
-    result->exit_status = exit_status;
-    result->stdout_buf = stdout_buf;
-    result->stderr_buf = stderr_buf;
-    g_task_return_pointer(task, result, (GDestroyNotify)ffmpeg_result_free);
+/*
+ * Copies a file, cloning its extents where the filesystem can (Btrfs, XFS,
+ * ZFS, ...) so that neither a hit nor a store costs a data copy. Hard links
+ * are not used: ffmpeg -y truncates an existing output in place, which would
+ * corrupt the entry linked to it.
+ */
+static gboolean output_cache_copy_file(const gchar *source, const gchar *target, GError **error) {
+#if defined(__linux__) && defined(FICLONE)
+    int source_fd = g_open(source, O_RDONLY, 0);
+    if (source_fd >= 0) {
+        int target_fd = g_open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        gboolean cloned = target_fd >= 0 && ioctl(target_fd, FICLONE, source_fd) == 0;
+        if (target_fd >= 0) {
+            close(target_fd);
+        }
+        close(source_fd);
+        if (cloned) {
+            return TRUE;
+        }
+    }
+#endif
+    GFile *from = g_file_new_for_path(source);
+    GFile *to = g_file_new_for_path(target);
+    gboolean copied = g_file_copy(from, to, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, error);
+    g_object_unref(to);
+    g_object_unref(from);
+    return copied;
 }
 
-static void ffmpeg_task_completed(GObject *source_object, GAsyncResult *result, gpointer user_data) {
-    AppWidgets *app = user_data;
-    app->task_running = FALSE;
-    gtk_widget_set_sensitive(app->start_button, TRUE);
+/*
+ * Lists the complete entries, least recently used first, and sums their
+ * sizes. Temporary folders left behind by a crashed store are removed once
+ * they are a day old.
+ */
+static GPtrArray *output_cache_scan(gint64 *total_bytes) {
+    GPtrArray *entries = g_ptr_array_new_with_free_func((GDestroyNotify)output_cache_entry_free);
+    *total_bytes = 0;
+    GDir *dir = output_cache_dir ? g_dir_open(output_cache_dir, 0, NULL) : NULL;
+    if (!dir) {
+        return entries;
+    }
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    const gchar *name = NULL;
+    while ((name = g_dir_read_name(dir))) {
+        gchar *path = g_build_filename(output_cache_dir, name, NULL);
+        GStatBuf st;
+        if (strstr(name, ".tmp-")) {
+            if (g_stat(path, &st) == 0 && now - (gint64)st.st_mtime > OUTPUT_CACHE_STALE_SECONDS) {
+                remove_work_dir(path);
+            }
+            g_free(path);
+            continue;
+        }
+        GDir *files = g_dir_open(path, 0, NULL);
+        if (!files) {
+            g_free(path);
+            continue;
+        }
+        OutputCacheEntry *entry = g_new0(OutputCacheEntry, 1);
+        entry->path = path;
+        const gchar *file_name = NULL;
+        while ((file_name = g_dir_read_name(files))) {
+            gchar *file_path = g_build_filename(path, file_name, NULL);
+            if (g_stat(file_path, &st) == 0) {
+                entry->bytes += (gint64)st.st_size;
+                if (strcmp(file_name, "entry.json") == 0) {
+                    entry->last_used = (gint64)st.st_mtime;
+                }
+            }
+            g_free(file_path);
+        }
+        g_dir_close(files);
+        *total_bytes += entry->bytes;
+        g_ptr_array_add(entries, entry);
+    }
+    g_dir_close(dir);
+    g_ptr_array_sort(entries, compare_output_cache_entries);
+    return entries;
+}
 
-    GError *error = NULL;
-    FfmpegResult *ff_result = g_task_propagate_pointer(G_TASK(result), &error);
-    if (error) {
-        append_log_line(app, "ffmpeg failed:");
-        append_log_line(app, error->message);
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_ERROR, "ffmpeg failed", error->message);
-        g_error_free(error);
-        return;
+static void output_cache_evict(gint64 limit_bytes) {
+    gint64 total = 0;
+    GPtrArray *entries = output_cache_scan(&total);
+    for (guint i = 0; i < entries->len && total > limit_bytes; ++i) {
+        OutputCacheEntry *entry = g_ptr_array_index(entries, i);
+        remove_work_dir(entry->path);
+        total -= entry->bytes;
     }
+    g_ptr_array_unref(entries);
+}
 
-    if (ff_result->stdout_buf && *ff_result->stdout_buf) {
-        append_log_block(app, ff_result->stdout_buf, "ffmpeg stdout:");
+/* Prints the entries of the output cache, most recently used first. */
+static int output_cache_list(void) {
+    if (!output_cache_dir) {
+        g_print("The output cache is off.\n");
+        return 0;
     }
-    if (ff_result->stderr_buf && *ff_result->stderr_buf) {
-        append_log_block(app, ff_result->stderr_buf, "ffmpeg stderr:");
+    gint64 total = 0;
+    GPtrArray *entries = output_cache_scan(&total);
+    for (guint i = entries->len; i > 0; --i) {
+        OutputCacheEntry *entry = g_ptr_array_index(entries, i - 1);
+        gchar *metadata = g_build_filename(entry->path, "entry.json", NULL);
+        JsonParser *parser = json_parser_new();
+        GString *description = g_string_new(NULL);
+        if (json_parser_load_from_file(parser, metadata, NULL) && JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+            JsonObject *object = json_node_get_object(json_parser_get_root(parser));
+            gchar *input = g_path_get_basename(json_object_get_string_member_with_default(object, "input", ""));
+            g_string_append_printf(description, "%s %s %s %s", json_object_get_string_member_with_default(object, "encoder", "?"), json_object_get_string_member_with_default(object, "preset", "?"), json_object_get_string_member_with_default(object, "mode", "?"), input);
+            JsonArray *ranges = json_object_get_array_member(object, "ranges");
+            for (guint r = 0; ranges && r < json_array_get_length(ranges); ++r) {
+                g_string_append_printf(description, " %s", json_array_get_string_element(ranges, r));
+            }
+            g_free(input);
+        } else {
+            g_string_append(description, "(incomplete)");
+        }
+        GDateTime *used = g_date_time_new_from_unix_local(entry->last_used);
+        gchar *used_text = g_date_time_format(used, "%Y-%m-%d %H:%M");
+        gchar *key = g_path_get_basename(entry->path);
+        g_print("%.16s  %s  %8.1f MiB  %s\n", key, used_text, (gdouble)entry->bytes / (1024 * 1024), description->str);
+        g_free(key);
+        g_free(used_text);
+        g_date_time_unref(used);
+        g_string_free(description, TRUE);
+        g_object_unref(parser);
+        g_free(metadata);
     }
+    g_print("%u entries, %.1f of %.1f MiB in %s\n", entries->len, (gdouble)total / (1024 * 1024), (gdouble)output_cache_limit / (1024 * 1024), output_cache_dir);
+    g_ptr_array_unref(entries);
+    return 0;
+}
 
-    if (ff_result->exit_status == 0) {
-        append_log_line(app, "ffmpeg completed with exit code 0.");
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_INFO, "Done", "FFmpeg finished successfully.");
-    } else {
-        gchar *status_msg = g_strdup_printf("ffmpeg exit code %d", ff_result->exit_status);
-        append_log_line(app, status_msg);
-        show_message(GTK_WINDOW(app->window), GTK_MESSAGE_WARNING, "ffmpeg did not finish successfully", status_msg);
-        g_free(status_msg);
+static int output_cache_purge(void) {
+    if (!output_cache_dir) {
+        g_print("The output cache is off.\n");
+        return 0;
+    }
+    gint64 total = 0;
+    GPtrArray *entries = output_cache_scan(&total);
+    for (guint i = 0; i < entries->len; ++i) {
+        remove_work_dir(((OutputCacheEntry *)g_ptr_array_index(entries, i))->path);
     }
+    g_print("Removed %u entries, %.1f MiB, from %s\n", entries->len, (gdouble)total / (1024 * 1024), output_cache_dir);
+    g_ptr_array_unref(entries);
+    return 0;
+}
 
-    ffmpeg_result_free(ff_result);
+static void output_cache_entry_free(OutputCacheEntry *entry) {
+    g_free(entry->path);
+    g_free(entry);
+}
+
+static gint compare_output_cache_entries(gconstpointer a, gconstpointer b) {
+    const OutputCacheEntry *left = *(OutputCacheEntry * const *)a;
+    const OutputCacheEntry *right = *(OutputCacheEntry * const *)b;
+    return (left->last_used > right->last_used) - (left->last_used < right->last_used);
+}
+
+static void video_stream_info_clear(VideoStreamInfo *info) {
+    g_clear_pointer(&info->codec_name, g_free);
+    g_clear_pointer(&info->profile, g_free);
+    g_clear_pointer(&info->pix_fmt, g_free);
+}
+
+static void audio_stream_info_clear(AudioStreamInfo *info) {
+    g_clear_pointer(&info->codec_name, g_free);
+    g_clear_pointer(&info->channel_layout, g_free);
+}
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) {
+    gdouble lhs = *(const gdouble *)a;
+    gdouble rhs = *(const gdouble *)b;
+    return (lhs > rhs) - (lhs < rhs);
 }
 
 static void show_message(GtkWindow *parent, GtkMessageType type, const gchar *primary, const gchar *secondary) {
@@ -471,6 +8861,16 @@ static void show_message(GtkWindow *parent, GtkMessageType type, const gchar *pr
     gtk_widget_destroy(dialog);
 }
 
+static gboolean confirm_message(GtkWindow *parent, const gchar *primary, const gchar *secondary) {
+    GtkWidget *dialog = gtk_message_dialog_new(parent, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, "%s", primary ? primary : "");
+    if (secondary && *secondary) {
+        gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog), "%s", secondary);
+    }
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+    return response == GTK_RESPONSE_YES;
+}
+
 static gchar *format_command_for_log(gchar **argv) {
     if (!argv) {
         return NULL;
@@ -500,35 +8900,290 @@ static GtkWidget *create_time_entry(const gchar *default_text) {
     return entry;
 }
 
+static void set_time_entries(GtkEntry *hour_entry, GtkEntry *min_entry, GtkEntry *sec_entry, gint64 seconds) {
+    gchar text[8];
+    g_snprintf(text, sizeof(text), "%02d", (gint)MIN(seconds / 3600, 99));
+    gtk_entry_set_text(hour_entry, text);
+    g_snprintf(text, sizeof(text), "%02d", (gint)((seconds / 60) % 60));
+    gtk_entry_set_text(min_entry, text);
+    g_snprintf(text, sizeof(text), "%02d", (gint)(seconds % 60));
+    gtk_entry_set_text(sec_entry, text);
+}
+
+/* Reads the entries without validating them; empty or garbled fields count as 0. */
+static gint64 time_entries_seconds(GtkEntry *hour_entry, GtkEntry *min_entry, GtkEntry *sec_entry) {
+    return g_ascii_strtoll(gtk_entry_get_text(hour_entry), NULL, 10) * 3600 + g_ascii_strtoll(gtk_entry_get_text(min_entry), NULL, 10) * 60 + g_ascii_strtoll(gtk_entry_get_text(sec_entry), NULL, 10);
+}
+
 static gboolean normalize_time_entry(GtkEntry *entry, gint min_value, gint max_value, gint default_value, GtkWindow *parent, const gchar *time_label, const gchar *component_label, gint *value_out) {
-    gchar *raw = g_strstrip(g_strdup(gtk_entry_get_text(entry)));
-    if (!raw || !*raw) {
+    GError *error = NULL;
+    if (!parse_time_component(gtk_entry_get_text(entry), min_value, max_value, default_value, time_label, component_label, value_out, &error)) {
+        show_message(parent, GTK_MESSAGE_WARNING, error->message, NULL);
+        g_error_free(error);
+        return FALSE;
+    }
+    gchar *normalized = g_strdup_printf("%02d", *value_out);
+    gtk_entry_set_text(entry, normalized);
+    g_free(normalized);
+    return TRUE;
+}
+
+/* Validates one hour, minute or second field; an empty field takes default_value. */
+static gboolean parse_time_component(const gchar *text, gint min_value, gint max_value, gint default_value, const gchar *time_label, const gchar *component_label, gint *value_out, GError **error) {
+    gchar *raw = g_strstrip(g_strdup(text ? text : ""));
+    if (!*raw) {
         *value_out = default_value;
-    } else {
-        for (gchar *p = raw; *p; ++p) {
-            if (!g_ascii_isdigit(*p)) {
-                gchar *message = g_strdup_printf("%s %s accepts digits only.", time_label, component_label);
-                show_message(parent, GTK_MESSAGE_WARNING, message, NULL);
-                g_free(message);
-                g_free(raw);
-                return FALSE;
-            }
-        }
-        long parsed = strtol(raw, NULL, 10);
-        if (parsed < min_value || parsed > max_value) {
-            gchar *message = g_strdup_printf("%s %s must be between %02d and %02d.", time_label, component_label, min_value, max_value);
-            show_message(parent, GTK_MESSAGE_WARNING, message, NULL);
-            g_free(message);
+        g_free(raw);
+        return TRUE;
+    }
+    for (gchar *p = raw; *p; ++p) {
+        if (!g_ascii_isdigit(*p)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s %s accepts digits only.", time_label, component_label);
             g_free(raw);
             return FALSE;
         }
-        *value_out = (gint)parsed;
     }
-    gchar *normalized = g_strdup_printf("%02d", *value_out);
-    gtk_entry_set_text(entry, normalized);
-    g_free(normalized);
+    long parsed = strtol(raw, NULL, 10);
     g_free(raw);
+    if (parsed < min_value || parsed > max_value) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s %s must be between %02d and %02d.", time_label, component_label, min_value, max_value);
+        return FALSE;
+    }
+    *value_out = (gint)parsed;
+    return TRUE;
+}
+
+/* Accepts HH:MM:SS, MM:SS or SS with the same limits as the time entries. */
+static gboolean parse_time_string(const gchar *text, const gchar *label, gchar **out_time, GError **error) {
+    static const gint MAX_VALUES[] = { 99, 59, 59 };
+    static const gchar *const COMPONENTS[] = { "hour", "minute", "second" };
+    gint values[3] = { 0, 0, 0 };
+    gchar **parts = g_strsplit(text ? text : "", ":", -1);
+    guint count = g_strv_length(parts);
+    if (count == 0 || count > 3) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s must look like HH:MM:SS.", label);
+        g_strfreev(parts);
+        return FALSE;
+    }
+    for (guint i = 0; i < count; ++i) {
+        guint slot = 3 - count + i;
+        if (!parse_time_component(parts[i], 0, MAX_VALUES[slot], 0, label, COMPONENTS[slot], &values[slot], error)) {
+            g_strfreev(parts);
+            return FALSE;
+        }
+    }
+    g_strfreev(parts);
+    g_free(*out_time);
+    *out_time = g_strdup_printf("%02d:%02d:%02d", values[0], values[1], values[2]);
+    return TRUE;
+}
+
+/* Parses "START-END" and checks that the range is not empty. */
+static gboolean parse_time_range(const gchar *text, gchar **start_out, gchar **end_out, GError **error) {
+    gchar **bounds = g_strsplit(text, "-", 2);
+    gboolean ok = FALSE;
+    if (!bounds[0] || !bounds[1]) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "\"%s\" is not a START-END range.", text);
+        goto cleanup;
+    }
+    if (!parse_time_string(g_strstrip(bounds[0]), "Range start", start_out, error) || !parse_time_string(g_strstrip(bounds[1]), "Range end", end_out, error)) {
+        goto cleanup;
+    }
+    if (time_string_to_seconds(*end_out) <= time_string_to_seconds(*start_out)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Range %s ends before it starts.", text);
+        goto cleanup;
+    }
+    ok = TRUE;
+
+cleanup:
+    g_strfreev(bounds);
+    return ok;
+}
+
+/* Parses a comma-separated list of ranges into CutRange entries without outputs. */
+static GPtrArray *parse_range_list(const gchar *text, GError **error) {
+    GPtrArray *ranges = g_ptr_array_new_with_free_func((GDestroyNotify)cut_range_free);
+    gchar **items = g_strsplit_set(text ? text : "", ",;\n", -1);
+    for (guint i = 0; items[i]; ++i) {
+        gchar *item = g_strstrip(items[i]);
+        if (!*item) {
+            continue;
+        }
+        CutRange *range = g_new0(CutRange, 1);
+        g_ptr_array_add(ranges, range);
+        if (!parse_time_range(item, &range->start_time, &range->end_time, error)) {
+            g_ptr_array_free(ranges, TRUE);
+            ranges = NULL;
+            break;
+        }
+    }
+    g_strfreev(items);
+    return ranges;
+}
+
+static gboolean cut_mode_from_id(const gchar *id, CutMode *mode) {
+    if (g_strcmp0(id, "reencode") == 0) {
+        *mode = CUT_MODE_REENCODE;
+    } else if (g_strcmp0(id, "smart") == 0) {
+        *mode = CUT_MODE_SMART;
+    } else if (g_strcmp0(id, "chunked") == 0) {
+        *mode = CUT_MODE_CHUNKED;
+    } else if (g_strcmp0(id, "incremental") == 0) {
+        *mode = CUT_MODE_INCREMENTAL;
+    } else if (g_strcmp0(id, "resumable") == 0) {
+        *mode = CUT_MODE_RESUMABLE;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static const gchar *cut_mode_id(CutMode mode) {
+    switch (mode) {
+    case CUT_MODE_REENCODE:
+        return "reencode";
+    case CUT_MODE_SMART:
+        return "smart";
+    case CUT_MODE_CHUNKED:
+        return "chunked";
+    case CUT_MODE_INCREMENTAL:
+        return "incremental";
+    case CUT_MODE_RESUMABLE:
+        return "resumable";
+    case CUT_MODE_JOIN:
+        return "join";
+    }
+    return "";
+}
+
+static const gchar *cut_mode_label(CutMode mode) {
+    switch (mode) {
+    case CUT_MODE_REENCODE:
+        return "Re-encoding";
+    case CUT_MODE_SMART:
+        return "Smart cut";
+    case CUT_MODE_CHUNKED:
+        return "Chunked encoding";
+    case CUT_MODE_INCREMENTAL:
+        return "Incremental encoding";
+    case CUT_MODE_RESUMABLE:
+        return "Resumable encoding";
+    case CUT_MODE_JOIN:
+        return "Join";
+    }
+    return "";
+}
+
+static gboolean output_format_from_id(const gchar *id, OutputFormat *format) {
+    if (g_strcmp0(id, "mp4") == 0) {
+        *format = OUTPUT_FORMAT_MP4;
+    } else if (g_strcmp0(id, "fmp4") == 0) {
+        *format = OUTPUT_FORMAT_FMP4;
+    } else if (g_strcmp0(id, "ts") == 0) {
+        *format = OUTPUT_FORMAT_MPEGTS;
+    } else if (g_strcmp0(id, "mkv") == 0) {
+        *format = OUTPUT_FORMAT_MATROSKA;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static const gchar *output_format_id(OutputFormat format) {
+    switch (format) {
+    case OUTPUT_FORMAT_MP4:
+        return "mp4";
+    case OUTPUT_FORMAT_FMP4:
+        return "fmp4";
+    case OUTPUT_FORMAT_MPEGTS:
+        return "ts";
+    case OUTPUT_FORMAT_MATROSKA:
+        return "mkv";
+    }
+    return "";
+}
+
+static const gchar *output_format_extension(OutputFormat format) {
+    switch (format) {
+    case OUTPUT_FORMAT_MP4:
+    case OUTPUT_FORMAT_FMP4:
+        return ".mp4";
+    case OUTPUT_FORMAT_MPEGTS:
+        return ".ts";
+    case OUTPUT_FORMAT_MATROSKA:
+        return ".mkv";
+    }
+    return "";
+}
+
+/*
+ * Plain MP4 is left to ffmpeg's guess from the extension. Fragmented MP4
+ * starts with an empty moov and writes a moof per keyframe, so the file is
+ * playable as it grows and needs no second +faststart pass over it.
+ */
+static void append_output_format_args(GPtrArray *args, OutputFormat format) {
+    const gchar *muxer = NULL;
+    switch (format) {
+    case OUTPUT_FORMAT_MP4:
+        return;
+    case OUTPUT_FORMAT_FMP4:
+        muxer = "mp4";
+        break;
+    case OUTPUT_FORMAT_MPEGTS:
+        muxer = "mpegts";
+        break;
+    case OUTPUT_FORMAT_MATROSKA:
+        muxer = "matroska";
+        break;
+    }
+    g_ptr_array_add(args, g_strdup("-f"));
+    g_ptr_array_add(args, g_strdup(muxer));
+    if (format == OUTPUT_FORMAT_FMP4) {
+        g_ptr_array_add(args, g_strdup("-movflags"));
+        g_ptr_array_add(args, g_strdup("+frag_keyframe+empty_moov+default_base_moof"));
+    }
+}
+
+/* OUTPUT_STDOUT or a local socket URL ffmpeg connects to; anything else is a file. */
+static gboolean output_is_stream(const gchar *output_path) {
+    return g_strcmp0(output_path, OUTPUT_STDOUT) == 0 || g_str_has_prefix(output_path, "unix:") || g_str_has_prefix(output_path, "tcp://");
+}
+
+/* What ffmpeg is given for an output; see run_ffmpeg_process() for OUTPUT_STDOUT_URL. */
+static const gchar *output_url(const gchar *output_path) {
+    return g_strcmp0(output_path, OUTPUT_STDOUT) == 0 ? OUTPUT_STDOUT_URL : output_path;
+}
+
+/*
+ * Lets a headless cut write to fast_cut's stdout. The descriptor is kept for
+ * the ffmpeg children and stdout itself is pointed at stderr, so the progress
+ * and summary lines printed with g_print() do not end up inside the video.
+ */
+static gboolean output_stdout_claim(GError **error) {
+#ifdef G_OS_UNIX
+    fflush(stdout);
+    output_stdout_fd = dup(STDOUT_FILENO);
+    if (output_stdout_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Unable to hand stdout to ffmpeg: %s", g_strerror(saved_errno));
+        return FALSE;
+    }
     return TRUE;
+#else
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Writing the cut to stdout is only supported on Unix");
+    return FALSE;
+#endif
+}
+
+/* Relative output paths are taken relative to the input's folder; streams are kept as given. */
+static gchar *resolve_output_path(const gchar *input_path, const gchar *output_text) {
+    if (g_path_is_absolute(output_text) || output_is_stream(output_text)) {
+        return g_strdup(output_text);
+    }
+    gchar *input_dir = g_path_get_dirname(input_path);
+    gchar *output_path = g_build_filename(input_dir, output_text, NULL);
+    g_free(input_dir);
+    return output_path;
 }
 
 static gboolean collect_time_string(AppWidgets *app, GtkEntry *hour_entry, GtkEntry *min_entry, GtkEntry *sec_entry, gchar **out_time, const gchar *label) {
@@ -551,30 +9206,181 @@ static gboolean collect_time_string(AppWidgets *app, GtkEntry *hour_entry, GtkEn
     return TRUE;
 }
 
-static gchar **build_ffmpeg_argv(const gchar *input_path, const gchar *start_time, const gchar *end_time, const gchar *preset, const gchar *output_path) {
-    if (!input_path || !start_time || !end_time || !preset || !output_path) {
-        return NULL;
-    }
-    gchar **argv = g_new0(gchar *, 13 + 1);
-    guint idx = 0;
-    //argv[idx++] = g_strdup("D:\\Software\\ffmpeg\\bin\\ffmpeg.exe");
-    argv[idx++] = g_strdup("ffmpeg");
-    argv[idx++] = g_strdup("-y");
-    argv[idx++] = g_strdup("-ss");
-    argv[idx++] = g_strdup(start_time);
-    argv[idx++] = g_strdup("-to");
-    argv[idx++] = g_strdup(end_time);
-    argv[idx++] = g_strdup("-i");
-    argv[idx++] = g_strdup(input_path);
-    argv[idx++] = g_strdup("-c:v");
-    argv[idx++] = g_strdup("hevc_nvenc");
-    //argv[idx++] = g_strdup("hevc_amf");
-    //argv[idx++] = g_strdup("hevc_qsv");
-    argv[idx++] = g_strdup("-preset");
-    argv[idx++] = g_strdup(preset);
-    argv[idx++] = g_strdup(output_path);
-    argv[idx] = NULL;
-    return argv;
+/*
+ * Asks ffmpeg which of the backends it was built with, then opens a short
+ * session on each hardware one: a build can list hevc_nvenc on a machine
+ * without an NVIDIA GPU and only fails once an encode starts. Runs once per
+ * process; later calls return straight away.
+ */
+static void probe_encoder_backends(void) {
+    static gsize probed = 0;
+    if (!g_once_init_enter(&probed)) {
+        return;
+    }
+    gchar *argv[] = { "ffmpeg", "-hide_banner", "-encoders", NULL };
+    gchar *output = NULL;
+    if (run_capture_process(argv, NULL, &output, NULL)) {
+        gchar **lines = g_strsplit(output, "\n", -1);
+        for (guint i = 0; lines[i]; ++i) {
+            gchar **fields = g_strsplit_set(g_strstrip(lines[i]), " \t", 3);
+            if (fields[0] && fields[0][0] == 'V' && fields[1]) {
+                for (guint b = 0; b < G_N_ELEMENTS(ENCODER_BACKENDS); ++b) {
+                    if (g_strcmp0(fields[1], ENCODER_BACKENDS[b].encoder) == 0) {
+                        encoder_available[b] = TRUE;
+                    }
+                }
+            }
+            g_strfreev(fields);
+        }
+        g_strfreev(lines);
+        g_free(output);
+    }
+    for (guint b = 0; b < G_N_ELEMENTS(ENCODER_BACKENDS); ++b) {
+        if (encoder_available[b] && ENCODER_BACKENDS[b].hardware) {
+            encoder_available[b] = encoder_backend_usable(ENCODER_BACKENDS[b].encoder);
+        }
+    }
+    g_once_init_leave(&probed, 1);
+}
+
+/* Encodes a few frames of a synthetic source to /dev/null. */
+static gboolean encoder_backend_usable(const gchar *encoder_name) {
+    gchar *argv[] = { "ffmpeg", "-hide_banner", "-v", "error", "-f", "lavfi", "-i", "color=c=black:s=256x256:r=25", "-frames:v", "5", "-c:v", (gchar *)encoder_name, "-f", "null", "-", NULL };
+    gchar *output = NULL;
+    gboolean ok = run_capture_process(argv, NULL, &output, NULL);
+    g_free(output);
+    return ok;
+}
+
+static const EncoderBackend *encoder_backend_find(const gchar *id) {
+    if (!id) {
+        return NULL;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(ENCODER_BACKENDS); ++i) {
+        if (g_strcmp0(ENCODER_BACKENDS[i].id, id) == 0) {
+            return &ENCODER_BACKENDS[i];
+        }
+    }
+    return NULL;
+}
+
+/* Like encoder_backend_find(), but also requires the backend to have passed the probe. */
+static const EncoderBackend *encoder_backend_lookup(const gchar *id, GError **error) {
+    const EncoderBackend *encoder = encoder_backend_find(id);
+    if (!encoder) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unknown encoder: %s", id);
+        return NULL;
+    }
+    probe_encoder_backends();
+    if (!encoder_available[encoder - ENCODER_BACKENDS]) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "%s is not usable with this ffmpeg or hardware", encoder->encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+/* The fastest backend that passed the probe, or NULL if none did. */
+static const EncoderBackend *encoder_backend_default(void) {
+    probe_encoder_backends();
+    for (guint i = 0; i < G_N_ELEMENTS(ENCODER_BACKENDS); ++i) {
+        if (encoder_available[i]) {
+            return &ENCODER_BACKENDS[i];
+        }
+    }
+    return NULL;
+}
+
+static void append_encoder_args(const EncoderBackend *encoder, GPtrArray *args, const gchar *preset, guint threads) {
+    g_ptr_array_add(args, g_strdup("-c:v"));
+    g_ptr_array_add(args, g_strdup(encoder->encoder));
+    g_ptr_array_add(args, g_strdup(encoder->preset_option));
+    g_ptr_array_add(args, g_strdup(preset));
+    for (guint i = 0; encoder->rate_control[i]; ++i) {
+        g_ptr_array_add(args, g_strdup(encoder->rate_control[i]));
+    }
+    if (threads > 0) {
+        g_ptr_array_add(args, g_strdup("-threads"));
+        g_ptr_array_add(args, g_strdup_printf("%u", threads));
+    }
+}
+
+/* x265 sizes its own thread pool, so the limit goes through -x265-params. */
+static void append_x265_args(const EncoderBackend *encoder, GPtrArray *args, const gchar *preset, guint threads) {
+    append_encoder_args(encoder, args, preset, 0);
+    if (threads > 0) {
+        g_ptr_array_add(args, g_strdup("-x265-params"));
+        g_ptr_array_add(args, g_strdup_printf("pools=%u", threads));
+    }
+}
+
+static gchar **build_ffmpeg_argv(const gchar *input_path, const gchar *start_time, const gchar *end_time, const EncoderBackend *encoder, const gchar *preset, guint threads, OutputFormat format, const gchar *output_path) {
+    if (!input_path || !start_time || !end_time || !encoder || !preset || !output_path) {
+        return NULL;
+    }
+    GPtrArray *args = g_ptr_array_new();
+    //g_ptr_array_add(args, g_strdup("D:\\Software\\ffmpeg\\bin\\ffmpeg.exe"));
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-y"));
+    g_ptr_array_add(args, g_strdup("-nostats"));
+    g_ptr_array_add(args, g_strdup("-progress"));
+    g_ptr_array_add(args, g_strdup("pipe:1"));
+    g_ptr_array_add(args, g_strdup("-ss"));
+    g_ptr_array_add(args, g_strdup(start_time));
+    g_ptr_array_add(args, g_strdup("-to"));
+    g_ptr_array_add(args, g_strdup(end_time));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(input_path));
+    encoder->append_args(encoder, args, preset, threads);
+    append_output_format_args(args, format);
+    g_ptr_array_add(args, g_strdup(output_url(output_path)));
+    g_ptr_array_add(args, NULL);
+    return (gchar **)g_ptr_array_free(args, FALSE);
+}
+
+/*
+ * Cuts every range of the job in one ffmpeg process. The input is read once
+ * from the earliest start to the latest end and each range becomes its own
+ * output with output-side -ss/-t, so ffmpeg decodes the source a single time
+ * and feeds the frames to one encoder per output. output_paths, if given,
+ * replaces the ranges' own output paths, in the same order.
+ */
+static gchar **build_multi_range_argv(const CutJob *job, gchar **output_paths) {
+    guint count = cut_job_range_count(job);
+    gint64 first_s = G_MAXINT64;
+    gint64 last_s = 0;
+    for (guint i = 0; i < count; ++i) {
+        const CutRange *range = i == 0 ? NULL : g_ptr_array_index(job->extra_ranges, i - 1);
+        first_s = MIN(first_s, time_string_to_seconds(range ? range->start_time : job->start_time));
+        last_s = MAX(last_s, time_string_to_seconds(range ? range->end_time : job->end_time));
+    }
+
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, g_strdup("ffmpeg"));
+    g_ptr_array_add(args, g_strdup("-y"));
+    g_ptr_array_add(args, g_strdup("-nostats"));
+    g_ptr_array_add(args, g_strdup("-progress"));
+    g_ptr_array_add(args, g_strdup("pipe:1"));
+    g_ptr_array_add(args, g_strdup("-ss"));
+    g_ptr_array_add(args, format_seconds(first_s));
+    g_ptr_array_add(args, g_strdup("-to"));
+    g_ptr_array_add(args, format_seconds(last_s));
+    g_ptr_array_add(args, g_strdup("-i"));
+    g_ptr_array_add(args, g_strdup(job->input_path));
+    for (guint i = 0; i < count; ++i) {
+        const CutRange *range = i == 0 ? NULL : g_ptr_array_index(job->extra_ranges, i - 1);
+        gint64 start_s = time_string_to_seconds(range ? range->start_time : job->start_time);
+        gint64 end_s = time_string_to_seconds(range ? range->end_time : job->end_time);
+        /* Output options count from the input seek point, not from zero. */
+        g_ptr_array_add(args, g_strdup("-ss"));
+        g_ptr_array_add(args, format_seconds_arg((gdouble)(start_s - first_s)));
+        g_ptr_array_add(args, g_strdup("-t"));
+        g_ptr_array_add(args, format_seconds_arg((gdouble)(end_s - start_s)));
+        job->encoder->append_args(job->encoder, args, job->preset, job->policy.threads);
+        append_output_format_args(args, job->format);
+        g_ptr_array_add(args, g_strdup(output_paths ? output_paths[i] : output_url(range ? range->output_path : job->output_path)));
+    }
+    g_ptr_array_add(args, NULL);
+    return (gchar **)g_ptr_array_free(args, FALSE);
 }
 
 static void free_argv(gchar **argv) {
@@ -591,12 +9397,172 @@ static void ffmpeg_result_free(FfmpegResult *result) {
     if (!result) {
         return;
     }
-    g_free(result->stdout_buf);
-    g_free(result->stderr_buf);
+    g_free(result->stderr_tail);
     g_free(result);
 }
 
-static gchar *build_default_output_path(const gchar *input_path) {
+static CutJob *cut_job_new(const gchar *input_path, const gchar *start_time, const gchar *end_time, const EncoderBackend *encoder, const gchar *preset, const gchar *output_path, CutMode mode) {
+    CutJob *job = g_new0(CutJob, 1);
+    job->input_path = g_strdup(input_path);
+    job->start_time = g_strdup(start_time);
+    job->end_time = g_strdup(end_time);
+    job->encoder = encoder;
+    job->preset = g_strdup(preset);
+    job->output_path = g_strdup(output_path);
+    job->mode = mode;
+    return job;
+}
+
+/* A NULL output_path names the range's file after the job's own output. */
+static void cut_job_add_range(CutJob *job, const gchar *start_time, const gchar *end_time, const gchar *output_path) {
+    if (!job->extra_ranges) {
+        job->extra_ranges = g_ptr_array_new_with_free_func((GDestroyNotify)cut_range_free);
+    }
+    CutRange *range = g_new0(CutRange, 1);
+    range->start_time = g_strdup(start_time);
+    range->end_time = g_strdup(end_time);
+    range->output_path = output_path ? g_strdup(output_path) : build_range_output_path(job->output_path, job->extra_ranges->len + 2);
+    g_ptr_array_add(job->extra_ranges, range);
+}
+
+/* NULL times add the whole file. */
+static void cut_job_add_clip(CutJob *job, const gchar *input_path, const gchar *start_time, const gchar *end_time) {
+    if (!job->join_clips) {
+        job->join_clips = g_ptr_array_new_with_free_func((GDestroyNotify)join_clip_free);
+    }
+    JoinClip *clip = g_new0(JoinClip, 1);
+    clip->input_path = g_strdup(input_path);
+    clip->start_time = g_strdup(start_time);
+    clip->end_time = g_strdup(end_time);
+    g_ptr_array_add(job->join_clips, clip);
+}
+
+/* Parses "FILE" or "FILE@START-END"; the times come back NULL for a whole file. */
+static gboolean parse_join_clip(const gchar *text, gchar **input_out, gchar **start_out, gchar **end_out, GError **error) {
+    const gchar *at = strrchr(text, '@');
+    gchar *input = at ? g_strndup(text, (gsize)(at - text)) : g_strdup(text);
+    *start_out = NULL;
+    *end_out = NULL;
+    if (!*input || !g_file_test(input, G_FILE_TEST_EXISTS)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Video file not found: %s", input);
+        g_free(input);
+        return FALSE;
+    }
+    if (at && !parse_time_range(at + 1, start_out, end_out, error)) {
+        g_free(input);
+        return FALSE;
+    }
+    *input_out = input;
+    return TRUE;
+}
+
+static guint cut_job_range_count(const CutJob *job) {
+    return 1 + (job->extra_ranges ? job->extra_ranges->len : 0);
+}
+
+/* Index 0 is the main range, the others follow extra_ranges. */
+static const gchar *cut_job_output_path(const CutJob *job, guint index) {
+    if (index == 0) {
+        return job->output_path;
+    }
+    return ((CutRange *)g_ptr_array_index(job->extra_ranges, index - 1))->output_path;
+}
+
+/* Returns the extension with its dot, or "" when the file name has none. */
+static const gchar *path_extension(const gchar *path) {
+    const gchar *name = strrchr(path, G_DIR_SEPARATOR);
+    const gchar *dot = strrchr(name ? name : path, '.');
+    return dot ? dot : "";
+}
+
+/*
+ * ffmpeg reports the furthest output position, so progress follows the
+ * longest range. A join runs through its clips one after another.
+ */
+static gint64 cut_job_duration_us(const CutJob *job) {
+    if (job->join_clips) {
+        gdouble total = 0.0;
+        for (guint i = 0; i < job->join_clips->len; ++i) {
+            total += join_clip_seconds(g_ptr_array_index(job->join_clips, i));
+        }
+        return (gint64)(total * G_USEC_PER_SEC);
+    }
+    gint64 longest = time_string_to_seconds(job->end_time) - time_string_to_seconds(job->start_time);
+    for (guint i = 0; job->extra_ranges && i < job->extra_ranges->len; ++i) {
+        CutRange *range = g_ptr_array_index(job->extra_ranges, i);
+        longest = MAX(longest, time_string_to_seconds(range->end_time) - time_string_to_seconds(range->start_time));
+    }
+    return longest * G_USEC_PER_SEC;
+}
+
+/* Sums the sizes of all outputs of the job that exist. */
+static gint64 cut_job_output_bytes(const CutJob *job) {
+    GStatBuf st;
+    gint64 total = 0;
+    for (guint i = 0; i < cut_job_range_count(job); ++i) {
+        total += g_stat(cut_job_output_path(job, i), &st) == 0 ? (gint64)st.st_size : 0;
+    }
+    return total;
+}
+
+static void cut_range_free(CutRange *range) {
+    if (!range) {
+        return;
+    }
+    g_free(range->start_time);
+    g_free(range->end_time);
+    g_free(range->output_path);
+    g_free(range);
+}
+
+static void join_clip_free(JoinClip *clip) {
+    if (!clip) {
+        return;
+    }
+    g_free(clip->input_path);
+    g_free(clip->start_time);
+    g_free(clip->end_time);
+    g_free(clip);
+}
+
+/* "clip_hevc.mp4" becomes "clip_hevc_2.mp4" for the second range. */
+static gchar *build_range_output_path(const gchar *output_path, guint number) {
+    gchar *dir = g_path_get_dirname(output_path);
+    gchar *base = g_path_get_basename(output_path);
+    gchar *dot = g_strrstr(base, ".");
+    const gchar *extension = "";
+    if (dot && dot != base) {
+        *dot = '\0';
+        extension = dot + 1;
+    }
+    gchar *name = *extension ? g_strdup_printf("%s_%u.%s", base, number, extension) : g_strdup_printf("%s_%u", base, number);
+    gchar *full_path = g_build_filename(dir, name, NULL);
+    g_free(name);
+    g_free(base);
+    g_free(dir);
+    return full_path;
+}
+
+static void cut_job_free(CutJob *job) {
+    if (!job) {
+        return;
+    }
+    g_free(job->input_path);
+    g_free(job->start_time);
+    g_free(job->end_time);
+    g_free(job->preset);
+    g_free(job->output_path);
+    if (job->extra_ranges) {
+        g_ptr_array_free(job->extra_ranges, TRUE);
+    }
+    if (job->join_clips) {
+        g_ptr_array_free(job->join_clips, TRUE);
+    }
+    resource_policy_clear(&job->policy);
+    g_free(job);
+}
+
+static gchar *build_default_output_path(const gchar *input_path, const gchar *codec, OutputFormat format) {
     if (!input_path || !*input_path) {
         return NULL;
     }
@@ -606,10 +9572,33 @@ static gchar *build_default_output_path(const gchar *input_path) {
     if (dot && dot != base) {
         *dot = '\0';
     }
-    gchar *new_name = g_strdup_printf("%s_hevc.mp4", base);
+    gchar *new_name = g_strdup_printf("%s_%s%s", base, codec, output_format_extension(format));
     gchar *full_path = g_build_filename(dir, new_name, NULL);
     g_free(dir);
     g_free(base);
     g_free(new_name);
     return full_path;
 }
+
+static gint64 time_string_to_seconds(const gchar *time_string) {
+    gint hour = 0;
+    gint minute = 0;
+    gint second = 0;
+    if (!time_string || sscanf(time_string, "%d:%d:%d", &hour, &minute, &second) != 3) {
+        return 0;
+    }
+    return (gint64)hour * 3600 + minute * 60 + second;
+}
+
+static gchar *format_seconds(gint64 seconds) {
+    if (seconds < 0) {
+        seconds = 0;
+    }
+    return g_strdup_printf("%02" G_GINT64_FORMAT ":%02" G_GINT64_FORMAT ":%02" G_GINT64_FORMAT, seconds / 3600, (seconds / 60) % 60, seconds % 60);
+}
+
+/* ffmpeg expects '.' as the decimal separator regardless of the locale. */
+static gchar *format_seconds_arg(gdouble seconds) {
+    gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+    return g_strdup(g_ascii_formatd(buffer, sizeof(buffer), "%.6f", MAX(seconds, 0.0)));
+}